@@ -0,0 +1,85 @@
+#pragma once
+
+#include "thread_pool.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace mfp {
+
+// Tables to compute, combined as a bit mask
+enum ArithmeticFunction : unsigned {
+    ARITH_PHI = 1,     // Euler phi
+    ARITH_MU = 2,      // Moebius mu
+    ARITH_SIGMA = 4,   // Sum of divisors
+    ARITH_OMEGA = 8,   // Number of distinct prime factors
+    ARITH_ALL = 15
+};
+
+// Ranges must end below this so that sigma(n) fits in 64 bits
+const uint64_t ARITHMETIC_SIEVE_LIMIT = 1ULL << 60;
+
+// Caller-owned arrays indexed by n - low; null arrays are not computed.
+// Values for n = 0 are all zero.
+struct ArithmeticOutput {
+    uint64_t* phi = nullptr;
+    int8_t* mu = nullptr;
+    uint64_t* sigma = nullptr;
+    uint8_t* omega = nullptr;
+};
+
+// Owned tables for n = low, low + 1, ...; tables not requested stay empty
+struct ArithmeticTables {
+    uint64_t low = 0;
+    std::vector<uint64_t> phi;
+    std::vector<int8_t> mu;
+    std::vector<uint64_t> sigma;
+    std::vector<uint8_t> omega;
+};
+
+// Header of a table file written by computeToFile. The arrays follow at the
+// given byte offsets, each 64-byte aligned; absent tables have offset 0.
+struct ArithmeticFileHeader {
+    char magic[8];          // "MFPARITH"
+    uint32_t version;       // 1
+    uint32_t functions;     // ArithmeticFunction mask
+    uint64_t low;
+    uint64_t count;
+    uint64_t phi_offset;    // uint64_t[count]
+    uint64_t mu_offset;     // int8_t[count]
+    uint64_t sigma_offset;  // uint64_t[count]
+    uint64_t omega_offset;  // uint8_t[count]
+};
+
+// Computes multiplicative-function tables over [low, high) with a segmented
+// sieve of prime powers up to sqrt(high). Segments are sized to stay in cache
+// and run in parallel, each writing its own slice of the output. The only
+// division per integer recovers its prime factor above sqrt(high), if any;
+// nothing is factored.
+class ArithmeticSieve {
+public:
+    // segment_size 0 picks one from the range: about sqrt(high), clamped to [2^15, 2^20]
+    explicit ArithmeticSieve(int num_threads = 0, uint32_t segment_size = 0);
+    
+    // Fill caller arrays; false when the range is empty or reaches ARITHMETIC_SIEVE_LIMIT
+    bool compute(uint64_t low, uint64_t high, const ArithmeticOutput& output);
+    
+    // Allocate and fill the requested tables
+    bool computeTables(uint64_t low, uint64_t high, unsigned functions, ArithmeticTables& tables);
+    
+    // Write the tables straight into a memory-mapped file (Linux only)
+    bool computeToFile(uint64_t low, uint64_t high, unsigned functions, const std::string& path);
+    
+    int getThreadCount() const;
+    
+private:
+    uint32_t segmentSizeFor(uint64_t high) const;
+    void sieveSegment(uint64_t low, size_t count, uint64_t high, const ArithmeticOutput& output) const;
+    
+    std::unique_ptr<ThreadPool> m_pool;
+    uint32_t m_segment_size;
+};
+
+} // namespace mfp
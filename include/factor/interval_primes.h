@@ -0,0 +1,42 @@
+#pragma once
+
+#include "thread_pool.h"
+#include <gmp.h>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace mfp {
+
+// Enumerates the (probable) primes in intervals of any size, such as
+// [10^40, 10^40 + 10^8]. Every sieving prime gets its offset into the interval
+// from one multi-precision remainder. Segments of odd numbers are then sieved
+// in a bit array, and the survivors of each segment are PRP-tested as one batch
+// on the pool. When the sieve reaches sqrt(high), survivors are primes and are
+// not tested.
+class IntervalPrimeSieve {
+public:
+    // Primes base + offsets[i], ascending
+    typedef std::function<void(mpz_srcptr base, const std::vector<uint32_t>& offsets)> PrimeCallback;
+    
+    explicit IntervalPrimeSieve(int num_threads = 0, uint32_t segment_size = 1 << 18,
+                                uint32_t sieve_bound = 1 << 24, int reps = 25);
+    
+    // Pass the primes in [low, high) to callback a segment at a time, in order, on
+    // the calling thread. At most two segments per thread are in flight.
+    void findPrimes(const mpz_t low, const mpz_t high, const PrimeCallback& callback);
+    
+    // Number of primes in [low, high)
+    uint64_t countPrimes(const mpz_t low, const mpz_t high);
+    
+    int getThreadCount() const;
+    
+private:
+    std::unique_ptr<ThreadPool> m_pool;
+    uint32_t m_segment_size;  // Odd numbers per segment
+    uint32_t m_sieve_bound;
+    int m_reps;
+};
+
+} // namespace mfp
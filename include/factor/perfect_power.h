@@ -0,0 +1,14 @@
+#pragma once
+
+#include <gmp.h>
+
+namespace mfp {
+
+// Largest exponent k > 1 with n = root^k. Non-powers are rejected by a residue
+// test up front. For powers, prime exponents up to log2(n) are tried, and the
+// root is searched again in case it is itself a power. Residues modulo small
+// primes q = 1 (mod k) rule out most exponents before any k-th root is taken.
+// False when n is not a perfect power or n < 4.
+bool perfectPower(const mpz_t n, mpz_t root, unsigned long& exponent);
+
+} // namespace mfp
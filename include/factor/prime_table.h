@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace mfp {
+
+// Primes up to at least limit from a process-wide sieve of Eratosthenes. The
+// table grows on demand; the returned snapshot stays valid while it is held.
+std::shared_ptr<const std::vector<uint32_t>> getPrimeTable(uint32_t limit);
+
+// Mark primes in [low, high): flags[i] is 1 when low + i is prime. primes must
+// hold every prime up to sqrt(high).
+void segmentPrimeFlags(uint64_t low, uint64_t high, const std::vector<uint32_t>& primes,
+                       std::vector<uint8_t>& flags);
+
+// Largest prime powers p^k <= bound for every prime p <= bound, in prime order
+std::shared_ptr<const std::vector<uint64_t>> getPrimePowers(uint64_t bound);
+
+} // namespace mfp
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <gmp.h>
+#include <cstdint>
+#include <vector>
+
+namespace mfp {
+
+// One member multiplier * q + offset of a prime tuple
+struct TupleForm {
+    unsigned long multiplier;
+    long offset;
+};
+
+typedef std::vector<TupleForm> TuplePattern;
+
+// q and 2q + 1: q is a Sophie Germain prime and 2q + 1 a safe prime
+TuplePattern safePrimePattern();
+
+// q and q + 2
+TuplePattern twinPrimePattern();
+
+// q, 2q + 1, 4q + 3, ...: a Cunningham chain of the first kind
+TuplePattern cunninghamChainPattern(unsigned length);
+
+struct TupleSearchParams {
+    int num_threads = 0;            // 0 uses every core
+    uint32_t window = 1 << 18;      // Candidates q sieved together
+    uint32_t sieve_bound = 1 << 20; // Small primes used by the sieve
+    int reps = 25;                  // Miller-Rabin rounds per member once all pass base-2 Fermat
+};
+
+// Smallest q >= start for which every form of the pattern is a probable prime.
+// Each window of candidates is sieved for all forms at once, and only joint
+// survivors are tested, in parallel. Returns false for an empty pattern or one
+// that some prime always divides.
+bool findPrimeTuple(const mpz_t start, const TuplePattern& pattern, mpz_t q,
+                    const TupleSearchParams& params = TupleSearchParams());
+
+// A safe prime p = 2q + 1 of exactly bits bits, searched from a random start
+bool randomSafePrime(unsigned long bits, gmp_randstate_t state, mpz_t p,
+                     const TupleSearchParams& params = TupleSearchParams());
+
+} // namespace mfp
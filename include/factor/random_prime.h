@@ -0,0 +1,31 @@
+#pragma once
+
+#include <gmp.h>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+namespace mfp {
+
+// Fills buffer with size random bytes; false on failure. Supply a CSPRNG for
+// key generation.
+typedef std::function<bool(unsigned char* buffer, size_t size)> RandomBytesSource;
+
+struct RandomPrimeParams {
+    int num_threads = 0;            // 0 uses every core
+    uint32_t window = 1 << 11;      // Odd candidates sieved per random window
+    uint32_t sieve_bound = 0;       // Small primes used by the sieve; 0 scales with bits
+    int reps = 25;                  // Miller-Rabin rounds once base-2 Fermat passes
+    bool set_top_two_bits = false;  // So the product of two such primes has exactly 2 * bits bits
+    RandomBytesSource random;       // Defaults to std::random_device
+};
+
+// A random probable prime of exactly bits bits. Each random window of odd
+// candidates is sieved by small primes, and the survivors are tested in
+// parallel in a random order. Testing stops as soon as one is prime. A window
+// without a prime is replaced by a fresh random one rather than extended, so
+// primes after long gaps are not favoured. Returns false if bits < 2 or the
+// random source fails.
+bool randomPrime(unsigned long bits, mpz_t prime, const RandomPrimeParams& params = RandomPrimeParams());
+
+} // namespace mfp
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "thread_pool.h"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace mfp {
+
+// Distinct sieving primes recorded per integer; integers with more are
+// factored directly
+const uint32_t RANGE_SIEVE_SLOTS = 8;
+
+// A prime and its exponent
+struct PrimePower {
+    uint64_t prime;
+    uint32_t exponent;
+};
+
+// Factorizations of the consecutive integers low, low + 1, ... in compact form.
+// The factors of low + i are factors[offsets[i]] up to factors[offsets[i + 1]],
+// primes ascending; 0 and 1 have none.
+struct FactoredSegment {
+    uint64_t low = 0;
+    std::vector<uint32_t> offsets;
+    std::vector<PrimePower> factors;
+    
+    size_t size() const { return offsets.empty() ? 0 : offsets.size() - 1; }
+    uint64_t number(size_t i) const { return low + i; }
+    const PrimePower* factorsBegin(size_t i) const { return factors.data() + offsets[i]; }
+    const PrimePower* factorsEnd(size_t i) const { return factors.data() + offsets[i + 1]; }
+};
+
+// Factors every integer in a range with a segmented sieve. Each prime up to
+// sqrt(high) records itself in the slots of its multiples without dividing.
+// Integers whose recorded primes multiply back to n are done; the rest get
+// their exponents and their one large prime factor by division. Segments are
+// sieved in parallel and handed out in ascending order.
+class RangeFactorizer {
+public:
+    typedef std::function<void(const FactoredSegment&)> SegmentCallback;
+    
+    explicit RangeFactorizer(int num_threads = 0, uint32_t segment_size = 1 << 16);
+    
+    // Factor every n in [low, high), passing segments to callback in order on the
+    // calling thread. At most two segments per thread are in flight.
+    void factorRange(uint64_t low, uint64_t high, const SegmentCallback& callback);
+    
+    // Factor the single segment [low, high) on the calling thread
+    void factorSegment(uint64_t low, uint64_t high, FactoredSegment& segment) const;
+    
+    int getThreadCount() const;
+    uint32_t getSegmentSize() const;
+    
+private:
+    std::unique_ptr<ThreadPool> m_pool;
+    uint32_t m_segment_size;
+};
+
+// "2^3 * 5" style text for one factorization; "1" when empty
+std::string formatFactorization(const PrimePower* begin, const PrimePower* end);
+
+} // namespace mfp
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <gmp.h>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace mfp {
+
+// Primes up to this are stripped before the factoring engines run
+const uint32_t SMALL_FACTOR_BOUND = 1 << 20;
+
+// Bound for the primality pre-filter. It grows with the input so that the
+// primorial GCD costs about as much as one Miller-Rabin round.
+uint32_t smallFactorFilterBound(size_t bits);
+
+// True when a prime p <= bound with p < n divides n
+bool hasSmallFactor(const mpz_t n, uint32_t bound);
+
+// Divide every prime up to bound out of n, appending each with multiplicity in
+// ascending order; n is left with the cofactor.
+//
+// Primes below 2^10 are tested a word-sized block at a time. The rest are
+// detected together by one GCD of n with their primorial. The primes in that
+// GCD are then identified by divisibility tests with precomputed inverses
+// modulo 2^64.
+void stripSmallFactors(mpz_t n, std::vector<uint64_t>& factors, uint32_t bound = SMALL_FACTOR_BOUND);
+
+} // namespace mfp
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <gmp.h>
+
+namespace mfp {
+
+class ThreadPool;
+
+// Bounds for the p-1 and p+1 engines. A prime factor p is found when p-1
+// (or p+1) is B1-smooth apart from at most one prime in (B1, B2].
+struct SmoothFactorParams {
+    uint64_t b1 = 50000;        // Stage 1 bound
+    uint64_t b2 = 5000000;      // Stage 2 bound; no stage 2 when b2 <= b1
+    int num_threads = 1;        // Stage 2 workers, each taking a slice of (B1, B2]
+    ThreadPool* pool = nullptr; // Runs the stage 2 workers; null starts threads
+    int pplus1_seeds = 3;       // Starting values tried by Williams p+1
+    std::function<bool()> checkpoint; // Polled at every GCD check; true gives up
+};
+
+// Pollard p-1. Returns true and sets factor to a proper divisor of n.
+// n must be odd, composite and not a perfect power.
+bool pollardPMinus1(const mpz_t n, mpz_t factor, const SmoothFactorParams& params = SmoothFactorParams());
+
+// Williams p+1 over Lucas sequences. Each seed finds p only when its
+// discriminant is a non-residue mod p, so several seeds are tried.
+bool williamsPPlus1(const mpz_t n, mpz_t factor, const SmoothFactorParams& params = SmoothFactorParams());
+
+} // namespace mfp
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace mfp {
+
+typedef unsigned __int128 uint128_t;
+
+// Deterministic for every 64-bit n (Miller-Rabin over the seven Jaeschke/Sinclair bases)
+bool isPrime64(uint64_t n);
+
+// Miller-Rabin over the first 13 prime bases: deterministic below 3.3e24
+// (about 2^81), probable prime above
+bool isPrime128(uint128_t n);
+
+// Individual engines. Each returns a proper factor of n, or 0 when it gives up.
+uint64_t lehmanFactor(uint64_t n);                                  // n < 2^42; deterministic
+uint64_t hartFactor(uint64_t n, uint32_t max_iterations = 1 << 20); // Hart's one line method
+uint64_t squfofFactor(uint64_t n);                                  // odd n < 2^62
+uint64_t rhoFactor64(uint64_t n);                                   // odd composite n
+uint128_t rhoFactor128(uint128_t n);                                // odd composite n
+
+// Proper factor of n, choosing the engine by size; 0 when n is prime or below 4
+uint64_t findFactor64(uint64_t n);
+uint128_t findFactor128(uint128_t n);
+
+// Complete factorization into primes in ascending order; empty for 0 and 1
+std::vector<uint64_t> factorize64(uint64_t n);
+std::vector<uint128_t> factorize128(uint128_t n);
+
+// Decimal conversion. Parsing fails on anything but digits and on values of 2^128 or more.
+bool parseUint128(const std::string& text, uint128_t& value);
+std::string uint128ToString(uint128_t value);
+
+} // namespace mfp
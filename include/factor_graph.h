@@ -0,0 +1,51 @@
+#pragma once
+
+#include "mfp_base.h"
+#include "factorization.h"
+#include "thread_pool.h"
+#include <functional>
+#include <string>
+
+namespace mfp {
+
+// One prime of a streamed factorization, with its full exponent
+struct StreamedFactor {
+    std::string prime;
+    unsigned long exponent;
+    std::string cofactor; // The number with every prime delivered so far divided out
+};
+
+// Receives each prime as soon as it is proven; returning false stops the
+// factorization
+using FactorCallback = std::function<bool(const StreamedFactor&)>;
+
+// Complete factorization as a task graph on a shared pool. Every split that
+// is found spawns independent tasks for its parts, so the wall time follows
+// the hardest cofactor instead of the sum of all of them. A part that turns
+// up more than once is factored once and its exponents are added.
+class FactorGraph {
+public:
+    // The method's isPrime() and splitComposite() are called from several
+    // pool threads at once
+    FactorGraph(MFPBase& method, ThreadPool& pool);
+    
+    // The caller works on the graph too, so this is safe to call from inside
+    // a pool task. 1 has no entries; 0 and anything that is not a decimal
+    // integer throw std::invalid_argument.
+    PrimeFactorMap factorize(const std::string& number);
+    
+    // Deliver each prime of number as soon as a split proves it, in the order
+    // found, after -1 (with the magnitude as cofactor) for a negative number.
+    // Calls to the callback do not overlap but may come from pool threads.
+    // Returns the cofactor left: "1" once every prime was delivered, otherwise
+    // the composites no engine split, or what remained when the callback
+    // stopped the graph. Splits already running when it stops still
+    // finish unless the method is cancelled too.
+    std::string stream(const std::string& number, const FactorCallback& callback);
+    
+private:
+    MFPBase& m_method;
+    ThreadPool& m_pool;
+};
+
+} // namespace mfp
@@ -0,0 +1,120 @@
+#pragma once
+
+#include "factor/word_factor.h"
+#include <gmp.h>
+#include <cstddef>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace mfp {
+
+// Orders decimal integers without leading zeros by value
+struct DecimalLess {
+    bool operator()(const std::string& a, const std::string& b) const;
+};
+
+// Prime factors in ascending order with their exponents, led by -1 for a
+// negative number. A composite that no engine could split is kept as a
+// single entry.
+using PrimeFactorMap = std::map<std::string, unsigned long, DecimalLess>;
+
+// The factor list form: each entry repeated by its exponent, in order
+std::vector<std::string> expandPrimeFactors(const PrimeFactorMap& factors);
+
+// Canonical digits of the magnitude of a signed decimal integer. Throws
+// std::invalid_argument on anything else, and on 0, which has no
+// factorization.
+std::string factorableMagnitude(const std::string& number, bool& negative);
+
+// A prime in binary form. Values below 2^128 are held inline with no heap
+// allocation; larger ones in a GMP integer. toString() formats in any base.
+class FactorPrime {
+public:
+    explicit FactorPrime(uint128_t value = 0);
+    explicit FactorPrime(const mpz_t value);
+    FactorPrime(const FactorPrime& other);
+    FactorPrime(FactorPrime&& other) noexcept;
+    FactorPrime& operator=(FactorPrime other) noexcept;
+    ~FactorPrime();
+    
+    // Decimal digits of a value of 2 or more; false (and the value unchanged)
+    // on anything else, including 0 and 1, which are not primes
+    bool parse(const std::string& text);
+    
+    bool isInline() const;
+    uint128_t getInline() const; // Only meaningful when isInline()
+    void get(mpz_t value) const;
+    
+    // Digits in base 2 to 36, lower case
+    std::string toString(int base = 10) const;
+    
+    int compare(const FactorPrime& other) const;
+    bool operator<(const FactorPrime& other) const { return compare(other) < 0; }
+    bool operator==(const FactorPrime& other) const { return compare(other) == 0; }
+    
+private:
+    bool m_inline;
+    uint128_t m_small;
+    mpz_t m_large; // Initialized only when !m_inline
+};
+
+// Prime factorization as sorted (prime, exponent) pairs: 2^64 is one entry
+// with exponent 64 rather than 64 strings. A negative number also carries a
+// factor of -1, held as a sign rather than an entry.
+class Factorization {
+public:
+    struct Entry {
+        FactorPrime prime;
+        unsigned long exponent;
+    };
+    
+    using const_iterator = std::vector<Entry>::const_iterator;
+    
+    // Multiply in prime^exponent; the exponent of a prime already present grows
+    void add(const FactorPrime& prime, unsigned long exponent = 1);
+    
+    // Multiply in -1
+    void negate() { m_negative = !m_negative; }
+    bool isNegative() const { return m_negative; }
+    
+    size_t size() const { return m_entries.size(); }
+    bool empty() const { return m_entries.empty(); }
+    const Entry& operator[](size_t index) const { return m_entries[index]; }
+    const_iterator begin() const { return m_entries.begin(); }
+    const_iterator end() const { return m_entries.end(); }
+    
+    // Exponent of prime, 0 when it does not divide
+    unsigned long exponentOf(const FactorPrime& prime) const;
+    
+    // Sum of the exponents, plus one for a -1: the length of the equivalent
+    // factor list
+    unsigned long countFactors() const;
+    
+    void product(mpz_t result) const;
+    
+    // "2^64 * 3 * 5^2" with the primes in the given base, led by "-1 * " when
+    // negative
+    std::string toString(int base = 10) const;
+    
+    // The factor list form: each prime repeated by its exponent, ascending,
+    // after "-1" when negative
+    std::vector<std::string> toStrings() const;
+    
+    // From prime powers as the factor graph produces them: one parse per
+    // distinct prime, and an entry of -1 multiplies in -1. False (and the
+    // result partly filled) when a key is not a decimal number of 2 or more.
+    static bool fromPrimePowers(const PrimeFactorMap& factors, Factorization& result);
+    
+    // From a factor list in any order, with repeats. A leading '-' on an
+    // entry multiplies in -1, and entries of 1 are skipped. False (and the
+    // result partly filled) when an entry is anything else that is not a
+    // decimal number of 2 or more, such as 0.
+    static bool fromStrings(const std::vector<std::string>& factors, Factorization& result);
+    
+private:
+    std::vector<Entry> m_entries; // Ascending by prime, exponents above 0
+    bool m_negative = false;
+};
+
+} // namespace mfp
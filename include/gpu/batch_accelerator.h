@@ -0,0 +1,33 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+namespace mfp {
+
+// Device side of the HYBRID strategy: a backend that takes whole batches in
+// one launch. The scheduler only talks to a device through this interface, so
+// the CPU-emulated device and a real GPU backend are interchangeable.
+class BatchAccelerator {
+public:
+    virtual ~BatchAccelerator() = default;
+    
+    // Check if the device is ready
+    virtual bool isAvailable() const = 0;
+    
+    // Get device properties
+    virtual std::string getDeviceProperties() const = 0;
+    
+    // Lanes the device runs at once; the scheduler's throughput estimate until
+    // a batch has been measured
+    virtual int getParallelism() const = 0;
+    
+    // Batch operations. False means the device could not run the batch (no
+    // kernel for it, or an input it cannot hold); the caller runs it elsewhere.
+    virtual bool isPrimeBatch(const std::vector<std::string>& numbers, std::vector<uint8_t>& results) = 0;
+    virtual bool factorizeBatch(const std::vector<std::string>& numbers,
+                                std::vector<std::vector<std::string>>& factors) = 0;
+};
+
+} // namespace mfp
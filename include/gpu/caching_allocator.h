@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace mfp {
+
+// Caching allocator statistics
+struct CachingAllocatorStats {
+    size_t allocated_bytes = 0;   // Bytes in blocks handed out to callers
+    size_t cached_bytes = 0;      // Bytes in free blocks kept for reuse
+    size_t peak_reserved_bytes = 0;
+    size_t cache_hits = 0;
+    size_t cache_misses = 0;
+    size_t trims = 0;             // Times cached blocks were returned under pressure
+};
+
+// Size-class caching allocator for device memory. Requests are rounded up to a
+// size class, freed blocks are kept per class and reused by later requests, and
+// cached blocks are returned to the backend when the capacity would be exceeded
+// or the backend allocation fails.
+class CachingAllocator {
+public:
+    using RawAllocate = std::function<void*(size_t)>;
+    using RawFree = std::function<void(void*)>;
+    
+    CachingAllocator(RawAllocate raw_allocate, RawFree raw_free, size_t capacity_bytes);
+    ~CachingAllocator();
+    
+    CachingAllocator(const CachingAllocator&) = delete;
+    CachingAllocator& operator=(const CachingAllocator&) = delete;
+    
+    // Allocate a block of at least size_bytes (nullptr if out of memory)
+    void* allocate(size_t size_bytes);
+    
+    // Return a block to the cache; false if the pointer is unknown
+    bool free(void* ptr);
+    
+    // Release cached blocks to the backend until at most max_cached_bytes stay cached
+    size_t trim(size_t max_cached_bytes = 0);
+    
+    // Get the size class of a live block (0 if unknown)
+    size_t getBlockSize(const void* ptr) const;
+    
+    // Bytes held from the backend (allocated + cached)
+    size_t getReservedBytes() const;
+    
+    // Get statistics
+    CachingAllocatorStats getStats() const;
+    
+    // Round a request up to its size class
+    static size_t sizeClass(size_t size_bytes);
+    
+private:
+    RawAllocate m_raw_allocate;
+    RawFree m_raw_free;
+    size_t m_capacity;
+    
+    mutable std::mutex m_mutex;
+    std::map<size_t, std::vector<void*>> m_free_blocks;   // Size class -> cached blocks
+    std::unordered_map<const void*, size_t> m_live_blocks; // Block -> size class
+    CachingAllocatorStats m_stats;
+    
+    // Release cached blocks, largest classes first; caller holds the lock
+    size_t trimLocked(size_t max_cached_bytes);
+};
+
+} // namespace mfp
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <gmp.h>
+#include "thread_pool.h"
+#include "gpu/batch_accelerator.h"
+
+namespace mfp {
+
+// Accelerator backend that executes the batch kernels on a dedicated CPU thread group,
+// so that the HYBRID strategy can be built, tested and load-tested on machines without a GPU
+class CPUEmulatedAccelerator : public BatchAccelerator {
+public:
+    CPUEmulatedAccelerator();
+    ~CPUEmulatedAccelerator() override;
+    
+    // Initialize the emulated device with its own thread group (0 = half of the cores)
+    bool initialize(int device_threads = 0);
+    
+    // Check if the emulated device is available
+    bool isAvailable() const override;
+    
+    // Get device properties
+    std::string getDeviceProperties() const override;
+    
+    // MFP operations
+    bool isPrime(const mpz_t number, bool& result);
+    bool factorize(const mpz_t number, std::vector<std::string>& factors);
+    bool nextPrime(const mpz_t number, mpz_t next_prime);
+    
+    // Batch operations: one upload, one kernel launch over all lanes, one download
+    bool isPrimeBatch(const std::vector<std::string>& numbers, std::vector<uint8_t>& results) override;
+    bool factorizeBatch(const std::vector<std::string>& numbers, std::vector<std::vector<std::string>>& factors) override;
+    
+    // Performance benchmarking
+    double benchmark(const mpz_t number);
+    
+    // Get number of device threads
+    int getDeviceThreads() const;
+    int getParallelism() const override;
+    
+private:
+    bool m_initialized;
+    int m_device_threads;
+    std::unique_ptr<ThreadPool> m_device_pool;
+    
+    // Run kernel(lane) for every lane in blocks of lanes, like a grid of thread blocks
+    void launch(size_t lanes, const std::function<void(size_t)>& kernel);
+};
+
+} // namespace mfp
@@ -5,6 +5,7 @@
 #include <memory>
 #include <gmp.h>
 #include "mfp_base.h"
+#include "gpu/cuda_memory.h"
 
 namespace mfp {
 
@@ -24,42 +25,6 @@ typedef void* CUmodule;
 typedef void* CUfunction;
 #endif
 
-// CUDA memory management
-class CUDAMemory {
-public:
-    CUDAMemory();
-    ~CUDAMemory();
-    
-    // Initialize CUDA memory system
-    bool initialize(size_t max_memory_bytes = 0);
-    
-    // Allocate device memory
-    void* allocate(size_t size_bytes);
-    
-    // Free device memory
-    void free(void* ptr);
-    
-    // Copy host to device
-    bool copyHostToDevice(void* device_ptr, const void* host_ptr, size_t size_bytes);
-    
-    // Copy device to host
-    bool copyDeviceToHost(void* host_ptr, const void* device_ptr, size_t size_bytes);
-    
-    // Copy device to device
-    bool copyDeviceToDevice(void* dst_ptr, const void* src_ptr, size_t size_bytes);
-    
-    // Get available memory
-    size_t getAvailableMemory() const;
-    
-    // Get total memory
-    size_t getTotalMemory() const;
-    
-private:
-    bool m_initialized;
-    size_t m_total_memory;
-    size_t m_allocated_memory;
-};
-
 // CUDA kernel management
 class CUDAKernel {
 public:
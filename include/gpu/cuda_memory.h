@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include "gpu/caching_allocator.h"
+
+namespace mfp {
+
+// CUDA memory management. Without __CUDA__ host memory stands in for the
+// device, so the caching path builds and runs everywhere.
+class CUDAMemory {
+public:
+    CUDAMemory();
+    ~CUDAMemory();
+    
+    // Initialize CUDA memory system
+    bool initialize(size_t max_memory_bytes = 0);
+    
+    // Allocate device memory (served from the size-class cache when possible)
+    void* allocate(size_t size_bytes);
+    
+    // Free device memory (the block is cached for reuse)
+    void free(void* ptr);
+    
+    // Return cached blocks to the driver
+    size_t trim();
+    
+    // Copy host to device
+    bool copyHostToDevice(void* device_ptr, const void* host_ptr, size_t size_bytes);
+    
+    // Copy device to host
+    bool copyDeviceToHost(void* host_ptr, const void* device_ptr, size_t size_bytes);
+    
+    // Copy device to device
+    bool copyDeviceToDevice(void* dst_ptr, const void* src_ptr, size_t size_bytes);
+    
+    // Get available memory
+    size_t getAvailableMemory() const;
+    
+    // Get total memory
+    size_t getTotalMemory() const;
+    
+    // Get bytes held in the cache
+    size_t getCachedMemory() const;
+    
+    // Get allocator statistics
+    CachingAllocatorStats getStats() const;
+    
+private:
+    bool m_initialized;
+    size_t m_total_memory;
+    std::unique_ptr<CachingAllocator> m_allocator;
+};
+
+} // namespace mfp
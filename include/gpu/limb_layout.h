@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <gmp.h>
+#include "memory_accounting.h"
+
+namespace mfp {
+
+// Limb type used by device and SIMD kernels (32-bit lanes map to GPU registers and AVX2/NEON lanes)
+typedef uint32_t limb_t;
+const unsigned int LIMB_BITS = 32;
+
+// Lane rows are padded to a multiple of this, one warp / SIMD register group
+const size_t LANE_ALIGNMENT = 32;
+
+// Batch of numbers packed as fixed-width little-endian limbs in structure-of-arrays
+// order: limb k of number i lives at limbs[k * lane_stride + i], so consecutive
+// lanes read consecutive words (coalesced on a GPU, contiguous for SIMD loads).
+struct PackedLimbBatch {
+    size_t lane_count = 0;   // Numbers in the batch
+    size_t lane_stride = 0;  // Lanes per limb row, padded to LANE_ALIGNMENT
+    size_t limb_count = 0;   // Limbs per number
+    std::vector<limb_t, AccountedAllocator<limb_t>> limbs;
+    
+    // Row of limb k for every lane
+    limb_t* row(size_t k) { return limbs.data() + k * lane_stride; }
+    const limb_t* row(size_t k) const { return limbs.data() + k * lane_stride; }
+    
+    // Limb k of lane i
+    limb_t limb(size_t lane, size_t k) const { return limbs[k * lane_stride + lane]; }
+    
+    // Size of the packed buffer in bytes
+    size_t byteSize() const { return limbs.size() * sizeof(limb_t); }
+};
+
+// Allocate a zeroed batch
+void resizeLimbBatch(PackedLimbBatch& batch, size_t lane_count, size_t limb_count);
+
+// Pack non-negative numbers; limb_count 0 sizes the batch to the largest input.
+// Returns false if an input is negative, malformed or wider than limb_count limbs.
+bool packLimbs(const std::vector<std::string>& numbers, PackedLimbBatch& batch, size_t limb_count = 0);
+bool packLimbs(const mpz_t* numbers, size_t count, PackedLimbBatch& batch, size_t limb_count = 0);
+
+// Unpack one lane
+void unpackLane(const PackedLimbBatch& batch, size_t lane, mpz_t number);
+std::string unpackLaneString(const PackedLimbBatch& batch, size_t lane, int base = 10);
+
+// Check whether a lane holds a single-limb value
+bool laneEquals(const PackedLimbBatch& batch, size_t lane, limb_t value);
+
+// SIMD kernel: remainder of every lane modulo a small divisor (< 2^32), computed
+// row by row from the most significant limb so the inner loop runs over lanes
+void batchRemainders(const PackedLimbBatch& batch, uint32_t divisor, std::vector<uint32_t>& remainders);
+
+} // namespace mfp
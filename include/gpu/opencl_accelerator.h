@@ -0,0 +1,139 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <gmp.h>
+#include "mfp_base.h"
+#include "gpu/limb_layout.h"
+#include "gpu/batch_accelerator.h"
+
+namespace mfp {
+
+// Forward declarations
+class ThreadPool;
+
+// OpenCL-specific data structures and types
+#ifdef __OPENCL__
+typedef struct _cl_device_id* CLDevice;
+typedef struct _cl_context* CLContext;
+typedef struct _cl_command_queue* CLCommandQueue;
+typedef struct _cl_program* CLProgram;
+typedef struct _cl_kernel* CLKernel;
+#else
+typedef void* CLDevice;
+typedef void* CLContext;
+typedef void* CLCommandQueue;
+typedef void* CLProgram;
+typedef void* CLKernel;
+#endif
+
+// Widest number the kernels accept (private scratch is sized for this many limbs)
+const size_t OPENCL_MAX_LIMBS = 128;
+
+// OpenCL accelerator for MFP operations. Kernels take batches in the packed
+// limb layout and run on any OpenCL device, including CPU runtimes such as
+// PoCL. Built without an OpenCL runtime, the same kernel source runs on host
+// threads so results can be validated anywhere.
+class OpenCLAccelerator : public BatchAccelerator {
+public:
+    OpenCLAccelerator();
+    ~OpenCLAccelerator() override;
+    
+    // Initialize on the first GPU device, or the first device of any type
+    bool initialize();
+    
+    // Check if the accelerator is ready
+    bool isAvailable() const override;
+    
+    // True when no OpenCL runtime is compiled in and kernels run on host threads
+    bool isEmulated() const;
+    
+    // True when the selected device is a GPU
+    bool isGPU() const;
+    
+    // Get device properties
+    std::string getDeviceName() const;
+    std::string getDeviceProperties() const override;
+    
+    // Compute units of the device, or host threads under emulation
+    int getParallelism() const override;
+    
+    // Compiler output from the last failed kernel build
+    const std::string& getBuildLog() const;
+    
+    // Batch Montgomery modular exponentiation: results[i] = bases[i]^exponents[i] mod moduli[i].
+    // Moduli must be odd.
+    bool modExpBatch(const std::vector<std::string>& bases, const std::vector<std::string>& exponents,
+                     const std::vector<std::string>& moduli, std::vector<std::string>& results);
+    
+    // Batch strong probable-prime test to every base in bases
+    bool sprpBatch(const std::vector<std::string>& numbers, const std::vector<uint32_t>& bases,
+                   std::vector<uint8_t>& results);
+    
+    // Mark composites in [low, low + length) using the given sieving primes;
+    // bit i of composite_bits is set when low + i has a factor among them
+    bool sieveSegment(uint64_t low, uint32_t length, const std::vector<uint32_t>& primes,
+                      std::vector<uint32_t>& composite_bits);
+    
+    // MFP operations
+    bool isPrime(const mpz_t number, bool& result);
+    bool isPrimeBatch(const std::vector<std::string>& numbers, std::vector<uint8_t>& results) override;
+    bool nextPrime(const mpz_t number, mpz_t next_prime);
+    
+    // No factorization kernel yet: always false, so batches stay on the host
+    bool factorizeBatch(const std::vector<std::string>& numbers,
+                        std::vector<std::vector<std::string>>& factors) override;
+    
+    // Performance benchmarking
+    double benchmark(const mpz_t number);
+    
+private:
+    bool m_initialized;
+    bool m_emulated;
+    bool m_is_gpu;
+    int m_compute_units;
+    std::string m_device_name;
+    std::string m_build_log;
+    
+    CLDevice m_device;
+    CLContext m_context;
+    CLCommandQueue m_queue;
+    CLProgram m_program;
+    CLKernel m_kernel_mod_exp;
+    CLKernel m_kernel_sprp;
+    CLKernel m_kernel_sieve;
+    
+    // Runs kernels when no OpenCL runtime is available
+    std::unique_ptr<ThreadPool> m_host_pool;
+    
+    // Helper methods
+    bool loadKernels();
+    void release();
+    bool launchSprp(const PackedLimbBatch& numbers, const std::vector<uint32_t>& bases, std::vector<uint8_t>& results);
+};
+
+// MFP implementation for the OPENCL_GPU strategy: primality and next-prime
+// run on the device, factorization on the host method
+class OpenCLMFP : public MFPBase {
+public:
+    OpenCLMFP(std::shared_ptr<OpenCLAccelerator> device, int method_number);
+    virtual ~OpenCLMFP();
+    
+    virtual bool isPrime(const std::string& number) override;
+    virtual std::vector<std::string> factorize(const std::string& number) override;
+    virtual std::string findNextPrime(const std::string& number) override;
+    
+    // Batch operations
+    std::vector<uint8_t> isPrimeBatch(const std::vector<std::string>& numbers);
+    
+private:
+    std::shared_ptr<OpenCLAccelerator> m_device;
+    std::unique_ptr<MFPBase> m_host_method;
+};
+
+// Factory method to create MFP implementation using OpenCL
+std::unique_ptr<MFPBase> createOpenCLMFP(int method_number, std::shared_ptr<OpenCLAccelerator> device);
+
+} // namespace mfp
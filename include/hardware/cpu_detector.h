@@ -34,12 +34,33 @@ struct CPUFeatures {
     bool has_sve = false;   // ARM
 };
 
+// Core classes on hybrid (heterogeneous) CPUs
+enum class CoreType {
+    UNIFORM,      // All cores are identical
+    PERFORMANCE,  // P-core (Intel cpu_core PMU, ARM big cores)
+    EFFICIENCY    // E-core (Intel cpu_atom PMU, ARM LITTLE cores)
+};
+
+// Per logical CPU information
+struct LogicalCPU {
+    int id = 0;
+    CoreType type = CoreType::UNIFORM;
+    int capacity = 1024;   // Relative capacity on the Linux cpu_capacity scale (fastest = 1024)
+    double max_mhz = 0.0;
+};
+
 // CPU topology information
 struct CPUTopology {
     int physical_cores = 0;
     int logical_cores = 0;
     int numa_nodes = 0;
     bool has_hyperthreading = false;
+    
+    // Hybrid CPU information
+    bool is_hybrid = false;
+    int performance_cpus = 0;
+    int efficiency_cpus = 0;
+    std::vector<LogicalCPU> cpus;
 };
 
 // CPU cache information
@@ -80,6 +101,9 @@ public:
     // Calculate optimal thread count for a specific workload
     int getOptimalThreadCount(bool memory_intensive = false, bool io_intensive = false) const;
 
+    // Get logical CPUs ordered fastest first (performance cores before efficiency cores)
+    std::vector<LogicalCPU> getCPUsBySpeed() const;
+
     // Check if specific feature is available
     bool hasFeature(const std::string& feature_name) const;
 
@@ -99,6 +123,9 @@ private:
     void detectOnLinux();
     void detectOnMacOS();
     void detectOnWindows();
+
+    // Detect P-core/E-core classes and per-CPU capacity from sysfs
+    void detectCoreClassesOnLinux();
 };
 
 } // namespace mfp
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <cstdint>
+#include "mfp_base.h"
+#include "thread_pool.h"
+#include "gpu/batch_accelerator.h"
+
+namespace mfp {
+
+// Splits batches between an accelerator device and the host thread pool in
+// proportion to the throughput each side delivered on previous batches. A
+// device share the device cannot run is finished on the host.
+class HybridScheduler {
+public:
+    HybridScheduler(std::shared_ptr<BatchAccelerator> device,
+                    std::shared_ptr<MFPBase> host_method,
+                    std::shared_ptr<ThreadPool> host_pool);
+    ~HybridScheduler();
+    
+    // Batch operations
+    std::vector<uint8_t> isPrimeBatch(const std::vector<std::string>& numbers);
+    std::vector<std::vector<std::string>> factorizeBatch(const std::vector<std::string>& numbers);
+    
+    // Fraction of each batch currently sent to the device
+    double getDeviceShare() const;
+    
+    // Measured throughput in items per millisecond
+    double getDeviceThroughput() const;
+    double getHostThroughput() const;
+    
+private:
+    std::shared_ptr<BatchAccelerator> m_device;
+    std::shared_ptr<MFPBase> m_host_method;
+    std::shared_ptr<ThreadPool> m_host_pool;
+    
+    mutable std::mutex m_mutex;
+    double m_device_throughput;
+    double m_host_throughput;
+    
+    // Number of leading items of a batch to give to the device
+    size_t deviceCount(size_t batch_size) const;
+    
+    // Fold one batch's measured throughput into the running estimates
+    void updateThroughput(size_t device_items, double device_ms, size_t host_items, double host_ms);
+};
+
+// MFP implementation for the HYBRID strategy: single calls run on the host
+// method, batch calls are split by the scheduler
+class HybridMFP : public MFPBase {
+public:
+    HybridMFP(std::shared_ptr<BatchAccelerator> device, int method_number);
+    virtual ~HybridMFP();
+    
+    virtual bool isPrime(const std::string& number) override;
+    virtual std::vector<std::string> factorize(const std::string& number) override;
+    virtual std::string findNextPrime(const std::string& number) override;
+    
+    // Batch operations
+    std::vector<uint8_t> isPrimeBatch(const std::vector<std::string>& numbers);
+    std::vector<std::vector<std::string>> factorizeBatch(const std::vector<std::string>& numbers);
+    
+    // Get the scheduler
+    HybridScheduler& getScheduler();
+    
+private:
+    std::shared_ptr<MFPBase> m_host_method;
+    std::unique_ptr<HybridScheduler> m_scheduler;
+};
+
+// Factory method to create MFP implementation for the HYBRID strategy
+std::unique_ptr<MFPBase> createHybridMFP(int method_number, std::shared_ptr<BatchAccelerator> device);
+
+} // namespace mfp
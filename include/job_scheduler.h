@@ -0,0 +1,148 @@
+#pragma once
+
+#include "mfp_base.h"
+#include "metrics.h"
+#include "factorization.h"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace mfp {
+
+class ThreadPool;
+
+// Expected cost of a job, from its operation and input size
+enum class SizeClass {
+    SHORT,  // Primality and next-prime up to 1024 bits, anything up to 128 bits
+    MEDIUM, // Primality and next-prime above 1024 bits
+    LONG    // Factorization above 128 bits
+};
+
+const size_t SIZE_CLASS_COUNT = 3;
+
+enum class JobStatus {
+    COMPLETED,
+    BUDGET_EXCEEDED // Stopped at a checkpoint, by its budget or by the scheduler
+                    // shutting down; the result fields are empty
+};
+
+struct JobOptions {
+    int priority = 0;       // Higher runs first within a size class
+    uint64_t budget_ms = 0; // Run time before the job is stopped, 0 for no limit
+};
+
+struct JobResult {
+    JobStatus status = JobStatus::COMPLETED;
+    bool is_prime = false;            // IS_PRIME
+    std::vector<std::string> factors; // FACTORIZE
+    PrimeFactorMap prime_factors;     // FACTORIZE on a factor pool, with exponents
+    std::string next_prime;           // NEXT_PRIME
+    uint64_t queued_nanoseconds = 0;
+    uint64_t run_nanoseconds = 0;     // Excluding jobs run at its checkpoints
+};
+
+struct SchedulerParams {
+    int num_workers = 0;    // 0 uses the hardware thread count
+    uint64_t aging_ms = 50; // Each wait of this long raises a job one priority level
+    int class_boost = 4;    // Priority levels a class gets over the next longer one
+    JobOptions default_options; // For jobs submitted without options of their own
+    ThreadPool* factor_pool = nullptr; // Runs factorizations as a factor graph; null
+                                       // leaves them to the method's factorize()
+};
+
+struct SchedulerStats {
+    std::array<uint64_t, SIZE_CLASS_COUNT> submitted = {};
+    std::array<uint64_t, SIZE_CLASS_COUNT> completed = {};
+    uint64_t preemptions = 0;     // Jobs run at a checkpoint of a longer one
+    uint64_t budget_exceeded = 0;
+};
+
+// Runs isPrime, factorize and nextPrime jobs from many callers on a fixed set
+// of workers, so that quick requests are not stuck behind long factorizations.
+//
+// Jobs wait in one queue per size class, ordered by priority plus one level
+// per aging_ms waited. A free worker takes the best job across the queues,
+// with shorter classes class_boost levels ahead, so a long job that has waited
+// long enough still gets its turn. Long jobs leave one worker free when there
+// is more than one. When shorter jobs wait and no worker is idle, a longer job
+// runs one on its own thread at its next checkpoint and then continues.
+class JobScheduler {
+public:
+    using MethodFactory = std::function<std::unique_ptr<MFPBase>()>;
+    
+    // Each job runs on its own method instance from the factory
+    JobScheduler(MethodFactory factory, const SchedulerParams& params = SchedulerParams());
+    ~JobScheduler();
+    
+    JobScheduler(const JobScheduler&) = delete;
+    JobScheduler& operator=(const JobScheduler&) = delete;
+    
+    // Queue a job, with the default options when none are given. Engine
+    // exceptions are rethrown from the future.
+    std::future<JobResult> submit(MetricsOperation operation, const std::string& number);
+    std::future<JobResult> submit(MetricsOperation operation, const std::string& number,
+                                  const JobOptions& options);
+    
+    static SizeClass classify(MetricsOperation operation, size_t bits);
+    
+    size_t getQueueLength(SizeClass size_class) const;
+    SchedulerStats getStats() const;
+    int getWorkerCount() const;
+    
+private:
+    struct Job {
+        MetricsOperation operation;
+        std::string number;
+        JobOptions options;
+        SizeClass size_class;
+        std::chrono::steady_clock::time_point queued;
+        std::promise<JobResult> promise;
+    };
+    
+    // Progress of a running job, shared by the engine threads at its checkpoints
+    struct RunState {
+        SizeClass size_class;
+        uint64_t budget_ns;
+        std::chrono::steady_clock::time_point start;
+        std::atomic<uint64_t> preempted_ns{0};
+        std::atomic<bool> serving{false};
+        std::atomic<bool> stopped{false};
+    };
+    
+    // Best first: priority in aging steps minus the time queued, so waiting
+    // jobs overtake newer ones of higher priority at the aging rate
+    using Queue = std::multimap<int64_t, std::unique_ptr<Job>, std::greater<int64_t>>;
+    
+    void workerLoop();
+    std::unique_ptr<Job> takeJob(size_t class_limit, bool allow_long);
+    void runJob(Job& job);
+    bool checkpoint(RunState& state);
+    
+    MethodFactory m_factory;
+    SchedulerParams m_params;
+    int m_max_long;
+    std::chrono::steady_clock::time_point m_epoch;
+    
+    mutable std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::array<Queue, SIZE_CLASS_COUNT> m_queues;
+    std::array<std::atomic<size_t>, SIZE_CLASS_COUNT> m_queued;
+    std::atomic<int> m_idle;
+    int m_long_running;
+    std::atomic<bool> m_stopping; // Also read at checkpoints without the lock
+    
+    SchedulerStats m_stats;
+    std::vector<std::thread> m_workers;
+};
+
+} // namespace mfp
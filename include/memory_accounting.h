@@ -0,0 +1,159 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace mfp {
+
+// Allocation totals for the process, one thread or one request
+struct MemoryUsage {
+    uint64_t allocations = 0;       // Allocations and reallocations
+    uint64_t frees = 0;
+    uint64_t allocated_bytes = 0;   // Bytes requested, counting reallocation growth
+    int64_t live_bytes = 0;         // Allocated minus freed
+    int64_t peak_live_bytes = 0;    // Highest live_bytes seen
+};
+
+// Usage of one thread, identified by a sequential number
+struct ThreadMemoryUsage {
+    uint32_t thread_id = 0;
+    MemoryUsage usage;
+};
+
+// Byte-level accounting of GMP limb memory (through mp_set_memory_functions)
+// and of the library's own buffers (through AccountedAllocator). Counters are
+// relaxed atomics; the only lock is taken when a thread first allocates and
+// when it exits.
+class MemoryAccounting {
+public:
+    // Requests whose peak can be tracked at the same time
+    static const size_t MAX_TRACKED_REQUESTS = 16;
+    
+    MemoryAccounting();
+    
+    MemoryAccounting(const MemoryAccounting&) = delete;
+    MemoryAccounting& operator=(const MemoryAccounting&) = delete;
+    
+    // Route GMP allocations through the accounting hooks. The hooks use
+    // malloc/realloc/free, so limbs allocated before installation stay valid.
+    void installGMPHooks();
+    bool hooksInstalled() const;
+    
+    // Record allocations made on the calling thread
+    void recordAllocation(size_t bytes);
+    void recordReallocation(size_t old_bytes, size_t new_bytes);
+    void recordFree(size_t bytes);
+    
+    // Get usage
+    MemoryUsage getProcessUsage() const;
+    MemoryUsage getThreadUsage() const;                    // Calling thread
+    std::vector<ThreadMemoryUsage> getThreadUsages() const; // Threads still running
+    
+    // Threads that have exited, and the largest peak any of them reached
+    uint64_t getExitedThreadCount() const;
+    int64_t getExitedThreadPeak() const;
+    
+    // Usage over one request. Counts are process-wide over the request's
+    // lifetime, so worker threads it spawns are included (as is concurrent
+    // work from other requests); the peak is live bytes above the level at
+    // the start.
+    class RequestScope {
+    public:
+        explicit RequestScope(MemoryAccounting& accounting);
+        ~RequestScope();
+        
+        RequestScope(const RequestScope&) = delete;
+        RequestScope& operator=(const RequestScope&) = delete;
+        
+        MemoryUsage getUsage() const;
+        
+    private:
+        MemoryAccounting& m_accounting;
+        MemoryUsage m_start;
+        int m_slot;   // -1 when every slot was taken and the peak is not tracked
+    };
+    
+    // Process totals and per-thread breakdown
+    std::string formatReport() const;
+    
+private:
+    struct Counters {
+        std::atomic<uint64_t> allocations{0};
+        std::atomic<uint64_t> frees{0};
+        std::atomic<uint64_t> allocated_bytes{0};
+        std::atomic<int64_t> live_bytes{0};
+        std::atomic<int64_t> peak_live_bytes{0};
+        
+        MemoryUsage snapshot() const;
+    };
+    
+    struct ThreadCounters {
+        uint32_t thread_id = 0;
+        Counters counters;
+    };
+    
+    struct RequestSlot {
+        std::atomic<bool> used{false};
+        std::atomic<int64_t> peak_live_bytes{0};
+    };
+    
+    friend struct ThreadMemoryHolder;
+    
+    void apply(int64_t delta, uint64_t bytes, bool allocation, bool release);
+    ThreadCounters* attachThread();
+    void detachThread(ThreadCounters* counters);
+    
+    std::atomic<bool> m_hooks_installed;
+    Counters m_process;
+    
+    std::array<RequestSlot, MAX_TRACKED_REQUESTS> m_requests;
+    std::atomic<int> m_active_requests;
+    
+    mutable std::mutex m_threads_mutex;
+    std::vector<std::unique_ptr<ThreadCounters>> m_threads;
+    uint32_t m_next_thread_id;
+    uint64_t m_exited_threads;
+    int64_t m_exited_peak;
+};
+
+// Global memory accounting instance
+MemoryAccounting& getMemoryAccounting();
+
+// Free a string returned by mpz_get_str(nullptr, ...) through GMP's free
+// function, so it is accounted like the allocation was
+void freeGMPString(char* str);
+
+// Standard allocator that reports its blocks to the memory accounting
+template <typename T>
+struct AccountedAllocator {
+    typedef T value_type;
+    
+    AccountedAllocator() = default;
+    template <typename U>
+    AccountedAllocator(const AccountedAllocator<U>&) {}
+    
+    T* allocate(size_t count) {
+        T* ptr = std::allocator<T>().allocate(count);
+        getMemoryAccounting().recordAllocation(count * sizeof(T));
+        return ptr;
+    }
+    
+    void deallocate(T* ptr, size_t count) {
+        getMemoryAccounting().recordFree(count * sizeof(T));
+        std::allocator<T>().deallocate(ptr, count);
+    }
+};
+
+template <typename T, typename U>
+bool operator==(const AccountedAllocator<T>&, const AccountedAllocator<U>&) { return true; }
+
+template <typename T, typename U>
+bool operator!=(const AccountedAllocator<T>&, const AccountedAllocator<U>&) { return false; }
+
+} // namespace mfp
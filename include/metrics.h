@@ -0,0 +1,132 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace mfp {
+
+// Operations tracked by the metrics registry
+enum class MetricsOperation {
+    IS_PRIME,
+    FACTORIZE,
+    NEXT_PRIME
+};
+
+const size_t METRICS_OPERATION_COUNT = 3;
+
+// Input size buckets: up to 32, 64, ..., 4096 bits, then everything larger
+const size_t METRICS_BIT_BUCKET_COUNT = 9;
+
+// HDR-style latency histogram over nanoseconds: log-linear buckets with 16
+// sub-buckets per power of two (at most 1/16 relative error). Recording is a
+// handful of relaxed atomic adds, so any number of threads can record at once.
+class LatencyHistogram {
+public:
+    static const unsigned int SUB_BUCKET_BITS = 4;
+    static const size_t SUB_BUCKET_COUNT = 1 << SUB_BUCKET_BITS;
+    static const unsigned int MAX_VALUE_BITS = 44;   // About 4.9 hours; longer values land in the last bucket
+    static const size_t BUCKET_COUNT = SUB_BUCKET_COUNT + (MAX_VALUE_BITS - SUB_BUCKET_BITS) * SUB_BUCKET_COUNT;
+    
+    LatencyHistogram();
+    
+    LatencyHistogram(const LatencyHistogram&) = delete;
+    LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+    
+    // Record one value
+    void record(uint64_t nanoseconds);
+    
+    // Get totals
+    uint64_t getCount() const;
+    uint64_t getSum() const;
+    uint64_t getMax() const;
+    
+    // Upper bound of the bucket holding the given quantile (0 if empty)
+    uint64_t valueAtQuantile(double quantile) const;
+    
+    // Values recorded in buckets that end at or below the bound
+    uint64_t countAtOrBelow(uint64_t nanoseconds) const;
+    
+    // Bucket mapping
+    static size_t bucketIndex(uint64_t value);
+    static uint64_t bucketUpperBound(size_t index);
+    
+private:
+    std::array<std::atomic<uint64_t>, BUCKET_COUNT> m_buckets;
+    std::atomic<uint64_t> m_count;
+    std::atomic<uint64_t> m_sum;
+    std::atomic<uint64_t> m_max;
+};
+
+// Process-wide operation metrics: latency histograms per operation and input
+// bit-length bucket, completion and failure counters, and in-flight gauges
+class MetricsRegistry {
+public:
+    MetricsRegistry();
+    
+    MetricsRegistry(const MetricsRegistry&) = delete;
+    MetricsRegistry& operator=(const MetricsRegistry&) = delete;
+    
+    // Guard for one call: counts it in flight and records its latency on exit.
+    // A call left by an exception is counted as failed.
+    class Scope {
+    public:
+        Scope(MetricsRegistry& registry, MetricsOperation operation, const std::string& number);
+        ~Scope();
+        
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+        
+    private:
+        MetricsRegistry& m_registry;
+        MetricsOperation m_operation;
+        size_t m_bits;
+        int m_uncaught_exceptions;
+        std::chrono::steady_clock::time_point m_start;
+    };
+    
+    // Record a finished call
+    void record(MetricsOperation operation, size_t bits, uint64_t nanoseconds, bool failed);
+    
+    // Get metrics
+    const LatencyHistogram& getHistogram(MetricsOperation operation, size_t bit_bucket) const;
+    uint64_t getCompleted(MetricsOperation operation) const;
+    uint64_t getFailed(MetricsOperation operation) const;
+    int64_t getInFlight(MetricsOperation operation) const;
+    
+    // Prometheus text exposition snapshot
+    std::string formatPrometheus() const;
+    
+    // Bit-length bucket of an input and its label
+    static size_t bitBucket(size_t bits);
+    static std::string bitBucketLabel(size_t bit_bucket);
+    
+    // Label value of an operation
+    static const char* operationName(MetricsOperation operation);
+    
+private:
+    struct OperationCounters {
+        std::atomic<uint64_t> completed{0};
+        std::atomic<uint64_t> failed{0};
+        std::atomic<int64_t> in_flight{0};
+    };
+    
+    std::array<OperationCounters, METRICS_OPERATION_COUNT> m_counters;
+    std::array<std::array<LatencyHistogram, METRICS_BIT_BUCKET_COUNT>, METRICS_OPERATION_COUNT> m_histograms;
+    std::chrono::steady_clock::time_point m_start;
+};
+
+// Global metrics registry instance
+MetricsRegistry& getMetricsRegistry();
+
+// Number of bits in a decimal number (0 for zero or malformed input)
+size_t decimalBitLength(const std::string& number);
+
+// The same from the digit count alone, without parsing: at most 4 bits above
+// the exact length. Used where only the size bucket matters.
+size_t decimalBitEstimate(const std::string& number);
+
+} // namespace mfp
@@ -1,10 +1,52 @@
 #pragma once
 
+#include <atomic>
+#include <functional>
+#include <memory>
 #include <string>
 #include <vector>
 
 namespace mfp {
 
+class ThreadPool;
+
+// How one call may be stopped. The engines poll the flag in their search
+// loops and run the hook at every loop checkpoint of the Miller-Rabin, rho,
+// Fermat and p-1/p+1 loops, possibly from several engine threads at once. The
+// hook may do other work on the calling thread before returning. Once either
+// says stop, the engines give up and report no factor.
+struct CallControl {
+    const std::atomic<bool>* cancel = nullptr;
+    std::function<bool()> checkpoint;
+    
+    // Neither a flag nor a hook: nothing can stop the call
+    bool empty() const;
+    
+    // Runs the hook, then true once the engines should stop
+    bool stopped() const;
+};
+
+// Installs a control for the method calls made on this thread while it
+// lives, then restores the previous one. Engines install the caller's control
+// on every thread they start, so the control belongs to the call rather than
+// to the method instance, and one instance can serve callers with different
+// controls at once.
+class CallControlScope {
+public:
+    explicit CallControlScope(CallControl control);
+    ~CallControlScope();
+    
+    CallControlScope(const CallControlScope&) = delete;
+    CallControlScope& operator=(const CallControlScope&) = delete;
+    
+private:
+    CallControl m_control;
+    const CallControl* m_previous;
+};
+
+// Control of the calls running on this thread (empty outside any scope)
+const CallControl& currentCallControl();
+
 class MFPBase {
 public:
     MFPBase();
@@ -14,10 +56,48 @@ public:
     virtual std::vector<std::string> factorize(const std::string& number);
     virtual std::string findNextPrime(const std::string& number);
     
+    // One split of a composite by this method's engines: appends parts whose
+    // product is number, which need not be prime. False when no engine
+    // succeeds. Used by factorize() and by the concurrent factor graph.
+    virtual bool splitComposite(const std::string& number, std::vector<std::string>& parts);
+    
+    // Run engine workers as tasks on a shared pool instead of starting
+    // threads on every call. Set before the method is shared; null (the
+    // default) starts threads per call.
+    void setEnginePool(std::shared_ptr<ThreadPool> pool);
+    const std::shared_ptr<ThreadPool>& getEnginePool() const;
+    
 protected:
     // Helper methods that can be used by derived classes
     bool isSmallPrime(unsigned long n);
     bool millerRabinTest(const std::string& n, int iterations = 40);
+    
+    // Pollard p-1, then Williams p+1, with stage 2 split over num_threads.
+    // On success appends the factor found and its cofactor.
+    bool smoothFactorization(const std::string& number, std::vector<std::string>& factors, int num_threads = 1);
+    
+    // Complete factorization with the native word-size engines (no GMP);
+    // false when the number does not fit in 128 bits
+    bool wordSizeFactorization(const std::string& number, std::vector<std::string>& factors);
+    
+    // Split off one factor with the word-size engines and append it and its
+    // cofactor; false when the number is prime or does not fit in 128 bits
+    bool wordSizeSplit(const std::string& number, std::vector<std::string>& factors);
+    
+    // When number = m^k, factor m with this method and append its factors k
+    // times; false when number is not a perfect power
+    bool perfectPowerFactorization(const std::string& number, std::vector<std::string>& factors);
+    
+    // Divide out every prime up to 2^20 and append them, then the factors of
+    // the cofactor from this method; false when the number fits in 128 bits
+    // or has no such prime
+    bool smallFactorStripping(const std::string& number, std::vector<std::string>& factors);
+    
+    // Loop checkpoint: the current call's control says stop
+    bool isCancelled() const;
+    
+private:
+    std::shared_ptr<ThreadPool> m_engine_pool;
 };
 
 } // namespace mfp
@@ -12,6 +12,7 @@ public:
     virtual bool isPrime(const std::string& number) override;
     virtual std::vector<std::string> factorize(const std::string& number) override;
     virtual std::string findNextPrime(const std::string& number) override;
+    virtual bool splitComposite(const std::string& number, std::vector<std::string>& parts) override;
     
 private:
     // Method 1 specific implementation details (Expanded q Factorization)
@@ -15,15 +15,27 @@ public:
     virtual bool isPrime(const std::string& number) override;
     virtual std::vector<std::string> factorize(const std::string& number) override;
     virtual std::string findNextPrime(const std::string& number) override;
+    virtual bool splitComposite(const std::string& number, std::vector<std::string>& parts) override;
+    
+    // Worker placement on hybrid CPUs: logical CPU to pin to (-1 = unpinned) and relative speed
+    struct WorkerSlot {
+        int cpu_id;
+        double speed;
+    };
+    
+    // Split total work units across slots proportionally to their speed;
+    // evenly when no slot has a known (positive) speed
+    static std::vector<int> splitBySpeed(const std::vector<WorkerSlot>& slots, int total);
     
 private:
     // Method 3 specific implementation details (Parallelized with Dynamic Blocks)
     bool parallelPrimalityTest(const std::string& number);
     bool parallelFactorization(const std::string& number, std::vector<std::string>& factors);
     
-    int m_numThreads;
-    std::vector<std::thread> m_threads;
-    std::mutex m_mutex;
+    // Select worker slots, optionally restricted to performance cores
+    std::vector<WorkerSlot> selectWorkerSlots(bool performance_only) const;
+    
+    int m_numThreads; // Engine workers per call, on the engine pool when one is set
 };
 
 } // namespace mfp
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "mfp_base.h"
+#include "metrics.h"
+#include <array>
+#include <cstdint>
+#include <mutex>
+
+namespace mfp {
+
+// Engines raced by the portfolio
+enum class PortfolioEntrant {
+    FERMAT,         // Method 1's expanded q search
+    RHO,            // Method 2's p-1/p+1 then unbounded rho walk
+    PARALLEL_RHO,   // Method 3's rho workers
+    TRIAL_DIVISION  // Sweep of divisors above the small-factor bound
+};
+
+const size_t PORTFOLIO_ENTRANT_COUNT = 4;
+
+// Races run and won by one entrant for one input size
+struct PortfolioRecord {
+    uint64_t races = 0;
+    uint64_t wins = 0;
+};
+
+// Threads per entrant, indexed by PortfolioEntrant; 0 sits the race out
+using PortfolioShares = std::array<int, PORTFOLIO_ENTRANT_COUNT>;
+
+// Portfolio factoring: a composite is split by racing the entrants at once on
+// shares of the thread budget. Shares are weighted by how often each entrant
+// has won for inputs of the same size. The first proper split cancels the
+// others, and its parts are factored the same way.
+class MFPPortfolio : public MFPBase {
+public:
+    MFPPortfolio(int numThreads = 0);
+    virtual ~MFPPortfolio();
+    
+    virtual bool isPrime(const std::string& number) override;
+    virtual std::vector<std::string> factorize(const std::string& number) override;
+    virtual std::string findNextPrime(const std::string& number) override;
+    virtual bool splitComposite(const std::string& number, std::vector<std::string>& parts) override;
+    
+    // Thread shares for an input of the given size. Every entrant gets one
+    // thread in order of its win rate while the budget lasts; spare threads go
+    // to the entrants that can use them, in proportion to their win rates.
+    PortfolioShares planShares(size_t bits) const;
+    
+    // Record of an entrant for a MetricsRegistry::bitBucket
+    PortfolioRecord getRecord(PortfolioEntrant entrant, size_t bit_bucket) const;
+    
+    static const char* entrantName(PortfolioEntrant entrant);
+    
+private:
+    int m_numThreads;
+    mutable std::mutex m_mutex;
+    std::array<std::array<PortfolioRecord, METRICS_BIT_BUCKET_COUNT>, PORTFOLIO_ENTRANT_COUNT> m_records;
+    
+    // Run one entrant on its share under this thread's call control; true
+    // when it found a proper split
+    bool runEntrant(PortfolioEntrant entrant, int threads, const std::string& number,
+                    std::vector<std::string>& parts);
+};
+
+} // namespace mfp
@@ -4,7 +4,15 @@
 #include "mfp_method1.h"
 #include "mfp_method2.h"
 #include "mfp_method3.h"
+#include "mfp_portfolio.h"
+#include "memory_accounting.h"
+#include "shadow_executor.h"
+#include "factor_graph.h"
+#include "factorization.h"
+#include "job_scheduler.h"
+#include "thread_pool.h"
 #include <memory>
+#include <mutex>
 
 namespace mfp {
 
@@ -12,27 +20,106 @@ enum class MFPMethodType {
     METHOD_1, // Expanded q Factorization
     METHOD_2, // Ultrafast with Structural Filter
     METHOD_3, // Parallelized with Dynamic Blocks
+    PORTFOLIO, // Race the methods' engines and cancel the losers
     AUTO      // Automatically select the best method
 };
 
+// Safe to share between threads: every call works on a snapshot of the
+// current method, shadow executor and scheduler, so setMethod() and the mode
+// switches take effect for calls that start afterwards while calls in flight
+// finish on what they started with. Methods keep no per-call state: cancel
+// flags and checkpoint hooks are per call (see CallControlScope). One pool of
+// numThreads threads is shared by all callers: every factorization, scheduled
+// or not, runs on it as a factor graph, and the engine workers of method 3 and
+// the portfolio run on it as tasks instead of threads started per call. Only
+// shadow runs start threads of their own, at the shadow thread's priority.
 class MFPSystem {
 public:
     MFPSystem(MFPMethodType method = MFPMethodType::AUTO, int numThreads = 0);
     ~MFPSystem();
 
     bool isPrime(const std::string& number);
+    
+    // Complete factorization as prime -> exponent, led by "-1" for a negative
+    // number. Cofactors from every split are factored concurrently until
+    // prime; a composite no engine could split is kept as an entry. Throws
+    // std::invalid_argument on 0 and on anything that is not a decimal
+    // integer, before any engine runs.
+    PrimeFactorMap factorizePrimePowers(const std::string& number);
+    
+    // The same factors as sorted (prime, exponent) pairs in binary form, with
+    // the sign of a negative number
+    Factorization factorization(const std::string& number);
+    
+    // The same factors as a list with each prime repeated by its exponent,
+    // after "-1" for a negative number
     std::vector<std::string> factorize(const std::string& number);
+    
+    // The same factorization, delivering each prime with its exponent and the
+    // cofactor left as soon as it is proven. When the callback returns false
+    // the engines still running are cancelled. Returns the cofactor left
+    // ("1" when every prime was delivered).
+    std::string streamFactors(const std::string& number, const FactorCallback& callback);
     std::string findNextPrime(const std::string& number);
     
     void setMethod(MFPMethodType method);
     MFPMethodType getMethod() const;
     
+    // Allocations made during the calling thread's most recent call on this
+    // system (empty when it has made none)
+    const MemoryUsage& getLastRequestMemory() const;
+    
+    // Shadow mode: rerun sample_rate of the calls on another method in the
+    // background and record latency deltas and disagreements. num_threads 0
+    // uses the system's thread count.
+    void enableShadowMode(MFPMethodType method, double sample_rate, int num_threads = 0);
+    void disableShadowMode();
+    bool isShadowModeEnabled() const;
+    
+    // Shadow results (empty when shadow mode is off)
+    ShadowStats getShadowStats() const;
+    std::vector<ShadowDisagreement> getShadowDisagreements() const;
+    
+    // Wait until queued shadow runs have finished
+    void waitForShadowRuns();
+    
+    // Scheduler mode: isPrime, factorize and findNextPrime go through a
+    // JobScheduler, so callers sharing this system are served by size class
+    // and priority instead of in arrival order. Each job runs on its own
+    // instance of the current method, with the params' default options; a
+    // job stopped by its budget throws std::runtime_error from the call
+    // rather than return an answer it never reached.
+    void enableScheduler(const SchedulerParams& params = SchedulerParams());
+    void disableScheduler();
+    bool isSchedulerEnabled() const;
+    
+    // Queue a job with its own priority and budget; turns scheduler mode on
+    // with default parameters when it is off
+    std::future<JobResult> submit(MetricsOperation operation, const std::string& number,
+                                  const JobOptions& options = JobOptions());
+    SchedulerStats getSchedulerStats() const;
+    
 private:
-    MFPMethodType m_methodType;
-    std::unique_ptr<MFPBase> m_method;
+    // What one call runs on, taken under the lock
+    struct Snapshot {
+        std::shared_ptr<MFPBase> method;
+        std::shared_ptr<ShadowExecutor> shadow;
+        std::shared_ptr<JobScheduler> scheduler;
+    };
+    
+    Snapshot snapshot() const;
+    std::shared_ptr<JobScheduler> createScheduler(const SchedulerParams& params);
+    void recordRequestMemory(const MemoryUsage& usage) const;
+    
     int m_numThreads;
     
-    void createMethod();
+    mutable std::mutex m_mutex; // Guards the members below
+    MFPMethodType m_methodType;
+    std::shared_ptr<MFPBase> m_method;
+    std::shared_ptr<ShadowExecutor> m_shadow;
+    std::shared_ptr<JobScheduler> m_scheduler;
+    
+    std::shared_ptr<ThreadPool> m_pool; // Also held by every method instance using it
 };
 
 } // namespace mfp
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+namespace mfp {
+
+// Engine stages measured by the counters
+enum class PerfStage {
+    PRIMALITY_FILTER,   // Small-prime and Fermat pre-filter
+    PRIMALITY_TEST,     // Miller-Rabin rounds
+    FACTOR_SEARCH,      // Expanded q, Pollard rho, parallel rho
+    TRIAL_DIVISION,     // The portfolio's 6k +- 1 sweep
+    WORD_SIZE,          // Complete factorization below 2^128 by the native engines
+    SMALL_FACTORS       // Dividing out the primes up to 2^20
+};
+
+const size_t PERF_STAGE_COUNT = 6;
+
+// Hardware events read around each stage
+enum class PerfEvent {
+    CYCLES,
+    INSTRUCTIONS,
+    L1D_MISSES,
+    LLC_MISSES,
+    BRANCH_MISSES
+};
+
+const size_t PERF_EVENT_COUNT = 5;
+
+// Totals for one stage. Counts are summed over every thread that ran the
+// stage, so time is thread time rather than wall time.
+struct PerfStageTotals {
+    uint64_t calls = 0;
+    uint64_t nanoseconds = 0;
+    std::array<uint64_t, PERF_EVENT_COUNT> events{};
+    std::array<bool, PERF_EVENT_COUNT> counted{};   // False when the event could not be opened
+    
+    // Derived ratios (0 when the inputs were not counted)
+    double instructionsPerCycle() const;
+    double effectiveGHz() const;
+};
+
+// Optional per-thread hardware counter instrumentation built on Linux
+// perf_event_open. Disabled by default; when enabled, each thread opens its
+// own user-space-only counters on first use. If the kernel refuses (for
+// example perf_event_paranoid or a container seccomp profile), stages are
+// still timed and the counters are reported as unavailable.
+class PerfCounterRegistry {
+public:
+    PerfCounterRegistry();
+    
+    PerfCounterRegistry(const PerfCounterRegistry&) = delete;
+    PerfCounterRegistry& operator=(const PerfCounterRegistry&) = delete;
+    
+    // Guard for one stage on the calling thread. Nested scopes are exclusive:
+    // the enclosing stage is paused while an inner one runs.
+    class Scope {
+    public:
+        explicit Scope(PerfStage stage);
+        ~Scope();
+        
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+        
+    private:
+        struct Reading {
+            uint64_t nanoseconds = 0;
+            std::array<uint64_t, PERF_EVENT_COUNT> values{};
+            std::array<uint64_t, PERF_EVENT_COUNT> enabled{};
+            std::array<uint64_t, PERF_EVENT_COUNT> running{};
+        };
+        
+        void charge(const Reading& now);
+        static void takeReading(Reading& reading);
+        
+        bool m_active;
+        PerfStage m_stage;
+        Scope* m_parent;
+        Reading m_checkpoint;
+    };
+    
+    // Enable or disable instrumentation for scopes opened afterwards
+    void setEnabled(bool enabled);
+    bool isEnabled() const;
+    
+    // Open counters on the calling thread if not yet done; false if denied
+    bool probe();
+    
+    // True once some thread has opened at least one counter
+    bool isAvailable() const;
+    
+    // Why counters are unavailable (empty while available or not yet probed)
+    std::string getUnavailableReason() const;
+    
+    // Get and clear totals
+    PerfStageTotals getTotals(PerfStage stage) const;
+    void reset();
+    
+    // Table of stage timings with counters beside them
+    std::string formatReport() const;
+    
+    // Display names
+    static const char* stageName(PerfStage stage);
+    static const char* eventName(PerfEvent event);
+    
+private:
+    struct StageCounters {
+        std::atomic<uint64_t> calls{0};
+        std::atomic<uint64_t> nanoseconds{0};
+        std::array<std::atomic<uint64_t>, PERF_EVENT_COUNT> events{};
+        std::array<std::atomic<bool>, PERF_EVENT_COUNT> counted{};
+    };
+    
+    void add(PerfStage stage, uint64_t nanoseconds, const std::array<uint64_t, PERF_EVENT_COUNT>& events,
+             const std::array<bool, PERF_EVENT_COUNT>& counted, bool finished);
+    void recordOpenResult(bool any_opened, const std::string& reason);
+    
+    std::atomic<bool> m_enabled;
+    std::atomic<bool> m_available;
+    std::atomic<bool> m_denied;
+    std::array<StageCounters, PERF_STAGE_COUNT> m_stages;
+    
+    mutable std::mutex m_reason_mutex;
+    std::string m_unavailable_reason;
+};
+
+// Global performance counter registry instance
+PerfCounterRegistry& getPerfCounters();
+
+} // namespace mfp
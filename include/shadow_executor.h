@@ -0,0 +1,111 @@
+#pragma once
+
+#include "mfp_base.h"
+#include "metrics.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace mfp {
+
+class ThreadPool;
+
+// Disagreements kept for inspection; later ones are only counted
+const size_t MAX_SHADOW_DISAGREEMENTS = 32;
+
+// Shadow execution totals
+struct ShadowStats {
+    uint64_t sampled = 0;          // Calls queued for a shadow run
+    uint64_t completed = 0;        // Shadow runs finished
+    uint64_t dropped = 0;          // Sampled calls skipped because the queue was full
+    uint64_t disagreements = 0;    // Shadow results that differ from the primary
+    uint64_t primary_nanoseconds = 0;
+    uint64_t shadow_nanoseconds = 0;
+    
+    // Mean shadow minus primary latency over completed runs
+    double meanLatencyDeltaMs() const;
+};
+
+// One call where the shadow engine returned something else
+struct ShadowDisagreement {
+    MetricsOperation operation;
+    std::string number;
+    std::string primary_result;
+    std::string shadow_result;
+};
+
+// Reruns a sampled fraction of calls on an alternate engine on a background
+// thread at lower scheduling priority, and compares result and latency with
+// the primary run. The caller's result is never touched; when the backlog is
+// full, further samples are dropped instead of queued. Destruction cancels the
+// run in flight instead of waiting for it.
+class ShadowExecutor {
+public:
+    using MethodFactory = std::function<std::unique_ptr<MFPBase>()>;
+    
+    ShadowExecutor(MethodFactory factory, double sample_rate, size_t max_queue = 64);
+    ~ShadowExecutor();
+    
+    ShadowExecutor(const ShadowExecutor&) = delete;
+    ShadowExecutor& operator=(const ShadowExecutor&) = delete;
+    
+    // Decide whether the next call is shadowed. Samples are spread evenly:
+    // a rate of 0.25 shadows every fourth call.
+    bool sample();
+    
+    // Queue a shadow run of a finished primary call
+    void submitIsPrime(const std::string& number, bool primary_result, uint64_t primary_nanoseconds);
+    void submitFactorize(const std::string& number, const std::vector<std::string>& primary_result,
+                         uint64_t primary_nanoseconds);
+    void submitNextPrime(const std::string& number, const std::string& primary_result, uint64_t primary_nanoseconds);
+    
+    // Block until every queued run has finished
+    void waitForIdle();
+    
+    // Get results
+    ShadowStats getStats() const;
+    std::vector<ShadowDisagreement> getDisagreements() const;
+    double getSampleRate() const;
+    
+    // Canonical result text used for comparison (factors are sorted)
+    static std::string canonicalFactors(std::vector<std::string> factors);
+    
+private:
+    struct Job {
+        MetricsOperation operation;
+        std::string number;
+        std::string primary_result;
+        uint64_t primary_nanoseconds;
+    };
+    
+    void submit(Job job);
+    void workerLoop();
+    std::string run(MFPBase& method, ThreadPool& pool, const Job& job);
+    
+    MethodFactory m_factory;
+    double m_sample_rate;
+    size_t m_max_queue;
+    double m_sample_credit;
+    
+    mutable std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::condition_variable m_idle_cv;
+    std::deque<Job> m_queue;
+    bool m_busy;
+    bool m_stopping;
+    std::atomic<bool> m_cancel; // The shadow engine's control; set on destruction
+    
+    ShadowStats m_stats;
+    std::vector<ShadowDisagreement> m_disagreements;
+    
+    std::thread m_worker;
+};
+
+} // namespace mfp
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace mfp {
+
+// Fixed-size worker pool shared by the CPU execution paths
+class ThreadPool {
+public:
+    explicit ThreadPool(int numThreads = 0);
+    ~ThreadPool();
+    
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+    
+    // Queue a task and get a future for its result
+    template<typename F>
+    auto submit(F&& task) -> std::future<decltype(task())> {
+        using Result = decltype(task());
+        auto packaged = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(task));
+        std::future<Result> future = packaged->get_future();
+        enqueue([packaged] { (*packaged)(); });
+        return future;
+    }
+    
+    // Run body(i) for every i in [0, count) on the pool and the calling thread, then wait.
+    // The caller always takes part, so this is safe to call from inside a pool task.
+    void parallelFor(size_t count, const std::function<void(size_t)>& body);
+    
+    // Get number of worker threads
+    int getThreadCount() const;
+    
+private:
+    std::vector<std::thread> m_workers;
+    std::deque<std::function<void()>> m_tasks;
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    bool m_stopping;
+    
+    void enqueue(std::function<void()> task);
+    void workerLoop();
+};
+
+// Run worker(i) for every i in [0, count) concurrently and wait. With a pool
+// the workers are pool tasks and the caller takes some too, as in
+// parallelFor, so they run at once only as far as the pool has free threads.
+// Without one, a thread is started per worker and passed to started(i, thread)
+// first, e.g. to pin it.
+void runWorkers(ThreadPool* pool, size_t count, const std::function<void(size_t)>& worker,
+                const std::function<void(size_t, std::thread&)>& started = nullptr);
+
+} // namespace mfp
@@ -0,0 +1,155 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace mfp {
+
+// Traced spans
+enum class TraceEvent : uint16_t {
+    WORKER,             // Lifetime of a worker thread's task
+    MR_ROUND,           // One Miller-Rabin witness
+    RHO_BLOCK,          // A fixed number of Pollard rho steps
+    FERMAT_SWEEP,       // Fermat difference-of-squares search
+    THREAD_SPAWN,       // Starting worker threads
+    THREAD_JOIN,        // Waiting for worker threads
+    STRING_CONVERSION   // Decimal string to or from GMP
+};
+
+enum class TracePhase : uint8_t {
+    BEGIN,
+    END
+};
+
+// Records per thread buffer; older records are overwritten once it is full
+const size_t TRACE_BUFFER_CAPACITY = 1 << 14;
+
+// Rho steps per traced block
+const uint64_t TRACE_RHO_BLOCK = 1024;
+
+// Timestamped span events in per-thread ring buffers. Each thread writes only
+// its own buffer with a release store of the head, so recording never locks;
+// the only lock is taken once per thread when a buffer is claimed. Buffers of
+// exited threads are reused by new ones, which keeps memory bounded when
+// workers are spawned per call. Disabled by default.
+class TraceRecorder {
+public:
+    TraceRecorder();
+    ~TraceRecorder();
+    
+    TraceRecorder(const TraceRecorder&) = delete;
+    TraceRecorder& operator=(const TraceRecorder&) = delete;
+    
+    // Enable or disable recording for spans started afterwards
+    void setEnabled(bool enabled) { m_enabled.store(enabled, std::memory_order_relaxed); }
+    bool isEnabled() const { return m_enabled.load(std::memory_order_relaxed); }
+    
+    // Append an event to the calling thread's buffer
+    void record(TraceEvent event, TracePhase phase, uint64_t arg);
+    
+    // Drop all buffered events; call while no thread is tracing
+    void clear();
+    
+    // Events currently held across all buffers
+    size_t getEventCount() const;
+    
+    // Chrome/Perfetto trace JSON ("traceEvents" array of B/E events)
+    std::string exportChromeJson() const;
+    bool writeChromeTrace(const std::string& path) const;
+    
+    // Display name of an event
+    static const char* eventName(TraceEvent event);
+    
+private:
+    struct Record {
+        uint64_t timestamp;   // Nanoseconds since the recorder was created
+        uint64_t arg;
+        uint32_t thread_id;
+        TraceEvent event;
+        TracePhase phase;
+    };
+    
+    struct Buffer {
+        std::vector<Record> records;
+        std::atomic<uint64_t> head{0};
+        std::atomic<bool> owned{false};
+    };
+    
+    friend struct TraceThreadState;
+    
+    Buffer* claimBuffer();
+    
+    std::atomic<bool> m_enabled;
+    uint64_t m_epoch;
+    
+    mutable std::mutex m_buffers_mutex;
+    std::vector<std::unique_ptr<Buffer>> m_buffers;
+};
+
+// Global trace recorder instance
+TraceRecorder& getTraceRecorder();
+
+// Begin/end span for the enclosing block; a single relaxed load when disabled
+class TraceScope {
+public:
+    explicit TraceScope(TraceEvent event, uint64_t arg = 0)
+        : m_event(event), m_active(getTraceRecorder().isEnabled()) {
+        if (m_active) {
+            getTraceRecorder().record(m_event, TracePhase::BEGIN, arg);
+        }
+    }
+    
+    ~TraceScope() {
+        if (m_active) {
+            getTraceRecorder().record(m_event, TracePhase::END, 0);
+        }
+    }
+    
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+    
+private:
+    TraceEvent m_event;
+    bool m_active;
+};
+
+// Splits a long loop into traced blocks of block_size steps; the argument of
+// each block is the index of its first step
+class TraceBlocks {
+public:
+    TraceBlocks(TraceEvent event, uint64_t block_size)
+        : m_event(event), m_block_size(block_size), m_steps(0), m_active(getTraceRecorder().isEnabled()) {
+        if (m_active) {
+            getTraceRecorder().record(m_event, TracePhase::BEGIN, 0);
+        }
+    }
+    
+    ~TraceBlocks() {
+        if (m_active) {
+            getTraceRecorder().record(m_event, TracePhase::END, 0);
+        }
+    }
+    
+    TraceBlocks(const TraceBlocks&) = delete;
+    TraceBlocks& operator=(const TraceBlocks&) = delete;
+    
+    void step() {
+        if (m_active && ++m_steps % m_block_size == 0) {
+            getTraceRecorder().record(m_event, TracePhase::END, 0);
+            getTraceRecorder().record(m_event, TracePhase::BEGIN, m_steps);
+        }
+    }
+    
+private:
+    TraceEvent m_event;
+    uint64_t m_block_size;
+    uint64_t m_steps;
+    bool m_active;
+};
+
+} // namespace mfp
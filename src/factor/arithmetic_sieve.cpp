@@ -0,0 +1,274 @@
+#include "factor/arithmetic_sieve.h"
+#include "factor/prime_table.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace mfp {
+
+namespace {
+
+uint64_t isqrt64(uint64_t n) {
+    uint64_t root = static_cast<uint64_t>(std::sqrt(static_cast<double>(n)));
+    while (root > 0 && root * root > n) {
+        root--;
+    }
+    while ((root + 1) * (root + 1) <= n) {
+        root++;
+    }
+    return root;
+}
+
+uint64_t alignUp(uint64_t offset) {
+    return (offset + 63) & ~static_cast<uint64_t>(63);
+}
+
+// Shift every array so index 0 is the start of a segment
+ArithmeticOutput sliceOutput(const ArithmeticOutput& output, size_t offset) {
+    ArithmeticOutput slice;
+    slice.phi = output.phi ? output.phi + offset : nullptr;
+    slice.mu = output.mu ? output.mu + offset : nullptr;
+    slice.sigma = output.sigma ? output.sigma + offset : nullptr;
+    slice.omega = output.omega ? output.omega + offset : nullptr;
+    return slice;
+}
+
+} // namespace
+
+ArithmeticSieve::ArithmeticSieve(int num_threads, uint32_t segment_size)
+    : m_pool(new ThreadPool(num_threads)), m_segment_size(segment_size) {
+}
+
+bool ArithmeticSieve::compute(uint64_t low, uint64_t high, const ArithmeticOutput& output) {
+    if (low >= high || high > ARITHMETIC_SIEVE_LIMIT) {
+        return false;
+    }
+    
+    // Build the shared prime table once before the segments ask for it
+    getPrimeTable(static_cast<uint32_t>(std::max<uint64_t>(isqrt64(high - 1), 2)));
+    
+    uint64_t segment_size = segmentSizeFor(high);
+    size_t segments = static_cast<size_t>((high - low + segment_size - 1) / segment_size);
+    m_pool->parallelFor(segments, [&](size_t segment) {
+        uint64_t offset = segment * segment_size;
+        size_t count = static_cast<size_t>(std::min<uint64_t>(segment_size, high - low - offset));
+        sieveSegment(low + offset, count, high, sliceOutput(output, static_cast<size_t>(offset)));
+    });
+    
+    return true;
+}
+
+bool ArithmeticSieve::computeTables(uint64_t low, uint64_t high, unsigned functions, ArithmeticTables& tables) {
+    if (low >= high || high > ARITHMETIC_SIEVE_LIMIT) {
+        return false;
+    }
+    
+    size_t count = static_cast<size_t>(high - low);
+    tables.low = low;
+    tables.phi.assign((functions & ARITH_PHI) ? count : 0, 0);
+    tables.mu.assign((functions & ARITH_MU) ? count : 0, 0);
+    tables.sigma.assign((functions & ARITH_SIGMA) ? count : 0, 0);
+    tables.omega.assign((functions & ARITH_OMEGA) ? count : 0, 0);
+    
+    ArithmeticOutput output;
+    output.phi = tables.phi.empty() ? nullptr : tables.phi.data();
+    output.mu = tables.mu.empty() ? nullptr : tables.mu.data();
+    output.sigma = tables.sigma.empty() ? nullptr : tables.sigma.data();
+    output.omega = tables.omega.empty() ? nullptr : tables.omega.data();
+    return compute(low, high, output);
+}
+
+bool ArithmeticSieve::computeToFile(uint64_t low, uint64_t high, unsigned functions, const std::string& path) {
+#ifdef __linux__
+    if (low >= high || high > ARITHMETIC_SIEVE_LIMIT || (functions & ARITH_ALL) == 0) {
+        return false;
+    }
+    
+    // Lay out the header and the requested arrays
+    uint64_t count = high - low;
+    ArithmeticFileHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, "MFPARITH", sizeof(header.magic));
+    header.version = 1;
+    header.functions = functions & ARITH_ALL;
+    header.low = low;
+    header.count = count;
+    
+    uint64_t size = alignUp(sizeof(header));
+    if (functions & ARITH_PHI) {
+        header.phi_offset = size;
+        size = alignUp(size + count * sizeof(uint64_t));
+    }
+    if (functions & ARITH_MU) {
+        header.mu_offset = size;
+        size = alignUp(size + count * sizeof(int8_t));
+    }
+    if (functions & ARITH_SIGMA) {
+        header.sigma_offset = size;
+        size = alignUp(size + count * sizeof(uint64_t));
+    }
+    if (functions & ARITH_OMEGA) {
+        header.omega_offset = size;
+        size = alignUp(size + count * sizeof(uint8_t));
+    }
+    
+    int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    if (ftruncate(fd, static_cast<off_t>(size)) != 0) {
+        close(fd);
+        return false;
+    }
+    void* mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        return false;
+    }
+    
+    // The sieve writes straight into the mapped pages
+    char* base = static_cast<char*>(mapping);
+    std::memcpy(base, &header, sizeof(header));
+    ArithmeticOutput output;
+    output.phi = header.phi_offset ? reinterpret_cast<uint64_t*>(base + header.phi_offset) : nullptr;
+    output.mu = header.mu_offset ? reinterpret_cast<int8_t*>(base + header.mu_offset) : nullptr;
+    output.sigma = header.sigma_offset ? reinterpret_cast<uint64_t*>(base + header.sigma_offset) : nullptr;
+    output.omega = header.omega_offset ? reinterpret_cast<uint8_t*>(base + header.omega_offset) : nullptr;
+    bool computed = compute(low, high, output);
+    
+    bool synced = msync(mapping, size, MS_SYNC) == 0;
+    munmap(mapping, size);
+    return computed && synced;
+#else
+    (void)low;
+    (void)high;
+    (void)functions;
+    (void)path;
+    return false;
+#endif
+}
+
+int ArithmeticSieve::getThreadCount() const {
+    return m_pool->getThreadCount();
+}
+
+uint32_t ArithmeticSieve::segmentSizeFor(uint64_t high) const {
+    if (m_segment_size != 0) {
+        return m_segment_size;
+    }
+    
+    // Long enough that each sieving prime hits the segment, short enough to stay in cache
+    uint64_t root = isqrt64(high);
+    return static_cast<uint32_t>(std::min<uint64_t>(std::max<uint64_t>(root, 1 << 15), 1 << 20));
+}
+
+void ArithmeticSieve::sieveSegment(uint64_t low, size_t count, uint64_t high, const ArithmeticOutput& output) const {
+    uint64_t root = isqrt64(high - 1);
+    std::shared_ptr<const std::vector<uint32_t>> primes = getPrimeTable(static_cast<uint32_t>(std::max<uint64_t>(root, 2)));
+    
+    // Product of the prime powers found so far; what is left of n is one large prime
+    thread_local std::vector<uint64_t> found;
+    found.assign(count, 1);
+    
+    for (size_t i = 0; i < count; i++) {
+        if (output.phi) {
+            output.phi[i] = 1;
+        }
+        if (output.mu) {
+            output.mu[i] = 1;
+        }
+        if (output.sigma) {
+            output.sigma[i] = 1;
+        }
+        if (output.omega) {
+            output.omega[i] = 0;
+        }
+    }
+    
+    for (uint32_t p : *primes) {
+        if (p > root) {
+            break;
+        }
+        
+        // Multiples of p
+        for (size_t i = static_cast<size_t>((p - low % p) % p); i < count; i += p) {
+            found[i] *= p;
+            if (output.phi) {
+                output.phi[i] *= p - 1;
+            }
+            if (output.mu) {
+                output.mu[i] = static_cast<int8_t>(-output.mu[i]);
+            }
+            if (output.sigma) {
+                output.sigma[i] *= p + 1;
+            }
+            if (output.omega) {
+                output.omega[i]++;
+            }
+        }
+        
+        // Multiples of p^k, k >= 2: sigma(p^k) = sigma(p^k-1) + p^k
+        uint64_t previous_sigma = 1 + static_cast<uint64_t>(p);
+        for (uint64_t power = static_cast<uint64_t>(p) * p; power < high; power *= p) {
+            uint64_t power_sigma = previous_sigma + power;
+            for (size_t i = static_cast<size_t>((power - low % power) % power); i < count; i += power) {
+                found[i] *= p;
+                if (output.phi) {
+                    output.phi[i] *= p;
+                }
+                if (output.mu) {
+                    output.mu[i] = 0;
+                }
+                if (output.sigma) {
+                    output.sigma[i] = output.sigma[i] / previous_sigma * power_sigma;
+                }
+            }
+            previous_sigma = power_sigma;
+            if (power > (high - 1) / p) {
+                break;
+            }
+        }
+    }
+    
+    // Remaining prime factor above sqrt(high)
+    for (size_t i = 0; i < count; i++) {
+        uint64_t n = low + i;
+        if (n == 0) {
+            if (output.phi) {
+                output.phi[i] = 0;
+            }
+            if (output.mu) {
+                output.mu[i] = 0;
+            }
+            if (output.sigma) {
+                output.sigma[i] = 0;
+            }
+            continue;
+        }
+        if (found[i] == n) {
+            continue;
+        }
+        
+        uint64_t q = n / found[i];
+        if (output.phi) {
+            output.phi[i] *= q - 1;
+        }
+        if (output.mu) {
+            output.mu[i] = static_cast<int8_t>(-output.mu[i]);
+        }
+        if (output.sigma) {
+            output.sigma[i] *= q + 1;
+        }
+        if (output.omega) {
+            output.omega[i]++;
+        }
+    }
+}
+
+} // namespace mfp
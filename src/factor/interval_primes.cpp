@@ -0,0 +1,211 @@
+#include "factor/interval_primes.h"
+#include "factor/prime_table.h"
+#include <algorithm>
+#include <deque>
+#include <future>
+
+namespace mfp {
+
+namespace {
+
+// A sieving prime and where it first strikes: global odd index first, and
+// first mod p for segments that start after it
+struct SievePrime {
+    uint32_t prime;
+    uint32_t residue_index;
+    uint64_t first;
+};
+
+struct PrimeSegment {
+    uint64_t index = 0;
+    std::vector<uint32_t> offsets;
+};
+
+// Base-2 Fermat first, since most survivors are composite, then the full test
+bool isProbablePrime(const mpz_t n, int reps) {
+    if (mpz_sizeinbase(n, 2) <= 64) {
+        return mpz_probab_prime_p(n, reps) > 0;
+    }
+    mpz_t exponent, residue, base;
+    mpz_init(exponent);
+    mpz_init(residue);
+    mpz_init_set_ui(base, 2);
+    mpz_sub_ui(exponent, n, 1);
+    mpz_powm(residue, base, exponent, n);
+    bool passed = mpz_cmp_ui(residue, 1) == 0 && mpz_probab_prime_p(n, reps) > 0;
+    mpz_clear(exponent);
+    mpz_clear(residue);
+    mpz_clear(base);
+    return passed;
+}
+
+} // namespace
+
+IntervalPrimeSieve::IntervalPrimeSieve(int num_threads, uint32_t segment_size, uint32_t sieve_bound, int reps)
+    : m_pool(new ThreadPool(num_threads)),
+      m_segment_size(std::max<uint32_t>(std::min<uint32_t>(segment_size, 1U << 30), 64)),
+      m_sieve_bound(std::max<uint32_t>(sieve_bound, 3)),
+      m_reps(reps) {
+}
+
+void IntervalPrimeSieve::findPrimes(const mpz_t low, const mpz_t high, const PrimeCallback& callback) {
+    mpz_t base, limit;
+    mpz_init_set(base, low);
+    mpz_init(limit);
+    
+    // 2 is the only even prime; everything after it is sieved over odd numbers
+    if (mpz_cmp_ui(base, 2) <= 0) {
+        if (mpz_cmp_ui(high, 2) > 0) {
+            mpz_set_ui(limit, 2);
+            callback(limit, std::vector<uint32_t>(1, 0));
+        }
+        mpz_set_ui(base, 3);
+    }
+    if (mpz_even_p(base)) {
+        mpz_add_ui(base, base, 1);
+    }
+    if (mpz_cmp(base, high) >= 0) {
+        mpz_clear(base);
+        mpz_clear(limit);
+        return;
+    }
+    
+    // Odd numbers base, base + 2, ... below high
+    mpz_sub(limit, high, base);
+    mpz_cdiv_q_ui(limit, limit, 2);
+    uint64_t total = mpz_fits_ulong_p(limit) ? mpz_get_ui(limit) : UINT64_MAX;
+    uint64_t segments = (total - 1) / m_segment_size + 1;
+    
+    // Primes up to sqrt(high) suffice, and then no survivor needs testing
+    mpz_sub_ui(limit, high, 1);
+    mpz_sqrt(limit, limit);
+    // Short intervals are not worth a remainder for every prime up to the bound
+    uint32_t bound = static_cast<uint32_t>(std::min<uint64_t>(m_sieve_bound, std::max<uint64_t>(total, 1 << 10) * 64));
+    bool exact = false;
+    if (mpz_cmp_ui(limit, bound) <= 0) {
+        bound = static_cast<uint32_t>(std::max<unsigned long>(mpz_get_ui(limit), 3));
+        exact = true;
+    }
+    
+    // One remainder per sieving prime. When the interval starts low enough to
+    // contain the prime itself, striking starts at p^2.
+    std::shared_ptr<const std::vector<uint32_t>> primes = getPrimeTable(bound);
+    bool small_base = mpz_fits_ulong_p(base) != 0;
+    uint64_t small_value = small_base ? mpz_get_ui(base) : 0;
+    std::vector<SievePrime> sieve_primes;
+    for (size_t k = 1; k < primes->size() && (*primes)[k] <= bound; k++) {
+        uint64_t p = (*primes)[k];
+        uint64_t residue = mpz_fdiv_ui(base, p);
+        // base + 2i = 0 (mod p) at i = -base / 2
+        uint64_t index = (p - residue) % p * ((p + 1) / 2) % p;
+        uint64_t first = index;
+        if (small_base && p * p >= small_value) {
+            first = (p * p - small_value) / 2;
+        }
+        sieve_primes.push_back({static_cast<uint32_t>(p), static_cast<uint32_t>(index), first});
+    }
+    
+    uint64_t segment_size = m_segment_size;
+    int reps = m_reps;
+    auto sieveSegment = [&, segment_size, total, exact, reps](uint64_t segment_index, PrimeSegment& segment) {
+        uint64_t offset = segment_index * segment_size;
+        uint64_t count = std::min<uint64_t>(segment_size, total - offset);
+        
+        // Bit i stands for segment base + 2i
+        thread_local std::vector<uint64_t> bits;
+        bits.assign((count + 63) / 64, ~UINT64_C(0));
+        if (count % 64 != 0) {
+            bits.back() = (UINT64_C(1) << (count % 64)) - 1;
+        }
+        for (const SievePrime& entry : sieve_primes) {
+            uint64_t p = entry.prime;
+            uint64_t i;
+            if (entry.first >= offset) {
+                i = entry.first - offset;
+            } else {
+                i = (entry.residue_index + p - (offset % p)) % p;
+            }
+            for (; i < count; i += p) {
+                bits[i >> 6] &= ~(UINT64_C(1) << (i & 63));
+            }
+        }
+        
+        // Survivors of the whole segment are tested together
+        mpz_t segment_base, candidate;
+        mpz_init(segment_base);
+        mpz_init(candidate);
+        mpz_set_ui(segment_base, offset);
+        mpz_mul_2exp(segment_base, segment_base, 1);
+        mpz_add(segment_base, segment_base, base);
+        
+        segment.index = segment_index;
+        segment.offsets.clear();
+        for (size_t w = 0; w < bits.size(); w++) {
+            uint64_t word = bits[w];
+            while (word != 0) {
+                uint64_t i = w * 64 + static_cast<uint64_t>(__builtin_ctzll(word));
+                word &= word - 1;
+                if (!exact) {
+                    mpz_add_ui(candidate, segment_base, 2 * i);
+                    if (!isProbablePrime(candidate, reps)) {
+                        continue;
+                    }
+                }
+                segment.offsets.push_back(static_cast<uint32_t>(2 * i));
+            }
+        }
+        mpz_clear(segment_base);
+        mpz_clear(candidate);
+    };
+    
+    // Keep up to two segments per thread going, delivering them in order
+    size_t max_in_flight = 2 * static_cast<size_t>(m_pool->getThreadCount());
+    std::deque<std::future<std::shared_ptr<PrimeSegment>>> in_flight;
+    std::vector<std::shared_ptr<PrimeSegment>> spare;
+    uint64_t next = 0;
+    mpz_t delivered_base;
+    mpz_init(delivered_base);
+    
+    while (next < segments || !in_flight.empty()) {
+        while (next < segments && in_flight.size() < max_in_flight) {
+            std::shared_ptr<PrimeSegment> segment;
+            if (spare.empty()) {
+                segment = std::make_shared<PrimeSegment>();
+            } else {
+                segment = spare.back();
+                spare.pop_back();
+            }
+            uint64_t segment_index = next++;
+            in_flight.push_back(m_pool->submit([&sieveSegment, segment, segment_index]() {
+                sieveSegment(segment_index, *segment);
+                return segment;
+            }));
+        }
+        
+        std::shared_ptr<PrimeSegment> segment = in_flight.front().get();
+        in_flight.pop_front();
+        mpz_set_ui(delivered_base, segment->index * segment_size);
+        mpz_mul_2exp(delivered_base, delivered_base, 1);
+        mpz_add(delivered_base, delivered_base, base);
+        callback(delivered_base, segment->offsets);
+        spare.push_back(segment);
+    }
+    
+    mpz_clear(delivered_base);
+    mpz_clear(base);
+    mpz_clear(limit);
+}
+
+uint64_t IntervalPrimeSieve::countPrimes(const mpz_t low, const mpz_t high) {
+    uint64_t count = 0;
+    findPrimes(low, high, [&count](mpz_srcptr, const std::vector<uint32_t>& offsets) {
+        count += offsets.size();
+    });
+    return count;
+}
+
+int IntervalPrimeSieve::getThreadCount() const {
+    return m_pool->getThreadCount();
+}
+
+} // namespace mfp
@@ -0,0 +1,154 @@
+#include "factor/perfect_power.h"
+#include "factor/prime_table.h"
+#include <cstdint>
+#include <vector>
+
+namespace mfp {
+
+namespace {
+
+// Exponents up to this get residue filters; above it the roots are tiny anyway
+const uint32_t FILTER_MAX_EXPONENT = 1024;
+const int FILTER_MODULI = 4;
+
+// Primes q = 1 (mod exponent), for which only 1/exponent of the units are
+// exponent-th powers
+struct ExponentFilter {
+    uint32_t exponent;
+    uint32_t moduli[FILTER_MODULI];
+};
+
+bool isPrime32(uint64_t q) {
+    if (q < 2) {
+        return false;
+    }
+    for (uint64_t d = 2; d * d <= q; d++) {
+        if (q % d == 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+uint64_t powMod(uint64_t base, uint64_t exponent, uint64_t modulus) {
+    uint64_t result = 1;
+    base %= modulus;
+    while (exponent != 0) {
+        if (exponent & 1) {
+            result = result * base % modulus;
+        }
+        base = base * base % modulus;
+        exponent >>= 1;
+    }
+    return result;
+}
+
+std::vector<ExponentFilter> buildFilters() {
+    std::vector<ExponentFilter> filters;
+    for (uint32_t k : *getPrimeTable(FILTER_MAX_EXPONENT)) {
+        if (k > FILTER_MAX_EXPONENT) {
+            break;
+        }
+        if (k < 3) {
+            continue;
+        }
+        ExponentFilter filter;
+        filter.exponent = k;
+        int found = 0;
+        for (uint64_t q = 2 * static_cast<uint64_t>(k) + 1; found < FILTER_MODULI; q += 2 * k) {
+            if (isPrime32(q)) {
+                filter.moduli[found++] = static_cast<uint32_t>(q);
+            }
+        }
+        filters.push_back(filter);
+    }
+    return filters;
+}
+
+// Filters for the odd prime exponents in ascending order, built once
+const std::vector<ExponentFilter>& exponentFilters() {
+    static const std::vector<ExponentFilter> filters = buildFilters();
+    return filters;
+}
+
+// False when some residue of n is not a k-th power
+bool passesFilter(const mpz_t n, const ExponentFilter& filter) {
+    for (uint32_t q : filter.moduli) {
+        uint64_t residue = mpz_fdiv_ui(n, q);
+        if (residue != 0 && powMod(residue, (q - 1) / filter.exponent, q) != 1) {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+bool perfectPower(const mpz_t n, mpz_t root, unsigned long& exponent) {
+    if (mpz_cmp_ui(n, 4) < 0) {
+        return false;
+    }
+    
+    const std::vector<ExponentFilter>& filters = exponentFilters();
+    mpz_t current, candidate;
+    mpz_init_set(current, n);
+    mpz_init(candidate);
+    exponent = 1;
+    
+    // Each prime exponent found is divided out of the search and the root
+    // searched again, so 2^6 goes 64 -> 8 -> 2
+    bool reduced = true;
+    while (reduced) {
+        reduced = false;
+        size_t bits = mpz_sizeinbase(current, 2);
+        
+        // A power's exponent divides the power of 2 in it. GMP's residue test
+        // answers yes or no fast, so the search only runs on actual powers.
+        unsigned long valuation = mpz_scan1(current, 0);
+        if (valuation == 1 || bits < 3 || mpz_perfect_power_p(current) == 0) {
+            break;
+        }
+        
+        if (valuation % 2 == 0 && mpz_perfect_square_p(current)) {
+            mpz_sqrt(current, current);
+            exponent *= 2;
+            reduced = true;
+            continue;
+        }
+        
+        size_t filter = 0;
+        for (uint32_t k : *getPrimeTable(static_cast<uint32_t>(bits))) {
+            if (k < 3) {
+                continue;
+            }
+            if (k >= bits) {
+                break;
+            }
+            while (filter < filters.size() && filters[filter].exponent < k) {
+                filter++;
+            }
+            if (valuation != 0 && valuation % k != 0) {
+                continue;
+            }
+            if (filter < filters.size() && !passesFilter(current, filters[filter])) {
+                continue;
+            }
+            if (mpz_root(candidate, current, k) != 0) {
+                mpz_swap(current, candidate);
+                exponent *= k;
+                reduced = true;
+                break;
+            }
+        }
+    }
+    
+    bool found = exponent > 1;
+    if (found) {
+        mpz_set(root, current);
+    }
+    mpz_clear(current);
+    mpz_clear(candidate);
+    return found;
+}
+
+} // namespace mfp
@@ -0,0 +1,110 @@
+#include "factor/prime_table.h"
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <mutex>
+
+namespace mfp {
+
+namespace {
+
+std::mutex g_table_mutex;
+std::shared_ptr<const std::vector<uint32_t>> g_prime_table;
+uint32_t g_prime_table_limit = 0;
+
+std::mutex g_powers_mutex;
+std::map<uint64_t, std::shared_ptr<const std::vector<uint64_t>>> g_prime_powers;
+
+std::shared_ptr<const std::vector<uint32_t>> sievePrimes(uint32_t limit) {
+    std::vector<uint8_t> composite(static_cast<size_t>(limit) + 1, 0);
+    auto primes = std::make_shared<std::vector<uint32_t>>();
+    
+    for (uint64_t i = 2; i <= limit; i++) {
+        if (composite[i]) {
+            continue;
+        }
+        primes->push_back(static_cast<uint32_t>(i));
+        for (uint64_t j = i * i; j <= limit; j += i) {
+            composite[j] = 1;
+        }
+    }
+    
+    return primes;
+}
+
+uint32_t integerSqrt(uint64_t value) {
+    uint64_t root = static_cast<uint64_t>(std::sqrt(static_cast<double>(value)));
+    while (root * root > value) {
+        root--;
+    }
+    while ((root + 1) * (root + 1) <= value) {
+        root++;
+    }
+    return static_cast<uint32_t>(root);
+}
+
+} // namespace
+
+std::shared_ptr<const std::vector<uint32_t>> getPrimeTable(uint32_t limit) {
+    std::lock_guard<std::mutex> lock(g_table_mutex);
+    if (!g_prime_table || g_prime_table_limit < limit) {
+        // Grow geometrically so repeated small extensions stay cheap
+        uint32_t new_limit = std::max<uint32_t>(limit, std::min<uint64_t>(UINT32_MAX - 1, 2ULL * g_prime_table_limit));
+        new_limit = std::max<uint32_t>(new_limit, 1 << 16);
+        g_prime_table = sievePrimes(new_limit);
+        g_prime_table_limit = new_limit;
+    }
+    return g_prime_table;
+}
+
+void segmentPrimeFlags(uint64_t low, uint64_t high, const std::vector<uint32_t>& primes,
+                       std::vector<uint8_t>& flags) {
+    flags.assign(high > low ? high - low : 0, 1);
+    if (flags.empty()) {
+        return;
+    }
+    
+    // 0 and 1 are not prime
+    for (uint64_t value = low; value < std::min<uint64_t>(high, 2); value++) {
+        flags[value - low] = 0;
+    }
+    
+    uint32_t root = integerSqrt(high - 1);
+    for (uint32_t p : primes) {
+        if (p > root) {
+            break;
+        }
+        
+        // First multiple of p in range, never p itself
+        uint64_t start = std::max<uint64_t>(static_cast<uint64_t>(p) * p, (low + p - 1) / p * p);
+        for (uint64_t multiple = start; multiple < high; multiple += p) {
+            flags[multiple - low] = 0;
+        }
+    }
+}
+
+std::shared_ptr<const std::vector<uint64_t>> getPrimePowers(uint64_t bound) {
+    std::lock_guard<std::mutex> lock(g_powers_mutex);
+    auto found = g_prime_powers.find(bound);
+    if (found != g_prime_powers.end()) {
+        return found->second;
+    }
+    
+    auto powers = std::make_shared<std::vector<uint64_t>>();
+    std::shared_ptr<const std::vector<uint32_t>> primes = getPrimeTable(static_cast<uint32_t>(std::min<uint64_t>(bound, UINT32_MAX - 1)));
+    for (uint32_t p : *primes) {
+        if (p > bound) {
+            break;
+        }
+        uint64_t power = p;
+        while (power <= bound / p) {
+            power *= p;
+        }
+        powers->push_back(power);
+    }
+    
+    g_prime_powers[bound] = powers;
+    return powers;
+}
+
+} // namespace mfp
@@ -0,0 +1,280 @@
+#include "factor/prime_tuple.h"
+#include "factor/prime_table.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+
+namespace mfp {
+
+namespace {
+
+// Where a form's multiples fall: q = root (mod prime)
+struct SieveRoot {
+    uint32_t root;
+    uint32_t form;
+};
+
+uint64_t gcd64(uint64_t a, uint64_t b) {
+    while (b != 0) {
+        uint64_t t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+// Inverse of a modulo a prime m, a not divisible by m
+uint64_t inverseMod(uint64_t a, uint64_t m) {
+    int64_t t = 0;
+    int64_t new_t = 1;
+    int64_t r = static_cast<int64_t>(m);
+    int64_t new_r = static_cast<int64_t>(a % m);
+    while (new_r != 0) {
+        int64_t quotient = r / new_r;
+        int64_t next_t = t - quotient * new_t;
+        t = new_t;
+        new_t = next_t;
+        int64_t next_r = r - quotient * new_r;
+        r = new_r;
+        new_r = next_r;
+    }
+    return static_cast<uint64_t>(t < 0 ? t + static_cast<int64_t>(m) : t);
+}
+
+uint64_t offsetMod(long offset, uint64_t m) {
+    long residue = offset % static_cast<long>(m);
+    return static_cast<uint64_t>(residue < 0 ? residue + static_cast<long>(m) : residue);
+}
+
+// A pattern some prime always divides can have no (large) solutions. Only
+// primes up to the pattern length can cover every residue class.
+bool isAdmissible(const TuplePattern& pattern, const std::vector<uint32_t>& primes) {
+    if (pattern.empty()) {
+        return false;
+    }
+    for (const TupleForm& form : pattern) {
+        if (form.multiplier == 0 || gcd64(form.multiplier, static_cast<uint64_t>(std::labs(form.offset))) != 1) {
+            return false;
+        }
+    }
+    
+    for (uint32_t p : primes) {
+        if (p > pattern.size()) {
+            break;
+        }
+        std::vector<bool> covered(p, false);
+        for (const TupleForm& form : pattern) {
+            if (form.multiplier % p != 0) {
+                covered[(p - offsetMod(form.offset, p)) % p * inverseMod(form.multiplier, p) % p] = true;
+            }
+        }
+        if (std::find(covered.begin(), covered.end(), false) == covered.end()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Every member of the tuple at q is a probable prime. A base-2 Fermat test on
+// each member rejects most candidates before the full tests.
+bool isPrimeTuple(const mpz_t q, const TuplePattern& pattern, int reps) {
+    mpz_t value, exponent, residue, base;
+    mpz_init(value);
+    mpz_init(exponent);
+    mpz_init(residue);
+    mpz_init_set_ui(base, 2);
+    
+    std::vector<bool> small(pattern.size(), false);
+    bool passed = true;
+    for (size_t i = 0; i < pattern.size() && passed; i++) {
+        mpz_mul_ui(value, q, pattern[i].multiplier);
+        if (pattern[i].offset >= 0) {
+            mpz_add_ui(value, value, static_cast<unsigned long>(pattern[i].offset));
+        } else {
+            mpz_sub_ui(value, value, static_cast<unsigned long>(-pattern[i].offset));
+        }
+        if (mpz_cmp_ui(value, 2) < 0) {
+            passed = false;
+        } else if (mpz_sizeinbase(value, 2) <= 64) {
+            // Exact for word-size values
+            small[i] = true;
+            passed = mpz_probab_prime_p(value, reps) > 0;
+        } else {
+            mpz_sub_ui(exponent, value, 1);
+            mpz_powm(residue, base, exponent, value);
+            passed = mpz_cmp_ui(residue, 1) == 0;
+        }
+    }
+    
+    for (size_t i = 0; i < pattern.size() && passed; i++) {
+        if (small[i]) {
+            continue;
+        }
+        mpz_mul_ui(value, q, pattern[i].multiplier);
+        if (pattern[i].offset >= 0) {
+            mpz_add_ui(value, value, static_cast<unsigned long>(pattern[i].offset));
+        } else {
+            mpz_sub_ui(value, value, static_cast<unsigned long>(-pattern[i].offset));
+        }
+        passed = mpz_probab_prime_p(value, reps) > 0;
+    }
+    
+    mpz_clear(value);
+    mpz_clear(exponent);
+    mpz_clear(residue);
+    mpz_clear(base);
+    return passed;
+}
+
+} // namespace
+
+TuplePattern safePrimePattern() {
+    return {{1, 0}, {2, 1}};
+}
+
+TuplePattern twinPrimePattern() {
+    return {{1, 0}, {1, 2}};
+}
+
+TuplePattern cunninghamChainPattern(unsigned length) {
+    TuplePattern pattern;
+    unsigned long multiplier = 1;
+    for (unsigned i = 0; i < length; i++) {
+        pattern.push_back({multiplier, static_cast<long>(multiplier - 1)});
+        multiplier *= 2;
+    }
+    return pattern;
+}
+
+bool findPrimeTuple(const mpz_t start, const TuplePattern& pattern, mpz_t q, const TupleSearchParams& params) {
+    uint32_t window = std::max<uint32_t>(params.window, 64);
+    std::shared_ptr<const std::vector<uint32_t>> primes = getPrimeTable(std::max<uint32_t>(params.sieve_bound, 2));
+    if (!isAdmissible(pattern, *primes)) {
+        return false;
+    }
+    
+    mpz_t base;
+    mpz_init_set(base, start);
+    if (mpz_cmp_ui(base, 1) < 0) {
+        mpz_set_ui(base, 1);
+    }
+    
+    // Roots of every form modulo each sieving prime, and the start's residues
+    std::vector<uint32_t> sieve_primes;
+    std::vector<uint32_t> start_residues;
+    std::vector<uint32_t> root_offsets;
+    std::vector<SieveRoot> roots;
+    for (uint32_t p : *primes) {
+        if (p > params.sieve_bound) {
+            break;
+        }
+        sieve_primes.push_back(p);
+        start_residues.push_back(static_cast<uint32_t>(mpz_fdiv_ui(base, p)));
+        root_offsets.push_back(static_cast<uint32_t>(roots.size()));
+        for (size_t f = 0; f < pattern.size(); f++) {
+            if (pattern[f].multiplier % p != 0) {
+                uint64_t root = (p - offsetMod(pattern[f].offset, p)) % p * inverseMod(pattern[f].multiplier, p) % p;
+                roots.push_back({static_cast<uint32_t>(root), static_cast<uint32_t>(f)});
+            }
+        }
+    }
+    root_offsets.push_back(static_cast<uint32_t>(roots.size()));
+    
+    ThreadPool pool(params.num_threads);
+    std::vector<uint8_t> candidates(window);
+    std::vector<uint32_t> survivors;
+    bool found = false;
+    
+    for (uint64_t w = 0; !found; w++) {
+        // While the window holds small numbers a member may equal the sieving
+        // prime itself, which must not be struck out
+        bool small = mpz_sizeinbase(base, 2) <= 40;
+        int64_t small_base = small ? static_cast<int64_t>(mpz_get_ui(base)) : 0;
+        
+        std::fill(candidates.begin(), candidates.end(), 1);
+        for (size_t k = 0; k < sieve_primes.size(); k++) {
+            uint64_t p = sieve_primes[k];
+            uint64_t residue = (start_residues[k] + (w % p) * (window % p)) % p;
+            for (uint32_t r = root_offsets[k]; r < root_offsets[k + 1]; r++) {
+                const SieveRoot& entry = roots[r];
+                uint64_t keep = window;
+                if (small) {
+                    const TupleForm& form = pattern[entry.form];
+                    int64_t numerator = static_cast<int64_t>(p) - form.offset;
+                    int64_t multiplier = static_cast<int64_t>(form.multiplier);
+                    if (numerator % multiplier == 0 && numerator / multiplier >= small_base) {
+                        keep = static_cast<uint64_t>(numerator / multiplier - small_base);
+                    }
+                }
+                for (uint64_t i = (entry.root + p - residue) % p; i < window; i += p) {
+                    if (i != keep) {
+                        candidates[i] = 0;
+                    }
+                }
+            }
+        }
+        
+        survivors.clear();
+        for (uint32_t i = 0; i < window; i++) {
+            if (candidates[i]) {
+                survivors.push_back(i);
+            }
+        }
+        
+        // Joint survivors are tested in parallel; work past the best hit is skipped
+        std::atomic<size_t> best(survivors.size());
+        pool.parallelFor(survivors.size(), [&](size_t s) {
+            if (s >= best.load()) {
+                return;
+            }
+            mpz_t candidate;
+            mpz_init(candidate);
+            mpz_add_ui(candidate, base, survivors[s]);
+            if (isPrimeTuple(candidate, pattern, params.reps)) {
+                size_t current = best.load();
+                while (s < current && !best.compare_exchange_weak(current, s)) {
+                }
+            }
+            mpz_clear(candidate);
+        });
+        
+        if (best.load() < survivors.size()) {
+            mpz_add_ui(q, base, survivors[best.load()]);
+            found = true;
+        } else {
+            mpz_add_ui(base, base, window);
+        }
+    }
+    
+    mpz_clear(base);
+    return true;
+}
+
+bool randomSafePrime(unsigned long bits, gmp_randstate_t state, mpz_t p, const TupleSearchParams& params) {
+    if (bits < 3) {
+        return false;
+    }
+    
+    // q from [2^(bits-2), 2^(bits-1)) makes 2q + 1 a bits-bit number; retry in
+    // the rare case the search runs past the top
+    mpz_t start, q;
+    mpz_init(start);
+    mpz_init(q);
+    bool found = false;
+    while (!found) {
+        mpz_urandomb(start, state, bits - 2);
+        mpz_setbit(start, bits - 2);
+        if (!findPrimeTuple(start, safePrimePattern(), q, params)) {
+            break;
+        }
+        mpz_mul_2exp(p, q, 1);
+        mpz_add_ui(p, p, 1);
+        found = mpz_sizeinbase(p, 2) == bits;
+    }
+    mpz_clear(start);
+    mpz_clear(q);
+    return found;
+}
+
+} // namespace mfp
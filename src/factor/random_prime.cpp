@@ -0,0 +1,178 @@
+#include "factor/random_prime.h"
+#include "factor/prime_table.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <atomic>
+#include <random>
+#include <vector>
+
+namespace mfp {
+
+namespace {
+
+// Below this many bits the search just samples random integers
+const unsigned long DIRECT_SAMPLING_BITS = 32;
+
+bool randomDeviceBytes(unsigned char* buffer, size_t size) {
+    std::random_device device;
+    for (size_t i = 0; i < size; i += 4) {
+        unsigned int value = device();
+        for (size_t j = i; j < size && j < i + 4; j++) {
+            buffer[j] = static_cast<unsigned char>(value >> (8 * (j - i)));
+        }
+    }
+    return true;
+}
+
+// Random bits-bit integer with the requested top bits set
+bool randomInteger(unsigned long bits, bool top_two_bits, const RandomBytesSource& source,
+                   std::vector<unsigned char>& buffer, mpz_t value) {
+    if (!source(buffer.data(), buffer.size())) {
+        return false;
+    }
+    mpz_import(value, buffer.size(), 1, 1, 0, 0, buffer.data());
+    mpz_fdiv_r_2exp(value, value, bits);
+    mpz_setbit(value, bits - 1);
+    if (top_two_bits && bits >= 2) {
+        mpz_setbit(value, bits - 2);
+    }
+    return true;
+}
+
+// Base-2 Fermat first, since most composites fail it, then the full test
+bool isProbablePrime(const mpz_t n, int reps, const std::atomic<bool>& cancelled) {
+    mpz_t exponent, residue, base;
+    mpz_init(exponent);
+    mpz_init(residue);
+    mpz_init_set_ui(base, 2);
+    mpz_sub_ui(exponent, n, 1);
+    mpz_powm(residue, base, exponent, n);
+    bool passed = mpz_cmp_ui(residue, 1) == 0 && !cancelled.load() && mpz_probab_prime_p(n, reps) > 0;
+    mpz_clear(exponent);
+    mpz_clear(residue);
+    mpz_clear(base);
+    return passed;
+}
+
+} // namespace
+
+bool randomPrime(unsigned long bits, mpz_t prime, const RandomPrimeParams& params) {
+    if (bits < 2) {
+        return false;
+    }
+    
+    RandomBytesSource source = params.random ? params.random : RandomBytesSource(randomDeviceBytes);
+    std::vector<unsigned char> buffer((bits + 7) / 8);
+    bool top_two_bits = params.set_top_two_bits;
+    
+    // Small sizes: uniform sampling is already cheap
+    if (bits <= DIRECT_SAMPLING_BITS) {
+        do {
+            if (!randomInteger(bits, top_two_bits, source, buffer, prime)) {
+                return false;
+            }
+        } while (mpz_probab_prime_p(prime, params.reps) == 0);
+        return true;
+    }
+    
+    // Sieving primes grouped so one multi-precision remainder serves several
+    uint32_t bound = params.sieve_bound;
+    if (bound == 0) {
+        bound = static_cast<uint32_t>(std::min<unsigned long>(std::max<unsigned long>(bits * bits, 1 << 10), 1 << 22));
+    }
+    std::shared_ptr<const std::vector<uint32_t>> primes = getPrimeTable(bound);
+    std::vector<uint64_t> group_products;
+    std::vector<size_t> group_ends;
+    uint64_t product = 1;
+    size_t index = 1;  // 2 never divides an odd candidate
+    for (; index < primes->size() && (*primes)[index] <= bound; index++) {
+        uint64_t p = (*primes)[index];
+        if (product > (UINT64_C(1) << 63) / p) {
+            group_products.push_back(product);
+            group_ends.push_back(index);
+            product = 1;
+        }
+        product *= p;
+    }
+    group_products.push_back(product);
+    group_ends.push_back(index);
+    
+    // The order survivors are tested in comes from the caller's source too
+    uint64_t seed = 0;
+    if (!source(reinterpret_cast<unsigned char*>(&seed), sizeof(seed))) {
+        return false;
+    }
+    std::mt19937_64 order(seed);
+    
+    ThreadPool pool(params.num_threads);
+    uint32_t window = std::max<uint32_t>(params.window, 16);
+    std::vector<uint8_t> candidates(window);
+    std::vector<uint32_t> survivors;
+    mpz_t start, room;
+    mpz_init(start);
+    mpz_init(room);
+    bool found = false;
+    
+    while (!found) {
+        // Odd candidates start + 2i that still have bits bits
+        if (!randomInteger(bits, top_two_bits, source, buffer, start)) {
+            break;
+        }
+        mpz_setbit(start, 0);
+        mpz_set_ui(room, 0);
+        mpz_setbit(room, bits);
+        mpz_sub(room, room, start);
+        mpz_cdiv_q_ui(room, room, 2);
+        uint32_t count = mpz_cmp_ui(room, window) < 0 ? static_cast<uint32_t>(mpz_get_ui(room)) : window;
+        
+        std::fill(candidates.begin(), candidates.begin() + count, 1);
+        size_t first = 1;
+        for (size_t g = 0; g < group_products.size(); g++) {
+            uint64_t residue = mpz_fdiv_ui(start, group_products[g]);
+            for (size_t k = first; k < group_ends[g]; k++) {
+                uint64_t p = (*primes)[k];
+                // start + 2i = 0 (mod p) at i = -start / 2
+                uint64_t i = (p - residue % p) % p * ((p + 1) / 2) % p;
+                for (; i < count; i += p) {
+                    candidates[i] = 0;
+                }
+            }
+            first = group_ends[g];
+        }
+        
+        survivors.clear();
+        for (uint32_t i = 0; i < count; i++) {
+            if (candidates[i]) {
+                survivors.push_back(i);
+            }
+        }
+        std::shuffle(survivors.begin(), survivors.end(), order);
+        
+        // The first survivor proven prime cancels the rest
+        std::atomic<bool> done(false);
+        uint32_t winner = 0;
+        pool.parallelFor(survivors.size(), [&](size_t s) {
+            if (done.load()) {
+                return;
+            }
+            mpz_t candidate;
+            mpz_init(candidate);
+            mpz_add_ui(candidate, start, 2 * static_cast<unsigned long>(survivors[s]));
+            if (isProbablePrime(candidate, params.reps, done) && !done.exchange(true)) {
+                winner = survivors[s];
+            }
+            mpz_clear(candidate);
+        });
+        
+        if (done.load()) {
+            mpz_add_ui(prime, start, 2 * static_cast<unsigned long>(winner));
+            found = true;
+        }
+    }
+    
+    mpz_clear(start);
+    mpz_clear(room);
+    return found;
+}
+
+} // namespace mfp
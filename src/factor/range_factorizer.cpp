@@ -0,0 +1,190 @@
+#include "factor/range_factorizer.h"
+#include "factor/prime_table.h"
+#include "factor/word_factor.h"
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <future>
+
+namespace mfp {
+
+namespace {
+
+uint64_t isqrt64(uint64_t n) {
+    uint64_t root = static_cast<uint64_t>(std::sqrt(static_cast<double>(n)));
+    while (root > 0 && static_cast<uint128_t>(root) * root > n) {
+        root--;
+    }
+    while (static_cast<uint128_t>(root + 1) * (root + 1) <= n) {
+        root++;
+    }
+    return root;
+}
+
+// Group an ascending prime list into prime powers
+void appendGrouped(const std::vector<uint64_t>& primes, std::vector<PrimePower>& factors) {
+    for (uint64_t prime : primes) {
+        if (!factors.empty() && factors.back().prime == prime) {
+            factors.back().exponent++;
+        } else {
+            factors.push_back({prime, 1});
+        }
+    }
+}
+
+} // namespace
+
+RangeFactorizer::RangeFactorizer(int num_threads, uint32_t segment_size)
+    : m_pool(new ThreadPool(num_threads)),
+      m_segment_size(std::max<uint32_t>(segment_size, 64)) {
+}
+
+void RangeFactorizer::factorRange(uint64_t low, uint64_t high, const SegmentCallback& callback) {
+    if (low >= high) {
+        return;
+    }
+    
+    // Build the shared prime table once before the workers ask for it
+    getPrimeTable(static_cast<uint32_t>(std::max<uint64_t>(isqrt64(high - 1), 2)));
+    
+    size_t max_in_flight = 2 * static_cast<size_t>(m_pool->getThreadCount());
+    std::deque<std::future<std::shared_ptr<FactoredSegment>>> in_flight;
+    uint64_t next = low;
+    
+    // Delivered segments are recycled so their buffers are not reallocated
+    std::vector<std::shared_ptr<FactoredSegment>> spare;
+    
+    while (next < high || !in_flight.empty()) {
+        while (next < high && in_flight.size() < max_in_flight) {
+            uint64_t segment_low = next;
+            uint64_t segment_high = high - next > m_segment_size ? next + m_segment_size : high;
+            std::shared_ptr<FactoredSegment> segment;
+            if (spare.empty()) {
+                segment = std::make_shared<FactoredSegment>();
+            } else {
+                segment = spare.back();
+                spare.pop_back();
+            }
+            in_flight.push_back(m_pool->submit([this, segment, segment_low, segment_high]() {
+                factorSegment(segment_low, segment_high, *segment);
+                return segment;
+            }));
+            next = segment_high;
+        }
+        
+        std::shared_ptr<FactoredSegment> segment = in_flight.front().get();
+        in_flight.pop_front();
+        callback(*segment);
+        spare.push_back(segment);
+    }
+}
+
+void RangeFactorizer::factorSegment(uint64_t low, uint64_t high, FactoredSegment& segment) const {
+    size_t count = high > low ? static_cast<size_t>(high - low) : 0;
+    segment.low = low;
+    segment.offsets.assign(count + 1, 0);
+    segment.factors.clear();
+    if (count == 0) {
+        return;
+    }
+    
+    uint64_t root = isqrt64(high - 1);
+    std::shared_ptr<const std::vector<uint32_t>> primes = getPrimeTable(static_cast<uint32_t>(std::max<uint64_t>(root, 2)));
+    
+    // Sieve: record each prime in its multiples' slots; filled saturates at SLOTS + 1.
+    // The buffers stay with the thread, only filled needs clearing.
+    thread_local std::vector<uint32_t> slots;
+    thread_local std::vector<uint8_t> filled;
+    slots.resize(count * RANGE_SIEVE_SLOTS);
+    filled.assign(count, 0);
+    for (uint32_t p : *primes) {
+        if (p > root) {
+            break;
+        }
+        uint64_t offset = (p - low % p) % p;
+        for (uint64_t i = offset; i < count; i += p) {
+            uint8_t& used = filled[i];
+            if (used < RANGE_SIEVE_SLOTS) {
+                slots[i * RANGE_SIEVE_SLOTS + used] = p;
+            }
+            if (used <= RANGE_SIEVE_SLOTS) {
+                used++;
+            }
+        }
+    }
+    
+    // Resolve each integer from its slots
+    segment.factors.reserve(count * 3);
+    for (size_t i = 0; i < count; i++) {
+        segment.offsets[i] = static_cast<uint32_t>(segment.factors.size());
+        uint64_t n = low + i;
+        if (n < 2) {
+            continue;
+        }
+        
+        uint8_t used = filled[i];
+        if (used > RANGE_SIEVE_SLOTS) {
+            appendGrouped(factorize64(n), segment.factors);
+            continue;
+        }
+        
+        // The recorded primes divide n, so their product never overflows
+        const uint32_t* recorded = &slots[i * RANGE_SIEVE_SLOTS];
+        uint64_t product = 1;
+        for (uint8_t k = 0; k < used; k++) {
+            product *= recorded[k];
+        }
+        
+        if (product == n) {
+            // Squarefree and sqrt(high)-smooth: no division needed
+            for (uint8_t k = 0; k < used; k++) {
+                segment.factors.push_back({recorded[k], 1});
+            }
+            continue;
+        }
+        
+        // Exponents and the cofactor, which is 1 or a prime above sqrt(high)
+        uint64_t remaining = n;
+        for (uint8_t k = 0; k < used; k++) {
+            uint32_t p = recorded[k];
+            uint32_t exponent = 0;
+            do {
+                remaining /= p;
+                exponent++;
+            } while (remaining % p == 0);
+            segment.factors.push_back({p, exponent});
+        }
+        if (remaining > 1) {
+            segment.factors.push_back({remaining, 1});
+        }
+    }
+    segment.offsets[count] = static_cast<uint32_t>(segment.factors.size());
+}
+
+int RangeFactorizer::getThreadCount() const {
+    return m_pool->getThreadCount();
+}
+
+uint32_t RangeFactorizer::getSegmentSize() const {
+    return m_segment_size;
+}
+
+std::string formatFactorization(const PrimePower* begin, const PrimePower* end) {
+    if (begin == end) {
+        return "1";
+    }
+    
+    std::string text;
+    for (const PrimePower* factor = begin; factor != end; ++factor) {
+        if (!text.empty()) {
+            text += " * ";
+        }
+        text += std::to_string(factor->prime);
+        if (factor->exponent > 1) {
+            text += "^" + std::to_string(factor->exponent);
+        }
+    }
+    return text;
+}
+
+} // namespace mfp
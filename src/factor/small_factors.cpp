@@ -0,0 +1,224 @@
+#include "factor/small_factors.h"
+#include "factor/prime_table.h"
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <mutex>
+
+namespace mfp {
+
+namespace {
+
+// Primes below this are tested directly; a GCD covers the rest
+const uint32_t QUICK_BOUND = 1 << 10;
+
+// Odd primes up to a bound with what the tests need. Quick-stage primes come
+// first, grouped into word-sized products; the primorial covers the others.
+struct SmallFactorTable {
+    std::vector<uint32_t> primes;
+    std::vector<uint64_t> inverses;   // p^-1 mod 2^64
+    std::vector<uint64_t> limits;     // (2^64 - 1) / p
+    std::vector<uint64_t> blocks;     // Products of consecutive primes below 2^64
+    std::vector<size_t> block_ends;   // One past each block's last prime
+    size_t quick_count = 0;           // Primes below QUICK_BOUND
+    size_t quick_blocks = 0;          // Blocks made of them
+    mpz_t primorial;                  // Product of the primes from QUICK_BOUND up
+    
+    SmallFactorTable() { mpz_init(primorial); }
+    ~SmallFactorTable() { mpz_clear(primorial); }
+    SmallFactorTable(const SmallFactorTable&) = delete;
+    SmallFactorTable& operator=(const SmallFactorTable&) = delete;
+};
+
+std::mutex g_tables_mutex;
+std::map<uint32_t, std::shared_ptr<const SmallFactorTable>> g_tables;
+
+// Group primes [begin, end) into word-sized products
+void appendBlocks(SmallFactorTable& table, size_t begin, size_t end) {
+    uint64_t product = 1;
+    for (size_t i = begin; i < end; i++) {
+        uint64_t p = table.primes[i];
+        if (product > UINT64_MAX / p) {
+            table.blocks.push_back(product);
+            table.block_ends.push_back(i);
+            product = 1;
+        }
+        product *= p;
+    }
+    if (product != 1) {
+        table.blocks.push_back(product);
+        table.block_ends.push_back(end);
+    }
+}
+
+std::shared_ptr<const SmallFactorTable> getSmallFactorTable(uint32_t bound) {
+    std::lock_guard<std::mutex> lock(g_tables_mutex);
+    auto found = g_tables.find(bound);
+    if (found != g_tables.end()) {
+        return found->second;
+    }
+    
+    auto table = std::make_shared<SmallFactorTable>();
+    for (uint32_t p : *getPrimeTable(bound)) {
+        if (p > bound) {
+            break;
+        }
+        if (p == 2) {
+            continue;
+        }
+        // Newton's iteration doubles the correct low bits each step
+        uint64_t inverse = p;
+        for (int i = 0; i < 5; i++) {
+            inverse *= 2 - p * inverse;
+        }
+        table->primes.push_back(p);
+        table->inverses.push_back(inverse);
+        table->limits.push_back(UINT64_MAX / p);
+        if (p < QUICK_BOUND) {
+            table->quick_count++;
+        }
+    }
+    
+    appendBlocks(*table, 0, table->quick_count);
+    table->quick_blocks = table->blocks.size();
+    appendBlocks(*table, table->quick_count, table->primes.size());
+    
+    mpz_t below;
+    mpz_init(below);
+    mpz_primorial_ui(table->primorial, bound);
+    mpz_primorial_ui(below, QUICK_BOUND - 1);
+    mpz_divexact(table->primorial, table->primorial, below);
+    mpz_clear(below);
+    
+    g_tables[bound] = table;
+    return table;
+}
+
+// Exact-division test: p | value iff value * p^-1 mod 2^64 <= (2^64 - 1) / p
+inline bool divides(const SmallFactorTable& table, size_t i, uint64_t value) {
+    return value * table.inverses[i] <= table.limits[i];
+}
+
+// Divide p out of n as often as it goes, appending it each time
+void stripPrime(mpz_t n, uint64_t p, std::vector<uint64_t>& factors) {
+    do {
+        mpz_divexact_ui(n, n, p);
+        factors.push_back(p);
+    } while (mpz_divisible_ui_p(n, p));
+}
+
+} // namespace
+
+uint32_t smallFactorFilterBound(size_t bits) {
+    // The primorial of B has about 1.44 * B bits, and reducing it modulo n
+    // costs about as much as a modular exponentiation once that is bits^2
+    uint64_t target = static_cast<uint64_t>(bits) * bits / 16;
+    uint32_t bound = QUICK_BOUND;
+    while (bound < SMALL_FACTOR_BOUND && bound < target) {
+        bound <<= 1;
+    }
+    return bound;
+}
+
+bool hasSmallFactor(const mpz_t n, uint32_t bound) {
+    if (mpz_cmp_ui(n, 4) < 0) {
+        return false;
+    }
+    
+    // Small n: trial division up to sqrt(n)
+    if (mpz_cmp_ui(n, bound) <= 0) {
+        uint64_t value = mpz_get_ui(n);
+        for (uint32_t p : *getPrimeTable(bound)) {
+            if (static_cast<uint64_t>(p) * p > value) {
+                break;
+            }
+            if (value % p == 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+    
+    if (mpz_even_p(n)) {
+        return true;
+    }
+    
+    std::shared_ptr<const SmallFactorTable> table = getSmallFactorTable(bound);
+    for (size_t b = 0, i = 0; b < table->quick_blocks; b++) {
+        uint64_t residue = mpz_fdiv_ui(n, table->blocks[b]);
+        for (; i < table->block_ends[b]; i++) {
+            if (divides(*table, i, residue)) {
+                return true;
+            }
+        }
+    }
+    
+    if (table->quick_count == table->primes.size()) {
+        return false;
+    }
+    mpz_t common;
+    mpz_init(common);
+    mpz_gcd(common, n, table->primorial);
+    bool found = mpz_cmp_ui(common, 1) != 0;
+    mpz_clear(common);
+    return found;
+}
+
+void stripSmallFactors(mpz_t n, std::vector<uint64_t>& factors, uint32_t bound) {
+    if (mpz_sgn(n) == 0) {
+        return;
+    }
+    
+    unsigned long twos = mpz_scan1(n, 0);
+    if (twos > 0) {
+        factors.insert(factors.end(), twos, 2);
+        mpz_fdiv_q_2exp(n, n, twos);
+    }
+    
+    // Quick stage: one remainder per block of small primes. After dividing p
+    // out the block residue is stale, but still decides the block's other primes.
+    std::shared_ptr<const SmallFactorTable> table = getSmallFactorTable(std::max<uint32_t>(bound, 3));
+    for (size_t b = 0, i = 0; b < table->quick_blocks && mpz_cmp_ui(n, 1) > 0; b++) {
+        uint64_t residue = mpz_fdiv_ui(n, table->blocks[b]);
+        for (; i < table->block_ends[b]; i++) {
+            if (divides(*table, i, residue)) {
+                stripPrime(n, table->primes[i], factors);
+            }
+        }
+    }
+    
+    if (table->quick_count == table->primes.size() || mpz_cmp_ui(n, 1) == 0) {
+        return;
+    }
+    
+    // One GCD finds the product of the remaining small primes that divide n
+    mpz_t common;
+    mpz_init(common);
+    mpz_gcd(common, n, table->primorial);
+    
+    if (mpz_fits_ulong_p(common)) {
+        // A single word: test each prime against it directly
+        uint64_t value = mpz_get_ui(common);
+        for (size_t i = table->quick_count; i < table->primes.size() && value != 1; i++) {
+            if (divides(*table, i, value)) {
+                stripPrime(n, table->primes[i], factors);
+                value /= table->primes[i];
+            }
+        }
+    } else {
+        // Several words: one remainder of the GCD per block, then the same tests
+        for (size_t b = table->quick_blocks; b < table->blocks.size() && mpz_cmp_ui(common, 1) != 0; b++) {
+            uint64_t residue = mpz_fdiv_ui(common, table->blocks[b]);
+            for (size_t i = table->block_ends[b - 1]; i < table->block_ends[b]; i++) {
+                if (divides(*table, i, residue)) {
+                    stripPrime(n, table->primes[i], factors);
+                    mpz_divexact_ui(common, common, table->primes[i]);
+                }
+            }
+        }
+    }
+    
+    mpz_clear(common);
+}
+
+} // namespace mfp
@@ -0,0 +1,378 @@
+#include "factor/smooth_factor.h"
+#include "factor/prime_table.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace mfp {
+
+namespace {
+
+// Giant step for stage 2. With D = 2*3*5*7*11 only 240 odd d < D/2 are coprime to D.
+const uint64_t STAGE2_D = 2310;
+
+// Giant steps sieved and multiplied between gcd checks
+const uint64_t STAGE2_BLOCK = 256;
+
+// Prime powers folded into stage 1 between gcd checks
+const size_t STAGE1_GCD_INTERVAL = 512;
+
+// Outcome of a gcd with n
+enum class GcdResult {
+    NONE,   // gcd is 1
+    FOUND,  // proper factor
+    ALL     // gcd is n: every factor was caught at once
+};
+
+GcdResult checkGcd(const mpz_t value, const mpz_t n, mpz_t factor) {
+    mpz_gcd(factor, value, n);
+    if (mpz_cmp_ui(factor, 1) == 0) {
+        return GcdResult::NONE;
+    }
+    if (mpz_cmp(factor, n) == 0) {
+        return GcdResult::ALL;
+    }
+    return GcdResult::FOUND;
+}
+
+// V_m(x) mod n for the Lucas sequence V_0 = 2, V_1 = x, V_k+1 = x V_k - V_k-1.
+// result may alias x.
+void lucasV(mpz_t result, const mpz_t x, uint64_t m, const mpz_t n) {
+    if (m == 0) {
+        mpz_set_ui(result, 2);
+        return;
+    }
+    
+    // Ladder over (V_k, V_k+1) using V_2k = V_k^2 - 2 and V_2k+1 = V_k V_k+1 - x
+    mpz_t v0, v1;
+    mpz_init_set(v0, x);
+    mpz_init(v1);
+    mpz_mul(v1, x, x);
+    mpz_sub_ui(v1, v1, 2);
+    mpz_mod(v1, v1, n);
+    
+    for (int bit = 62 - __builtin_clzll(m); bit >= 0; bit--) {
+        if ((m >> bit) & 1) {
+            mpz_mul(v0, v0, v1);
+            mpz_sub(v0, v0, x);
+            mpz_mod(v0, v0, n);
+            mpz_mul(v1, v1, v1);
+            mpz_sub_ui(v1, v1, 2);
+            mpz_mod(v1, v1, n);
+        } else {
+            mpz_mul(v1, v0, v1);
+            mpz_sub(v1, v1, x);
+            mpz_mod(v1, v1, n);
+            mpz_mul(v0, v0, v0);
+            mpz_sub_ui(v0, v0, 2);
+            mpz_mod(v0, v0, n);
+        }
+    }
+    
+    mpz_set(result, v0);
+    mpz_clear(v0);
+    mpz_clear(v1);
+}
+
+bool isCancelled(const std::function<bool()>& checkpoint) {
+    return checkpoint && checkpoint();
+}
+
+// Stage 1: raise x to every prime power up to B1. apply(x, m) multiplies the
+// exponent by m and test(x) checks the gcd. Powers are folded into 64-bit
+// multipliers; if a check catches every factor at once, the interval is
+// replayed from its checkpoint one prime power at a time.
+template <typename Apply, typename Test>
+GcdResult runStageOne(mpz_t x, const std::vector<uint64_t>& powers, Apply apply, Test test,
+                      const std::function<bool()>& poll) {
+    mpz_t checkpoint;
+    mpz_init(checkpoint);
+    
+    GcdResult result = GcdResult::NONE;
+    for (size_t start = 0; start < powers.size() && result == GcdResult::NONE && !isCancelled(poll);
+         start += STAGE1_GCD_INTERVAL) {
+        size_t end = std::min(start + STAGE1_GCD_INTERVAL, powers.size());
+        mpz_set(checkpoint, x);
+        
+        uint64_t multiplier = 1;
+        for (size_t i = start; i < end; i++) {
+            if (multiplier > UINT64_MAX / powers[i]) {
+                apply(x, multiplier);
+                multiplier = 1;
+            }
+            multiplier *= powers[i];
+        }
+        apply(x, multiplier);
+        result = test(x);
+        
+        if (result == GcdResult::ALL) {
+            mpz_set(x, checkpoint);
+            result = GcdResult::NONE;
+            for (size_t i = start; i < end && result == GcdResult::NONE; i++) {
+                apply(x, powers[i]);
+                result = test(x);
+            }
+        }
+    }
+    
+    mpz_clear(checkpoint);
+    return result;
+}
+
+// Stage 2 over primes q in (B1, B2] on the symmetric form x = V_1. Writing
+// q = kD +- d with d < D/2, V_kD - V_d vanishes mod p when the order of the
+// stage 1 element divides kD - d or kD + d, so one product term covers a
+// pair of primes. Giant steps are split into contiguous slices, one per thread.
+bool runStageTwo(const mpz_t x, const mpz_t n, mpz_t factor, const SmoothFactorParams& params) {
+    if (params.b2 <= params.b1) {
+        return false;
+    }
+    
+    const uint64_t half = STAGE2_D / 2;
+    
+    // Baby steps V_d for odd d < D/2 coprime to D, via V_d+2 = V_d V_2 - V_d-2
+    std::vector<uint64_t> baby_d;
+    for (uint64_t d = 1; d < half; d += 2) {
+        if (d % 3 != 0 && d % 5 != 0 && d % 7 != 0 && d % 11 != 0) {
+            baby_d.push_back(d);
+        }
+    }
+    std::unique_ptr<mpz_t[]> baby(new mpz_t[baby_d.size()]);
+    {
+        mpz_t v2, prev, cur, next;
+        mpz_init(v2);
+        mpz_init_set(prev, x);   // V_-1 = V_1
+        mpz_init_set(cur, x);
+        mpz_init(next);
+        lucasV(v2, x, 2, n);
+        
+        size_t j = 0;
+        for (uint64_t d = 1; d < half; d += 2) {
+            if (j < baby_d.size() && baby_d[j] == d) {
+                mpz_init_set(baby[j], cur);
+                j++;
+            }
+            mpz_mul(next, cur, v2);
+            mpz_sub(next, next, prev);
+            mpz_mod(next, next, n);
+            mpz_swap(prev, cur);
+            mpz_swap(cur, next);
+        }
+        
+        mpz_clear(v2);
+        mpz_clear(prev);
+        mpz_clear(cur);
+        mpz_clear(next);
+    }
+    
+    uint64_t k_first = params.b1 / STAGE2_D;
+    uint64_t k_last = (params.b2 + half) / STAGE2_D;
+    uint64_t k_count = k_last - k_first + 1;
+    
+    uint64_t sieve_limit = static_cast<uint64_t>(std::sqrt(static_cast<double>(params.b2 + STAGE2_D))) + 1;
+    std::shared_ptr<const std::vector<uint32_t>> primes = getPrimeTable(static_cast<uint32_t>(sieve_limit));
+    
+    std::atomic<bool> factor_found(false);
+    std::mutex mtx;
+    
+    auto search_slice = [&](uint64_t k_lo, uint64_t k_hi) {
+        mpz_t w, vk, vprev, vnext, term, product, g;
+        mpz_init(w);
+        mpz_init(vk);
+        mpz_init(vprev);
+        mpz_init(vnext);
+        mpz_init(term);
+        mpz_init_set_ui(product, 1);
+        mpz_init(g);
+        
+        // Giant steps V_kD advance by V_k+1D = V_kD V_D - V_k-1D; V_-D = V_D
+        lucasV(w, x, STAGE2_D, n);
+        lucasV(vk, x, k_lo * STAGE2_D, n);
+        lucasV(vprev, x, (k_lo > 0 ? k_lo - 1 : 1) * STAGE2_D, n);
+        
+        std::vector<uint8_t> flags;
+        for (uint64_t block_lo = k_lo; block_lo < k_hi && !factor_found && !isCancelled(params.checkpoint);
+             block_lo += STAGE2_BLOCK) {
+            uint64_t block_hi = std::min(block_lo + STAGE2_BLOCK, k_hi);
+            uint64_t low = block_lo * STAGE2_D > half ? block_lo * STAGE2_D - half : 0;
+            uint64_t high = (block_hi - 1) * STAGE2_D + half;
+            segmentPrimeFlags(low, high, *primes, flags);
+            
+            for (uint64_t k = block_lo; k < block_hi; k++) {
+                uint64_t base = k * STAGE2_D;
+                for (size_t j = 0; j < baby_d.size(); j++) {
+                    uint64_t d = baby_d[j];
+                    uint64_t below = base - d;
+                    uint64_t above = base + d;
+                    bool hit = (base > d && below > params.b1 && below <= params.b2 && flags[below - low]) ||
+                               (above > params.b1 && above <= params.b2 && flags[above - low]);
+                    if (hit) {
+                        mpz_sub(term, vk, baby[j]);
+                        mpz_mul(product, product, term);
+                        mpz_mod(product, product, n);
+                    }
+                }
+                
+                mpz_mul(vnext, vk, w);
+                mpz_sub(vnext, vnext, vprev);
+                mpz_mod(vnext, vnext, n);
+                mpz_swap(vprev, vk);
+                mpz_swap(vk, vnext);
+            }
+            
+            GcdResult result = checkGcd(product, n, g);
+            if (result == GcdResult::FOUND) {
+                std::lock_guard<std::mutex> lock(mtx);
+                if (!factor_found) {
+                    factor_found = true;
+                    mpz_set(factor, g);
+                }
+            }
+            if (result != GcdResult::NONE) {
+                break;
+            }
+        }
+        
+        mpz_clear(w);
+        mpz_clear(vk);
+        mpz_clear(vprev);
+        mpz_clear(vnext);
+        mpz_clear(term);
+        mpz_clear(product);
+        mpz_clear(g);
+    };
+    
+    uint64_t num_threads = static_cast<uint64_t>(std::max(1, params.num_threads));
+    num_threads = std::min(num_threads, (k_count + STAGE2_BLOCK - 1) / STAGE2_BLOCK);
+    if (num_threads <= 1) {
+        search_slice(k_first, k_last + 1);
+    } else {
+        uint64_t slice = (k_count + num_threads - 1) / num_threads;
+        size_t slices = static_cast<size_t>((k_count + slice - 1) / slice);
+        runWorkers(params.pool, slices, [&](size_t i) {
+            uint64_t k_lo = k_first + i * slice;
+            search_slice(k_lo, std::min(k_lo + slice, k_last + 1));
+        });
+    }
+    
+    for (size_t j = 0; j < baby_d.size(); j++) {
+        mpz_clear(baby[j]);
+    }
+    
+    return factor_found;
+}
+
+// Clamp bounds to what the prime table supports
+SmoothFactorParams normalizeParams(const SmoothFactorParams& params) {
+    SmoothFactorParams normalized = params;
+    normalized.b1 = std::min<uint64_t>(std::max<uint64_t>(params.b1, 2), UINT32_MAX - 1);
+    normalized.b2 = std::min<uint64_t>(params.b2, UINT64_MAX / 4);
+    return normalized;
+}
+
+} // namespace
+
+bool pollardPMinus1(const mpz_t n, mpz_t factor, const SmoothFactorParams& params) {
+    if (mpz_cmp_ui(n, 4) < 0) {
+        return false;
+    }
+    if (mpz_even_p(n)) {
+        mpz_set_ui(factor, 2);
+        return true;
+    }
+    
+    SmoothFactorParams bounds = normalizeParams(params);
+    std::shared_ptr<const std::vector<uint64_t>> powers = getPrimePowers(bounds.b1);
+    
+    mpz_t a, t;
+    mpz_init_set_ui(a, 3);
+    mpz_init(t);
+    
+    // Stage 1: a = 3^E with E the product of prime powers up to B1
+    auto apply = [&](mpz_t value, uint64_t m) {
+        mpz_powm_ui(value, value, m, n);
+    };
+    auto test = [&](const mpz_t value) {
+        mpz_sub_ui(t, value, 1);
+        return checkGcd(t, n, factor);
+    };
+    GcdResult result = runStageOne(a, *powers, apply, test, bounds.checkpoint);
+    
+    bool found = result == GcdResult::FOUND;
+    if (result == GcdResult::NONE && !isCancelled(bounds.checkpoint)) {
+        // Stage 2 on V_1 = a + a^-1, so terms pair up like the p+1 ones
+        if (mpz_invert(t, a, n) == 0) {
+            found = checkGcd(a, n, factor) == GcdResult::FOUND;
+        } else {
+            mpz_add(t, t, a);
+            mpz_mod(t, t, n);
+            found = runStageTwo(t, n, factor, bounds);
+        }
+    }
+    
+    mpz_clear(a);
+    mpz_clear(t);
+    
+    return found;
+}
+
+bool williamsPPlus1(const mpz_t n, mpz_t factor, const SmoothFactorParams& params) {
+    if (mpz_cmp_ui(n, 4) < 0) {
+        return false;
+    }
+    if (mpz_even_p(n)) {
+        mpz_set_ui(factor, 2);
+        return true;
+    }
+    
+    SmoothFactorParams bounds = normalizeParams(params);
+    std::shared_ptr<const std::vector<uint64_t>> powers = getPrimePowers(bounds.b1);
+    
+    mpz_t v, t;
+    mpz_init(v);
+    mpz_init(t);
+    
+    auto apply = [&](mpz_t value, uint64_t m) {
+        lucasV(value, value, m, n);
+    };
+    auto test = [&](const mpz_t value) {
+        mpz_sub_ui(t, value, 2);
+        return checkGcd(t, n, factor);
+    };
+    
+    bool found = false;
+    for (int seed = 0; seed < bounds.pplus1_seeds && !found && !isCancelled(bounds.checkpoint); seed++) {
+        // Montgomery's seeds 2/7 and 6/5 first, then small integers
+        static const unsigned long SEEDS[2][2] = {{2, 7}, {6, 5}};
+        unsigned long numerator = seed < 2 ? SEEDS[seed][0] : static_cast<unsigned long>(seed + 1);
+        unsigned long denominator = seed < 2 ? SEEDS[seed][1] : 1;
+        
+        mpz_set_ui(t, denominator);
+        if (mpz_invert(v, t, n) == 0) {
+            found = checkGcd(t, n, factor) == GcdResult::FOUND;
+            continue;
+        }
+        mpz_mul_ui(v, v, numerator);
+        mpz_mod(v, v, n);
+        
+        // Stage 1: v = V_E(A)
+        GcdResult result = runStageOne(v, *powers, apply, test, bounds.checkpoint);
+        if (result == GcdResult::FOUND) {
+            found = true;
+        } else if (result == GcdResult::NONE && !isCancelled(bounds.checkpoint)) {
+            found = runStageTwo(v, n, factor, bounds);
+        }
+    }
+    
+    mpz_clear(v);
+    mpz_clear(t);
+    
+    return found;
+}
+
+} // namespace mfp
@@ -0,0 +1,628 @@
+#include "factor/word_factor.h"
+#include <algorithm>
+#include <cmath>
+
+namespace mfp {
+
+namespace {
+
+// Primes tried by division before any engine runs
+const uint32_t SMALL_PRIMES[] = {
+    3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41, 43, 47, 53, 59, 61, 67, 71, 73, 79, 83, 89, 97,
+    101, 103, 107, 109, 113, 127, 131, 137, 139, 149, 151, 157, 163, 167, 173, 179, 181, 191,
+    193, 197, 199, 211, 223, 227, 229, 233, 239, 241, 251
+};
+
+// Domains of the square-form engines
+const int HART_MAX_BITS = 42;
+const int SQUFOF_MAX_BITS = 62;
+
+// findFactor64 prefers Hart up to here; Montgomery rho is faster above
+const int HART_PREFERRED_BITS = 34;
+
+// Brent rho: steps between gcds and the number of polynomial constants tried
+const uint32_t RHO_BATCH = 128;
+const uint64_t RHO_MAX_CONSTANT = 64;
+
+int bitLength(uint128_t n) {
+    uint64_t hi = static_cast<uint64_t>(n >> 64);
+    if (hi != 0) {
+        return 128 - __builtin_clzll(hi);
+    }
+    uint64_t lo = static_cast<uint64_t>(n);
+    return lo == 0 ? 0 : 64 - __builtin_clzll(lo);
+}
+
+int trailingZeros(uint128_t n) {
+    uint64_t lo = static_cast<uint64_t>(n);
+    return lo != 0 ? __builtin_ctzll(lo) : 64 + __builtin_ctzll(static_cast<uint64_t>(n >> 64));
+}
+
+// Binary gcd; word-size only, std::gcd does not take __int128 in strict mode
+template <typename Word>
+Word binaryGcd(Word a, Word b) {
+    if (a == 0) {
+        return b;
+    }
+    if (b == 0) {
+        return a;
+    }
+    int shift = trailingZeros(a | b);
+    a >>= trailingZeros(a);
+    while (b != 0) {
+        b >>= trailingZeros(b);
+        if (a > b) {
+            std::swap(a, b);
+        }
+        b -= a;
+    }
+    return a << shift;
+}
+
+uint64_t isqrt64(uint64_t n) {
+    uint64_t root = static_cast<uint64_t>(std::sqrt(static_cast<double>(n)));
+    while (root > 0 && static_cast<uint128_t>(root) * root > n) {
+        root--;
+    }
+    while (static_cast<uint128_t>(root + 1) * (root + 1) <= n) {
+        root++;
+    }
+    return root;
+}
+
+// Floor square root for n < 2^126
+uint64_t isqrt128(uint128_t n) {
+    uint64_t root = static_cast<uint64_t>(std::sqrt(static_cast<long double>(n)));
+    while (root > 0 && static_cast<uint128_t>(root) * root > n) {
+        root--;
+    }
+    while (static_cast<uint128_t>(root + 1) * (root + 1) <= n) {
+        root++;
+    }
+    return root;
+}
+
+uint64_t icbrt64(uint64_t n) {
+    uint64_t root = static_cast<uint64_t>(std::cbrt(static_cast<double>(n)));
+    while (root > 0 && static_cast<uint128_t>(root) * root * root > n) {
+        root--;
+    }
+    while (static_cast<uint128_t>(root + 1) * (root + 1) * (root + 1) <= n) {
+        root++;
+    }
+    return root;
+}
+
+bool isSquare(uint64_t n, uint64_t& root) {
+    // Squares occupy 12 of the 64 residues mod 64
+    if (((0x0202021202030213ULL >> (n & 63)) & 1) == 0) {
+        return false;
+    }
+    root = isqrt64(n);
+    return root * root == n;
+}
+
+// Montgomery arithmetic mod an odd 64-bit n, residues kept in [0, n)
+struct Montgomery64 {
+    uint64_t n;
+    uint64_t inv;   // n^-1 mod 2^64
+    uint64_t one;   // 2^64 mod n
+    uint64_t r2;    // 2^128 mod n
+    
+    explicit Montgomery64(uint64_t modulus) : n(modulus) {
+        // Newton doubles the correct low bits each step: 3, 6, 12, 24, 48, 96
+        inv = n;
+        for (int i = 0; i < 5; i++) {
+            inv *= 2 - n * inv;
+        }
+        one = static_cast<uint64_t>((static_cast<uint128_t>(1) << 64) % n);
+        r2 = static_cast<uint64_t>((static_cast<uint128_t>(one) << 64) % n);
+    }
+    
+    uint64_t reduce(uint128_t t) const {
+        uint64_t m = static_cast<uint64_t>(t) * inv;
+        uint64_t mn_hi = static_cast<uint64_t>((static_cast<uint128_t>(m) * n) >> 64);
+        uint64_t t_hi = static_cast<uint64_t>(t >> 64);
+        uint64_t r = t_hi - mn_hi;
+        return t_hi < mn_hi ? r + n : r;
+    }
+    
+    uint64_t mul(uint64_t a, uint64_t b) const {
+        return reduce(static_cast<uint128_t>(a) * b);
+    }
+    
+    uint64_t add(uint64_t a, uint64_t b) const {
+        uint64_t s = a + b;
+        return (s < a || s >= n) ? s - n : s;
+    }
+    
+    uint64_t toMont(uint64_t a) const {
+        return mul(a % n, r2);
+    }
+};
+
+// 128 x 128 -> 256-bit product
+struct U256 {
+    uint128_t hi;
+    uint128_t lo;
+};
+
+U256 mulWide(uint128_t a, uint128_t b) {
+    uint64_t a0 = static_cast<uint64_t>(a), a1 = static_cast<uint64_t>(a >> 64);
+    uint64_t b0 = static_cast<uint64_t>(b), b1 = static_cast<uint64_t>(b >> 64);
+    uint128_t p00 = static_cast<uint128_t>(a0) * b0;
+    uint128_t p01 = static_cast<uint128_t>(a0) * b1;
+    uint128_t p10 = static_cast<uint128_t>(a1) * b0;
+    uint128_t p11 = static_cast<uint128_t>(a1) * b1;
+    
+    uint128_t mid = (p00 >> 64) + static_cast<uint64_t>(p01) + static_cast<uint64_t>(p10);
+    U256 result;
+    result.lo = (mid << 64) | static_cast<uint64_t>(p00);
+    result.hi = p11 + (p01 >> 64) + (p10 >> 64) + (mid >> 64);
+    return result;
+}
+
+// Montgomery arithmetic mod an odd 128-bit n
+struct Montgomery128 {
+    uint128_t n;
+    uint128_t inv;   // n^-1 mod 2^128
+    uint128_t one;   // 2^128 mod n
+    uint128_t r2;    // 2^256 mod n
+    
+    explicit Montgomery128(uint128_t modulus) : n(modulus) {
+        inv = n;
+        for (int i = 0; i < 6; i++) {
+            inv *= 2 - n * inv;
+        }
+        one = (0 - n) % n;
+        r2 = one;
+        for (int i = 0; i < 128; i++) {
+            r2 = add(r2, r2);
+        }
+    }
+    
+    uint128_t reduce(const U256& t) const {
+        uint128_t m = t.lo * inv;
+        uint128_t mn_hi = mulWide(m, n).hi;
+        uint128_t r = t.hi - mn_hi;
+        return t.hi < mn_hi ? r + n : r;
+    }
+    
+    uint128_t mul(uint128_t a, uint128_t b) const {
+        return reduce(mulWide(a, b));
+    }
+    
+    uint128_t add(uint128_t a, uint128_t b) const {
+        uint128_t s = a + b;
+        return (s < a || s >= n) ? s - n : s;
+    }
+    
+    uint128_t toMont(uint128_t a) const {
+        return mul(a % n, r2);
+    }
+};
+
+// Strong probable-prime test of odd n > 2 to base a (any size, reduced here)
+template <typename Word, typename Mont>
+bool strongProbablePrime(const Mont& mont, Word a) {
+    Word n = mont.n;
+    a %= n;
+    if (a == 0) {
+        return true;
+    }
+    
+    Word d = n - 1;
+    int s = trailingZeros(d);
+    d >>= s;
+    
+    Word minus_one = n - mont.one;
+    Word base = mont.toMont(a);
+    Word x = mont.one;
+    while (d != 0) {
+        if (d & 1) {
+            x = mont.mul(x, base);
+        }
+        base = mont.mul(base, base);
+        d >>= 1;
+    }
+    
+    if (x == mont.one || x == minus_one) {
+        return true;
+    }
+    for (int r = 1; r < s; r++) {
+        x = mont.mul(x, x);
+        if (x == minus_one) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Division by 2 and the small prime table; returns a factor or 0
+template <typename Word>
+Word smallFactor(Word n) {
+    if ((n & 1) == 0) {
+        return 2;
+    }
+    for (uint32_t p : SMALL_PRIMES) {
+        if (n % p == 0) {
+            return n == p ? 0 : p;
+        }
+    }
+    return 0;
+}
+
+// Brent's rho on x^2 + c in Montgomery form, multiplying RHO_BATCH differences
+// per gcd and backtracking when a batch overshoots
+template <typename Word, typename Mont>
+Word brentRho(Word n) {
+    Mont mont(n);
+    for (uint64_t c = 1; c <= RHO_MAX_CONSTANT; c++) {
+        Word c_mont = mont.toMont(c);
+        auto f = [&](Word x) { return mont.add(mont.mul(x, x), c_mont); };
+        
+        Word y = mont.toMont(2);
+        Word x = y, ys = y;
+        Word q = mont.one;
+        Word g = 1;
+        for (uint64_t r = 1; g == 1; r <<= 1) {
+            x = y;
+            for (uint64_t i = 0; i < r; i++) {
+                y = f(y);
+            }
+            for (uint64_t k = 0; k < r && g == 1; k += RHO_BATCH) {
+                ys = y;
+                uint64_t steps = std::min<uint64_t>(RHO_BATCH, r - k);
+                for (uint64_t i = 0; i < steps; i++) {
+                    y = f(y);
+                    q = mont.mul(q, x > y ? x - y : y - x);
+                }
+                g = binaryGcd<Word>(q, n);
+            }
+        }
+        
+        if (g == n) {
+            // Redo the last batch one step at a time
+            do {
+                ys = f(ys);
+                g = binaryGcd<Word>(x > ys ? x - ys : ys - x, n);
+            } while (g == 1);
+        }
+        if (g != n) {
+            return g;
+        }
+    }
+    return 0;
+}
+
+} // namespace
+
+bool isPrime64(uint64_t n) {
+    if (n < 2) {
+        return false;
+    }
+    if (n < 4) {
+        return true;
+    }
+    if (smallFactor<uint64_t>(n) != 0) {
+        return false;
+    }
+    if (n < 257 * 257) {
+        return true;
+    }
+    
+    Montgomery64 mont(n);
+    static const uint64_t BASES[] = {2, 325, 9375, 28178, 450775, 9780504, 1795265022};
+    for (uint64_t base : BASES) {
+        if (!strongProbablePrime<uint64_t>(mont, base)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool isPrime128(uint128_t n) {
+    if ((n >> 64) == 0) {
+        return isPrime64(static_cast<uint64_t>(n));
+    }
+    if (smallFactor<uint128_t>(n) != 0) {
+        return false;
+    }
+    
+    Montgomery128 mont(n);
+    static const uint64_t BASES[] = {2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41};
+    for (uint64_t base : BASES) {
+        if (!strongProbablePrime<uint128_t>(mont, base)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+uint64_t lehmanFactor(uint64_t n) {
+    if (n < 4 || bitLength(n) > HART_MAX_BITS) {
+        return 0;
+    }
+    
+    // Trial division up to n^1/3
+    uint64_t cbrt = icbrt64(n);
+    if ((n & 1) == 0) {
+        return 2;
+    }
+    for (uint64_t p = 3; p <= cbrt; p += 2) {
+        if (n % p == 0) {
+            return p;
+        }
+    }
+    
+    // a^2 - 4kn = b^2 for some k <= n^1/3 with a within n^1/6 / (4 sqrt(k)) of sqrt(4kn)
+    double sixth = std::pow(static_cast<double>(n), 1.0 / 6.0);
+    for (uint64_t k = 1; k <= cbrt; k++) {
+        uint128_t four_kn = static_cast<uint128_t>(4 * k) * n;
+        uint64_t a = isqrt128(four_kn);
+        if (static_cast<uint128_t>(a) * a < four_kn) {
+            a++;
+        }
+        uint64_t a_max = static_cast<uint64_t>(std::sqrt(static_cast<double>(four_kn)) +
+                                               sixth / (4.0 * std::sqrt(static_cast<double>(k))));
+        for (; a <= a_max; a++) {
+            uint64_t b2 = static_cast<uint64_t>(static_cast<uint128_t>(a) * a - four_kn);
+            uint64_t b;
+            if (isSquare(b2, b)) {
+                uint64_t g = binaryGcd<uint64_t>(a + b, n);
+                if (g > 1 && g < n) {
+                    return g;
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+uint64_t hartFactor(uint64_t n, uint32_t max_iterations) {
+    if (n < 4 || bitLength(n) > HART_MAX_BITS) {
+        return 0;
+    }
+    
+    // s = ceil(sqrt(480 n i)); s^2 mod n a square t^2 gives gcd(s - t, n)
+    const uint64_t MULTIPLIER = 480;
+    uint128_t n_mult = static_cast<uint128_t>(n) * MULTIPLIER;
+    uint128_t product = 0;
+    for (uint32_t i = 1; i <= max_iterations; i++) {
+        product += n_mult;
+        uint64_t s = isqrt128(product);
+        if (static_cast<uint128_t>(s) * s < product) {
+            s++;
+        }
+        uint64_t m = static_cast<uint64_t>((static_cast<uint128_t>(s) * s) % n);
+        uint64_t t;
+        if (isSquare(m, t)) {
+            uint64_t g = binaryGcd<uint64_t>(s > t ? s - t : t - s, n);
+            if (g > 1 && g < n) {
+                return g;
+            }
+        }
+    }
+    return 0;
+}
+
+uint64_t squfofFactor(uint64_t n) {
+    if (n < 4 || (n & 1) == 0 || bitLength(n) > SQUFOF_MAX_BITS) {
+        return 0;
+    }
+    
+    uint64_t root;
+    if (isSquare(n, root)) {
+        return root;
+    }
+    
+    // Racing multipliers of Gower and Wagstaff
+    static const uint32_t MULTIPLIERS[] = {
+        1, 3, 5, 7, 11, 3 * 5, 3 * 7, 3 * 11, 5 * 7, 5 * 11, 7 * 11,
+        3 * 5 * 7, 3 * 5 * 11, 3 * 7 * 11, 5 * 7 * 11, 3 * 5 * 7 * 11
+    };
+    
+    uint64_t s = isqrt64(n);
+    uint64_t bound = 3 * 2 * isqrt64(2 * s);
+    
+    for (uint32_t k : MULTIPLIERS) {
+        if (n > UINT64_MAX / k) {
+            break;
+        }
+        uint64_t d = k * n;
+        uint64_t p0 = isqrt64(d);
+        uint64_t p = p0, p_prev = p0;
+        uint64_t q_prev = 1;
+        uint64_t q = d - p0 * p0;
+        if (q == 0) {
+            continue;
+        }
+        
+        // Forward cycle until Q is a square at an even step
+        uint64_t r = 0;
+        uint64_t i;
+        for (i = 2; i < bound; i++) {
+            uint64_t b = (p0 + p) / q;
+            p = b * q - p;
+            uint64_t q_old = q;
+            q = q_prev + b * (p_prev - p);
+            if ((i & 1) == 0 && isSquare(q, r)) {
+                break;
+            }
+            q_prev = q_old;
+            p_prev = p;
+        }
+        if (i >= bound || r == 0) {
+            continue;
+        }
+        
+        // Reverse cycle from the square root until P repeats
+        uint64_t b = (p0 - p) / r;
+        p = b * r + p;
+        p_prev = p;
+        q_prev = r;
+        q = (d - p_prev * p_prev) / q_prev;
+        if (q == 0) {
+            continue;
+        }
+        for (i = 0; i < bound; i++) {
+            b = (p0 + p) / q;
+            p_prev = p;
+            p = b * q - p;
+            uint64_t q_old = q;
+            q = q_prev + b * (p_prev - p);
+            q_prev = q_old;
+            if (p == p_prev) {
+                break;
+            }
+        }
+        
+        uint64_t g = binaryGcd<uint64_t>(n, q_prev);
+        if (g > 1 && g < n) {
+            return g;
+        }
+    }
+    return 0;
+}
+
+uint64_t rhoFactor64(uint64_t n) {
+    if (n < 4) {
+        return 0;
+    }
+    if ((n & 1) == 0) {
+        return 2;
+    }
+    return brentRho<uint64_t, Montgomery64>(n);
+}
+
+uint128_t rhoFactor128(uint128_t n) {
+    if ((n >> 64) == 0) {
+        return rhoFactor64(static_cast<uint64_t>(n));
+    }
+    if ((n & 1) == 0) {
+        return 2;
+    }
+    return brentRho<uint128_t, Montgomery128>(n);
+}
+
+uint64_t findFactor64(uint64_t n) {
+    if (n < 4) {
+        return 0;
+    }
+    uint64_t factor = smallFactor<uint64_t>(n);
+    if (factor != 0 || n < 257 * 257) {
+        return factor;
+    }
+    if (isPrime64(n)) {
+        return 0;
+    }
+    
+    uint64_t root;
+    if (isSquare(n, root)) {
+        return root;
+    }
+    
+    // Hart, backed by the deterministic Lehman, for small inputs. Above that rho
+    // beats SQUFOF at every size, so SQUFOF only covers the rare rho failure.
+    if (bitLength(n) <= HART_PREFERRED_BITS) {
+        factor = hartFactor(n, 1 << 16);
+        return factor != 0 ? factor : lehmanFactor(n);
+    }
+    factor = rhoFactor64(n);
+    return factor != 0 ? factor : squfofFactor(n);
+}
+
+uint128_t findFactor128(uint128_t n) {
+    if ((n >> 64) == 0) {
+        return findFactor64(static_cast<uint64_t>(n));
+    }
+    uint128_t factor = smallFactor<uint128_t>(n);
+    if (factor != 0) {
+        return factor;
+    }
+    if (isPrime128(n)) {
+        return 0;
+    }
+    return rhoFactor128(n);
+}
+
+std::vector<uint64_t> factorize64(uint64_t n) {
+    std::vector<uint64_t> factors;
+    std::vector<uint64_t> pending;
+    if (n > 1) {
+        pending.push_back(n);
+    }
+    
+    while (!pending.empty()) {
+        uint64_t m = pending.back();
+        pending.pop_back();
+        uint64_t factor = findFactor64(m);
+        if (factor == 0) {
+            factors.push_back(m);
+        } else {
+            pending.push_back(factor);
+            pending.push_back(m / factor);
+        }
+    }
+    
+    std::sort(factors.begin(), factors.end());
+    return factors;
+}
+
+std::vector<uint128_t> factorize128(uint128_t n) {
+    std::vector<uint128_t> factors;
+    std::vector<uint128_t> pending;
+    if (n > 1) {
+        pending.push_back(n);
+    }
+    
+    while (!pending.empty()) {
+        uint128_t m = pending.back();
+        pending.pop_back();
+        uint128_t factor = findFactor128(m);
+        if (factor == 0) {
+            factors.push_back(m);
+        } else {
+            pending.push_back(factor);
+            pending.push_back(m / factor);
+        }
+    }
+    
+    std::sort(factors.begin(), factors.end());
+    return factors;
+}
+
+bool parseUint128(const std::string& text, uint128_t& value) {
+    if (text.empty()) {
+        return false;
+    }
+    
+    const uint128_t max_value = ~static_cast<uint128_t>(0);
+    value = 0;
+    for (char c : text) {
+        if (c < '0' || c > '9') {
+            return false;
+        }
+        unsigned digit = static_cast<unsigned>(c - '0');
+        if (value > (max_value - digit) / 10) {
+            return false;
+        }
+        value = value * 10 + digit;
+    }
+    return true;
+}
+
+std::string uint128ToString(uint128_t value) {
+    if (value == 0) {
+        return "0";
+    }
+    std::string text;
+    while (value != 0) {
+        text.push_back(static_cast<char>('0' + static_cast<unsigned>(value % 10)));
+        value /= 10;
+    }
+    std::reverse(text.begin(), text.end());
+    return text;
+}
+
+} // namespace mfp
@@ -0,0 +1,329 @@
+#include "factor_graph.h"
+#include "perf_counters.h"
+#include "trace.h"
+#include "memory_accounting.h"
+#include "factor/perfect_power.h"
+#include "factor/small_factors.h"
+#include <gmp.h>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace mfp {
+
+namespace {
+
+using FactorParts = std::vector<std::pair<std::string, unsigned long>>;
+
+// One distinct number in the graph. Parts are strictly smaller than the
+// number, so walking the nodes from the largest down visits every parent
+// before its parts.
+struct FactorNode {
+    FactorParts parts;              // Empty for primes and unsplit composites
+    unsigned long multiplicity = 0; // Filled in once the graph is complete
+};
+
+// Shared between the caller and the pool helpers; helpers that start after
+// the graph is complete exit without touching the method or the control
+struct GraphState {
+    MFPBase* method = nullptr;
+    CallControl control; // The caller's, installed on every helper
+    std::map<std::string, FactorNode, DecimalLess> nodes;
+    std::deque<std::string> ready;
+    size_t pending = 0; // Numbers queued or being split
+    int helpers = 0;    // Pool tasks currently draining the queue
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::exception_ptr error;
+    
+    // Streaming only: primes are divided out of the cofactor as they are
+    // delivered, one at a time under deliver_mutex
+    const FactorCallback* callback = nullptr;
+    std::mutex deliver_mutex;
+    mpz_t cofactor;
+    std::atomic<bool> stopped{false}; // Nothing more to deliver; no new splits start
+    
+    GraphState() { mpz_init(cofactor); }
+    ~GraphState() { mpz_clear(cofactor); }
+};
+
+std::string toDecimal(const mpz_t value) {
+    char* str = mpz_get_str(nullptr, 10, value);
+    std::string result(str);
+    freeGMPString(str);
+    return result;
+}
+
+// Parts with their counts, in ascending order
+FactorParts groupParts(const std::vector<std::string>& parts) {
+    std::map<std::string, unsigned long, DecimalLess> counts;
+    for (const std::string& part : parts) {
+        counts[part]++;
+    }
+    return FactorParts(counts.begin(), counts.end());
+}
+
+// A split is usable when every part is a proper divisor and they multiply to n
+bool isProperSplit(const mpz_t n, const std::vector<std::string>& parts) {
+    if (parts.size() < 2) {
+        return false;
+    }
+    
+    mpz_t product, part;
+    mpz_init_set_ui(product, 1);
+    mpz_init(part);
+    bool proper = true;
+    for (const std::string& text : parts) {
+        if (mpz_set_str(part, text.c_str(), 10) != 0 || mpz_cmp_ui(part, 1) <= 0 || mpz_cmp(part, n) >= 0) {
+            proper = false;
+            break;
+        }
+        mpz_mul(product, product, part);
+    }
+    proper = proper && mpz_cmp(product, n) == 0;
+    mpz_clear(product);
+    mpz_clear(part);
+    return proper;
+}
+
+// One step of the graph: the parts of number, or none when it is prime or
+// cannot be split
+FactorParts splitNumber(MFPBase& method, const std::string& number, bool& prime) {
+    prime = method.isPrime(number);
+    if (prime) {
+        return FactorParts();
+    }
+    
+    mpz_t n, root;
+    mpz_init(n);
+    mpz_init(root);
+    {
+        TraceScope trace(TraceEvent::STRING_CONVERSION, number.size());
+        mpz_set_str(n, number.c_str(), 10);
+    }
+    
+    FactorParts parts;
+    if (mpz_cmp_ui(n, 4) < 0) {
+        mpz_clear(n);
+        mpz_clear(root);
+        return parts;
+    }
+    
+    // Small primes first; below 2^128 the word-size engines are cheaper
+    if (mpz_sizeinbase(n, 2) > 128) {
+        std::vector<uint64_t> small_factors;
+        {
+            PerfCounterRegistry::Scope perf_scope(PerfStage::SMALL_FACTORS);
+            stripSmallFactors(n, small_factors);
+        }
+        if (!small_factors.empty()) {
+            std::vector<std::string> found;
+            for (uint64_t p : small_factors) {
+                found.push_back(std::to_string(p));
+            }
+            if (mpz_cmp_ui(n, 1) > 0) {
+                found.push_back(toDecimal(n));
+            }
+            parts = groupParts(found);
+        }
+    }
+    
+    // Perfect powers m^k become one part m with count k
+    unsigned long exponent = 0;
+    bool power = false;
+    if (parts.empty()) {
+        PerfCounterRegistry::Scope perf_scope(PerfStage::FACTOR_SEARCH);
+        power = perfectPower(n, root, exponent);
+    }
+    if (power) {
+        parts.emplace_back(toDecimal(root), exponent);
+    }
+    
+    if (parts.empty()) {
+        std::vector<std::string> split;
+        if (method.splitComposite(number, split) && isProperSplit(n, split)) {
+            parts = groupParts(split);
+        }
+    }
+    
+    mpz_clear(n);
+    mpz_clear(root);
+    return parts;
+}
+
+// Divide every power of a proven prime out of the cofactor and hand it to
+// the callback. A prime reached again through another split no longer
+// divides the cofactor and is skipped.
+void deliverPrime(GraphState& state, const std::string& prime) {
+    std::lock_guard<std::mutex> lock(state.deliver_mutex);
+    if (state.stopped) {
+        return;
+    }
+    
+    mpz_t p;
+    mpz_init_set_str(p, prime.c_str(), 10);
+    unsigned long exponent = mpz_remove(state.cofactor, state.cofactor, p);
+    mpz_clear(p);
+    if (exponent == 0) {
+        return;
+    }
+    
+    StreamedFactor factor{prime, exponent, toDecimal(state.cofactor)};
+    if (!(*state.callback)(factor) || mpz_cmp_ui(state.cofactor, 1) == 0) {
+        state.stopped = true;
+    }
+}
+
+void drainGraph(const std::shared_ptr<GraphState>& state, ThreadPool& pool, bool caller);
+
+// Start pool helpers for queued numbers, at most one per worker. Called with
+// the state locked.
+void wakeHelpers(const std::shared_ptr<GraphState>& state, ThreadPool& pool) {
+    while (state->helpers < pool.getThreadCount() && static_cast<size_t>(state->helpers) < state->ready.size()) {
+        state->helpers++;
+        pool.submit([state, &pool] {
+            CallControlScope control_scope(state->control);
+            drainGraph(state, pool, false);
+        });
+    }
+}
+
+// Split queued numbers until the queue is empty. Helpers return then; the
+// caller waits for running splits that may queue more, until none are left.
+void drainGraph(const std::shared_ptr<GraphState>& state, ThreadPool& pool, bool caller) {
+    std::unique_lock<std::mutex> lock(state->mutex);
+    while (true) {
+        if (state->ready.empty()) {
+            if (!caller) {
+                state->helpers--;
+                return;
+            }
+            if (state->pending == 0) {
+                return;
+            }
+            state->cv.wait(lock);
+            continue;
+        }
+        
+        std::string number = std::move(state->ready.front());
+        state->ready.pop_front();
+        lock.unlock();
+        
+        FactorParts parts;
+        bool prime = false;
+        std::exception_ptr error;
+        try {
+            parts = splitNumber(*state->method, number, prime);
+            if (prime && state->callback) {
+                deliverPrime(*state, number);
+            }
+        } catch (...) {
+            error = std::current_exception();
+        }
+        
+        lock.lock();
+        if (error && !state->error) {
+            state->error = error;
+        }
+        if (state->stopped) {
+            // Streaming is over: drop the queue and let running splits finish
+            state->pending -= state->ready.size();
+            state->ready.clear();
+        } else if (!state->error) {
+            // Parts seen before are already queued or split; only new ones are queued
+            for (const auto& part : parts) {
+                if (state->nodes.emplace(part.first, FactorNode()).second) {
+                    state->ready.push_back(part.first);
+                    state->pending++;
+                }
+            }
+            state->nodes[number].parts = std::move(parts);
+        }
+        state->pending--;
+        wakeHelpers(state, pool);
+        state->cv.notify_all();
+    }
+}
+
+// Split number and everything it breaks into, with the caller working too
+void runGraph(const std::shared_ptr<GraphState>& state, MFPBase& method, ThreadPool& pool,
+              const std::string& number) {
+    state->method = &method;
+    state->control = currentCallControl();
+    state->nodes.emplace(number, FactorNode());
+    state->ready.push_back(number);
+    state->pending = 1;
+    
+    drainGraph(state, pool, true);
+    
+    std::lock_guard<std::mutex> lock(state->mutex);
+    if (state->error) {
+        std::rethrow_exception(state->error);
+    }
+}
+
+} // namespace
+
+FactorGraph::FactorGraph(MFPBase& method, ThreadPool& pool)
+    : m_method(method), m_pool(pool) {
+}
+
+PrimeFactorMap FactorGraph::factorize(const std::string& signed_number) {
+    bool negative = false;
+    std::string number = factorableMagnitude(signed_number, negative);
+    PrimeFactorMap result;
+    if (negative) {
+        result["-1"] = 1;
+    }
+    if (number == "1") {
+        return result;
+    }
+    
+    auto state = std::make_shared<GraphState>();
+    runGraph(state, m_method, m_pool, number);
+    
+    // Pool helpers may still hold the state, but the graph is complete
+    std::lock_guard<std::mutex> lock(state->mutex);
+    
+    // Push multiplicities down from the number to the leaves
+    state->nodes[number].multiplicity = 1;
+    for (auto node = state->nodes.rbegin(); node != state->nodes.rend(); ++node) {
+        if (node->second.parts.empty()) {
+            result[node->first] += node->second.multiplicity;
+            continue;
+        }
+        for (const auto& part : node->second.parts) {
+            state->nodes[part.first].multiplicity += node->second.multiplicity * part.second;
+        }
+    }
+    
+    return result;
+}
+
+std::string FactorGraph::stream(const std::string& signed_number, const FactorCallback& callback) {
+    bool negative = false;
+    std::string number = factorableMagnitude(signed_number, negative);
+    if (negative && !callback(StreamedFactor{"-1", 1, number})) {
+        return number;
+    }
+    if (number == "1") {
+        return number;
+    }
+    
+    auto state = std::make_shared<GraphState>();
+    state->callback = &callback;
+    mpz_set_str(state->cofactor, number.c_str(), 10);
+    runGraph(state, m_method, m_pool, number);
+    
+    std::lock_guard<std::mutex> lock(state->deliver_mutex);
+    return toDecimal(state->cofactor);
+}
+
+} // namespace mfp
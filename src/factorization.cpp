@@ -0,0 +1,301 @@
+#include "factorization.h"
+#include "memory_accounting.h"
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <utility>
+
+namespace mfp {
+
+namespace {
+
+const char DIGITS[] = "0123456789abcdefghijklmnopqrstuvwxyz";
+
+std::string uint128ToBase(uint128_t value, int base) {
+    if (base == 10) {
+        return uint128ToString(value);
+    }
+    if (value == 0) {
+        return "0";
+    }
+    std::string text;
+    while (value != 0) {
+        text.push_back(DIGITS[static_cast<unsigned>(value % base)]);
+        value /= base;
+    }
+    std::reverse(text.begin(), text.end());
+    return text;
+}
+
+bool isDecimal(const std::string& text) {
+    return !text.empty() && std::all_of(text.begin(), text.end(), [](char c) { return c >= '0' && c <= '9'; });
+}
+
+// Decimal digits with the value 1, leading zeros allowed
+bool isOne(const std::string& text) {
+    size_t last = text.find_first_not_of('0');
+    return last + 1 == text.size() && text[last] == '1';
+}
+
+} // namespace
+
+bool DecimalLess::operator()(const std::string& a, const std::string& b) const {
+    bool a_negative = !a.empty() && a[0] == '-';
+    bool b_negative = !b.empty() && b[0] == '-';
+    if (a_negative != b_negative) {
+        return a_negative;
+    }
+    if (a_negative) {
+        // Larger magnitudes are smaller values
+        return (*this)(b.substr(1), a.substr(1));
+    }
+    if (a.size() != b.size()) {
+        return a.size() < b.size();
+    }
+    return a < b;
+}
+
+std::vector<std::string> expandPrimeFactors(const PrimeFactorMap& factors) {
+    std::vector<std::string> list;
+    for (const auto& factor : factors) {
+        list.insert(list.end(), factor.second, factor.first);
+    }
+    return list;
+}
+
+std::string factorableMagnitude(const std::string& number, bool& negative) {
+    negative = !number.empty() && number[0] == '-';
+    size_t start = negative ? 1 : 0;
+    if (number.size() == start || number.find_first_not_of("0123456789", start) != std::string::npos) {
+        throw std::invalid_argument("Cannot factorize " + number + ": not an integer");
+    }
+    
+    size_t digits = number.find_first_not_of('0', start);
+    if (digits == std::string::npos) {
+        throw std::invalid_argument("Cannot factorize 0");
+    }
+    return number.substr(digits);
+}
+
+FactorPrime::FactorPrime(uint128_t value)
+    : m_inline(true), m_small(value), m_large() {
+}
+
+FactorPrime::FactorPrime(const mpz_t value)
+    : m_inline(true), m_small(0), m_large() {
+    if (mpz_sgn(value) >= 0 && mpz_sizeinbase(value, 2) <= 128) {
+        uint64_t words[2] = {0, 0};
+        mpz_export(words, nullptr, -1, sizeof(uint64_t), 0, 0, value);
+        m_small = (static_cast<uint128_t>(words[1]) << 64) | words[0];
+    } else {
+        m_inline = false;
+        mpz_init_set(m_large, value);
+    }
+}
+
+FactorPrime::FactorPrime(const FactorPrime& other)
+    : m_inline(other.m_inline), m_small(other.m_small), m_large() {
+    if (!m_inline) {
+        mpz_init_set(m_large, other.m_large);
+    }
+}
+
+FactorPrime::FactorPrime(FactorPrime&& other) noexcept
+    : m_inline(other.m_inline), m_small(other.m_small), m_large() {
+    // Take over the limbs, as gmpxx does; the source is left inline
+    if (!m_inline) {
+        m_large[0] = other.m_large[0];
+        other.m_inline = true;
+        other.m_small = 0;
+    }
+}
+
+FactorPrime& FactorPrime::operator=(FactorPrime other) noexcept {
+    std::swap(m_inline, other.m_inline);
+    std::swap(m_small, other.m_small);
+    std::swap(m_large[0], other.m_large[0]);
+    return *this;
+}
+
+FactorPrime::~FactorPrime() {
+    if (!m_inline) {
+        mpz_clear(m_large);
+    }
+}
+
+bool FactorPrime::parse(const std::string& text) {
+    uint128_t value = 0;
+    if (parseUint128(text, value)) {
+        if (value < 2) {
+            return false;
+        }
+        *this = FactorPrime(value);
+        return true;
+    }
+    if (!isDecimal(text)) {
+        return false;
+    }
+    
+    mpz_t large;
+    mpz_init_set_str(large, text.c_str(), 10);
+    *this = FactorPrime(large);
+    mpz_clear(large);
+    return true;
+}
+
+bool FactorPrime::isInline() const {
+    return m_inline;
+}
+
+uint128_t FactorPrime::getInline() const {
+    return m_small;
+}
+
+void FactorPrime::get(mpz_t value) const {
+    if (!m_inline) {
+        mpz_set(value, m_large);
+        return;
+    }
+    uint64_t words[2] = {static_cast<uint64_t>(m_small), static_cast<uint64_t>(m_small >> 64)};
+    mpz_import(value, 2, -1, sizeof(uint64_t), 0, 0, words);
+}
+
+std::string FactorPrime::toString(int base) const {
+    if (m_inline) {
+        return uint128ToBase(m_small, base);
+    }
+    char* str = mpz_get_str(nullptr, base, m_large);
+    std::string result(str);
+    freeGMPString(str);
+    return result;
+}
+
+int FactorPrime::compare(const FactorPrime& other) const {
+    if (m_inline && other.m_inline) {
+        return m_small < other.m_small ? -1 : (m_small > other.m_small ? 1 : 0);
+    }
+    if (m_inline != other.m_inline) {
+        // Only values of 2^128 and above are held in GMP
+        return m_inline ? -1 : 1;
+    }
+    int cmp = mpz_cmp(m_large, other.m_large);
+    return cmp < 0 ? -1 : (cmp > 0 ? 1 : 0);
+}
+
+void Factorization::add(const FactorPrime& prime, unsigned long exponent) {
+    if (exponent == 0) {
+        return;
+    }
+    auto entry = std::lower_bound(m_entries.begin(), m_entries.end(), prime,
+                                  [](const Entry& e, const FactorPrime& p) { return e.prime < p; });
+    if (entry != m_entries.end() && entry->prime == prime) {
+        entry->exponent += exponent;
+        return;
+    }
+    m_entries.insert(entry, Entry{prime, exponent});
+}
+
+unsigned long Factorization::exponentOf(const FactorPrime& prime) const {
+    auto entry = std::lower_bound(m_entries.begin(), m_entries.end(), prime,
+                                  [](const Entry& e, const FactorPrime& p) { return e.prime < p; });
+    return entry != m_entries.end() && entry->prime == prime ? entry->exponent : 0;
+}
+
+unsigned long Factorization::countFactors() const {
+    unsigned long count = m_negative ? 1 : 0;
+    for (const Entry& entry : m_entries) {
+        count += entry.exponent;
+    }
+    return count;
+}
+
+void Factorization::product(mpz_t result) const {
+    mpz_t power;
+    mpz_init(power);
+    mpz_set_ui(result, 1);
+    for (const Entry& entry : m_entries) {
+        entry.prime.get(power);
+        mpz_pow_ui(power, power, entry.exponent);
+        mpz_mul(result, result, power);
+    }
+    if (m_negative) {
+        mpz_neg(result, result);
+    }
+    mpz_clear(power);
+}
+
+std::string Factorization::toString(int base) const {
+    if (m_entries.empty()) {
+        return m_negative ? "-1" : "1";
+    }
+    std::string text = m_negative ? "-1" : "";
+    for (const Entry& entry : m_entries) {
+        if (!text.empty()) {
+            text += " * ";
+        }
+        text += entry.prime.toString(base);
+        if (entry.exponent > 1) {
+            text += "^" + std::to_string(entry.exponent);
+        }
+    }
+    return text;
+}
+
+std::vector<std::string> Factorization::toStrings() const {
+    std::vector<std::string> factors;
+    factors.reserve(countFactors());
+    if (m_negative) {
+        factors.push_back("-1");
+    }
+    for (const Entry& entry : m_entries) {
+        // One conversion per distinct prime
+        factors.insert(factors.end(), entry.exponent, entry.prime.toString());
+    }
+    return factors;
+}
+
+bool Factorization::fromPrimePowers(const PrimeFactorMap& factors, Factorization& result) {
+    FactorPrime prime;
+    for (const auto& factor : factors) {
+        if (factor.first == "-1") {
+            if (factor.second % 2 != 0) {
+                result.negate();
+            }
+            continue;
+        }
+        if (!prime.parse(factor.first)) {
+            return false;
+        }
+        result.add(prime, factor.second);
+    }
+    return true;
+}
+
+bool Factorization::fromStrings(const std::vector<std::string>& factors, Factorization& result) {
+    const std::string* last_text = nullptr;
+    FactorPrime prime;
+    bool unit = false;
+    for (const std::string& text : factors) {
+        // The engines hand back the sign of a negative input on one entry
+        bool negative = !text.empty() && text[0] == '-';
+        if (negative) {
+            result.negate();
+        }
+        
+        // Repeats usually come in runs; parse each run once
+        if (last_text == nullptr || text != *last_text) {
+            std::string magnitude = negative ? text.substr(1) : text;
+            unit = isDecimal(magnitude) && isOne(magnitude);
+            if (!unit && !prime.parse(magnitude)) {
+                return false;
+            }
+            last_text = &text;
+        }
+        if (!unit) {
+            result.add(prime);
+        }
+    }
+    return true;
+}
+
+} // namespace mfp
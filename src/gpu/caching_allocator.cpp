@@ -0,0 +1,163 @@
+#include "gpu/caching_allocator.h"
+#include <algorithm>
+
+namespace mfp {
+
+namespace {
+
+// Smallest size class; tiny result buffers share one class
+const size_t MIN_BLOCK_SIZE = 256;
+
+// Above this, classes grow linearly instead of doubling to bound waste
+const size_t LARGE_BLOCK_THRESHOLD = 32ULL * 1024 * 1024;
+const size_t LARGE_BLOCK_GRANULARITY = 2ULL * 1024 * 1024;
+
+} // namespace
+
+CachingAllocator::CachingAllocator(RawAllocate raw_allocate, RawFree raw_free, size_t capacity_bytes)
+    : m_raw_allocate(raw_allocate), m_raw_free(raw_free), m_capacity(capacity_bytes) {
+}
+
+CachingAllocator::~CachingAllocator() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    
+    // Blocks still live at destruction are released too, the backend context is going away
+    for (auto& entry : m_live_blocks) {
+        m_raw_free(const_cast<void*>(entry.first));
+    }
+    m_live_blocks.clear();
+    
+    trimLocked(0);
+}
+
+void* CachingAllocator::allocate(size_t size_bytes) {
+    if (size_bytes == 0) {
+        return nullptr;
+    }
+    
+    size_t block_size = sizeClass(size_bytes);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    
+    // Reuse a cached block of the same class
+    auto it = m_free_blocks.find(block_size);
+    if (it != m_free_blocks.end() && !it->second.empty()) {
+        void* ptr = it->second.back();
+        it->second.pop_back();
+        
+        m_stats.cached_bytes -= block_size;
+        m_stats.allocated_bytes += block_size;
+        m_stats.cache_hits++;
+        m_live_blocks[ptr] = block_size;
+        return ptr;
+    }
+    
+    m_stats.cache_misses++;
+    
+    // Make room by returning cached blocks before exceeding the capacity
+    size_t reserved = m_stats.allocated_bytes + m_stats.cached_bytes;
+    if (reserved + block_size > m_capacity) {
+        size_t needed = reserved + block_size - m_capacity;
+        if (needed > m_stats.cached_bytes) {
+            return nullptr;  // Out of memory even with an empty cache
+        }
+        trimLocked(m_stats.cached_bytes - needed);
+    }
+    
+    void* ptr = m_raw_allocate(block_size);
+    if (!ptr && m_stats.cached_bytes > 0) {
+        // Backend is under pressure from outside this allocator; drop the cache and retry
+        trimLocked(0);
+        ptr = m_raw_allocate(block_size);
+    }
+    
+    if (!ptr) {
+        return nullptr;
+    }
+    
+    m_stats.allocated_bytes += block_size;
+    m_stats.peak_reserved_bytes = std::max(m_stats.peak_reserved_bytes, m_stats.allocated_bytes + m_stats.cached_bytes);
+    m_live_blocks[ptr] = block_size;
+    return ptr;
+}
+
+bool CachingAllocator::free(void* ptr) {
+    if (!ptr) {
+        return false;
+    }
+    
+    std::lock_guard<std::mutex> lock(m_mutex);
+    
+    auto it = m_live_blocks.find(ptr);
+    if (it == m_live_blocks.end()) {
+        return false;
+    }
+    
+    size_t block_size = it->second;
+    m_live_blocks.erase(it);
+    
+    m_free_blocks[block_size].push_back(ptr);
+    m_stats.allocated_bytes -= block_size;
+    m_stats.cached_bytes += block_size;
+    return true;
+}
+
+size_t CachingAllocator::trim(size_t max_cached_bytes) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return trimLocked(max_cached_bytes);
+}
+
+size_t CachingAllocator::getBlockSize(const void* ptr) const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    
+    auto it = m_live_blocks.find(ptr);
+    return it != m_live_blocks.end() ? it->second : 0;
+}
+
+size_t CachingAllocator::getReservedBytes() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats.allocated_bytes + m_stats.cached_bytes;
+}
+
+CachingAllocatorStats CachingAllocator::getStats() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats;
+}
+
+size_t CachingAllocator::sizeClass(size_t size_bytes) {
+    if (size_bytes <= MIN_BLOCK_SIZE) {
+        return MIN_BLOCK_SIZE;
+    }
+    
+    if (size_bytes > LARGE_BLOCK_THRESHOLD) {
+        return (size_bytes + LARGE_BLOCK_GRANULARITY - 1) / LARGE_BLOCK_GRANULARITY * LARGE_BLOCK_GRANULARITY;
+    }
+    
+    // Next power of two
+    size_t block_size = MIN_BLOCK_SIZE;
+    while (block_size < size_bytes) {
+        block_size <<= 1;
+    }
+    return block_size;
+}
+
+size_t CachingAllocator::trimLocked(size_t max_cached_bytes) {
+    size_t released = 0;
+    
+    for (auto it = m_free_blocks.rbegin(); it != m_free_blocks.rend() && m_stats.cached_bytes > max_cached_bytes; ++it) {
+        std::vector<void*>& blocks = it->second;
+        while (!blocks.empty() && m_stats.cached_bytes > max_cached_bytes) {
+            m_raw_free(blocks.back());
+            blocks.pop_back();
+            m_stats.cached_bytes -= it->first;
+            released += it->first;
+        }
+    }
+    
+    if (released > 0) {
+        m_stats.trims++;
+    }
+    
+    return released;
+}
+
+} // namespace mfp
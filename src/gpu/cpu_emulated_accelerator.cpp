@@ -0,0 +1,411 @@
+#include "gpu/cpu_emulated_accelerator.h"
+#include "gpu/limb_layout.h"
+#include "memory_accounting.h"
+#include <iostream>
+#include <sstream>
+#include <algorithm>
+#include <chrono>
+
+namespace mfp {
+
+namespace {
+
+// Lanes handled by one device thread per scheduling step (the emulated thread block)
+const size_t EMULATED_BLOCK_SIZE = 64;
+
+// Fixed witness set shared by every lane, as a GPU kernel would use
+const unsigned long KERNEL_WITNESSES[] = {2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37};
+
+// Strong probable prime test for one lane
+bool isPrimeKernel(const mpz_t n) {
+    if (mpz_cmp_ui(n, 2) < 0) {
+        return false;
+    }
+    
+    // Small prime trial division
+    for (unsigned long p : KERNEL_WITNESSES) {
+        if (mpz_cmp_ui(n, p) == 0) {
+            return true;
+        }
+        if (mpz_divisible_ui_p(n, p) != 0) {
+            return false;
+        }
+    }
+    
+    mpz_t d, a, y, n_minus_1;
+    mpz_init(d);
+    mpz_init(a);
+    mpz_init(y);
+    mpz_init(n_minus_1);
+    
+    // Write n-1 as 2^s * d where d is odd
+    mpz_sub_ui(n_minus_1, n, 1);
+    unsigned long s = mpz_scan1(n_minus_1, 0);
+    mpz_tdiv_q_2exp(d, n_minus_1, s);
+    
+    bool probable_prime = true;
+    for (unsigned long base : KERNEL_WITNESSES) {
+        mpz_set_ui(a, base);
+        mpz_powm(y, a, d, n);
+        
+        if (mpz_cmp_ui(y, 1) == 0 || mpz_cmp(y, n_minus_1) == 0) {
+            continue;
+        }
+        
+        bool witness = true;
+        for (unsigned long r = 1; r < s; r++) {
+            mpz_mul(y, y, y);
+            mpz_mod(y, y, n);
+            if (mpz_cmp(y, n_minus_1) == 0) {
+                witness = false;
+                break;
+            }
+        }
+        
+        if (witness) {
+            probable_prime = false;
+            break;
+        }
+    }
+    
+    mpz_clear(d);
+    mpz_clear(a);
+    mpz_clear(y);
+    mpz_clear(n_minus_1);
+    
+    return probable_prime;
+}
+
+// Brent's variant of Pollard's rho for one lane; returns false if the iteration cap is hit
+bool rhoKernel(const mpz_t n, mpz_t factor) {
+    mpz_t x, y, ys, q, diff;
+    mpz_init(x);
+    mpz_init(y);
+    mpz_init(ys);
+    mpz_init(q);
+    mpz_init(diff);
+    
+    bool found = false;
+    const unsigned long max_iterations = 1UL << 20;
+    
+    for (unsigned long c = 1; c < 8 && !found; c++) {
+        mpz_set_ui(y, 2);
+        mpz_set_ui(q, 1);
+        mpz_set_ui(factor, 1);
+        unsigned long r = 1;
+        unsigned long iterations = 0;
+        
+        while (mpz_cmp_ui(factor, 1) == 0 && iterations < max_iterations) {
+            mpz_set(x, y);
+            for (unsigned long i = 0; i < r; i++) {
+                mpz_mul(y, y, y);
+                mpz_add_ui(y, y, c);
+                mpz_mod(y, y, n);
+            }
+            
+            // Accumulate differences and take one gcd per block of 128 steps
+            for (unsigned long k = 0; k < r && mpz_cmp_ui(factor, 1) == 0; k += 128) {
+                mpz_set(ys, y);
+                unsigned long block = std::min(128UL, r - k);
+                for (unsigned long i = 0; i < block; i++) {
+                    mpz_mul(y, y, y);
+                    mpz_add_ui(y, y, c);
+                    mpz_mod(y, y, n);
+                    mpz_sub(diff, x, y);
+                    mpz_mul(q, q, diff);
+                    mpz_mod(q, q, n);
+                }
+                mpz_gcd(factor, q, n);
+                iterations += block;
+            }
+            r *= 2;
+        }
+        
+        // Backtrack one step at a time if the block gcd overshot to n
+        if (mpz_cmp(factor, n) == 0) {
+            do {
+                mpz_mul(ys, ys, ys);
+                mpz_add_ui(ys, ys, c);
+                mpz_mod(ys, ys, n);
+                mpz_sub(diff, x, ys);
+                mpz_gcd(factor, diff, n);
+            } while (mpz_cmp_ui(factor, 1) == 0);
+        }
+        
+        found = mpz_cmp_ui(factor, 1) > 0 && mpz_cmp(factor, n) < 0;
+    }
+    
+    mpz_clear(x);
+    mpz_clear(y);
+    mpz_clear(ys);
+    mpz_clear(q);
+    mpz_clear(diff);
+    
+    return found;
+}
+
+// Full factorization for one lane: trial division, then rho on the cofactors
+void factorizeKernel(const mpz_t number, std::vector<std::string>& factors) {
+    mpz_t n, factor;
+    mpz_init_set(n, number);
+    mpz_init(factor);
+    
+    if (mpz_cmp_ui(n, 1) <= 0) {
+        mpz_clear(n);
+        mpz_clear(factor);
+        return;
+    }
+    
+    for (unsigned long p = 2; p < 1000 && mpz_cmp_ui(n, 1) > 0; p += (p == 2 ? 1 : 2)) {
+        while (mpz_divisible_ui_p(n, p) != 0) {
+            factors.push_back(std::to_string(p));
+            mpz_divexact_ui(n, n, p);
+        }
+    }
+    
+    // Work stack of cofactors still to split
+    std::vector<std::string> pending;
+    if (mpz_cmp_ui(n, 1) > 0) {
+        char* n_str = mpz_get_str(nullptr, 10, n);
+        pending.push_back(n_str);
+        freeGMPString(n_str);
+    }
+    
+    while (!pending.empty()) {
+        mpz_set_str(n, pending.back().c_str(), 10);
+        std::string current = pending.back();
+        pending.pop_back();
+        
+        if (isPrimeKernel(n) || !rhoKernel(n, factor)) {
+            factors.push_back(current);
+            continue;
+        }
+        
+        char* factor_str = mpz_get_str(nullptr, 10, factor);
+        pending.push_back(factor_str);
+        freeGMPString(factor_str);
+        
+        mpz_divexact(n, n, factor);
+        char* cofactor_str = mpz_get_str(nullptr, 10, n);
+        pending.push_back(cofactor_str);
+        freeGMPString(cofactor_str);
+    }
+    
+    std::sort(factors.begin(), factors.end(), [](const std::string& a, const std::string& b) {
+        return a.size() != b.size() ? a.size() < b.size() : a < b;
+    });
+    
+    mpz_clear(n);
+    mpz_clear(factor);
+}
+
+} // namespace
+
+CPUEmulatedAccelerator::CPUEmulatedAccelerator() : m_initialized(false), m_device_threads(0) {
+}
+
+CPUEmulatedAccelerator::~CPUEmulatedAccelerator() {
+    // Device pool joins its threads on destruction
+}
+
+bool CPUEmulatedAccelerator::initialize(int device_threads) {
+    if (device_threads <= 0) {
+        device_threads = std::max(1, static_cast<int>(std::thread::hardware_concurrency()) / 2);
+    }
+    
+    m_device_threads = device_threads;
+    m_device_pool = std::make_unique<ThreadPool>(device_threads);
+    m_initialized = true;
+    return true;
+}
+
+bool CPUEmulatedAccelerator::isAvailable() const {
+    return m_initialized;
+}
+
+std::string CPUEmulatedAccelerator::getDeviceProperties() const {
+    if (!m_initialized) {
+        return "CPU-emulated accelerator not initialized";
+    }
+    
+    std::stringstream ss;
+    ss << "CPU-Emulated Device Properties:" << std::endl;
+    ss << "  Device threads: " << m_device_threads << std::endl;
+    ss << "  Block size: " << EMULATED_BLOCK_SIZE << " lanes" << std::endl;
+    
+    return ss.str();
+}
+
+bool CPUEmulatedAccelerator::isPrime(const mpz_t number, bool& result) {
+    if (!m_initialized) {
+        return false;
+    }
+    
+    result = isPrimeKernel(number);
+    return true;
+}
+
+bool CPUEmulatedAccelerator::factorize(const mpz_t number, std::vector<std::string>& factors) {
+    if (!m_initialized) {
+        return false;
+    }
+    
+    factors.clear();
+    factorizeKernel(number, factors);
+    return true;
+}
+
+bool CPUEmulatedAccelerator::nextPrime(const mpz_t number, mpz_t next_prime) {
+    if (!m_initialized) {
+        return false;
+    }
+    
+    // Test candidates in parallel windows of one block per device thread
+    mpz_t base;
+    mpz_init(base);
+    mpz_add_ui(base, number, 1);
+    
+    const size_t window = EMULATED_BLOCK_SIZE * m_device_threads;
+    std::vector<uint8_t> hits(window);
+    bool found = false;
+    
+    while (!found) {
+        launch(window, [&](size_t lane) {
+            mpz_t candidate;
+            mpz_init(candidate);
+            mpz_add_ui(candidate, base, lane);
+            hits[lane] = isPrimeKernel(candidate) ? 1 : 0;
+            mpz_clear(candidate);
+        });
+        
+        for (size_t lane = 0; lane < window; lane++) {
+            if (hits[lane]) {
+                mpz_add_ui(next_prime, base, lane);
+                found = true;
+                break;
+            }
+        }
+        
+        mpz_add_ui(base, base, window);
+    }
+    
+    mpz_clear(base);
+    return true;
+}
+
+bool CPUEmulatedAccelerator::isPrimeBatch(const std::vector<std::string>& numbers, std::vector<uint8_t>& results) {
+    if (!m_initialized) {
+        return false;
+    }
+    
+    // Upload: one packed structure-of-arrays buffer for the whole batch
+    PackedLimbBatch device_numbers;
+    if (!packLimbs(numbers, device_numbers)) {
+        return false;
+    }
+    
+    // SIMD prefilter over all lanes: lanes divisible by a witness prime are decided here
+    results.assign(numbers.size(), 2);
+    std::vector<uint32_t> remainders;
+    for (unsigned long p : KERNEL_WITNESSES) {
+        batchRemainders(device_numbers, static_cast<uint32_t>(p), remainders);
+        for (size_t lane = 0; lane < numbers.size(); lane++) {
+            if (remainders[lane] == 0 && results[lane] == 2) {
+                // Divisible by p: prime only if the lane is p itself
+                results[lane] = laneEquals(device_numbers, lane, static_cast<limb_t>(p)) ? 1 : 0;
+            }
+        }
+    }
+    
+    launch(numbers.size(), [&](size_t lane) {
+        if (results[lane] != 2) {
+            return;
+        }
+        
+        mpz_t n;
+        mpz_init(n);
+        unpackLane(device_numbers, lane, n);
+        results[lane] = isPrimeKernel(n) ? 1 : 0;
+        mpz_clear(n);
+    });
+    
+    return true;
+}
+
+bool CPUEmulatedAccelerator::factorizeBatch(const std::vector<std::string>& numbers, std::vector<std::vector<std::string>>& factors) {
+    if (!m_initialized) {
+        return false;
+    }
+    
+    PackedLimbBatch device_numbers;
+    if (!packLimbs(numbers, device_numbers)) {
+        return false;
+    }
+    
+    factors.assign(numbers.size(), std::vector<std::string>());
+    launch(numbers.size(), [&](size_t lane) {
+        mpz_t n;
+        mpz_init(n);
+        unpackLane(device_numbers, lane, n);
+        factorizeKernel(n, factors[lane]);
+        mpz_clear(n);
+    });
+    
+    return true;
+}
+
+double CPUEmulatedAccelerator::benchmark(const mpz_t number) {
+    if (!m_initialized) {
+        return -1.0;
+    }
+    
+    // Measure time for isPrime operation
+    auto start = std::chrono::high_resolution_clock::now();
+    
+    bool is_prime_result;
+    bool success = isPrime(number, is_prime_result);
+    
+    auto end = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double, std::milli> elapsed = end - start;
+    
+    if (!success) {
+        return -1.0;
+    }
+    
+    return elapsed.count();
+}
+
+int CPUEmulatedAccelerator::getDeviceThreads() const {
+    return m_device_threads;
+}
+
+int CPUEmulatedAccelerator::getParallelism() const {
+    return m_device_threads;
+}
+
+void CPUEmulatedAccelerator::launch(size_t lanes, const std::function<void(size_t)>& kernel) {
+    size_t blocks = (lanes + EMULATED_BLOCK_SIZE - 1) / EMULATED_BLOCK_SIZE;
+    std::atomic<size_t> next_block(0);
+    
+    // Only device threads execute the kernel; the launching thread just waits, as for a GPU
+    std::vector<std::future<void>> workers;
+    size_t worker_count = std::min(blocks, static_cast<size_t>(m_device_threads));
+    for (size_t w = 0; w < worker_count; w++) {
+        workers.push_back(m_device_pool->submit([&] {
+            size_t block;
+            while ((block = next_block.fetch_add(1)) < blocks) {
+                size_t first = block * EMULATED_BLOCK_SIZE;
+                size_t last = std::min(lanes, first + EMULATED_BLOCK_SIZE);
+                for (size_t lane = first; lane < last; lane++) {
+                    kernel(lane);
+                }
+            }
+        }));
+    }
+    
+    for (auto& worker : workers) {
+        worker.get();
+    }
+}
+
+} // namespace mfp
@@ -68,138 +68,6 @@ const char* CUDA_PTX_NEXT_PRIME = R"(
 }
 )";
 
-// CUDAMemory implementation
-CUDAMemory::CUDAMemory() : m_initialized(false), m_total_memory(0), m_allocated_memory(0) {
-}
-
-CUDAMemory::~CUDAMemory() {
-    // Cleanup would happen here in a real implementation
-}
-
-bool CUDAMemory::initialize(size_t max_memory_bytes) {
-#ifdef __CUDA__
-    // Initialize CUDA context
-    CUdevice device;
-    if (cuDeviceGet(&device, 0) != CUDA_SUCCESS) {
-        return false;
-    }
-    
-    CUcontext context;
-    if (cuCtxCreate(&context, 0, device) != CUDA_SUCCESS) {
-        return false;
-    }
-    
-    // Get device properties
-    size_t free_memory, total_memory;
-    if (cuMemGetInfo(&free_memory, &total_memory) != CUDA_SUCCESS) {
-        return false;
-    }
-    
-    m_total_memory = (max_memory_bytes > 0 && max_memory_bytes < total_memory) ? 
-                     max_memory_bytes : total_memory;
-    m_initialized = true;
-    return true;
-#else
-    // Simulate success for testing without CUDA
-    m_total_memory = max_memory_bytes > 0 ? max_memory_bytes : 8ULL * 1024 * 1024 * 1024;
-    m_initialized = true;
-    return true;
-#endif
-}
-
-void* CUDAMemory::allocate(size_t size_bytes) {
-    if (!m_initialized) {
-        return nullptr;
-    }
-    
-    if (m_allocated_memory + size_bytes > m_total_memory) {
-        return nullptr;  // Out of memory
-    }
-    
-#ifdef __CUDA__
-    void* ptr = nullptr;
-    if (cuMemAlloc((CUdeviceptr*)&ptr, size_bytes) != CUDA_SUCCESS) {
-        return nullptr;
-    }
-    
-    m_allocated_memory += size_bytes;
-    return ptr;
-#else
-    // Simulate allocation for testing without CUDA
-    void* ptr = malloc(size_bytes);
-    if (ptr) {
-        m_allocated_memory += size_bytes;
-    }
-    return ptr;
-#endif
-}
-
-void CUDAMemory::free(void* ptr) {
-    if (!m_initialized || !ptr) {
-        return;
-    }
-    
-#ifdef __CUDA__
-    cuMemFree((CUdeviceptr)ptr);
-#else
-    // Simulate free for testing without CUDA
-    free(ptr);
-#endif
-    
-    // Note: In a real implementation, we would track the size of each allocation
-    // to properly update m_allocated_memory when freeing memory
-}
-
-bool CUDAMemory::copyHostToDevice(void* device_ptr, const void* host_ptr, size_t size_bytes) {
-    if (!m_initialized || !device_ptr || !host_ptr) {
-        return false;
-    }
-    
-#ifdef __CUDA__
-    return cuMemcpyHtoD((CUdeviceptr)device_ptr, host_ptr, size_bytes) == CUDA_SUCCESS;
-#else
-    // Simulate copy for testing without CUDA
-    memcpy(device_ptr, host_ptr, size_bytes);
-    return true;
-#endif
-}
-
-bool CUDAMemory::copyDeviceToHost(void* host_ptr, const void* device_ptr, size_t size_bytes) {
-    if (!m_initialized || !device_ptr || !host_ptr) {
-        return false;
-    }
-    
-#ifdef __CUDA__
-    return cuMemcpyDtoH(host_ptr, (CUdeviceptr)device_ptr, size_bytes) == CUDA_SUCCESS;
-#else
-    // Simulate copy for testing without CUDA
-    memcpy(host_ptr, device_ptr, size_bytes);
-    return true;
-#endif
-}
-
-bool CUDAMemory::copyDeviceToDevice(void* dst_ptr, const void* src_ptr, size_t size_bytes) {
-    if (!m_initialized || !dst_ptr || !src_ptr) {
-        return false;
-    }
-    
-#ifdef __CUDA__
-    return cuMemcpyDtoD((CUdeviceptr)dst_ptr, (CUdeviceptr)src_ptr, size_bytes) == CUDA_SUCCESS;
-#else
-    // Simulate copy for testing without CUDA
-    memcpy(dst_ptr, src_ptr, size_bytes);
-    return true;
-#endif
-}
-
-size_t CUDAMemory::getAvailableMemory() const {
-    return m_total_memory - m_allocated_memory;
-}
-
-size_t CUDAMemory::getTotalMemory() const {
-    return m_total_memory;
-}
-
 // CUDAKernel implementation
 CUDAKernel::CUDAKernel() : m_module(nullptr), m_function(nullptr) {
     m_grid_dim[0] = m_grid_dim[1] = m_grid_dim[2] = 1;
@@ -444,6 +312,7 @@ std::string CUDAAccelerator::getDeviceProperties() const {
     ss << "CUDA Device Properties:" << std::endl;
     ss << "  Total Memory: " << (m_memory.getTotalMemory() / (1024 * 1024)) << " MB" << std::endl;
     ss << "  Available Memory: " << (m_memory.getAvailableMemory() / (1024 * 1024)) << " MB" << std::endl;
+    ss << "  Cached Memory: " << (m_memory.getCachedMemory() / (1024 * 1024)) << " MB" << std::endl;
     
     return ss.str();
 }
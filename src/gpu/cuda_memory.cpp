@@ -0,0 +1,161 @@
+#include "gpu/cuda_memory.h"
+#include <cstdlib>
+#include <cstring>
+
+// Include CUDA headers if available
+#ifdef __CUDA__
+#include <cuda.h>
+#endif
+
+namespace mfp {
+
+CUDAMemory::CUDAMemory() : m_initialized(false), m_total_memory(0) {
+}
+
+CUDAMemory::~CUDAMemory() {
+    // Release cached and live blocks before the context goes away
+    m_allocator.reset();
+}
+
+bool CUDAMemory::initialize(size_t max_memory_bytes) {
+#ifdef __CUDA__
+    // Initialize CUDA context
+    CUdevice device;
+    if (cuDeviceGet(&device, 0) != CUDA_SUCCESS) {
+        return false;
+    }
+    
+    CUcontext context;
+    if (cuCtxCreate(&context, 0, device) != CUDA_SUCCESS) {
+        return false;
+    }
+    
+    // Get device properties
+    size_t free_memory, total_memory;
+    if (cuMemGetInfo(&free_memory, &total_memory) != CUDA_SUCCESS) {
+        return false;
+    }
+    
+    m_total_memory = (max_memory_bytes > 0 && max_memory_bytes < total_memory) ? 
+                     max_memory_bytes : total_memory;
+    
+    m_allocator = std::make_unique<CachingAllocator>(
+        [](size_t size_bytes) -> void* {
+            CUdeviceptr ptr = 0;
+            return cuMemAlloc(&ptr, size_bytes) == CUDA_SUCCESS ? (void*)ptr : nullptr;
+        },
+        [](void* ptr) { cuMemFree((CUdeviceptr)ptr); },
+        m_total_memory);
+    
+    m_initialized = true;
+    return true;
+#else
+    // Simulate success for testing without CUDA; host memory stands in for the device
+    m_total_memory = max_memory_bytes > 0 ? max_memory_bytes : 8ULL * 1024 * 1024 * 1024;
+    
+    m_allocator = std::make_unique<CachingAllocator>(
+        [](size_t size_bytes) { return ::malloc(size_bytes); },
+        [](void* ptr) { ::free(ptr); },
+        m_total_memory);
+    
+    m_initialized = true;
+    return true;
+#endif
+}
+
+void* CUDAMemory::allocate(size_t size_bytes) {
+    if (!m_initialized) {
+        return nullptr;
+    }
+    
+    return m_allocator->allocate(size_bytes);
+}
+
+void CUDAMemory::free(void* ptr) {
+    if (!m_initialized || !ptr) {
+        return;
+    }
+    
+    m_allocator->free(ptr);
+}
+
+size_t CUDAMemory::trim() {
+    if (!m_initialized) {
+        return 0;
+    }
+    
+    return m_allocator->trim();
+}
+
+bool CUDAMemory::copyHostToDevice(void* device_ptr, const void* host_ptr, size_t size_bytes) {
+    if (!m_initialized || !device_ptr || !host_ptr) {
+        return false;
+    }
+    
+#ifdef __CUDA__
+    return cuMemcpyHtoD((CUdeviceptr)device_ptr, host_ptr, size_bytes) == CUDA_SUCCESS;
+#else
+    // Simulate copy for testing without CUDA
+    memcpy(device_ptr, host_ptr, size_bytes);
+    return true;
+#endif
+}
+
+bool CUDAMemory::copyDeviceToHost(void* host_ptr, const void* device_ptr, size_t size_bytes) {
+    if (!m_initialized || !device_ptr || !host_ptr) {
+        return false;
+    }
+    
+#ifdef __CUDA__
+    return cuMemcpyDtoH(host_ptr, (CUdeviceptr)device_ptr, size_bytes) == CUDA_SUCCESS;
+#else
+    // Simulate copy for testing without CUDA
+    memcpy(host_ptr, device_ptr, size_bytes);
+    return true;
+#endif
+}
+
+bool CUDAMemory::copyDeviceToDevice(void* dst_ptr, const void* src_ptr, size_t size_bytes) {
+    if (!m_initialized || !dst_ptr || !src_ptr) {
+        return false;
+    }
+    
+#ifdef __CUDA__
+    return cuMemcpyDtoD((CUdeviceptr)dst_ptr, (CUdeviceptr)src_ptr, size_bytes) == CUDA_SUCCESS;
+#else
+    // Simulate copy for testing without CUDA
+    memcpy(dst_ptr, src_ptr, size_bytes);
+    return true;
+#endif
+}
+
+size_t CUDAMemory::getAvailableMemory() const {
+    // Cached blocks are returned on demand, so only live blocks count as used
+    if (!m_initialized) {
+        return 0;
+    }
+    
+    return m_total_memory - m_allocator->getStats().allocated_bytes;
+}
+
+size_t CUDAMemory::getTotalMemory() const {
+    return m_total_memory;
+}
+
+size_t CUDAMemory::getCachedMemory() const {
+    if (!m_initialized) {
+        return 0;
+    }
+    
+    return m_allocator->getStats().cached_bytes;
+}
+
+CachingAllocatorStats CUDAMemory::getStats() const {
+    if (!m_initialized) {
+        return CachingAllocatorStats();
+    }
+    
+    return m_allocator->getStats();
+}
+
+} // namespace mfp
@@ -0,0 +1,121 @@
+#include "gpu/limb_layout.h"
+#include "memory_accounting.h"
+#include <algorithm>
+#include <cstdlib>
+
+namespace mfp {
+
+void resizeLimbBatch(PackedLimbBatch& batch, size_t lane_count, size_t limb_count) {
+    batch.lane_count = lane_count;
+    batch.lane_stride = (lane_count + LANE_ALIGNMENT - 1) / LANE_ALIGNMENT * LANE_ALIGNMENT;
+    batch.limb_count = limb_count;
+    batch.limbs.assign(batch.lane_stride * limb_count, 0);
+}
+
+bool packLimbs(const std::vector<std::string>& numbers, PackedLimbBatch& batch, size_t limb_count) {
+    std::vector<__mpz_struct> values(numbers.size());
+    bool valid = true;
+    
+    for (size_t i = 0; i < numbers.size(); i++) {
+        if (mpz_init_set_str(&values[i], numbers[i].c_str(), 10) != 0) {
+            valid = false;
+        }
+    }
+    
+    if (valid) {
+        // mpz_t is a one-element array, so contiguous structs are a contiguous mpz_t array
+        valid = packLimbs(reinterpret_cast<const mpz_t*>(values.data()), values.size(), batch, limb_count);
+    }
+    
+    for (auto& value : values) {
+        mpz_clear(&value);
+    }
+    
+    return valid;
+}
+
+bool packLimbs(const mpz_t* numbers, size_t count, PackedLimbBatch& batch, size_t limb_count) {
+    // Size the batch to the widest input unless a width was requested
+    size_t widest = 1;
+    for (size_t i = 0; i < count; i++) {
+        if (mpz_sgn(numbers[i]) < 0) {
+            return false;
+        }
+        widest = std::max(widest, (mpz_sizeinbase(numbers[i], 2) + LIMB_BITS - 1) / LIMB_BITS);
+    }
+    
+    if (limb_count == 0) {
+        limb_count = widest;
+    } else if (widest > limb_count) {
+        return false;
+    }
+    
+    resizeLimbBatch(batch, count, limb_count);
+    
+    // Export each number least significant limb first, then scatter into the rows
+    std::vector<limb_t> scratch(limb_count);
+    for (size_t i = 0; i < count; i++) {
+        size_t written = 0;
+        std::fill(scratch.begin(), scratch.end(), 0);
+        mpz_export(scratch.data(), &written, -1, sizeof(limb_t), 0, 0, numbers[i]);
+        
+        for (size_t k = 0; k < written; k++) {
+            batch.row(k)[i] = scratch[k];
+        }
+    }
+    
+    return true;
+}
+
+void unpackLane(const PackedLimbBatch& batch, size_t lane, mpz_t number) {
+    // Gather the lane's limbs back into one contiguous word array
+    std::vector<limb_t> scratch(batch.limb_count);
+    for (size_t k = 0; k < batch.limb_count; k++) {
+        scratch[k] = batch.limb(lane, k);
+    }
+    
+    mpz_import(number, scratch.size(), -1, sizeof(limb_t), 0, 0, scratch.data());
+}
+
+std::string unpackLaneString(const PackedLimbBatch& batch, size_t lane, int base) {
+    mpz_t number;
+    mpz_init(number);
+    unpackLane(batch, lane, number);
+    
+    char* number_str = mpz_get_str(nullptr, base, number);
+    std::string result(number_str);
+    freeGMPString(number_str);
+    mpz_clear(number);
+    
+    return result;
+}
+
+bool laneEquals(const PackedLimbBatch& batch, size_t lane, limb_t value) {
+    if (batch.limb_count == 0) {
+        return value == 0;
+    }
+    
+    for (size_t k = 1; k < batch.limb_count; k++) {
+        if (batch.limb(lane, k) != 0) {
+            return false;
+        }
+    }
+    
+    return batch.limb(lane, 0) == value;
+}
+
+void batchRemainders(const PackedLimbBatch& batch, uint32_t divisor, std::vector<uint32_t>& remainders) {
+    std::vector<uint64_t> acc(batch.lane_stride, 0);
+    
+    // Horner's rule over limb rows; the lane loop has no dependencies and vectorizes
+    for (size_t k = batch.limb_count; k-- > 0;) {
+        const limb_t* row = batch.row(k);
+        for (size_t i = 0; i < batch.lane_stride; i++) {
+            acc[i] = ((acc[i] << LIMB_BITS) | row[i]) % divisor;
+        }
+    }
+    
+    remainders.assign(acc.begin(), acc.begin() + batch.lane_count);
+}
+
+} // namespace mfp
@@ -0,0 +1,930 @@
+#include "gpu/opencl_accelerator.h"
+#include "mfp_method1.h"
+#include "mfp_method2.h"
+#include "mfp_method3.h"
+#include "thread_pool.h"
+#include "memory_accounting.h"
+#include <sstream>
+#include <cstring>
+#include <algorithm>
+#include <chrono>
+
+// Include OpenCL headers if available
+#ifdef __OPENCL__
+#define CL_TARGET_OPENCL_VERSION 120
+#define CL_USE_DEPRECATED_OPENCL_1_2_APIS
+#ifdef __APPLE__
+#include <OpenCL/opencl.h>
+#else
+#include <CL/cl.h>
+#endif
+#endif
+
+namespace mfp {
+
+namespace {
+
+// The kernel source below is written once and used twice: stringified and
+// compiled by the OpenCL runtime, and expanded as C++ in opencl_host so the
+// same kernels run on host threads when no runtime is available. It must stay
+// in the common subset of OpenCL C and C++ (no preprocessor lines, no bool).
+#define MFP_MAX_LIMBS 128
+static_assert(MFP_MAX_LIMBS == OPENCL_MAX_LIMBS, "kernel scratch must match OPENCL_MAX_LIMBS");
+#define MFP_STRINGIFY(x) #x
+#define MFP_TO_STRING(x) MFP_STRINGIFY(x)
+
+#define OPENCL_PREAMBLE \
+    "#define MFP_KERNEL __kernel\n" \
+    "#define MFP_GLOBAL __global\n" \
+    "#define MFP_ATOMIC_OR(p, v) atomic_or(p, v)\n" \
+    "#define MFP_MAX_LIMBS " MFP_TO_STRING(MFP_MAX_LIMBS) "\n"
+
+#define MFP_KERNEL
+#define MFP_GLOBAL
+#define MFP_ATOMIC_OR(p, v) __atomic_fetch_or((p), (v), __ATOMIC_RELAXED)
+
+#define OPENCL_PROGRAM(...) \
+    const char* const OPENCL_PROGRAM_SOURCE = OPENCL_PREAMBLE #__VA_ARGS__; \
+    namespace opencl_host { __VA_ARGS__ }
+
+namespace opencl_host {
+
+typedef uint32_t uint;
+typedef uint64_t ulong;
+typedef uint8_t uchar;
+
+// Work-item index of the calling host thread
+thread_local size_t t_global_id = 0;
+
+size_t get_global_id(uint) {
+    return t_global_id;
+}
+
+} // namespace opencl_host
+
+OPENCL_PROGRAM(
+
+/* Numbers are little-endian 32-bit limbs; batches use the packed layout
+   where limb k of lane i is at k * lane_stride + i */
+
+uint laneLimbs(const uint* a, uint limb_count) {
+    uint n = limb_count;
+    while (n > 1 && a[n - 1] == 0) n--;
+    return n;
+}
+
+void loadLane(MFP_GLOBAL const uint* src, uint lane, uint lane_stride, uint limb_count, uint* dst) {
+    for (uint k = 0; k < limb_count; k++) dst[k] = src[k * lane_stride + lane];
+}
+
+void storeLane(MFP_GLOBAL uint* dst, uint lane, uint lane_stride, uint limb_count, const uint* src, uint n) {
+    for (uint k = 0; k < limb_count; k++) dst[k * lane_stride + lane] = k < n ? src[k] : 0;
+}
+
+int compareLimbs(const uint* a, const uint* b, uint n) {
+    for (uint k = n; k-- > 0;) {
+        if (a[k] != b[k]) return a[k] > b[k] ? 1 : -1;
+    }
+    return 0;
+}
+
+/* a -= b, returns the borrow out */
+uint subLimbs(uint* a, const uint* b, uint n) {
+    uint borrow = 0;
+    for (uint k = 0; k < n; k++) {
+        ulong d = (ulong)a[k] - b[k] - borrow;
+        a[k] = (uint)d;
+        borrow = (uint)(d >> 63);
+    }
+    return borrow;
+}
+
+/* x = 2x mod m for x < m */
+void modDouble(uint* x, const uint* m, uint n) {
+    uint carry = 0;
+    for (uint k = 0; k < n; k++) {
+        uint next = x[k] >> 31;
+        x[k] = (x[k] << 1) | carry;
+        carry = next;
+    }
+    if (carry || compareLimbs(x, m, n) >= 0) subLimbs(x, m, n);
+}
+
+/* x = x * R mod m with R = 2^(32n), by repeated doubling */
+void toMontgomery(uint* x, const uint* m, uint n) {
+    for (uint i = 0; i < 32 * n; i++) modDouble(x, m, n);
+}
+
+/* -m^-1 mod 2^32 for odd m0 by Newton iteration */
+uint montInverse(uint m0) {
+    uint inv = m0;
+    for (int i = 0; i < 4; i++) inv *= 2 - m0 * inv;
+    return (uint)0 - inv;
+}
+
+/* r = a * b / R mod m (CIOS); r may alias a or b */
+void montMul(const uint* a, const uint* b, const uint* m, uint minv, uint n, uint* r) {
+    uint t[MFP_MAX_LIMBS + 2];
+    ulong s;
+    for (uint k = 0; k < n + 2; k++) t[k] = 0;
+    for (uint i = 0; i < n; i++) {
+        ulong carry = 0;
+        for (uint j = 0; j < n; j++) {
+            s = (ulong)t[j] + (ulong)a[j] * b[i] + carry;
+            t[j] = (uint)s;
+            carry = s >> 32;
+        }
+        s = (ulong)t[n] + carry;
+        t[n] = (uint)s;
+        t[n + 1] = (uint)(s >> 32);
+        
+        uint q = t[0] * minv;
+        carry = ((ulong)t[0] + (ulong)q * m[0]) >> 32;
+        for (uint j = 1; j < n; j++) {
+            s = (ulong)t[j] + (ulong)q * m[j] + carry;
+            t[j - 1] = (uint)s;
+            carry = s >> 32;
+        }
+        s = (ulong)t[n] + carry;
+        t[n - 1] = (uint)s;
+        t[n] = t[n + 1] + (uint)(s >> 32);
+    }
+    if (t[n] != 0 || compareLimbs(t, m, n) >= 0) subLimbs(t, m, n);
+    for (uint k = 0; k < n; k++) r[k] = t[k];
+}
+
+/* r = x^e in Montgomery form, left to right over the exponent bits */
+void montPow(const uint* x, const uint* e, uint e_limbs, const uint* m, uint minv, uint n, const uint* one, uint* r) {
+    uint acc[MFP_MAX_LIMBS];
+    for (uint k = 0; k < n; k++) acc[k] = one[k];
+    int top = (int)(32 * e_limbs) - 1;
+    while (top >= 0 && ((e[top >> 5] >> (top & 31)) & 1) == 0) top--;
+    for (int bit = top; bit >= 0; bit--) {
+        montMul(acc, acc, m, minv, n, acc);
+        if ((e[bit >> 5] >> (bit & 31)) & 1) montMul(acc, x, m, minv, n, acc);
+    }
+    for (uint k = 0; k < n; k++) r[k] = acc[k];
+}
+
+/* results = bases^exponents mod moduli; moduli odd, bases reduced below their modulus */
+MFP_KERNEL void montModExpBatch(MFP_GLOBAL const uint* bases, MFP_GLOBAL const uint* exponents,
+                                MFP_GLOBAL const uint* moduli, MFP_GLOBAL uint* results,
+                                uint lane_count, uint lane_stride, uint limb_count, uint exponent_limbs) {
+    uint lane = (uint)get_global_id(0);
+    if (lane >= lane_count) return;
+    
+    uint m[MFP_MAX_LIMBS];
+    uint x[MFP_MAX_LIMBS];
+    uint e[MFP_MAX_LIMBS];
+    uint one[MFP_MAX_LIMBS];
+    uint r[MFP_MAX_LIMBS];
+    loadLane(moduli, lane, lane_stride, limb_count, m);
+    loadLane(bases, lane, lane_stride, limb_count, x);
+    loadLane(exponents, lane, lane_stride, exponent_limbs, e);
+    uint n = laneLimbs(m, limb_count);
+    
+    for (uint k = 0; k < n; k++) one[k] = 0;
+    one[0] = 1;
+    uint minv = montInverse(m[0]);
+    toMontgomery(one, m, n);
+    toMontgomery(x, m, n);
+    montPow(x, e, exponent_limbs, m, minv, n, one, r);
+    
+    /* Leave Montgomery form by multiplying with plain 1 */
+    for (uint k = 0; k < n; k++) x[k] = 0;
+    x[0] = 1;
+    montMul(r, x, m, minv, n, r);
+    storeLane(results, lane, lane_stride, limb_count, r, n);
+}
+
+/* results = 1 if the lane is a strong probable prime to every base */
+MFP_KERNEL void sprpBatch(MFP_GLOBAL const uint* numbers, MFP_GLOBAL const uint* bases, MFP_GLOBAL uchar* results,
+                          uint lane_count, uint lane_stride, uint limb_count, uint base_count) {
+    uint lane = (uint)get_global_id(0);
+    if (lane >= lane_count) return;
+    
+    uint m[MFP_MAX_LIMBS];
+    uint d[MFP_MAX_LIMBS];
+    uint one[MFP_MAX_LIMBS];
+    uint minus_one[MFP_MAX_LIMBS];
+    uint x[MFP_MAX_LIMBS];
+    loadLane(numbers, lane, lane_stride, limb_count, m);
+    uint n = laneLimbs(m, limb_count);
+    
+    if (n == 1 && m[0] < 4) {
+        results[lane] = m[0] >= 2 ? 1 : 0;
+        return;
+    }
+    if ((m[0] & 1) == 0) {
+        results[lane] = 0;
+        return;
+    }
+    
+    /* m - 1 = d * 2^s */
+    for (uint k = 0; k < MFP_MAX_LIMBS; k++) d[k] = k < n ? m[k] : 0;
+    d[0] -= 1;
+    uint s = 0;
+    while (((d[s >> 5] >> (s & 31)) & 1) == 0) s++;
+    uint limb_shift = s >> 5;
+    uint bit_shift = s & 31;
+    for (uint k = 0; k < n; k++) {
+        uint lo = k + limb_shift < n ? d[k + limb_shift] : 0;
+        uint hi = k + limb_shift + 1 < n ? d[k + limb_shift + 1] : 0;
+        d[k] = bit_shift ? (lo >> bit_shift) | (hi << (32 - bit_shift)) : lo;
+    }
+    
+    uint minv = montInverse(m[0]);
+    for (uint k = 0; k < n; k++) one[k] = 0;
+    one[0] = 1;
+    toMontgomery(one, m, n);
+    for (uint k = 0; k < n; k++) minus_one[k] = m[k];
+    subLimbs(minus_one, one, n);
+    
+    for (uint b = 0; b < base_count; b++) {
+        uint a = bases[b];
+        if (n == 1) a %= m[0];
+        if (a == 0) continue;
+        
+        for (uint k = 0; k < n; k++) x[k] = 0;
+        x[0] = a;
+        toMontgomery(x, m, n);
+        montPow(x, d, n, m, minv, n, one, x);
+        if (compareLimbs(x, one, n) == 0 || compareLimbs(x, minus_one, n) == 0) continue;
+        
+        uint passed = 0;
+        for (uint r = 1; r < s && !passed; r++) {
+            montMul(x, x, m, minv, n, x);
+            if (compareLimbs(x, minus_one, n) == 0) passed = 1;
+            else if (compareLimbs(x, one, n) == 0) break;
+        }
+        if (!passed) {
+            results[lane] = 0;
+            return;
+        }
+    }
+    results[lane] = 1;
+}
+
+/* One work-item per sieving prime marks its multiples from max(p^2, low) */
+MFP_KERNEL void sieveMarkSegment(MFP_GLOBAL const uint* primes, MFP_GLOBAL uint* composite_bits,
+                                 uint prime_count, ulong low, uint length) {
+    uint j = (uint)get_global_id(0);
+    if (j >= prime_count) return;
+    
+    ulong p = primes[j];
+    ulong start = (low + p - 1) / p * p;
+    if (start < p * p) start = p * p;
+    for (ulong i = start - low; i < length; i += p) {
+        MFP_ATOMIC_OR(&composite_bits[i >> 5], (uint)1 << (uint)(i & 31));
+    }
+}
+
+)
+
+// Bases for the single-call primality test (deterministic below 3.3e24)
+const uint32_t SPRP_BASES[] = {2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37};
+
+// Host work-items per block when running kernels on the host pool
+const size_t HOST_BLOCK_SIZE = 64;
+
+// Candidates examined per nextPrime round
+const uint32_t NEXT_PRIME_WINDOW = 2048;
+
+// Run a kernel for every work-item in [0, global_size) on the host pool
+void runOnHost(ThreadPool& pool, size_t global_size, const std::function<void()>& kernel) {
+    size_t blocks = (global_size + HOST_BLOCK_SIZE - 1) / HOST_BLOCK_SIZE;
+    pool.parallelFor(blocks, [&](size_t block) {
+        size_t end = std::min(global_size, (block + 1) * HOST_BLOCK_SIZE);
+        for (size_t id = block * HOST_BLOCK_SIZE; id < end; id++) {
+            opencl_host::t_global_id = id;
+            kernel();
+        }
+    });
+}
+
+// Sieving primes below limit
+std::vector<uint32_t> smallPrimes(uint32_t limit) {
+    std::vector<uint8_t> composite(limit, 0);
+    std::vector<uint32_t> primes;
+    for (uint32_t i = 2; i < limit; i++) {
+        if (composite[i]) continue;
+        primes.push_back(i);
+        for (uint64_t j = static_cast<uint64_t>(i) * i; j < limit; j += i) {
+            composite[j] = 1;
+        }
+    }
+    return primes;
+}
+
+#ifdef __OPENCL__
+// Device buffer released on scope exit
+class CLBuffer {
+public:
+    CLBuffer(cl_context context, cl_mem_flags flags, size_t size_bytes, const void* host_ptr = nullptr) {
+        cl_int err = CL_SUCCESS;
+        m_mem = clCreateBuffer(context, flags, size_bytes, const_cast<void*>(host_ptr), &err);
+        if (err != CL_SUCCESS) {
+            m_mem = nullptr;
+        }
+    }
+    
+    ~CLBuffer() {
+        if (m_mem) {
+            clReleaseMemObject(m_mem);
+        }
+    }
+    
+    CLBuffer(const CLBuffer&) = delete;
+    CLBuffer& operator=(const CLBuffer&) = delete;
+    
+    cl_mem get() const { return m_mem; }
+    
+private:
+    cl_mem m_mem;
+};
+
+template<typename T>
+bool setArg(cl_kernel kernel, cl_uint index, const T& value) {
+    return clSetKernelArg(kernel, index, sizeof(T), &value) == CL_SUCCESS;
+}
+
+bool runKernel(cl_command_queue queue, cl_kernel kernel, size_t global_size) {
+    return clEnqueueNDRangeKernel(queue, kernel, 1, nullptr, &global_size, nullptr, 0, nullptr, nullptr) == CL_SUCCESS;
+}
+
+bool readBuffer(cl_command_queue queue, const CLBuffer& buffer, void* host_ptr, size_t size_bytes) {
+    return clEnqueueReadBuffer(queue, buffer.get(), CL_TRUE, 0, size_bytes, host_ptr, 0, nullptr, nullptr) == CL_SUCCESS;
+}
+#endif
+
+} // namespace
+
+// OpenCLAccelerator implementation
+OpenCLAccelerator::OpenCLAccelerator()
+    : m_initialized(false), m_emulated(false), m_is_gpu(false), m_compute_units(0),
+      m_device(nullptr), m_context(nullptr), m_queue(nullptr), m_program(nullptr),
+      m_kernel_mod_exp(nullptr), m_kernel_sprp(nullptr), m_kernel_sieve(nullptr) {
+}
+
+OpenCLAccelerator::~OpenCLAccelerator() {
+    release();
+}
+
+bool OpenCLAccelerator::initialize() {
+    release();
+
+#ifdef __OPENCL__
+    cl_uint platform_count = 0;
+    if (clGetPlatformIDs(0, nullptr, &platform_count) != CL_SUCCESS || platform_count == 0) {
+        return false;
+    }
+    
+    std::vector<cl_platform_id> platforms(platform_count);
+    if (clGetPlatformIDs(platform_count, platforms.data(), nullptr) != CL_SUCCESS) {
+        return false;
+    }
+    
+    // Prefer a GPU; otherwise take any device, e.g. PoCL on the CPU
+    cl_device_id device = nullptr;
+    for (cl_device_type type : {CL_DEVICE_TYPE_GPU, CL_DEVICE_TYPE_ALL}) {
+        for (cl_platform_id platform : platforms) {
+            if (clGetDeviceIDs(platform, type, 1, &device, nullptr) == CL_SUCCESS && device) {
+                break;
+            }
+            device = nullptr;
+        }
+        if (device) {
+            break;
+        }
+    }
+    
+    if (!device) {
+        return false;
+    }
+    m_device = device;
+    
+    char name[256] = {0};
+    clGetDeviceInfo(device, CL_DEVICE_NAME, sizeof(name) - 1, name, nullptr);
+    m_device_name = name;
+    
+    cl_device_type device_type = 0;
+    clGetDeviceInfo(device, CL_DEVICE_TYPE, sizeof(device_type), &device_type, nullptr);
+    m_is_gpu = (device_type & CL_DEVICE_TYPE_GPU) != 0;
+    
+    cl_uint compute_units = 0;
+    clGetDeviceInfo(device, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(compute_units), &compute_units, nullptr);
+    m_compute_units = static_cast<int>(compute_units);
+    
+    cl_int err = CL_SUCCESS;
+    m_context = clCreateContext(nullptr, 1, &device, nullptr, nullptr, &err);
+    if (err != CL_SUCCESS) {
+        m_context = nullptr;
+        return false;
+    }
+    
+    m_queue = clCreateCommandQueue(m_context, device, 0, &err);
+    if (err != CL_SUCCESS) {
+        m_queue = nullptr;
+        release();
+        return false;
+    }
+#else
+    // No runtime: the kernels run on a host pool
+    m_emulated = true;
+    m_device_name = "Host emulation (no OpenCL runtime)";
+    m_host_pool = std::make_unique<ThreadPool>();
+    m_compute_units = m_host_pool->getThreadCount();
+#endif
+
+    if (!loadKernels()) {
+        release();
+        return false;
+    }
+    
+    m_initialized = true;
+    return true;
+}
+
+bool OpenCLAccelerator::isAvailable() const {
+    return m_initialized;
+}
+
+bool OpenCLAccelerator::isEmulated() const {
+    return m_emulated;
+}
+
+bool OpenCLAccelerator::isGPU() const {
+    return m_is_gpu;
+}
+
+std::string OpenCLAccelerator::getDeviceName() const {
+    return m_device_name;
+}
+
+int OpenCLAccelerator::getParallelism() const {
+    return m_compute_units;
+}
+
+std::string OpenCLAccelerator::getDeviceProperties() const {
+    if (!m_initialized) {
+        return "OpenCL not initialized";
+    }
+    
+    std::stringstream ss;
+    ss << "OpenCL Device Properties:" << std::endl;
+    ss << "  Device: " << m_device_name << std::endl;
+    ss << "  Type: " << (m_emulated ? "Host emulation" : (m_is_gpu ? "GPU" : "Other (CPU/accelerator)")) << std::endl;
+    ss << "  Compute units: " << m_compute_units << std::endl;
+    ss << "  Maximum operand size: " << (OPENCL_MAX_LIMBS * LIMB_BITS) << " bits" << std::endl;
+    
+    return ss.str();
+}
+
+const std::string& OpenCLAccelerator::getBuildLog() const {
+    return m_build_log;
+}
+
+bool OpenCLAccelerator::modExpBatch(const std::vector<std::string>& bases, const std::vector<std::string>& exponents,
+                                    const std::vector<std::string>& moduli, std::vector<std::string>& results) {
+    if (!m_initialized || bases.size() != moduli.size() || exponents.size() != moduli.size()) {
+        return false;
+    }
+    
+    results.clear();
+    if (moduli.empty()) {
+        return true;
+    }
+    
+    // Reduce bases on the host; the kernel requires odd moduli and bases below them
+    std::vector<std::string> reduced(bases.size());
+    mpz_t base, modulus;
+    mpz_init(base);
+    mpz_init(modulus);
+    
+    bool valid = true;
+    for (size_t i = 0; i < moduli.size() && valid; i++) {
+        valid = mpz_set_str(base, bases[i].c_str(), 10) == 0 &&
+                mpz_set_str(modulus, moduli[i].c_str(), 10) == 0 &&
+                mpz_sgn(modulus) > 0 && mpz_odd_p(modulus);
+        if (valid) {
+            mpz_mod(base, base, modulus);
+            char* base_str = mpz_get_str(nullptr, 10, base);
+            reduced[i] = base_str;
+            freeGMPString(base_str);
+        }
+    }
+    
+    mpz_clear(base);
+    mpz_clear(modulus);
+    
+    PackedLimbBatch h_moduli, h_bases, h_exponents;
+    if (!valid || !packLimbs(moduli, h_moduli) || h_moduli.limb_count > OPENCL_MAX_LIMBS ||
+        !packLimbs(reduced, h_bases, h_moduli.limb_count) ||
+        !packLimbs(exponents, h_exponents) || h_exponents.limb_count > OPENCL_MAX_LIMBS) {
+        return false;
+    }
+    
+    PackedLimbBatch h_results;
+    resizeLimbBatch(h_results, h_moduli.lane_count, h_moduli.limb_count);
+    
+    uint32_t lane_count = static_cast<uint32_t>(h_moduli.lane_count);
+    uint32_t lane_stride = static_cast<uint32_t>(h_moduli.lane_stride);
+    uint32_t limb_count = static_cast<uint32_t>(h_moduli.limb_count);
+    uint32_t exponent_limbs = static_cast<uint32_t>(h_exponents.limb_count);
+
+#ifdef __OPENCL__
+    CLBuffer d_bases(m_context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, h_bases.byteSize(), h_bases.limbs.data());
+    CLBuffer d_exponents(m_context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, h_exponents.byteSize(), h_exponents.limbs.data());
+    CLBuffer d_moduli(m_context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, h_moduli.byteSize(), h_moduli.limbs.data());
+    CLBuffer d_results(m_context, CL_MEM_WRITE_ONLY, h_results.byteSize());
+    if (!d_bases.get() || !d_exponents.get() || !d_moduli.get() || !d_results.get()) {
+        return false;
+    }
+    
+    bool success = setArg(m_kernel_mod_exp, 0, d_bases.get()) &&
+                   setArg(m_kernel_mod_exp, 1, d_exponents.get()) &&
+                   setArg(m_kernel_mod_exp, 2, d_moduli.get()) &&
+                   setArg(m_kernel_mod_exp, 3, d_results.get()) &&
+                   setArg(m_kernel_mod_exp, 4, lane_count) &&
+                   setArg(m_kernel_mod_exp, 5, lane_stride) &&
+                   setArg(m_kernel_mod_exp, 6, limb_count) &&
+                   setArg(m_kernel_mod_exp, 7, exponent_limbs) &&
+                   runKernel(m_queue, m_kernel_mod_exp, lane_stride) &&
+                   readBuffer(m_queue, d_results, h_results.limbs.data(), h_results.byteSize());
+    if (!success) {
+        return false;
+    }
+#else
+    runOnHost(*m_host_pool, lane_stride, [&] {
+        opencl_host::montModExpBatch(h_bases.limbs.data(), h_exponents.limbs.data(), h_moduli.limbs.data(),
+                                     h_results.limbs.data(), lane_count, lane_stride, limb_count, exponent_limbs);
+    });
+#endif
+
+    results.reserve(lane_count);
+    for (size_t lane = 0; lane < lane_count; lane++) {
+        results.push_back(unpackLaneString(h_results, lane));
+    }
+    
+    return true;
+}
+
+bool OpenCLAccelerator::sprpBatch(const std::vector<std::string>& numbers, const std::vector<uint32_t>& bases,
+                                  std::vector<uint8_t>& results) {
+    if (!m_initialized) {
+        return false;
+    }
+    
+    PackedLimbBatch h_numbers;
+    if (!packLimbs(numbers, h_numbers)) {
+        return false;
+    }
+    
+    return launchSprp(h_numbers, bases, results);
+}
+
+bool OpenCLAccelerator::sieveSegment(uint64_t low, uint32_t length, const std::vector<uint32_t>& primes,
+                                     std::vector<uint32_t>& composite_bits) {
+    if (!m_initialized) {
+        return false;
+    }
+    
+    // Marking must not wrap past 2^64
+    uint64_t largest = primes.empty() ? 0 : *std::max_element(primes.begin(), primes.end());
+    if (low > UINT64_MAX - length - largest) {
+        return false;
+    }
+    
+    composite_bits.assign((length + 31) / 32, 0);
+    if (primes.empty() || length == 0) {
+        return true;
+    }
+    
+    uint32_t prime_count = static_cast<uint32_t>(primes.size());
+
+#ifdef __OPENCL__
+    CLBuffer d_primes(m_context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, primes.size() * sizeof(uint32_t), primes.data());
+    CLBuffer d_bits(m_context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, composite_bits.size() * sizeof(uint32_t), composite_bits.data());
+    if (!d_primes.get() || !d_bits.get()) {
+        return false;
+    }
+    
+    cl_ulong cl_low = low;
+    return setArg(m_kernel_sieve, 0, d_primes.get()) &&
+           setArg(m_kernel_sieve, 1, d_bits.get()) &&
+           setArg(m_kernel_sieve, 2, prime_count) &&
+           setArg(m_kernel_sieve, 3, cl_low) &&
+           setArg(m_kernel_sieve, 4, length) &&
+           runKernel(m_queue, m_kernel_sieve, prime_count) &&
+           readBuffer(m_queue, d_bits, composite_bits.data(), composite_bits.size() * sizeof(uint32_t));
+#else
+    runOnHost(*m_host_pool, prime_count, [&] {
+        opencl_host::sieveMarkSegment(primes.data(), composite_bits.data(), prime_count, low, length);
+    });
+    return true;
+#endif
+}
+
+bool OpenCLAccelerator::isPrime(const mpz_t number, bool& result) {
+    if (!m_initialized) {
+        return false;
+    }
+    
+    // A single number is a batch of one lane
+    mpz_t lane;
+    mpz_init_set(lane, number);
+    PackedLimbBatch h_numbers;
+    bool packed = packLimbs(&lane, 1, h_numbers);
+    mpz_clear(lane);
+    
+    std::vector<uint8_t> results;
+    std::vector<uint32_t> bases(std::begin(SPRP_BASES), std::end(SPRP_BASES));
+    if (!packed || !launchSprp(h_numbers, bases, results)) {
+        return false;
+    }
+    
+    result = results[0] != 0;
+    return true;
+}
+
+bool OpenCLAccelerator::isPrimeBatch(const std::vector<std::string>& numbers, std::vector<uint8_t>& results) {
+    std::vector<uint32_t> bases(std::begin(SPRP_BASES), std::end(SPRP_BASES));
+    return sprpBatch(numbers, bases, results);
+}
+
+bool OpenCLAccelerator::factorizeBatch(const std::vector<std::string>& numbers,
+                                       std::vector<std::vector<std::string>>& factors) {
+    (void)numbers;
+    (void)factors;
+    return false;
+}
+
+bool OpenCLAccelerator::nextPrime(const mpz_t number, mpz_t next_prime) {
+    if (!m_initialized) {
+        return false;
+    }
+    
+    // Primes up to 2^16 sieve every window below 2^32 completely
+    static const std::vector<uint32_t> sieve_primes = smallPrimes(1 << 16);
+    
+    mpz_t candidate;
+    mpz_init(candidate);
+    mpz_add_ui(candidate, number, 1);
+    if (mpz_cmp_ui(candidate, 2) < 0) {
+        mpz_set_ui(candidate, 2);
+    }
+    
+    std::vector<std::string> window;
+    std::vector<uint8_t> results;
+    std::vector<uint32_t> composite_bits;
+    bool found = false;
+    bool success = true;
+    
+    while (!found && success) {
+        window.clear();
+        
+        // Sieve the window on the device while it fits in 64 bits, otherwise test every odd candidate
+        if (mpz_sizeinbase(candidate, 2) <= 63) {
+            uint64_t low = mpz_get_ui(candidate);
+            success = sieveSegment(low, NEXT_PRIME_WINDOW, sieve_primes, composite_bits);
+            for (uint32_t i = 0; success && i < NEXT_PRIME_WINDOW; i++) {
+                if (!(composite_bits[i >> 5] & (1u << (i & 31)))) {
+                    window.push_back(std::to_string(low + i));
+                }
+            }
+        } else {
+            mpz_t value;
+            mpz_init(value);
+            for (uint32_t i = 0; i < NEXT_PRIME_WINDOW; i++) {
+                mpz_add_ui(value, candidate, i);
+                if (mpz_odd_p(value)) {
+                    char* value_str = mpz_get_str(nullptr, 10, value);
+                    window.push_back(value_str);
+                    freeGMPString(value_str);
+                }
+            }
+            mpz_clear(value);
+        }
+        
+        success = success && isPrimeBatch(window, results);
+        for (size_t i = 0; success && i < window.size(); i++) {
+            if (results[i]) {
+                mpz_set_str(next_prime, window[i].c_str(), 10);
+                found = true;
+                break;
+            }
+        }
+        
+        mpz_add_ui(candidate, candidate, NEXT_PRIME_WINDOW);
+    }
+    
+    mpz_clear(candidate);
+    return found;
+}
+
+double OpenCLAccelerator::benchmark(const mpz_t number) {
+    if (!m_initialized) {
+        return -1.0;
+    }
+    
+    // Measure time for isPrime operation
+    auto start = std::chrono::high_resolution_clock::now();
+    
+    bool is_prime_result;
+    bool success = isPrime(number, is_prime_result);
+    
+    auto end = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double, std::milli> elapsed = end - start;
+    
+    if (!success) {
+        return -1.0;
+    }
+    
+    return elapsed.count();
+}
+
+bool OpenCLAccelerator::loadKernels() {
+#ifdef __OPENCL__
+    cl_int err = CL_SUCCESS;
+    const char* source = OPENCL_PROGRAM_SOURCE;
+    m_program = clCreateProgramWithSource(m_context, 1, &source, nullptr, &err);
+    if (err != CL_SUCCESS) {
+        m_program = nullptr;
+        return false;
+    }
+    
+    if (clBuildProgram(m_program, 1, &m_device, "", nullptr, nullptr) != CL_SUCCESS) {
+        // Keep the compiler output so a failed build on a new device can be diagnosed
+        size_t log_size = 0;
+        clGetProgramBuildInfo(m_program, m_device, CL_PROGRAM_BUILD_LOG, 0, nullptr, &log_size);
+        std::vector<char> log(log_size + 1, 0);
+        clGetProgramBuildInfo(m_program, m_device, CL_PROGRAM_BUILD_LOG, log_size, log.data(), nullptr);
+        m_build_log = log.data();
+        return false;
+    }
+    
+    m_kernel_mod_exp = clCreateKernel(m_program, "montModExpBatch", &err);
+    if (err != CL_SUCCESS) {
+        m_kernel_mod_exp = nullptr;
+        return false;
+    }
+    
+    m_kernel_sprp = clCreateKernel(m_program, "sprpBatch", &err);
+    if (err != CL_SUCCESS) {
+        m_kernel_sprp = nullptr;
+        return false;
+    }
+    
+    m_kernel_sieve = clCreateKernel(m_program, "sieveMarkSegment", &err);
+    if (err != CL_SUCCESS) {
+        m_kernel_sieve = nullptr;
+        return false;
+    }
+    
+    return true;
+#else
+    // Kernels are compiled into the host build
+    return true;
+#endif
+}
+
+void OpenCLAccelerator::release() {
+#ifdef __OPENCL__
+    if (m_kernel_mod_exp) clReleaseKernel(m_kernel_mod_exp);
+    if (m_kernel_sprp) clReleaseKernel(m_kernel_sprp);
+    if (m_kernel_sieve) clReleaseKernel(m_kernel_sieve);
+    if (m_program) clReleaseProgram(m_program);
+    if (m_queue) clReleaseCommandQueue(m_queue);
+    if (m_context) clReleaseContext(m_context);
+#endif
+
+    m_kernel_mod_exp = nullptr;
+    m_kernel_sprp = nullptr;
+    m_kernel_sieve = nullptr;
+    m_program = nullptr;
+    m_queue = nullptr;
+    m_context = nullptr;
+    m_device = nullptr;
+    m_host_pool.reset();
+    m_compute_units = 0;
+    m_initialized = false;
+}
+
+bool OpenCLAccelerator::launchSprp(const PackedLimbBatch& h_numbers, const std::vector<uint32_t>& bases,
+                                   std::vector<uint8_t>& results) {
+    if (h_numbers.limb_count > OPENCL_MAX_LIMBS) {
+        return false;
+    }
+    
+    results.assign(h_numbers.lane_count, 0);
+    if (h_numbers.lane_count == 0) {
+        return true;
+    }
+    
+    uint32_t lane_count = static_cast<uint32_t>(h_numbers.lane_count);
+    uint32_t lane_stride = static_cast<uint32_t>(h_numbers.lane_stride);
+    uint32_t limb_count = static_cast<uint32_t>(h_numbers.limb_count);
+    uint32_t base_count = static_cast<uint32_t>(bases.size());
+
+#ifdef __OPENCL__
+    // Zero bases still needs a valid buffer
+    std::vector<uint32_t> h_bases(bases);
+    if (h_bases.empty()) {
+        h_bases.push_back(0);
+    }
+    
+    CLBuffer d_numbers(m_context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, h_numbers.byteSize(), h_numbers.limbs.data());
+    CLBuffer d_bases(m_context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, h_bases.size() * sizeof(uint32_t), h_bases.data());
+    CLBuffer d_results(m_context, CL_MEM_WRITE_ONLY, lane_stride);
+    if (!d_numbers.get() || !d_bases.get() || !d_results.get()) {
+        return false;
+    }
+    
+    return setArg(m_kernel_sprp, 0, d_numbers.get()) &&
+           setArg(m_kernel_sprp, 1, d_bases.get()) &&
+           setArg(m_kernel_sprp, 2, d_results.get()) &&
+           setArg(m_kernel_sprp, 3, lane_count) &&
+           setArg(m_kernel_sprp, 4, lane_stride) &&
+           setArg(m_kernel_sprp, 5, limb_count) &&
+           setArg(m_kernel_sprp, 6, base_count) &&
+           runKernel(m_queue, m_kernel_sprp, lane_stride) &&
+           readBuffer(m_queue, d_results, results.data(), lane_count);
+#else
+    runOnHost(*m_host_pool, lane_stride, [&] {
+        opencl_host::sprpBatch(h_numbers.limbs.data(), bases.data(), results.data(),
+                               lane_count, lane_stride, limb_count, base_count);
+    });
+    return true;
+#endif
+}
+
+// OpenCLMFP implementation
+OpenCLMFP::OpenCLMFP(std::shared_ptr<OpenCLAccelerator> device, int method_number) : m_device(device) {
+    switch (method_number) {
+        case 1:
+            m_host_method = std::make_unique<MFPMethod1>();
+            break;
+        case 3:
+            m_host_method = std::make_unique<MFPMethod3>();
+            break;
+        case 2:
+        default:
+            m_host_method = std::make_unique<MFPMethod2>();
+            break;
+    }
+}
+
+OpenCLMFP::~OpenCLMFP() {
+}
+
+bool OpenCLMFP::isPrime(const std::string& number) {
+    mpz_t n;
+    mpz_init(n);
+    
+    bool result = false;
+    bool success = mpz_set_str(n, number.c_str(), 10) == 0 && m_device->isPrime(n, result);
+    mpz_clear(n);
+    
+    // Numbers the device cannot take (too wide, malformed) go to the host method
+    return success ? result : m_host_method->isPrime(number);
+}
+
+std::vector<std::string> OpenCLMFP::factorize(const std::string& number) {
+    return m_host_method->factorize(number);
+}
+
+std::string OpenCLMFP::findNextPrime(const std::string& number) {
+    mpz_t n, next;
+    mpz_init(n);
+    mpz_init(next);
+    
+    std::string result;
+    if (mpz_set_str(n, number.c_str(), 10) == 0 && m_device->nextPrime(n, next)) {
+        char* next_str = mpz_get_str(nullptr, 10, next);
+        result = next_str;
+        freeGMPString(next_str);
+    } else {
+        result = m_host_method->findNextPrime(number);
+    }
+    
+    mpz_clear(n);
+    mpz_clear(next);
+    return result;
+}
+
+std::vector<uint8_t> OpenCLMFP::isPrimeBatch(const std::vector<std::string>& numbers) {
+    std::vector<uint8_t> results;
+    if (!m_device->isPrimeBatch(numbers, results)) {
+        results.clear();
+        for (const auto& number : numbers) {
+            results.push_back(m_host_method->isPrime(number) ? 1 : 0);
+        }
+    }
+    return results;
+}
+
+std::unique_ptr<MFPBase> createOpenCLMFP(int method_number, std::shared_ptr<OpenCLAccelerator> device) {
+    return std::make_unique<OpenCLMFP>(device, method_number);
+}
+
+} // namespace mfp
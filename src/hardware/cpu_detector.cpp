@@ -4,6 +4,8 @@
 #include <regex>
 #include <thread>
 #include <iostream>
+#include <set>
+#include <algorithm>
 
 #ifdef __linux__
 #include <unistd.h>
@@ -20,6 +22,46 @@
 
 namespace mfp {
 
+namespace {
+
+// Parse a sysfs CPU list such as "0-7,16,18-19"
+std::vector<int> parseCPUList(const std::string& list) {
+    std::vector<int> cpus;
+    std::stringstream ss(list);
+    std::string range;
+    
+    while (std::getline(ss, range, ',')) {
+        if (range.empty()) {
+            continue;
+        }
+        
+        try {
+            size_t dash = range.find('-');
+            int first = std::stoi(range.substr(0, dash));
+            int last = (dash == std::string::npos) ? first : std::stoi(range.substr(dash + 1));
+            for (int cpu = first; cpu <= last; cpu++) {
+                cpus.push_back(cpu);
+            }
+        } catch (const std::exception& e) {
+            // Ignore malformed entries
+        }
+    }
+    
+    return cpus;
+}
+
+// Read the first line of a sysfs file, empty if it does not exist
+std::string readSysfsLine(const std::string& path) {
+    std::ifstream file(path);
+    std::string line;
+    if (file.is_open()) {
+        std::getline(file, line);
+    }
+    return line;
+}
+
+} // namespace
+
 CPUInfo::CPUInfo() {
     // Initialize with defaults
 }
@@ -40,6 +82,16 @@ void CPUInfo::detect() {
     m_topology.logical_cores = std::thread::hardware_concurrency();
     m_topology.physical_cores = m_topology.logical_cores;
 #endif
+
+    // Without core class information, treat all logical CPUs as identical
+    if (m_topology.cpus.empty()) {
+        for (int i = 0; i < m_topology.logical_cores; i++) {
+            LogicalCPU cpu;
+            cpu.id = i;
+            cpu.max_mhz = m_frequency.max_mhz;
+            m_topology.cpus.push_back(cpu);
+        }
+    }
 }
 
 int CPUInfo::getOptimalThreadCount(bool memory_intensive, bool io_intensive) const {
@@ -64,6 +116,17 @@ int CPUInfo::getOptimalThreadCount(bool memory_intensive, bool io_intensive) con
     return thread_count;
 }
 
+std::vector<LogicalCPU> CPUInfo::getCPUsBySpeed() const {
+    std::vector<LogicalCPU> cpus = m_topology.cpus;
+    
+    // Stable sort keeps sibling CPUs of the same class in id order
+    std::stable_sort(cpus.begin(), cpus.end(), [](const LogicalCPU& a, const LogicalCPU& b) {
+        return a.capacity > b.capacity;
+    });
+    
+    return cpus;
+}
+
 bool CPUInfo::hasFeature(const std::string& feature_name) const {
     if (feature_name == "sse") return m_features.has_sse;
     if (feature_name == "sse2") return m_features.has_sse2;
@@ -104,6 +167,11 @@ std::string CPUInfo::getSummary() const {
     ss << "  Cores: " << m_topology.physical_cores << " physical, " 
        << m_topology.logical_cores << " logical" << std::endl;
     
+    if (m_topology.is_hybrid) {
+        ss << "  Hybrid: " << m_topology.performance_cpus << " performance, "
+           << m_topology.efficiency_cpus << " efficiency logical CPUs" << std::endl;
+    }
+    
     ss << "  Frequency: " << m_frequency.base_mhz << " MHz base";
     if (m_frequency.max_mhz > 0) {
         ss << ", " << m_frequency.max_mhz << " MHz max";
@@ -203,7 +271,6 @@ void CPUInfo::detectOnLinux() {
     }
     
     // Try to get physical core count from topology
-    int physical_cores = 0;
     std::set<std::string> core_ids;
     
     for (int i = 0; i < m_topology.logical_cores; i++) {
@@ -258,6 +325,9 @@ void CPUInfo::detectOnLinux() {
     // Base frequency is harder to get, use max as fallback
     m_frequency.base_mhz = m_frequency.max_mhz;
     
+    // Detect performance/efficiency core classes
+    detectCoreClassesOnLinux();
+    
     // Get cache information
     std::ifstream l1d_cache("/sys/devices/system/cpu/cpu0/cache/index0/size");
     if (l1d_cache.is_open()) {
@@ -288,6 +358,91 @@ void CPUInfo::detectOnLinux() {
     }
 }
 
+void CPUInfo::detectCoreClassesOnLinux() {
+    m_topology.cpus.clear();
+    
+    // Intel hybrid CPUs expose one PMU per core class
+    std::vector<int> pcore_list = parseCPUList(readSysfsLine("/sys/bus/event_source/devices/cpu_core/cpus"));
+    std::vector<int> ecore_list = parseCPUList(readSysfsLine("/sys/bus/event_source/devices/cpu_atom/cpus"));
+    std::set<int> pcores(pcore_list.begin(), pcore_list.end());
+    std::set<int> ecores(ecore_list.begin(), ecore_list.end());
+    
+    bool has_capacity = false;
+    int max_capacity = 0;
+    double max_mhz = 0.0;
+    
+    for (int i = 0; i < m_topology.logical_cores; i++) {
+        LogicalCPU cpu;
+        cpu.id = i;
+        
+        // cpu_capacity is provided by the scheduler on ARM big.LITTLE and recent x86 hybrid kernels
+        std::string base = "/sys/devices/system/cpu/cpu" + std::to_string(i);
+        std::string capacity_str = readSysfsLine(base + "/cpu_capacity");
+        if (!capacity_str.empty()) {
+            try {
+                cpu.capacity = std::stoi(capacity_str);
+                has_capacity = true;
+            } catch (const std::exception& e) {
+                // Keep the default capacity
+            }
+        }
+        
+        std::string freq_str = readSysfsLine(base + "/cpufreq/cpuinfo_max_freq");
+        if (!freq_str.empty()) {
+            try {
+                cpu.max_mhz = std::stod(freq_str) / 1000.0;
+            } catch (const std::exception& e) {
+                // Frequency unknown
+            }
+        }
+        
+        max_capacity = std::max(max_capacity, cpu.capacity);
+        max_mhz = std::max(max_mhz, cpu.max_mhz);
+        m_topology.cpus.push_back(cpu);
+    }
+    
+    // Without cpu_capacity, estimate relative capacity from the maximum frequency
+    if (!has_capacity && max_mhz > 0.0) {
+        for (auto& cpu : m_topology.cpus) {
+            if (cpu.max_mhz > 0.0) {
+                cpu.capacity = static_cast<int>(1024.0 * cpu.max_mhz / max_mhz);
+            }
+        }
+        max_capacity = 1024;
+    }
+    
+    // Classify cores: PMU membership wins, otherwise compare capacities
+    int min_capacity = max_capacity;
+    for (const auto& cpu : m_topology.cpus) {
+        min_capacity = std::min(min_capacity, cpu.capacity);
+    }
+    
+    bool pmu_hybrid = !pcores.empty() && !ecores.empty();
+    bool capacity_hybrid = min_capacity < max_capacity;
+    
+    m_topology.is_hybrid = pmu_hybrid || capacity_hybrid;
+    m_topology.performance_cpus = 0;
+    m_topology.efficiency_cpus = 0;
+    
+    if (!m_topology.is_hybrid) {
+        return;
+    }
+    
+    for (auto& cpu : m_topology.cpus) {
+        if (pmu_hybrid) {
+            cpu.type = ecores.count(cpu.id) ? CoreType::EFFICIENCY : CoreType::PERFORMANCE;
+        } else {
+            cpu.type = (cpu.capacity == max_capacity) ? CoreType::PERFORMANCE : CoreType::EFFICIENCY;
+        }
+        
+        if (cpu.type == CoreType::PERFORMANCE) {
+            m_topology.performance_cpus++;
+        } else {
+            m_topology.efficiency_cpus++;
+        }
+    }
+}
+
 void CPUInfo::detectOnMacOS() {
 #ifdef __APPLE__
     // Get CPU brand string
@@ -0,0 +1,208 @@
+#include "hybrid_scheduler.h"
+#include "mfp_method1.h"
+#include "mfp_method2.h"
+#include "mfp_method3.h"
+#include <gmp.h>
+#include <algorithm>
+#include <chrono>
+
+namespace mfp {
+
+namespace {
+
+// Weight of the newest batch in the throughput estimates
+const double THROUGHPUT_SMOOTHING = 0.3;
+
+// Both sides always get a slice of large batches so their throughput stays measured
+const double MIN_SIDE_SHARE = 0.05;
+
+} // namespace
+
+HybridScheduler::HybridScheduler(std::shared_ptr<BatchAccelerator> device,
+                                 std::shared_ptr<MFPBase> host_method,
+                                 std::shared_ptr<ThreadPool> host_pool)
+    : m_device(device), m_host_method(host_method), m_host_pool(host_pool) {
+    // Until measured, assume both sides deliver the same throughput per lane
+    m_device_throughput = (m_device && m_device->isAvailable()) ? m_device->getParallelism() : 0.0;
+    m_host_throughput = m_host_pool ? m_host_pool->getThreadCount() + 1 : 1.0;
+}
+
+HybridScheduler::~HybridScheduler() {
+    // Nothing to clean up
+}
+
+std::vector<uint8_t> HybridScheduler::isPrimeBatch(const std::vector<std::string>& numbers) {
+    std::vector<uint8_t> results(numbers.size(), 0);
+    size_t device_items = deviceCount(numbers.size());
+    size_t host_items = numbers.size() - device_items;
+    
+    // Host share runs on the host pool while this thread drives the device
+    auto start = std::chrono::steady_clock::now();
+    std::future<double> host_done = m_host_pool->submit([&]() {
+        m_host_pool->parallelFor(host_items, [&](size_t i) {
+            results[device_items + i] = m_host_method->isPrime(numbers[device_items + i]) ? 1 : 0;
+        });
+        auto end = std::chrono::steady_clock::now();
+        return std::chrono::duration<double, std::milli>(end - start).count();
+    });
+    
+    double device_ms = 0.0;
+    bool device_ran = false;
+    if (device_items > 0) {
+        std::vector<std::string> device_numbers(numbers.begin(), numbers.begin() + device_items);
+        std::vector<uint8_t> device_results;
+        device_ran = m_device->isPrimeBatch(device_numbers, device_results);
+        if (device_ran) {
+            std::copy(device_results.begin(), device_results.end(), results.begin());
+            auto end = std::chrono::steady_clock::now();
+            device_ms = std::chrono::duration<double, std::milli>(end - start).count();
+        }
+    }
+    
+    double host_ms = host_done.get();
+    if (device_items > 0 && !device_ran) {
+        // The device refused its share, so the host runs it and the device estimate stands
+        m_host_pool->parallelFor(device_items, [&](size_t i) {
+            results[i] = m_host_method->isPrime(numbers[i]) ? 1 : 0;
+        });
+        device_items = 0;
+    }
+    updateThroughput(device_items, device_ms, host_items, host_ms);
+    
+    return results;
+}
+
+std::vector<std::vector<std::string>> HybridScheduler::factorizeBatch(const std::vector<std::string>& numbers) {
+    std::vector<std::vector<std::string>> results(numbers.size());
+    size_t device_items = deviceCount(numbers.size());
+    size_t host_items = numbers.size() - device_items;
+    
+    auto start = std::chrono::steady_clock::now();
+    std::future<double> host_done = m_host_pool->submit([&]() {
+        m_host_pool->parallelFor(host_items, [&](size_t i) {
+            results[device_items + i] = m_host_method->factorize(numbers[device_items + i]);
+        });
+        auto end = std::chrono::steady_clock::now();
+        return std::chrono::duration<double, std::milli>(end - start).count();
+    });
+    
+    double device_ms = 0.0;
+    bool device_ran = false;
+    if (device_items > 0) {
+        std::vector<std::string> device_numbers(numbers.begin(), numbers.begin() + device_items);
+        std::vector<std::vector<std::string>> device_results;
+        device_ran = m_device->factorizeBatch(device_numbers, device_results);
+        if (device_ran) {
+            std::move(device_results.begin(), device_results.end(), results.begin());
+            auto end = std::chrono::steady_clock::now();
+            device_ms = std::chrono::duration<double, std::milli>(end - start).count();
+        }
+    }
+    
+    double host_ms = host_done.get();
+    if (device_items > 0 && !device_ran) {
+        m_host_pool->parallelFor(device_items, [&](size_t i) {
+            results[i] = m_host_method->factorize(numbers[i]);
+        });
+        device_items = 0;
+    }
+    updateThroughput(device_items, device_ms, host_items, host_ms);
+    
+    return results;
+}
+
+double HybridScheduler::getDeviceShare() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    double total = m_device_throughput + m_host_throughput;
+    return total > 0.0 ? m_device_throughput / total : 0.0;
+}
+
+double HybridScheduler::getDeviceThroughput() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_device_throughput;
+}
+
+double HybridScheduler::getHostThroughput() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_host_throughput;
+}
+
+size_t HybridScheduler::deviceCount(size_t batch_size) const {
+    if (!m_device || !m_device->isAvailable()) {
+        return 0;
+    }
+    
+    double share = getDeviceShare();
+    if (batch_size >= static_cast<size_t>(2.0 / MIN_SIDE_SHARE)) {
+        share = std::min(std::max(share, MIN_SIDE_SHARE), 1.0 - MIN_SIDE_SHARE);
+    }
+    
+    return std::min(batch_size, static_cast<size_t>(share * batch_size + 0.5));
+}
+
+void HybridScheduler::updateThroughput(size_t device_items, double device_ms, size_t host_items, double host_ms) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    
+    if (device_items > 0 && device_ms > 0.0) {
+        double measured = device_items / device_ms;
+        m_device_throughput += THROUGHPUT_SMOOTHING * (measured - m_device_throughput);
+    }
+    
+    if (host_items > 0 && host_ms > 0.0) {
+        double measured = host_items / host_ms;
+        m_host_throughput += THROUGHPUT_SMOOTHING * (measured - m_host_throughput);
+    }
+}
+
+HybridMFP::HybridMFP(std::shared_ptr<BatchAccelerator> device, int method_number) {
+    // The host pool provides the parallelism, so Method 3 runs single-threaded per item
+    switch (method_number) {
+        case 1:
+            m_host_method = std::make_shared<MFPMethod1>();
+            break;
+        case 3:
+            m_host_method = std::make_shared<MFPMethod3>(1);
+            break;
+        case 2:
+        default:
+            m_host_method = std::make_shared<MFPMethod2>();
+            break;
+    }
+    
+    auto host_pool = std::make_shared<ThreadPool>();
+    m_scheduler = std::make_unique<HybridScheduler>(device, m_host_method, host_pool);
+}
+
+HybridMFP::~HybridMFP() {
+    // Scheduler and pools are released by their owners
+}
+
+bool HybridMFP::isPrime(const std::string& number) {
+    return m_host_method->isPrime(number);
+}
+
+std::vector<std::string> HybridMFP::factorize(const std::string& number) {
+    return m_host_method->factorize(number);
+}
+
+std::string HybridMFP::findNextPrime(const std::string& number) {
+    return m_host_method->findNextPrime(number);
+}
+
+std::vector<uint8_t> HybridMFP::isPrimeBatch(const std::vector<std::string>& numbers) {
+    return m_scheduler->isPrimeBatch(numbers);
+}
+
+std::vector<std::vector<std::string>> HybridMFP::factorizeBatch(const std::vector<std::string>& numbers) {
+    return m_scheduler->factorizeBatch(numbers);
+}
+
+HybridScheduler& HybridMFP::getScheduler() {
+    return *m_scheduler;
+}
+
+std::unique_ptr<MFPBase> createHybridMFP(int method_number, std::shared_ptr<BatchAccelerator> device) {
+    return std::make_unique<HybridMFP>(device, method_number);
+}
+
+} // namespace mfp
@@ -0,0 +1,271 @@
+#include "job_scheduler.h"
+#include "factor_graph.h"
+#include <algorithm>
+#include <exception>
+
+namespace mfp {
+
+namespace {
+
+uint64_t nanosecondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+} // namespace
+
+JobScheduler::JobScheduler(MethodFactory factory, const SchedulerParams& params)
+    : m_factory(std::move(factory)),
+      m_params(params),
+      m_epoch(std::chrono::steady_clock::now()),
+      m_idle(0),
+      m_long_running(0),
+      m_stopping(false) {
+    int workers = params.num_workers;
+    if (workers <= 0) {
+        workers = std::thread::hardware_concurrency();
+        if (workers <= 0) workers = 1; // Fallback to single thread
+    }
+    m_params.num_workers = workers;
+    m_params.aging_ms = std::max<uint64_t>(1, params.aging_ms);
+    
+    // Long jobs leave one worker for the rest; with one worker, checkpoints do
+    m_max_long = workers > 1 ? workers - 1 : 1;
+    
+    for (auto& queued : m_queued) {
+        queued.store(0);
+    }
+    for (int i = 0; i < workers; i++) {
+        m_workers.emplace_back([this] { workerLoop(); });
+    }
+}
+
+JobScheduler::~JobScheduler() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+        
+        // Queued jobs are abandoned; their futures report a broken promise
+        for (auto& queue : m_queues) {
+            queue.clear();
+        }
+        for (auto& queued : m_queued) {
+            queued.store(0);
+        }
+    }
+    m_cv.notify_all();
+    
+    for (auto& worker : m_workers) {
+        worker.join();
+    }
+}
+
+std::future<JobResult> JobScheduler::submit(MetricsOperation operation, const std::string& number) {
+    return submit(operation, number, m_params.default_options);
+}
+
+std::future<JobResult> JobScheduler::submit(MetricsOperation operation, const std::string& number,
+                                            const JobOptions& options) {
+    auto job = std::make_unique<Job>();
+    job->operation = operation;
+    job->number = number;
+    job->options = options;
+    job->size_class = classify(operation, decimalBitLength(number));
+    job->queued = std::chrono::steady_clock::now();
+    std::future<JobResult> future = job->promise.get_future();
+    
+    int64_t aging_ns = static_cast<int64_t>(m_params.aging_ms) * 1000000;
+    int64_t waited_from = std::chrono::duration_cast<std::chrono::nanoseconds>(job->queued - m_epoch).count();
+    int64_t key = static_cast<int64_t>(options.priority) * aging_ns - waited_from;
+    
+    size_t size_class = static_cast<size_t>(job->size_class);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_queues[size_class].emplace(key, std::move(job));
+        m_queued[size_class]++;
+        m_stats.submitted[size_class]++;
+    }
+    m_cv.notify_one();
+    
+    return future;
+}
+
+SizeClass JobScheduler::classify(MetricsOperation operation, size_t bits) {
+    if (operation == MetricsOperation::FACTORIZE) {
+        return bits <= 128 ? SizeClass::SHORT : SizeClass::LONG;
+    }
+    return bits <= 1024 ? SizeClass::SHORT : SizeClass::MEDIUM;
+}
+
+size_t JobScheduler::getQueueLength(SizeClass size_class) const {
+    return m_queued[static_cast<size_t>(size_class)].load();
+}
+
+SchedulerStats JobScheduler::getStats() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats;
+}
+
+int JobScheduler::getWorkerCount() const {
+    return m_params.num_workers;
+}
+
+void JobScheduler::workerLoop() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+        std::unique_ptr<Job> job = takeJob(SIZE_CLASS_COUNT, m_long_running < m_max_long);
+        if (!job) {
+            if (m_stopping) {
+                return;
+            }
+            m_idle++;
+            m_cv.wait(lock);
+            m_idle--;
+            continue;
+        }
+        
+        bool is_long = job->size_class == SizeClass::LONG;
+        if (is_long) {
+            m_long_running++;
+        }
+        lock.unlock();
+        runJob(*job);
+        lock.lock();
+        if (is_long) {
+            // A long job that was held back may run now
+            m_long_running--;
+            m_cv.notify_one();
+        }
+    }
+}
+
+std::unique_ptr<JobScheduler::Job> JobScheduler::takeJob(size_t class_limit, bool allow_long) {
+    // Called with the lock held. Shorter classes win ties.
+    int64_t boost = static_cast<int64_t>(m_params.class_boost) * static_cast<int64_t>(m_params.aging_ms) * 1000000;
+    Queue* best = nullptr;
+    int64_t best_score = 0;
+    size_t best_class = 0;
+    for (size_t size_class = 0; size_class < std::min(class_limit, SIZE_CLASS_COUNT); size_class++) {
+        Queue& queue = m_queues[size_class];
+        if (queue.empty() || (size_class == static_cast<size_t>(SizeClass::LONG) && !allow_long)) {
+            continue;
+        }
+        int64_t score = queue.begin()->first + static_cast<int64_t>(SIZE_CLASS_COUNT - 1 - size_class) * boost;
+        if (best == nullptr || score > best_score) {
+            best = &queue;
+            best_score = score;
+            best_class = size_class;
+        }
+    }
+    if (best == nullptr) {
+        return nullptr;
+    }
+    
+    std::unique_ptr<Job> job = std::move(best->begin()->second);
+    best->erase(best->begin());
+    m_queued[best_class]--;
+    return job;
+}
+
+void JobScheduler::runJob(Job& job) {
+    RunState state;
+    state.size_class = job.size_class;
+    state.budget_ns = job.options.budget_ms * 1000000;
+    state.start = std::chrono::steady_clock::now();
+    
+    JobResult result;
+    result.queued_nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(state.start - job.queued).count();
+    std::exception_ptr error;
+    try {
+        std::unique_ptr<MFPBase> method = m_factory();
+        CallControl control;
+        control.checkpoint = [this, &state] { return checkpoint(state); };
+        CallControlScope control_scope(std::move(control));
+        switch (job.operation) {
+            case MetricsOperation::IS_PRIME:
+                result.is_prime = method->isPrime(job.number);
+                break;
+            case MetricsOperation::FACTORIZE:
+                if (m_params.factor_pool) {
+                    FactorGraph graph(*method, *m_params.factor_pool);
+                    result.prime_factors = graph.factorize(job.number);
+                    result.factors = expandPrimeFactors(result.prime_factors);
+                } else {
+                    result.factors = method->factorize(job.number);
+                }
+                break;
+            case MetricsOperation::NEXT_PRIME:
+                result.next_prime = method->findNextPrime(job.number);
+                break;
+        }
+    } catch (...) {
+        error = std::current_exception();
+    }
+    
+    // Engines stopped part way leave nothing worth returning
+    if (state.stopped) {
+        result.status = JobStatus::BUDGET_EXCEEDED;
+        result.is_prime = false;
+        result.factors.clear();
+        result.prime_factors.clear();
+        result.next_prime.clear();
+    }
+    uint64_t elapsed = nanosecondsSince(state.start);
+    result.run_nanoseconds = elapsed - std::min<uint64_t>(elapsed, state.preempted_ns);
+    
+    // Counted before the caller can see the result
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stats.completed[static_cast<size_t>(job.size_class)]++;
+        if (state.stopped) {
+            m_stats.budget_exceeded++;
+        }
+    }
+    if (error) {
+        job.promise.set_exception(error);
+    } else {
+        job.promise.set_value(std::move(result));
+    }
+}
+
+bool JobScheduler::checkpoint(RunState& state) {
+    if (m_stopping || state.stopped.load(std::memory_order_relaxed)) {
+        state.stopped = true;
+        return true;
+    }
+    
+    // Shorter jobs waiting with every worker busy: run one here, one thread
+    // of this job at a time, and leave its time out of this job's budget
+    size_t limit = static_cast<size_t>(state.size_class);
+    size_t shorter = 0;
+    for (size_t size_class = 0; size_class < limit; size_class++) {
+        shorter += m_queued[size_class].load(std::memory_order_relaxed);
+    }
+    if (shorter > 0 && m_idle.load(std::memory_order_relaxed) == 0 && !state.serving.exchange(true)) {
+        std::unique_ptr<Job> job;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            job = takeJob(limit, false);
+        }
+        if (job) {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_stats.preemptions++;
+            }
+            auto start = std::chrono::steady_clock::now();
+            runJob(*job);
+            state.preempted_ns += nanosecondsSince(start);
+        }
+        state.serving = false;
+    }
+    
+    if (state.budget_ns != 0) {
+        uint64_t elapsed = nanosecondsSince(state.start);
+        if (elapsed - std::min<uint64_t>(elapsed, state.preempted_ns) > state.budget_ns) {
+            state.stopped = true;
+            return true;
+        }
+    }
+    return false;
+}
+
+} // namespace mfp
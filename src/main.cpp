@@ -2,7 +2,22 @@
 #include <string>
 #include <vector>
 #include <chrono>
+#include <ctime>
+#include <algorithm>
+#include <memory>
+#include <fstream>
+#include <stdexcept>
+#include <gmp.h>
 #include "mfp_system.h"
+#include "metrics.h"
+#include "perf_counters.h"
+#include "trace.h"
+#include "memory_accounting.h"
+#include "hybrid_scheduler.h"
+#include "gpu/cpu_emulated_accelerator.h"
+#include "factor/range_factorizer.h"
+#include "factor/prime_tuple.h"
+#include "factor/interval_primes.h"
 
 void printUsage(const char* programName) {
     std::cout << "Usage: " << programName << " [options] <command> [arguments]" << std::endl;
@@ -10,16 +25,52 @@ void printUsage(const char* programName) {
     std::cout << "Commands:" << std::endl;
     std::cout << "  isprime <number>              Check if a number is prime" << std::endl;
     std::cout << "  factorize <number>            Find prime factors of a number" << std::endl;
+    std::cout << "  factorpowers <number>         Factor completely into prime powers, splitting cofactors concurrently" << std::endl;
+    std::cout << "  factorstream <number>         Print each prime power with the remaining cofactor as soon as it is found" << std::endl;
     std::cout << "  nextprime <number>            Find the next prime number" << std::endl;
     std::cout << "  benchmark <number>            Run benchmark on all methods" << std::endl;
+    std::cout << "  hybridbench <bits>            Load-test the hybrid scheduler on the CPU-emulated device" << std::endl;
+    std::cout << "  factorrange <low> <high>      Factor every integer in [low, high) with a segmented sieve" << std::endl;
+    std::cout << "  primerange <low> <high>       List the primes in [low, high), for bounds of any size" << std::endl;
+    std::cout << "  safeprime <bits>              Generate a random safe prime 2q + 1 with a sieved tuple search" << std::endl;
     std::cout << std::endl;
     std::cout << "Options:" << std::endl;
-    std::cout << "  --method <1|2|3|auto>         Select MFP method (default: auto)" << std::endl;
+    std::cout << "  --method <1|2|3|portfolio|auto> Select MFP method (default: auto)" << std::endl;
     std::cout << "  --threads <num>               Number of threads to use (default: all cores)" << std::endl;
+    std::cout << "  --batch <size>                Batch size for hybridbench (default: 2048)" << std::endl;
+    std::cout << "  --metrics-file <path>         Write a Prometheus metrics snapshot after the command" << std::endl;
+    std::cout << "  --perf-counters               Show per-stage hardware counters (Linux perf_event_open)" << std::endl;
+    std::cout << "  --trace-file <path>           Write a Chrome/Perfetto trace of engine threads after the command" << std::endl;
+    std::cout << "  --memory-stats                Show GMP and buffer allocations per request and per thread" << std::endl;
+    std::cout << "  --hex                         Print the factors of factorize in hexadecimal" << std::endl;
+    std::cout << "  --shadow <1|2|3|auto>         Rerun calls on another method in the background and compare" << std::endl;
+    std::cout << "  --shadow-rate <fraction>      Fraction of calls to shadow (default: 1)" << std::endl;
     std::cout << "  --help                        Display this help message" << std::endl;
     std::cout << "  --version                     Display version information" << std::endl;
 }
 
+bool parseMethod(const std::string& methodStr, mfp::MFPMethodType& method) {
+    if (methodStr == "1") {
+        method = mfp::MFPMethodType::METHOD_1;
+    } else if (methodStr == "2") {
+        method = mfp::MFPMethodType::METHOD_2;
+    } else if (methodStr == "3") {
+        method = mfp::MFPMethodType::METHOD_3;
+    } else if (methodStr == "portfolio") {
+        method = mfp::MFPMethodType::PORTFOLIO;
+    } else if (methodStr == "auto") {
+        method = mfp::MFPMethodType::AUTO;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+void printRequestMemory(const mfp::MemoryUsage& usage) {
+    std::cout << "Memory: " << usage.allocations << " allocations, " << usage.allocated_bytes
+              << " bytes allocated, " << usage.peak_live_bytes << " bytes peak" << std::endl;
+}
+
 void printVersion() {
     std::cout << "MFP Implementation v1.0.0" << std::endl;
     std::cout << "Modular Factorization Pattern algorithm by Marlon F. Polegato" << std::endl;
@@ -30,8 +81,18 @@ int main(int argc, char* argv[]) {
     // Default values
     mfp::MFPMethodType method = mfp::MFPMethodType::AUTO;
     int numThreads = 0; // 0 means use all available cores
+    int batchSize = 2048;
+    std::string metricsFile;
+    bool perfCounters = false;
+    std::string traceFile;
+    bool memoryStats = false;
+    bool hexOutput = false;
+    bool shadow = false;
+    mfp::MFPMethodType shadowMethod = mfp::MFPMethodType::METHOD_1;
+    double shadowRate = 1.0;
     std::string command;
     std::string number;
+    std::string secondNumber;
     
     // Parse command line arguments
     for (int i = 1; i < argc; ++i) {
@@ -46,15 +107,7 @@ int main(int argc, char* argv[]) {
         } else if (arg == "--method" || arg == "-m") {
             if (i + 1 < argc) {
                 std::string methodStr = argv[++i];
-                if (methodStr == "1") {
-                    method = mfp::MFPMethodType::METHOD_1;
-                } else if (methodStr == "2") {
-                    method = mfp::MFPMethodType::METHOD_2;
-                } else if (methodStr == "3") {
-                    method = mfp::MFPMethodType::METHOD_3;
-                } else if (methodStr == "auto") {
-                    method = mfp::MFPMethodType::AUTO;
-                } else {
+                if (!parseMethod(methodStr, method)) {
                     std::cerr << "Invalid method: " << methodStr << std::endl;
                     return 1;
                 }
@@ -78,10 +131,76 @@ int main(int argc, char* argv[]) {
                 std::cerr << "Missing threads argument" << std::endl;
                 return 1;
             }
+        } else if (arg == "--batch" || arg == "-b") {
+            if (i + 1 < argc) {
+                try {
+                    batchSize = std::stoi(argv[++i]);
+                    if (batchSize <= 0) {
+                        std::cerr << "Batch size must be positive" << std::endl;
+                        return 1;
+                    }
+                } catch (const std::exception& e) {
+                    std::cerr << "Invalid batch size: " << argv[i] << std::endl;
+                    return 1;
+                }
+            } else {
+                std::cerr << "Missing batch argument" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--metrics-file") {
+            if (i + 1 < argc) {
+                metricsFile = argv[++i];
+            } else {
+                std::cerr << "Missing metrics file argument" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--perf-counters") {
+            perfCounters = true;
+        } else if (arg == "--shadow") {
+            if (i + 1 < argc) {
+                std::string methodStr = argv[++i];
+                if (!parseMethod(methodStr, shadowMethod)) {
+                    std::cerr << "Invalid shadow method: " << methodStr << std::endl;
+                    return 1;
+                }
+                shadow = true;
+            } else {
+                std::cerr << "Missing shadow method argument" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--shadow-rate") {
+            if (i + 1 < argc) {
+                try {
+                    shadowRate = std::stod(argv[++i]);
+                    if (shadowRate < 0.0 || shadowRate > 1.0) {
+                        std::cerr << "Shadow rate must be between 0 and 1" << std::endl;
+                        return 1;
+                    }
+                } catch (const std::exception& e) {
+                    std::cerr << "Invalid shadow rate: " << argv[i] << std::endl;
+                    return 1;
+                }
+            } else {
+                std::cerr << "Missing shadow rate argument" << std::endl;
+                return 1;
+            }
+        } else if (arg == "--memory-stats") {
+            memoryStats = true;
+        } else if (arg == "--hex") {
+            hexOutput = true;
+        } else if (arg == "--trace-file") {
+            if (i + 1 < argc) {
+                traceFile = argv[++i];
+            } else {
+                std::cerr << "Missing trace file argument" << std::endl;
+                return 1;
+            }
         } else if (command.empty()) {
             command = arg;
         } else if (number.empty()) {
             number = arg;
+        } else if (secondNumber.empty()) {
+            secondNumber = arg;
         }
     }
     
@@ -92,8 +211,15 @@ int main(int argc, char* argv[]) {
         return 1;
     }
     
+    // Hardware counters wrap each engine stage when requested
+    mfp::getPerfCounters().setEnabled(perfCounters);
+    mfp::getTraceRecorder().setEnabled(!traceFile.empty());
+    
     // Create MFP system
     mfp::MFPSystem mfpSystem(method, numThreads);
+    if (shadow) {
+        mfpSystem.enableShadowMode(shadowMethod, shadowRate);
+    }
     
     // Execute command
     if (command == "isprime") {
@@ -109,6 +235,12 @@ int main(int argc, char* argv[]) {
         
         std::cout << number << " is " << (isPrime ? "prime" : "not prime") << std::endl;
         std::cout << "Time: " << duration << " ms" << std::endl;
+        if (memoryStats) {
+            printRequestMemory(mfpSystem.getLastRequestMemory());
+        }
+        if (perfCounters) {
+            std::cout << mfp::getPerfCounters().formatReport();
+        }
     } else if (command == "factorize") {
         if (number.empty()) {
             std::cerr << "Missing number argument" << std::endl;
@@ -116,15 +248,100 @@ int main(int argc, char* argv[]) {
         }
         
         auto start = std::chrono::high_resolution_clock::now();
-        std::vector<std::string> factors = mfpSystem.factorize(number);
+        mfp::Factorization factors;
+        try {
+            factors = mfpSystem.factorization(number);
+        } catch (const std::invalid_argument& e) {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
         auto end = std::chrono::high_resolution_clock::now();
         auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
         
         std::cout << "Factors of " << number << ":" << std::endl;
+        if (factors.isNegative()) {
+            std::cout << "-1" << std::endl;
+        }
         for (const auto& factor : factors) {
-            std::cout << factor << std::endl;
+            std::cout << (hexOutput ? "0x" + factor.prime.toString(16) : factor.prime.toString());
+            if (factor.exponent > 1) {
+                std::cout << "^" << factor.exponent;
+            }
+            std::cout << std::endl;
+        }
+        std::cout << "Time: " << duration << " ms" << std::endl;
+        if (memoryStats) {
+            printRequestMemory(mfpSystem.getLastRequestMemory());
+        }
+        if (perfCounters) {
+            std::cout << mfp::getPerfCounters().formatReport();
+        }
+    } else if (command == "factorpowers") {
+        if (number.empty()) {
+            std::cerr << "Missing number argument" << std::endl;
+            return 1;
+        }
+        
+        auto start = std::chrono::high_resolution_clock::now();
+        mfp::PrimeFactorMap factors;
+        try {
+            factors = mfpSystem.factorizePrimePowers(number);
+        } catch (const std::invalid_argument& e) {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+        auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
+        
+        std::cout << "Prime factorization of " << number << ":" << std::endl;
+        for (const auto& factor : factors) {
+            std::cout << factor.first;
+            if (factor.second > 1) {
+                std::cout << "^" << factor.second;
+            }
+            std::cout << std::endl;
+        }
+        std::cout << "Time: " << duration << " ms" << std::endl;
+        if (memoryStats) {
+            printRequestMemory(mfpSystem.getLastRequestMemory());
+        }
+        if (perfCounters) {
+            std::cout << mfp::getPerfCounters().formatReport();
+        }
+    } else if (command == "factorstream") {
+        if (number.empty()) {
+            std::cerr << "Missing number argument" << std::endl;
+            return 1;
+        }
+        
+        auto start = std::chrono::high_resolution_clock::now();
+        std::cout << "Prime factors of " << number << " as found:" << std::endl;
+        std::string cofactor;
+        try {
+            cofactor = mfpSystem.streamFactors(number, [&](const mfp::StreamedFactor& factor) {
+                auto found = std::chrono::duration_cast<std::chrono::milliseconds>(
+                    std::chrono::high_resolution_clock::now() - start).count();
+                std::cout << "[" << found << " ms] " << factor.prime;
+                if (factor.exponent > 1) {
+                    std::cout << "^" << factor.exponent;
+                }
+                std::cout << "  cofactor " << factor.cofactor << std::endl;
+                return true;
+            });
+        } catch (const std::invalid_argument& e) {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+        auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
+        
+        if (cofactor != "1") {
+            std::cout << "Unfactored: " << cofactor << std::endl;
         }
         std::cout << "Time: " << duration << " ms" << std::endl;
+        if (memoryStats) {
+            printRequestMemory(mfpSystem.getLastRequestMemory());
+        }
     } else if (command == "nextprime") {
         if (number.empty()) {
             std::cerr << "Missing number argument" << std::endl;
@@ -138,6 +355,12 @@ int main(int argc, char* argv[]) {
         
         std::cout << "Next prime after " << number << " is " << nextPrime << std::endl;
         std::cout << "Time: " << duration << " ms" << std::endl;
+        if (memoryStats) {
+            printRequestMemory(mfpSystem.getLastRequestMemory());
+        }
+        if (perfCounters) {
+            std::cout << mfp::getPerfCounters().formatReport();
+        }
     } else if (command == "benchmark") {
         if (number.empty()) {
             std::cerr << "Missing number argument" << std::endl;
@@ -147,11 +370,15 @@ int main(int argc, char* argv[]) {
         std::cout << "Benchmarking MFP methods for number: " << number << std::endl;
         
         // Method 1
+        mfp::getPerfCounters().reset();
         mfpSystem.setMethod(mfp::MFPMethodType::METHOD_1);
         auto start1 = std::chrono::high_resolution_clock::now();
         bool isPrime1 = mfpSystem.isPrime(number);
         auto end1 = std::chrono::high_resolution_clock::now();
         auto duration1 = std::chrono::duration_cast<std::chrono::milliseconds>(end1 - start1).count();
+        std::string counters1 = mfp::getPerfCounters().formatReport();
+        mfp::MemoryUsage memory1 = mfpSystem.getLastRequestMemory();
+        mfp::getPerfCounters().reset();
         
         // Method 2
         mfpSystem.setMethod(mfp::MFPMethodType::METHOD_2);
@@ -159,6 +386,9 @@ int main(int argc, char* argv[]) {
         bool isPrime2 = mfpSystem.isPrime(number);
         auto end2 = std::chrono::high_resolution_clock::now();
         auto duration2 = std::chrono::duration_cast<std::chrono::milliseconds>(end2 - start2).count();
+        std::string counters2 = mfp::getPerfCounters().formatReport();
+        mfp::MemoryUsage memory2 = mfpSystem.getLastRequestMemory();
+        mfp::getPerfCounters().reset();
         
         // Method 3
         mfpSystem.setMethod(mfp::MFPMethodType::METHOD_3);
@@ -166,11 +396,31 @@ int main(int argc, char* argv[]) {
         bool isPrime3 = mfpSystem.isPrime(number);
         auto end3 = std::chrono::high_resolution_clock::now();
         auto duration3 = std::chrono::duration_cast<std::chrono::milliseconds>(end3 - start3).count();
+        std::string counters3 = mfp::getPerfCounters().formatReport();
+        mfp::MemoryUsage memory3 = mfpSystem.getLastRequestMemory();
         
         std::cout << "Results:" << std::endl;
         std::cout << "Method 1 (Expanded q Factorization): " << duration1 << " ms, " << (isPrime1 ? "prime" : "not prime") << std::endl;
+        if (memoryStats) {
+            printRequestMemory(memory1);
+        }
+        if (perfCounters) {
+            std::cout << counters1;
+        }
         std::cout << "Method 2 (Ultrafast with Structural Filter): " << duration2 << " ms, " << (isPrime2 ? "prime" : "not prime") << std::endl;
+        if (memoryStats) {
+            printRequestMemory(memory2);
+        }
+        if (perfCounters) {
+            std::cout << counters2;
+        }
         std::cout << "Method 3 (Parallelized with Dynamic Blocks): " << duration3 << " ms, " << (isPrime3 ? "prime" : "not prime") << std::endl;
+        if (memoryStats) {
+            printRequestMemory(memory3);
+        }
+        if (perfCounters) {
+            std::cout << counters3;
+        }
         
         // Determine fastest method
         if (duration1 <= duration2 && duration1 <= duration3) {
@@ -180,11 +430,230 @@ int main(int argc, char* argv[]) {
         } else {
             std::cout << "Method 3 is fastest" << std::endl;
         }
+    } else if (command == "hybridbench") {
+        if (number.empty()) {
+            std::cerr << "Missing bits argument" << std::endl;
+            return 1;
+        }
+        
+        unsigned long bits = 0;
+        try {
+            bits = std::stoul(number);
+        } catch (const std::exception& e) {
+            std::cerr << "Invalid bits argument: " << number << std::endl;
+            printUsage(argv[0]);
+            return 1;
+        }
+        if (bits < 2) {
+            std::cerr << "Hybrid load test inputs need at least 2 bits" << std::endl;
+            return 1;
+        }
+        
+        // Random odd inputs of the requested size
+        gmp_randstate_t state;
+        gmp_randinit_default(state);
+        gmp_randseed_ui(state, static_cast<unsigned long>(std::time(nullptr)));
+        
+        std::vector<std::string> batch;
+        mpz_t candidate;
+        mpz_init(candidate);
+        for (int i = 0; i < batchSize; i++) {
+            mpz_urandomb(candidate, state, bits);
+            mpz_setbit(candidate, bits - 1);
+            mpz_setbit(candidate, 0);
+            char* candidate_str = mpz_get_str(nullptr, 10, candidate);
+            batch.push_back(candidate_str);
+            mfp::freeGMPString(candidate_str);
+        }
+        mpz_clear(candidate);
+        gmp_randclear(state);
+        
+        auto device = std::make_shared<mfp::CPUEmulatedAccelerator>();
+        device->initialize(numThreads > 0 ? numThreads : 0);
+        
+        int methodNumber = (method == mfp::MFPMethodType::METHOD_1) ? 1 : (method == mfp::MFPMethodType::METHOD_3) ? 3 : 2;
+        mfp::HybridMFP hybrid(device, methodNumber);
+        
+        std::cout << "Hybrid load test: " << batchSize << " numbers of " << bits << " bits" << std::endl;
+        std::cout << device->getDeviceProperties();
+        
+        // Successive rounds let the scheduler converge on the measured throughput split
+        for (int round = 1; round <= 8; round++) {
+            double share = hybrid.getScheduler().getDeviceShare();
+            auto start = std::chrono::high_resolution_clock::now();
+            std::vector<uint8_t> results = hybrid.isPrimeBatch(batch);
+            auto end = std::chrono::high_resolution_clock::now();
+            auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
+            
+            size_t primes = std::count(results.begin(), results.end(), 1);
+            std::cout << "Round " << round << ": " << duration << " ms, device share " << share
+                      << ", " << primes << " probable primes" << std::endl;
+        }
+        
+        std::cout << "Device throughput: " << hybrid.getScheduler().getDeviceThroughput() << " items/ms" << std::endl;
+        std::cout << "Host throughput: " << hybrid.getScheduler().getHostThroughput() << " items/ms" << std::endl;
+    } else if (command == "factorrange") {
+        if (number.empty() || secondNumber.empty()) {
+            std::cerr << "Missing range arguments" << std::endl;
+            return 1;
+        }
+        
+        uint64_t low = 0;
+        uint64_t high = 0;
+        try {
+            low = std::stoull(number);
+            high = std::stoull(secondNumber);
+        } catch (const std::exception& e) {
+            std::cerr << "Invalid range: " << number << " " << secondNumber << std::endl;
+            return 1;
+        }
+        
+        // Records are written a segment at a time as they arrive in order
+        mfp::RangeFactorizer factorizer(numThreads);
+        uint64_t integers = 0;
+        auto start = std::chrono::high_resolution_clock::now();
+        factorizer.factorRange(low, high, [&integers](const mfp::FactoredSegment& segment) {
+            std::string text;
+            for (size_t i = 0; i < segment.size(); i++) {
+                text += std::to_string(segment.number(i));
+                text += ": ";
+                text += segment.number(i) == 0 ? "0" : mfp::formatFactorization(segment.factorsBegin(i), segment.factorsEnd(i));
+                text += '\n';
+            }
+            std::cout << text;
+            integers += segment.size();
+        });
+        auto end = std::chrono::high_resolution_clock::now();
+        auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
+        
+        std::cout << "Factored " << integers << " integers" << std::endl;
+        std::cout << "Time: " << duration << " ms" << std::endl;
+    } else if (command == "primerange") {
+        if (number.empty() || secondNumber.empty()) {
+            std::cerr << "Missing range arguments" << std::endl;
+            return 1;
+        }
+        
+        mpz_t low, high, prime;
+        mpz_init(low);
+        mpz_init(high);
+        mpz_init(prime);
+        if (mpz_set_str(low, number.c_str(), 10) != 0 || mpz_set_str(high, secondNumber.c_str(), 10) != 0) {
+            std::cerr << "Invalid range: " << number << " " << secondNumber << std::endl;
+            mpz_clear(low);
+            mpz_clear(high);
+            mpz_clear(prime);
+            return 1;
+        }
+        
+        // Primes are written a segment at a time as they arrive in order
+        mfp::IntervalPrimeSieve sieve(numThreads);
+        uint64_t primes = 0;
+        auto start = std::chrono::high_resolution_clock::now();
+        sieve.findPrimes(low, high, [&primes, &prime](mpz_srcptr base, const std::vector<uint32_t>& offsets) {
+            std::string text;
+            for (uint32_t offset : offsets) {
+                mpz_add_ui(prime, base, offset);
+                char* prime_str = mpz_get_str(nullptr, 10, prime);
+                text += prime_str;
+                text += '\n';
+                mfp::freeGMPString(prime_str);
+            }
+            std::cout << text;
+            primes += offsets.size();
+        });
+        auto end = std::chrono::high_resolution_clock::now();
+        auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
+        
+        std::cout << "Found " << primes << " primes" << std::endl;
+        std::cout << "Time: " << duration << " ms" << std::endl;
+        
+        mpz_clear(low);
+        mpz_clear(high);
+        mpz_clear(prime);
+    } else if (command == "safeprime") {
+        if (number.empty()) {
+            std::cerr << "Missing bits argument" << std::endl;
+            return 1;
+        }
+        
+        unsigned long bits = 0;
+        try {
+            bits = std::stoul(number);
+        } catch (const std::exception& e) {
+            std::cerr << "Invalid bits argument: " << number << std::endl;
+            printUsage(argv[0]);
+            return 1;
+        }
+        if (bits < 3) {
+            std::cerr << "Safe primes need at least 3 bits" << std::endl;
+            return 1;
+        }
+        
+        gmp_randstate_t state;
+        gmp_randinit_default(state);
+        gmp_randseed_ui(state, static_cast<unsigned long>(std::time(nullptr)));
+        
+        mfp::TupleSearchParams params;
+        params.num_threads = numThreads;
+        mpz_t prime;
+        mpz_init(prime);
+        auto start = std::chrono::high_resolution_clock::now();
+        mfp::randomSafePrime(bits, state, prime, params);
+        auto end = std::chrono::high_resolution_clock::now();
+        auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count();
+        
+        char* prime_str = mpz_get_str(nullptr, 10, prime);
+        std::cout << "Safe prime: " << prime_str << std::endl;
+        mfp::freeGMPString(prime_str);
+        mpz_sub_ui(prime, prime, 1);
+        mpz_fdiv_q_2exp(prime, prime, 1);
+        prime_str = mpz_get_str(nullptr, 10, prime);
+        std::cout << "Sophie Germain prime: " << prime_str << std::endl;
+        mfp::freeGMPString(prime_str);
+        std::cout << "Time: " << duration << " ms" << std::endl;
+        
+        mpz_clear(prime);
+        gmp_randclear(state);
     } else {
         std::cerr << "Unknown command: " << command << std::endl;
         printUsage(argv[0]);
         return 1;
     }
     
+    // Shadow comparison results
+    if (shadow) {
+        mfpSystem.waitForShadowRuns();
+        mfp::ShadowStats stats = mfpSystem.getShadowStats();
+        std::cout << "Shadow: " << stats.completed << " of " << stats.sampled << " sampled calls rerun, "
+                  << stats.dropped << " dropped, " << stats.disagreements << " disagreements, mean latency delta "
+                  << stats.meanLatencyDeltaMs() << " ms" << std::endl;
+        for (const auto& disagreement : mfpSystem.getShadowDisagreements()) {
+            std::cout << "  " << mfp::MetricsRegistry::operationName(disagreement.operation) << " " << disagreement.number
+                      << ": primary " << disagreement.primary_result << ", shadow " << disagreement.shadow_result << std::endl;
+        }
+    }
+    
+    // Process and per-thread allocation totals
+    if (memoryStats) {
+        std::cout << mfp::getMemoryAccounting().formatReport();
+    }
+    
+    // Dump the metrics snapshot
+    if (!metricsFile.empty()) {
+        std::ofstream out(metricsFile);
+        if (!out) {
+            std::cerr << "Cannot write metrics file: " << metricsFile << std::endl;
+            return 1;
+        }
+        out << mfp::getMetricsRegistry().formatPrometheus();
+    }
+    
+    // Dump the event trace
+    if (!traceFile.empty() && !mfp::getTraceRecorder().writeChromeTrace(traceFile)) {
+        std::cerr << "Cannot write trace file: " << traceFile << std::endl;
+        return 1;
+    }
+    
     return 0;
 }
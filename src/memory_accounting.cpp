@@ -0,0 +1,277 @@
+#include "memory_accounting.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <gmp.h>
+
+namespace mfp {
+
+// Calling thread's counters, moved to the exited totals when the thread ends
+struct ThreadMemoryHolder {
+    MemoryAccounting::ThreadCounters* counters = nullptr;
+    
+    ~ThreadMemoryHolder();
+};
+
+namespace {
+
+thread_local ThreadMemoryHolder t_holder;
+thread_local bool t_exited = false;   // Trivially destructible, safe to read after the holder is gone
+
+void raiseMax(std::atomic<int64_t>& peak, int64_t value) {
+    int64_t current = peak.load(std::memory_order_relaxed);
+    while (value > current && !peak.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+    }
+}
+
+void* gmpAllocate(size_t size) {
+    void* ptr = std::malloc(size);
+    if (ptr == nullptr) {
+        std::fprintf(stderr, "GMP: cannot allocate %zu bytes\n", size);
+        std::abort();
+    }
+    getMemoryAccounting().recordAllocation(size);
+    return ptr;
+}
+
+void* gmpReallocate(void* ptr, size_t old_size, size_t new_size) {
+    void* resized = std::realloc(ptr, new_size);
+    if (resized == nullptr) {
+        std::fprintf(stderr, "GMP: cannot reallocate %zu bytes\n", new_size);
+        std::abort();
+    }
+    getMemoryAccounting().recordReallocation(old_size, new_size);
+    return resized;
+}
+
+void gmpFree(void* ptr, size_t size) {
+    std::free(ptr);
+    getMemoryAccounting().recordFree(size);
+}
+
+} // namespace
+
+ThreadMemoryHolder::~ThreadMemoryHolder() {
+    if (counters != nullptr) {
+        getMemoryAccounting().detachThread(counters);
+        counters = nullptr;
+    }
+    t_exited = true;
+}
+
+MemoryUsage MemoryAccounting::Counters::snapshot() const {
+    MemoryUsage usage;
+    usage.allocations = allocations.load(std::memory_order_relaxed);
+    usage.frees = frees.load(std::memory_order_relaxed);
+    usage.allocated_bytes = allocated_bytes.load(std::memory_order_relaxed);
+    usage.live_bytes = live_bytes.load(std::memory_order_relaxed);
+    usage.peak_live_bytes = peak_live_bytes.load(std::memory_order_relaxed);
+    return usage;
+}
+
+MemoryAccounting::MemoryAccounting()
+    : m_hooks_installed(false), m_active_requests(0), m_next_thread_id(1),
+      m_exited_threads(0), m_exited_peak(0) {
+}
+
+void MemoryAccounting::installGMPHooks() {
+    if (!m_hooks_installed.exchange(true)) {
+        mp_set_memory_functions(gmpAllocate, gmpReallocate, gmpFree);
+    }
+}
+
+bool MemoryAccounting::hooksInstalled() const {
+    return m_hooks_installed.load();
+}
+
+void MemoryAccounting::recordAllocation(size_t bytes) {
+    apply(static_cast<int64_t>(bytes), bytes, true, false);
+}
+
+void MemoryAccounting::recordReallocation(size_t old_bytes, size_t new_bytes) {
+    apply(static_cast<int64_t>(new_bytes) - static_cast<int64_t>(old_bytes),
+          new_bytes > old_bytes ? new_bytes - old_bytes : 0, true, false);
+}
+
+void MemoryAccounting::recordFree(size_t bytes) {
+    apply(-static_cast<int64_t>(bytes), 0, false, true);
+}
+
+MemoryUsage MemoryAccounting::getProcessUsage() const {
+    return m_process.snapshot();
+}
+
+MemoryUsage MemoryAccounting::getThreadUsage() const {
+    if (t_exited || t_holder.counters == nullptr) {
+        return MemoryUsage();
+    }
+    return t_holder.counters->counters.snapshot();
+}
+
+std::vector<ThreadMemoryUsage> MemoryAccounting::getThreadUsages() const {
+    std::lock_guard<std::mutex> lock(m_threads_mutex);
+    std::vector<ThreadMemoryUsage> usages;
+    for (const auto& thread : m_threads) {
+        ThreadMemoryUsage usage;
+        usage.thread_id = thread->thread_id;
+        usage.usage = thread->counters.snapshot();
+        usages.push_back(usage);
+    }
+    return usages;
+}
+
+uint64_t MemoryAccounting::getExitedThreadCount() const {
+    std::lock_guard<std::mutex> lock(m_threads_mutex);
+    return m_exited_threads;
+}
+
+int64_t MemoryAccounting::getExitedThreadPeak() const {
+    std::lock_guard<std::mutex> lock(m_threads_mutex);
+    return m_exited_peak;
+}
+
+MemoryAccounting::RequestScope::RequestScope(MemoryAccounting& accounting)
+    : m_accounting(accounting), m_start(accounting.getProcessUsage()), m_slot(-1) {
+    for (size_t i = 0; i < MAX_TRACKED_REQUESTS; i++) {
+        bool expected = false;
+        if (m_accounting.m_requests[i].used.compare_exchange_strong(expected, true)) {
+            m_accounting.m_requests[i].peak_live_bytes.store(m_start.live_bytes, std::memory_order_relaxed);
+            m_accounting.m_active_requests.fetch_add(1);
+            m_slot = static_cast<int>(i);
+            break;
+        }
+    }
+}
+
+MemoryAccounting::RequestScope::~RequestScope() {
+    if (m_slot >= 0) {
+        m_accounting.m_active_requests.fetch_sub(1);
+        m_accounting.m_requests[m_slot].used.store(false);
+    }
+}
+
+MemoryUsage MemoryAccounting::RequestScope::getUsage() const {
+    MemoryUsage now = m_accounting.getProcessUsage();
+    MemoryUsage usage;
+    usage.allocations = now.allocations - m_start.allocations;
+    usage.frees = now.frees - m_start.frees;
+    usage.allocated_bytes = now.allocated_bytes - m_start.allocated_bytes;
+    usage.live_bytes = now.live_bytes - m_start.live_bytes;
+    
+    if (m_slot >= 0) {
+        usage.peak_live_bytes = m_accounting.m_requests[m_slot].peak_live_bytes.load(std::memory_order_relaxed) - m_start.live_bytes;
+    } else {
+        usage.peak_live_bytes = std::max<int64_t>(0, usage.live_bytes);
+    }
+    
+    return usage;
+}
+
+std::string MemoryAccounting::formatReport() const {
+    std::ostringstream ss;
+    MemoryUsage process = getProcessUsage();
+    
+    ss << "Memory (GMP limbs and library buffers"
+       << (hooksInstalled() ? "" : "; GMP hooks not installed") << "):" << std::endl;
+    ss << "  Process: " << process.allocations << " allocations, " << process.frees << " frees, "
+       << process.allocated_bytes << " bytes allocated, " << std::max<int64_t>(0, process.live_bytes)
+       << " bytes live, " << process.peak_live_bytes << " bytes peak live" << std::endl;
+    
+    std::vector<ThreadMemoryUsage> threads = getThreadUsages();
+    for (const ThreadMemoryUsage& thread : threads) {
+        ss << "  Thread " << thread.thread_id << ": " << thread.usage.allocations << " allocations, "
+           << thread.usage.allocated_bytes << " bytes allocated, " << thread.usage.peak_live_bytes
+           << " bytes peak live" << std::endl;
+    }
+    
+    uint64_t exited = getExitedThreadCount();
+    if (exited > 0) {
+        ss << "  Exited threads: " << exited << ", largest peak " << getExitedThreadPeak()
+           << " bytes live" << std::endl;
+    }
+    
+    return ss.str();
+}
+
+void MemoryAccounting::apply(int64_t delta, uint64_t bytes, bool allocation, bool release) {
+    // Process totals
+    if (allocation) {
+        m_process.allocations.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (release) {
+        m_process.frees.fetch_add(1, std::memory_order_relaxed);
+    }
+    m_process.allocated_bytes.fetch_add(bytes, std::memory_order_relaxed);
+    int64_t live = m_process.live_bytes.fetch_add(delta, std::memory_order_relaxed) + delta;
+    if (delta > 0) {
+        raiseMax(m_process.peak_live_bytes, live);
+        
+        if (m_active_requests.load(std::memory_order_relaxed) > 0) {
+            for (RequestSlot& slot : m_requests) {
+                if (slot.used.load(std::memory_order_relaxed)) {
+                    raiseMax(slot.peak_live_bytes, live);
+                }
+            }
+        }
+    }
+    
+    // Thread totals; only the owning thread writes them
+    if (t_exited) {
+        return;
+    }
+    if (t_holder.counters == nullptr) {
+        t_holder.counters = attachThread();
+    }
+    
+    Counters& thread = t_holder.counters->counters;
+    if (allocation) {
+        thread.allocations.store(thread.allocations.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+    if (release) {
+        thread.frees.store(thread.frees.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+    thread.allocated_bytes.store(thread.allocated_bytes.load(std::memory_order_relaxed) + bytes, std::memory_order_relaxed);
+    int64_t thread_live = thread.live_bytes.load(std::memory_order_relaxed) + delta;
+    thread.live_bytes.store(thread_live, std::memory_order_relaxed);
+    if (thread_live > thread.peak_live_bytes.load(std::memory_order_relaxed)) {
+        thread.peak_live_bytes.store(thread_live, std::memory_order_relaxed);
+    }
+}
+
+MemoryAccounting::ThreadCounters* MemoryAccounting::attachThread() {
+    std::unique_ptr<ThreadCounters> counters(new ThreadCounters());
+    ThreadCounters* raw = counters.get();
+    
+    std::lock_guard<std::mutex> lock(m_threads_mutex);
+    counters->thread_id = m_next_thread_id++;
+    m_threads.push_back(std::move(counters));
+    return raw;
+}
+
+void MemoryAccounting::detachThread(ThreadCounters* counters) {
+    std::lock_guard<std::mutex> lock(m_threads_mutex);
+    m_exited_threads++;
+    m_exited_peak = std::max(m_exited_peak, counters->counters.peak_live_bytes.load(std::memory_order_relaxed));
+    
+    m_threads.erase(std::remove_if(m_threads.begin(), m_threads.end(),
+                                   [counters](const std::unique_ptr<ThreadCounters>& thread) {
+                                       return thread.get() == counters;
+                                   }),
+                    m_threads.end());
+}
+
+MemoryAccounting& getMemoryAccounting() {
+    // Never destroyed: GMP may free limbs during static destruction
+    static MemoryAccounting* s_accounting = new MemoryAccounting();
+    return *s_accounting;
+}
+
+void freeGMPString(char* str) {
+    void (*free_function)(void*, size_t);
+    mp_get_memory_functions(nullptr, nullptr, &free_function);
+    free_function(str, std::strlen(str) + 1);
+}
+
+} // namespace mfp
@@ -0,0 +1,322 @@
+#include "metrics.h"
+#include <algorithm>
+#include <cmath>
+#include <exception>
+#include <iomanip>
+#include <sstream>
+#include <gmp.h>
+
+namespace mfp {
+
+namespace {
+
+// Exported Prometheus bucket bounds: decades from 1 microsecond to 100 seconds
+struct ExportBound {
+    uint64_t nanoseconds;
+    const char* label;
+};
+
+const ExportBound EXPORT_BOUNDS[] = {
+    {1000ULL, "1e-06"},
+    {10000ULL, "1e-05"},
+    {100000ULL, "0.0001"},
+    {1000000ULL, "0.001"},
+    {10000000ULL, "0.01"},
+    {100000000ULL, "0.1"},
+    {1000000000ULL, "1"},
+    {10000000000ULL, "10"},
+    {100000000000ULL, "100"},
+};
+
+// Quantiles exported in the summary alongside each histogram
+const double EXPORT_QUANTILES[] = {0.5, 0.9, 0.99, 0.999};
+
+// Bits per decimal digit, log2(10)
+const double BITS_PER_DIGIT = 3.321928094887362;
+
+// Smallest bit-length bucket bound; each later bucket doubles it
+const size_t FIRST_BUCKET_BITS = 32;
+
+int highestBit(uint64_t value) {
+    return 63 - __builtin_clzll(value);
+}
+
+std::string seconds(uint64_t nanoseconds) {
+    std::ostringstream ss;
+    ss << std::setprecision(9) << (nanoseconds / 1e9);
+    return ss.str();
+}
+
+} // namespace
+
+// LatencyHistogram implementation
+LatencyHistogram::LatencyHistogram() : m_count(0), m_sum(0), m_max(0) {
+    for (auto& bucket : m_buckets) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+}
+
+void LatencyHistogram::record(uint64_t nanoseconds) {
+    m_buckets[bucketIndex(nanoseconds)].fetch_add(1, std::memory_order_relaxed);
+    m_count.fetch_add(1, std::memory_order_relaxed);
+    m_sum.fetch_add(nanoseconds, std::memory_order_relaxed);
+    
+    uint64_t current = m_max.load(std::memory_order_relaxed);
+    while (nanoseconds > current && !m_max.compare_exchange_weak(current, nanoseconds, std::memory_order_relaxed)) {
+    }
+}
+
+uint64_t LatencyHistogram::getCount() const {
+    return m_count.load(std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::getSum() const {
+    return m_sum.load(std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::getMax() const {
+    return m_max.load(std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::valueAtQuantile(double quantile) const {
+    // Snapshot the buckets so concurrent recording cannot push the walk past the end
+    std::array<uint64_t, BUCKET_COUNT> counts;
+    uint64_t total = 0;
+    for (size_t i = 0; i < BUCKET_COUNT; i++) {
+        counts[i] = m_buckets[i].load(std::memory_order_relaxed);
+        total += counts[i];
+    }
+    
+    if (total == 0) {
+        return 0;
+    }
+    
+    quantile = std::min(1.0, std::max(0.0, quantile));
+    uint64_t target = std::max<uint64_t>(1, static_cast<uint64_t>(quantile * total + 0.5));
+    
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKET_COUNT; i++) {
+        seen += counts[i];
+        if (seen >= target) {
+            return std::min(bucketUpperBound(i), getMax());
+        }
+    }
+    
+    return getMax();
+}
+
+uint64_t LatencyHistogram::countAtOrBelow(uint64_t nanoseconds) const {
+    uint64_t count = 0;
+    for (size_t i = 0; i < BUCKET_COUNT && bucketUpperBound(i) <= nanoseconds; i++) {
+        count += m_buckets[i].load(std::memory_order_relaxed);
+    }
+    return count;
+}
+
+size_t LatencyHistogram::bucketIndex(uint64_t value) {
+    // Small values are exact
+    if (value < SUB_BUCKET_COUNT) {
+        return static_cast<size_t>(value);
+    }
+    
+    int msb = highestBit(value);
+    if (msb >= static_cast<int>(MAX_VALUE_BITS)) {
+        return BUCKET_COUNT - 1;
+    }
+    
+    // Top SUB_BUCKET_BITS + 1 bits select the bucket within the power of two
+    unsigned int shift = msb - SUB_BUCKET_BITS;
+    size_t sub_bucket = static_cast<size_t>(value >> shift) - SUB_BUCKET_COUNT;
+    return SUB_BUCKET_COUNT + shift * SUB_BUCKET_COUNT + sub_bucket;
+}
+
+uint64_t LatencyHistogram::bucketUpperBound(size_t index) {
+    if (index < SUB_BUCKET_COUNT) {
+        return index;
+    }
+    
+    if (index >= BUCKET_COUNT - 1) {
+        return UINT64_MAX;
+    }
+    
+    size_t shift = (index - SUB_BUCKET_COUNT) / SUB_BUCKET_COUNT;
+    size_t sub_bucket = (index - SUB_BUCKET_COUNT) % SUB_BUCKET_COUNT;
+    return ((static_cast<uint64_t>(SUB_BUCKET_COUNT + sub_bucket + 1)) << shift) - 1;
+}
+
+// MetricsRegistry implementation
+MetricsRegistry::MetricsRegistry() : m_start(std::chrono::steady_clock::now()) {
+}
+
+MetricsRegistry::Scope::Scope(MetricsRegistry& registry, MetricsOperation operation, const std::string& number)
+    : m_registry(registry), m_operation(operation), m_bits(decimalBitEstimate(number)),
+      m_uncaught_exceptions(std::uncaught_exceptions()), m_start(std::chrono::steady_clock::now()) {
+    m_registry.m_counters[static_cast<size_t>(m_operation)].in_flight.fetch_add(1, std::memory_order_relaxed);
+}
+
+MetricsRegistry::Scope::~Scope() {
+    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_start).count();
+    bool failed = std::uncaught_exceptions() > m_uncaught_exceptions;
+    
+    m_registry.record(m_operation, m_bits, static_cast<uint64_t>(elapsed), failed);
+    m_registry.m_counters[static_cast<size_t>(m_operation)].in_flight.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void MetricsRegistry::record(MetricsOperation operation, size_t bits, uint64_t nanoseconds, bool failed) {
+    size_t op = static_cast<size_t>(operation);
+    m_histograms[op][bitBucket(bits)].record(nanoseconds);
+    m_counters[op].completed.fetch_add(1, std::memory_order_relaxed);
+    if (failed) {
+        m_counters[op].failed.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+const LatencyHistogram& MetricsRegistry::getHistogram(MetricsOperation operation, size_t bit_bucket) const {
+    return m_histograms[static_cast<size_t>(operation)][std::min(bit_bucket, METRICS_BIT_BUCKET_COUNT - 1)];
+}
+
+uint64_t MetricsRegistry::getCompleted(MetricsOperation operation) const {
+    return m_counters[static_cast<size_t>(operation)].completed.load(std::memory_order_relaxed);
+}
+
+uint64_t MetricsRegistry::getFailed(MetricsOperation operation) const {
+    return m_counters[static_cast<size_t>(operation)].failed.load(std::memory_order_relaxed);
+}
+
+int64_t MetricsRegistry::getInFlight(MetricsOperation operation) const {
+    return m_counters[static_cast<size_t>(operation)].in_flight.load(std::memory_order_relaxed);
+}
+
+std::string MetricsRegistry::formatPrometheus() const {
+    std::ostringstream ss;
+    const MetricsOperation operations[] = {MetricsOperation::IS_PRIME, MetricsOperation::FACTORIZE, MetricsOperation::NEXT_PRIME};
+    
+    ss << "# HELP mfp_operations_total Finished operations, including failed ones" << std::endl;
+    ss << "# TYPE mfp_operations_total counter" << std::endl;
+    for (MetricsOperation operation : operations) {
+        ss << "mfp_operations_total{operation=\"" << operationName(operation) << "\"} " << getCompleted(operation) << std::endl;
+    }
+    
+    ss << "# HELP mfp_operation_failures_total Operations that ended with an exception" << std::endl;
+    ss << "# TYPE mfp_operation_failures_total counter" << std::endl;
+    for (MetricsOperation operation : operations) {
+        ss << "mfp_operation_failures_total{operation=\"" << operationName(operation) << "\"} " << getFailed(operation) << std::endl;
+    }
+    
+    ss << "# HELP mfp_operations_in_flight Operations currently running" << std::endl;
+    ss << "# TYPE mfp_operations_in_flight gauge" << std::endl;
+    for (MetricsOperation operation : operations) {
+        ss << "mfp_operations_in_flight{operation=\"" << operationName(operation) << "\"} " << getInFlight(operation) << std::endl;
+    }
+    
+    // Histograms, and the same data as a summary of quantiles; bit buckets
+    // that saw no calls are omitted
+    ss << "# HELP mfp_operation_latency_seconds Operation latency by input bit length" << std::endl;
+    ss << "# TYPE mfp_operation_latency_seconds histogram" << std::endl;
+    std::ostringstream summary;
+    for (MetricsOperation operation : operations) {
+        for (size_t bucket = 0; bucket < METRICS_BIT_BUCKET_COUNT; bucket++) {
+            const LatencyHistogram& histogram = getHistogram(operation, bucket);
+            uint64_t count = histogram.getCount();
+            if (count == 0) {
+                continue;
+            }
+            
+            std::string labels = std::string("operation=\"") + operationName(operation) + "\",bits=\"" + bitBucketLabel(bucket) + "\"";
+            for (const ExportBound& bound : EXPORT_BOUNDS) {
+                ss << "mfp_operation_latency_seconds_bucket{" << labels << ",le=\"" << bound.label << "\"} "
+                   << histogram.countAtOrBelow(bound.nanoseconds) << std::endl;
+            }
+            ss << "mfp_operation_latency_seconds_bucket{" << labels << ",le=\"+Inf\"} " << count << std::endl;
+            ss << "mfp_operation_latency_seconds_sum{" << labels << "} " << seconds(histogram.getSum()) << std::endl;
+            ss << "mfp_operation_latency_seconds_count{" << labels << "} " << count << std::endl;
+            
+            for (double quantile : EXPORT_QUANTILES) {
+                summary << "mfp_operation_latency_summary_seconds{" << labels << ",quantile=\"" << quantile << "\"} "
+                        << seconds(histogram.valueAtQuantile(quantile)) << std::endl;
+            }
+            summary << "mfp_operation_latency_summary_seconds{" << labels << ",quantile=\"1\"} "
+                    << seconds(histogram.getMax()) << std::endl;
+            summary << "mfp_operation_latency_summary_seconds_sum{" << labels << "} " << seconds(histogram.getSum()) << std::endl;
+            summary << "mfp_operation_latency_summary_seconds_count{" << labels << "} " << count << std::endl;
+        }
+    }
+    
+    ss << "# HELP mfp_operation_latency_summary_seconds Latency quantiles at histogram resolution" << std::endl;
+    ss << "# TYPE mfp_operation_latency_summary_seconds summary" << std::endl;
+    ss << summary.str();
+    
+    // Uptime lets a single snapshot be turned into average throughput
+    auto uptime = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_start).count();
+    ss << "# HELP mfp_uptime_seconds Time since the registry was created" << std::endl;
+    ss << "# TYPE mfp_uptime_seconds gauge" << std::endl;
+    ss << "mfp_uptime_seconds " << seconds(static_cast<uint64_t>(uptime)) << std::endl;
+    
+    return ss.str();
+}
+
+size_t MetricsRegistry::bitBucket(size_t bits) {
+    size_t bucket = 0;
+    size_t bound = FIRST_BUCKET_BITS;
+    while (bucket < METRICS_BIT_BUCKET_COUNT - 1 && bits > bound) {
+        bucket++;
+        bound *= 2;
+    }
+    return bucket;
+}
+
+std::string MetricsRegistry::bitBucketLabel(size_t bit_bucket) {
+    size_t upper = FIRST_BUCKET_BITS << bit_bucket;
+    if (bit_bucket >= METRICS_BIT_BUCKET_COUNT - 1) {
+        return ">" + std::to_string(upper / 2);
+    }
+    
+    size_t lower = bit_bucket == 0 ? 0 : upper / 2 + 1;
+    return std::to_string(lower) + "-" + std::to_string(upper);
+}
+
+const char* MetricsRegistry::operationName(MetricsOperation operation) {
+    switch (operation) {
+        case MetricsOperation::IS_PRIME: return "isprime";
+        case MetricsOperation::FACTORIZE: return "factorize";
+        case MetricsOperation::NEXT_PRIME: return "nextprime";
+    }
+    return "unknown";
+}
+
+// Global metrics registry instance
+MetricsRegistry& getMetricsRegistry() {
+    static MetricsRegistry s_registry;
+    return s_registry;
+}
+
+size_t decimalBitLength(const std::string& number) {
+    mpz_t n;
+    mpz_init(n);
+    
+    size_t bits = 0;
+    if (mpz_set_str(n, number.c_str(), 10) == 0 && mpz_sgn(n) != 0) {
+        bits = mpz_sizeinbase(n, 2);
+    }
+    
+    mpz_clear(n);
+    return bits;
+}
+
+size_t decimalBitEstimate(const std::string& number) {
+    size_t start = (!number.empty() && number[0] == '-') ? 1 : 0;
+    while (start < number.size() && number[start] == '0') {
+        start++;
+    }
+    
+    for (size_t i = start; i < number.size(); i++) {
+        if (number[i] < '0' || number[i] > '9') {
+            return 0;
+        }
+    }
+    
+    size_t digits = number.size() - start;
+    return digits == 0 ? 0 : static_cast<size_t>(std::ceil(digits * BITS_PER_DIGIT));
+}
+
+} // namespace mfp
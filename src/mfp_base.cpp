@@ -1,21 +1,33 @@
 #include "mfp_base.h"
+#include "perf_counters.h"
+#include "trace.h"
+#include "memory_accounting.h"
+#include "factor/smooth_factor.h"
+#include "factor/word_factor.h"
+#include "factor/perfect_power.h"
+#include "factor/small_factors.h"
 #include <gmp.h>
 #include <iostream>
-#include <cstdlib>
-#include <ctime>
 #include <random>
 
 namespace mfp {
 
 MFPBase::MFPBase() {
-    // Initialize random seed for Miller-Rabin test
-    std::srand(static_cast<unsigned int>(std::time(nullptr)));
+    // No global state: Miller-Rabin draws witnesses from a per-thread generator
 }
 
 MFPBase::~MFPBase() {
     // Nothing to clean up
 }
 
+void MFPBase::setEnginePool(std::shared_ptr<ThreadPool> pool) {
+    m_engine_pool = std::move(pool);
+}
+
+const std::shared_ptr<ThreadPool>& MFPBase::getEnginePool() const {
+    return m_engine_pool;
+}
+
 bool MFPBase::isPrime(const std::string& number) {
     // Try to convert to unsigned long for small numbers
     try {
@@ -45,13 +57,60 @@ std::vector<std::string> MFPBase::factorize(const std::string& number) {
     return factors;
 }
 
+bool MFPBase::splitComposite(const std::string& number, std::vector<std::string>& parts) {
+    // No engines here; derived classes provide them
+    (void)number;
+    (void)parts;
+    return false;
+}
+
+namespace {
+
+// Innermost scope's control; scopes nest on the stack, so a hook that runs a
+// nested call never sees its own control moved while it executes
+const CallControl EMPTY_CALL_CONTROL;
+thread_local const CallControl* t_call_control = &EMPTY_CALL_CONTROL;
+
+} // anonymous namespace
+
+bool CallControl::empty() const {
+    return cancel == nullptr && !checkpoint;
+}
+
+bool CallControl::stopped() const {
+    if (cancel != nullptr && cancel->load(std::memory_order_relaxed)) {
+        return true;
+    }
+    return checkpoint && checkpoint();
+}
+
+CallControlScope::CallControlScope(CallControl control)
+    : m_control(std::move(control)), m_previous(t_call_control) {
+    t_call_control = &m_control;
+}
+
+CallControlScope::~CallControlScope() {
+    t_call_control = m_previous;
+}
+
+const CallControl& currentCallControl() {
+    return *t_call_control;
+}
+
+bool MFPBase::isCancelled() const {
+    return t_call_control->stopped();
+}
+
 std::string MFPBase::findNextPrime(const std::string& number) {
     mpz_t n, next_prime;
     mpz_init(n);
     mpz_init(next_prime);
     
     // Convert string to mpz_t
-    mpz_set_str(n, number.c_str(), 10);
+    {
+        TraceScope trace(TraceEvent::STRING_CONVERSION, number.size());
+        mpz_set_str(n, number.c_str(), 10);
+    }
     
     // Find next prime
     mpz_nextprime(next_prime, n);
@@ -61,7 +120,7 @@ std::string MFPBase::findNextPrime(const std::string& number) {
     std::string result(result_str);
     
     // Free resources
-    free(result_str);
+    freeGMPString(result_str);
     mpz_clear(n);
     mpz_clear(next_prime);
     
@@ -81,6 +140,7 @@ bool MFPBase::isSmallPrime(unsigned long n) {
 }
 
 bool MFPBase::millerRabinTest(const std::string& n, int iterations) {
+    PerfCounterRegistry::Scope perf_scope(PerfStage::PRIMALITY_TEST);
     mpz_t num, a, r, y, j, minus_one;
     mpz_init(num);
     mpz_init(a);
@@ -90,7 +150,10 @@ bool MFPBase::millerRabinTest(const std::string& n, int iterations) {
     mpz_init(minus_one);
     
     // Convert string to mpz_t
-    mpz_set_str(num, n.c_str(), 10);
+    {
+        TraceScope trace(TraceEvent::STRING_CONVERSION, n.size());
+        mpz_set_str(num, n.c_str(), 10);
+    }
     
     // Check if n is 2 or 3
     if (mpz_cmp_ui(num, 2) == 0 || mpz_cmp_ui(num, 3) == 0) {
@@ -114,6 +177,17 @@ bool MFPBase::millerRabinTest(const std::string& n, int iterations) {
         return false;
     }
     
+    // Reject composites with a small prime factor before any exponentiation
+    if (hasSmallFactor(num, smallFactorFilterBound(mpz_sizeinbase(num, 2)))) {
+        mpz_clear(num);
+        mpz_clear(a);
+        mpz_clear(r);
+        mpz_clear(y);
+        mpz_clear(j);
+        mpz_clear(minus_one);
+        return false;
+    }
+    
     // Write n-1 as 2^s * d where d is odd
     mpz_sub_ui(r, num, 1);  // r = n-1
     unsigned int s = 0;
@@ -126,10 +200,23 @@ bool MFPBase::millerRabinTest(const std::string& n, int iterations) {
     mpz_sub_ui(minus_one, num, 1);
     
     // Perform Miller-Rabin test
-    std::random_device rd;
-    std::mt19937 gen(rd());
+    // Seeded once per thread, so concurrent tests share no generator
+    thread_local std::mt19937 gen(std::random_device{}());
     
     for (int i = 0; i < iterations; i++) {
+        TraceScope trace(TraceEvent::MR_ROUND, i);
+        
+        // A stopped test reports composite; whoever stopped it discards the result
+        if (isCancelled()) {
+            mpz_clear(num);
+            mpz_clear(a);
+            mpz_clear(r);
+            mpz_clear(y);
+            mpz_clear(j);
+            mpz_clear(minus_one);
+            return false;
+        }
+        
         // Generate random a in [2, n-2]
         std::uniform_int_distribution<unsigned long> dist(2, mpz_get_ui(num) - 2);
         mpz_set_ui(a, dist(gen));
@@ -183,4 +270,151 @@ bool MFPBase::millerRabinTest(const std::string& n, int iterations) {
     return true;
 }
 
+bool MFPBase::smoothFactorization(const std::string& number, std::vector<std::string>& factors, int num_threads) {
+    PerfCounterRegistry::Scope perf_scope(PerfStage::FACTOR_SEARCH);
+    mpz_t n, factor;
+    mpz_init(n);
+    mpz_init(factor);
+    
+    // Convert string to mpz_t
+    {
+        TraceScope trace(TraceEvent::STRING_CONVERSION, number.size());
+        mpz_set_str(n, number.c_str(), 10);
+    }
+    
+    SmoothFactorParams params;
+    params.num_threads = num_threads;
+    params.pool = m_engine_pool.get();
+    // Stage 2 threads poll the caller's control, not their own
+    const CallControl& control = currentCallControl();
+    if (!control.empty()) {
+        params.checkpoint = [control] { return control.stopped(); };
+    }
+    bool found = pollardPMinus1(n, factor, params) || williamsPPlus1(n, factor, params);
+    
+    if (found) {
+        char* factor1 = mpz_get_str(nullptr, 10, factor);
+        factors.push_back(std::string(factor1));
+        freeGMPString(factor1);
+        
+        // Calculate the other factor
+        mpz_divexact(n, n, factor);
+        char* factor2 = mpz_get_str(nullptr, 10, n);
+        factors.push_back(std::string(factor2));
+        freeGMPString(factor2);
+    }
+    
+    mpz_clear(n);
+    mpz_clear(factor);
+    
+    return found;
+}
+
+bool MFPBase::wordSizeFactorization(const std::string& number, std::vector<std::string>& factors) {
+    uint128_t n;
+    if (!parseUint128(number, n)) {
+        return false;
+    }
+    
+    PerfCounterRegistry::Scope perf_scope(PerfStage::WORD_SIZE);
+    for (uint128_t factor : factorize128(n)) {
+        factors.push_back(uint128ToString(factor));
+    }
+    
+    return true;
+}
+
+bool MFPBase::wordSizeSplit(const std::string& number, std::vector<std::string>& factors) {
+    uint128_t n;
+    if (!parseUint128(number, n)) {
+        return false;
+    }
+    
+    PerfCounterRegistry::Scope perf_scope(PerfStage::FACTOR_SEARCH);
+    uint128_t factor = findFactor128(n);
+    if (factor == 0) {
+        return false;
+    }
+    
+    factors.push_back(uint128ToString(factor));
+    factors.push_back(uint128ToString(n / factor));
+    return true;
+}
+
+bool MFPBase::perfectPowerFactorization(const std::string& number, std::vector<std::string>& factors) {
+    mpz_t n, root;
+    mpz_init(n);
+    mpz_init(root);
+    
+    // Convert string to mpz_t
+    {
+        TraceScope trace(TraceEvent::STRING_CONVERSION, number.size());
+        mpz_set_str(n, number.c_str(), 10);
+    }
+    
+    unsigned long exponent = 0;
+    bool found;
+    {
+        PerfCounterRegistry::Scope perf_scope(PerfStage::FACTOR_SEARCH);
+        found = perfectPower(n, root, exponent);
+    }
+    
+    if (found) {
+        // Factor the root once and carry the exponent
+        char* root_str = mpz_get_str(nullptr, 10, root);
+        std::vector<std::string> root_factors = factorize(std::string(root_str));
+        freeGMPString(root_str);
+        for (unsigned long i = 0; i < exponent; i++) {
+            factors.insert(factors.end(), root_factors.begin(), root_factors.end());
+        }
+    }
+    
+    mpz_clear(n);
+    mpz_clear(root);
+    
+    return found;
+}
+
+bool MFPBase::smallFactorStripping(const std::string& number, std::vector<std::string>& factors) {
+    mpz_t n;
+    mpz_init(n);
+    
+    // Convert string to mpz_t
+    {
+        TraceScope trace(TraceEvent::STRING_CONVERSION, number.size());
+        mpz_set_str(n, number.c_str(), 10);
+    }
+    
+    // Below 2^128 the word-size engines find small factors more cheaply
+    if (mpz_sizeinbase(n, 2) <= 128) {
+        mpz_clear(n);
+        return false;
+    }
+    
+    std::vector<uint64_t> small_factors;
+    {
+        PerfCounterRegistry::Scope perf_scope(PerfStage::SMALL_FACTORS);
+        stripSmallFactors(n, small_factors);
+    }
+    
+    bool found = !small_factors.empty();
+    if (found) {
+        for (uint64_t p : small_factors) {
+            factors.push_back(std::to_string(p));
+        }
+        
+        // Only the cofactor goes on to the expensive tests
+        if (mpz_cmp_ui(n, 1) > 0) {
+            char* cofactor_str = mpz_get_str(nullptr, 10, n);
+            std::vector<std::string> cofactor_factors = factorize(std::string(cofactor_str));
+            freeGMPString(cofactor_str);
+            factors.insert(factors.end(), cofactor_factors.begin(), cofactor_factors.end());
+        }
+    }
+    
+    mpz_clear(n);
+    
+    return found;
+}
+
 } // namespace mfp
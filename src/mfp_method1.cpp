@@ -1,4 +1,7 @@
 #include "mfp_method1.h"
+#include "perf_counters.h"
+#include "trace.h"
+#include "memory_accounting.h"
 #include <gmp.h>
 #include <iostream>
 #include <cmath>
@@ -28,40 +31,19 @@ std::vector<std::string> MFPMethod1::factorize(const std::string& number) {
         return factors;
     }
     
-    // Use the Expanded q Factorization method
-    if (expandedQFactorization(number, factors)) {
+    // Small primes come out first so only the cofactor reaches the engines
+    if (smallFactorStripping(number, factors)) {
         return factors;
     }
     
-    // Fallback to trial division for small numbers
-    try {
-        unsigned long n = std::stoul(number);
-        if (n <= 1000000) {
-            // Trial division for small numbers
-            if (n <= 1) {
-                return factors; // Empty for 0 and 1
-            }
-            
-            while (n % 2 == 0) {
-                factors.push_back("2");
-                n /= 2;
-            }
-            
-            for (unsigned long i = 3; i * i <= n; i += 2) {
-                while (n % i == 0) {
-                    factors.push_back(std::to_string(i));
-                    n /= i;
-                }
-            }
-            
-            if (n > 1) {
-                factors.push_back(std::to_string(n));
-            }
-            
-            return factors;
-        }
-    } catch (const std::exception& e) {
-        // Number is too large for unsigned long, continue with GMP
+    // Perfect powers m^k: factor m once instead of running the engines on n
+    if (perfectPowerFactorization(number, factors)) {
+        return factors;
+    }
+    
+    // One split by this method's engines
+    if (splitComposite(number, factors)) {
+        return factors;
     }
     
     // If all else fails, just return the number itself
@@ -69,12 +51,27 @@ std::vector<std::string> MFPMethod1::factorize(const std::string& number) {
     return factors;
 }
 
+bool MFPMethod1::splitComposite(const std::string& number, std::vector<std::string>& parts) {
+    // Use the Expanded q Factorization method
+    if (expandedQFactorization(number, parts)) {
+        return true;
+    }
+    
+    // Fallback: complete factorization with the word-size engines below 2^128
+    if (wordSizeFactorization(number, parts)) {
+        return true;
+    }
+    
+    return false;
+}
+
 std::string MFPMethod1::findNextPrime(const std::string& number) {
     // Use the base class implementation
     return MFPBase::findNextPrime(number);
 }
 
 bool MFPMethod1::expandedQFactorization(const std::string& number, std::vector<std::string>& factors) {
+    PerfCounterRegistry::Scope perf_scope(PerfStage::FACTOR_SEARCH);
     mpz_t n, q, a, b, gcd;
     mpz_init(n);
     mpz_init(q);
@@ -83,7 +80,10 @@ bool MFPMethod1::expandedQFactorization(const std::string& number, std::vector<s
     mpz_init(gcd);
     
     // Convert string to mpz_t
-    mpz_set_str(n, number.c_str(), 10);
+    {
+        TraceScope trace(TraceEvent::STRING_CONVERSION, number.size());
+        mpz_set_str(n, number.c_str(), 10);
+    }
     
     // Check if n is even
     if (mpz_even_p(n) != 0) {
@@ -93,7 +93,7 @@ bool MFPMethod1::expandedQFactorization(const std::string& number, std::vector<s
         // Convert n back to string and recursively factorize
         char* n_str = mpz_get_str(nullptr, 10, n);
         std::string remaining(n_str);
-        free(n_str);
+        freeGMPString(n_str);
         
         std::vector<std::string> remaining_factors = factorize(remaining);
         factors.insert(factors.end(), remaining_factors.begin(), remaining_factors.end());
@@ -112,7 +112,8 @@ bool MFPMethod1::expandedQFactorization(const std::string& number, std::vector<s
     mpz_add_ui(q, q, 1); // Start with q = sqrt(n) + 1
     
     // Try different values of q
-    for (int i = 0; i < 1000; i++) {
+    TraceScope sweep_trace(TraceEvent::FERMAT_SWEEP, 1000);
+    for (int i = 0; i < 1000 && !isCancelled(); i++) {
         // Calculate a^2 = q^2 - n
         mpz_mul(a, q, q);
         mpz_sub(a, a, n);
@@ -129,12 +130,12 @@ bool MFPMethod1::expandedQFactorization(const std::string& number, std::vector<s
             mpz_add(gcd, q, a);
             char* factor1 = mpz_get_str(nullptr, 10, gcd);
             factors.push_back(std::string(factor1));
-            free(factor1);
+            freeGMPString(factor1);
             
             // Second factor = q - a
             char* factor2 = mpz_get_str(nullptr, 10, b);
             factors.push_back(std::string(factor2));
-            free(factor2);
+            freeGMPString(factor2);
             
             mpz_clear(n);
             mpz_clear(q);
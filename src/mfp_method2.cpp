@@ -1,4 +1,8 @@
 #include "mfp_method2.h"
+#include "perf_counters.h"
+#include "trace.h"
+#include "memory_accounting.h"
+#include "factor/small_factors.h"
 #include <gmp.h>
 #include <iostream>
 #include <cmath>
@@ -33,40 +37,19 @@ std::vector<std::string> MFPMethod2::factorize(const std::string& number) {
         return factors;
     }
     
-    // Use the Ultrafast Factorization method
-    if (ultrafastFactorization(number, factors)) {
+    // Small primes come out first so only the cofactor reaches the engines
+    if (smallFactorStripping(number, factors)) {
         return factors;
     }
     
-    // Fallback to trial division for small numbers
-    try {
-        unsigned long n = std::stoul(number);
-        if (n <= 1000000) {
-            // Trial division for small numbers
-            if (n <= 1) {
-                return factors; // Empty for 0 and 1
-            }
-            
-            while (n % 2 == 0) {
-                factors.push_back("2");
-                n /= 2;
-            }
-            
-            for (unsigned long i = 3; i * i <= n; i += 2) {
-                while (n % i == 0) {
-                    factors.push_back(std::to_string(i));
-                    n /= i;
-                }
-            }
-            
-            if (n > 1) {
-                factors.push_back(std::to_string(n));
-            }
-            
-            return factors;
-        }
-    } catch (const std::exception& e) {
-        // Number is too large for unsigned long, continue with GMP
+    // Perfect powers m^k: factor m once instead of running the engines on n
+    if (perfectPowerFactorization(number, factors)) {
+        return factors;
+    }
+    
+    // One split by this method's engines
+    if (splitComposite(number, factors)) {
+        return factors;
     }
     
     // If all else fails, just return the number itself
@@ -74,12 +57,27 @@ std::vector<std::string> MFPMethod2::factorize(const std::string& number) {
     return factors;
 }
 
+bool MFPMethod2::splitComposite(const std::string& number, std::vector<std::string>& parts) {
+    // Use the Ultrafast Factorization method
+    if (ultrafastFactorization(number, parts)) {
+        return true;
+    }
+    
+    // Fallback: complete factorization with the word-size engines below 2^128
+    if (wordSizeFactorization(number, parts)) {
+        return true;
+    }
+    
+    return false;
+}
+
 std::string MFPMethod2::findNextPrime(const std::string& number) {
     // Use the base class implementation
     return MFPBase::findNextPrime(number);
 }
 
 bool MFPMethod2::structuralFilter(const std::string& number) {
+    PerfCounterRegistry::Scope perf_scope(PerfStage::PRIMALITY_FILTER);
     // Quick check for small numbers
     try {
         unsigned long n = std::stoul(number);
@@ -102,21 +100,15 @@ bool MFPMethod2::structuralFilter(const std::string& number) {
     mpz_init(n);
     
     // Convert string to mpz_t
-    mpz_set_str(n, number.c_str(), 10);
-    
-    // Check if n is divisible by small primes
-    const unsigned long small_primes[] = {2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41, 43, 47};
-    for (unsigned long p : small_primes) {
-        if (mpz_divisible_ui_p(n, p) != 0) {
-            // Check if n is equal to p
-            if (mpz_cmp_ui(n, p) == 0) {
-                mpz_clear(n);
-                return true;
-            }
-            
-            mpz_clear(n);
-            return false;
-        }
+    {
+        TraceScope trace(TraceEvent::STRING_CONVERSION, number.size());
+        mpz_set_str(n, number.c_str(), 10);
+    }
+    
+    // Shared small-factor filter: block remainders, then one primorial GCD
+    if (hasSmallFactor(n, smallFactorFilterBound(mpz_sizeinbase(n, 2)))) {
+        mpz_clear(n);
+        return false;
     }
     
     // Check if n passes Fermat's little theorem for base 2
@@ -145,13 +137,17 @@ bool MFPMethod2::structuralFilter(const std::string& number) {
 }
 
 bool MFPMethod2::ultrafastFactorization(const std::string& number, std::vector<std::string>& factors) {
+    PerfCounterRegistry::Scope perf_scope(PerfStage::FACTOR_SEARCH);
     mpz_t n, factor, temp;
     mpz_init(n);
     mpz_init(factor);
     mpz_init(temp);
     
     // Convert string to mpz_t
-    mpz_set_str(n, number.c_str(), 10);
+    {
+        TraceScope trace(TraceEvent::STRING_CONVERSION, number.size());
+        mpz_set_str(n, number.c_str(), 10);
+    }
     
     // Check if n is even
     if (mpz_even_p(n) != 0) {
@@ -161,7 +157,7 @@ bool MFPMethod2::ultrafastFactorization(const std::string& number, std::vector<s
         // Convert n back to string and recursively factorize
         char* n_str = mpz_get_str(nullptr, 10, n);
         std::string remaining(n_str);
-        free(n_str);
+        freeGMPString(n_str);
         
         std::vector<std::string> remaining_factors = factorize(remaining);
         factors.insert(factors.end(), remaining_factors.begin(), remaining_factors.end());
@@ -173,6 +169,24 @@ bool MFPMethod2::ultrafastFactorization(const std::string& number, std::vector<s
         return true;
     }
     
+    // Word-size inputs never reach the GMP rho below
+    if (mpz_sizeinbase(n, 2) <= 128) {
+        mpz_clear(n);
+        mpz_clear(factor);
+        mpz_clear(temp);
+        
+        return wordSizeSplit(number, factors);
+    }
+    
+    // Larger inputs: catch smooth p-1 or p+1 before the unbounded rho walk
+    if (smoothFactorization(number, factors)) {
+        mpz_clear(n);
+        mpz_clear(factor);
+        mpz_clear(temp);
+        
+        return true;
+    }
+    
     // Try Pollard's rho algorithm
     mpz_t x, y, d, one;
     mpz_init(x);
@@ -195,7 +209,8 @@ bool MFPMethod2::ultrafastFactorization(const std::string& number, std::vector<s
     };
     
     // Main loop
-    while (mpz_cmp_ui(d, 1) == 0) {
+    TraceBlocks rho_trace(TraceEvent::RHO_BLOCK, TRACE_RHO_BLOCK);
+    while (mpz_cmp_ui(d, 1) == 0 && !isCancelled()) {
         // x = f(x)
         f(x, x);
         
@@ -207,20 +222,21 @@ bool MFPMethod2::ultrafastFactorization(const std::string& number, std::vector<s
         mpz_sub(temp, x, y);
         mpz_abs(temp, temp);
         mpz_gcd(d, temp, n);
+        rho_trace.step();
     }
     
     // Check if we found a proper factor
-    if (mpz_cmp(d, n) != 0) {
+    if (mpz_cmp_ui(d, 1) > 0 && mpz_cmp(d, n) != 0) {
         // Found a factor
         char* factor1 = mpz_get_str(nullptr, 10, d);
         factors.push_back(std::string(factor1));
-        free(factor1);
+        freeGMPString(factor1);
         
         // Calculate the other factor
         mpz_divexact(temp, n, d);
         char* factor2 = mpz_get_str(nullptr, 10, temp);
         factors.push_back(std::string(factor2));
-        free(factor2);
+        freeGMPString(factor2);
         
         mpz_clear(n);
         mpz_clear(factor);
@@ -1,15 +1,158 @@
 #include "mfp_method3.h"
+#include "hardware/cpu_detector.h"
+#include "perf_counters.h"
+#include "trace.h"
+#include "memory_accounting.h"
+#include "factor/small_factors.h"
+#include "thread_pool.h"
 #include <gmp.h>
 #include <iostream>
 #include <cmath>
 #include <vector>
+#include <map>
 #include <thread>
 #include <mutex>
 #include <atomic>
 #include <functional>
+#include <chrono>
+#include <algorithm>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
 
 namespace mfp {
 
+namespace {
+
+// Host CPU information, detected once per process
+const CPUInfo& hostCPUInfo() {
+    static CPUInfo cpu_info;
+    static std::once_flag detected;
+    std::call_once(detected, [] { cpu_info.detect(); });
+    return cpu_info;
+}
+
+// Pin a thread to a logical CPU (no-op where unsupported or when cpu_id < 0)
+void pinToCPU(std::thread& thread, int cpu_id) {
+#ifdef __linux__
+    if (cpu_id < 0) {
+        return;
+    }
+    
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET(cpu_id, &cpuset);
+    pthread_setaffinity_np(thread.native_handle(), sizeof(cpu_set_t), &cpuset);
+#else
+    (void)thread;
+    (void)cpu_id;
+#endif
+}
+
+// Check whether the process is allowed to run on a logical CPU
+bool isCPUAllowed(int cpu_id) {
+#ifdef __linux__
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    if (sched_getaffinity(0, sizeof(cpu_set_t), &cpuset) != 0) {
+        return true;
+    }
+    return CPU_ISSET(cpu_id, &cpuset);
+#else
+    (void)cpu_id;
+    return true;
+#endif
+}
+
+// Measure modular exponentiation throughput on one logical CPU
+double measureCPUSpeed(int cpu_id) {
+    double ops_per_ms = 0.0;
+    
+    std::thread worker([&ops_per_ms] {
+        mpz_t base, exp, mod, result;
+        mpz_init_set_ui(base, 3);
+        mpz_init(exp);
+        mpz_init(mod);
+        mpz_init(result);
+        
+        // Fixed 512-bit odd modulus so every class runs identical work
+        mpz_ui_pow_ui(mod, 2, 512);
+        mpz_sub_ui(mod, mod, 569);
+        mpz_sub_ui(exp, mod, 1);
+        
+        // Warm up so frequency scaling settles before timing
+        for (int i = 0; i < 4; i++) {
+            mpz_powm(result, base, exp, mod);
+        }
+        
+        const int rounds = 32;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < rounds; i++) {
+            mpz_powm(result, base, exp, mod);
+        }
+        auto end = std::chrono::steady_clock::now();
+        double elapsed_ms = std::chrono::duration<double, std::milli>(end - start).count();
+        ops_per_ms = rounds / std::max(elapsed_ms, 1e-3);
+        
+        mpz_clear(base);
+        mpz_clear(exp);
+        mpz_clear(mod);
+        mpz_clear(result);
+    });
+    pinToCPU(worker, cpu_id);
+    worker.join();
+    
+    return ops_per_ms;
+}
+
+// Relative speed per logical CPU (fastest = 1.0), measured once per core class
+const std::map<int, double>& measuredCPUSpeeds() {
+    static std::map<int, double> speeds;
+    static std::once_flag measured;
+    
+    std::call_once(measured, [] {
+        const CPUInfo& cpu_info = hostCPUInfo();
+        const CPUTopology& topology = cpu_info.getTopology();
+        
+        if (!topology.is_hybrid) {
+            for (const auto& cpu : topology.cpus) {
+                speeds[cpu.id] = 1.0;
+            }
+            return;
+        }
+        
+        // Benchmark one representative CPU per (class, capacity) pair
+        std::map<std::pair<CoreType, int>, double> class_speed;
+        for (const auto& cpu : topology.cpus) {
+            auto key = std::make_pair(cpu.type, cpu.capacity);
+            if (class_speed.count(key) == 0 && isCPUAllowed(cpu.id)) {
+                class_speed[key] = measureCPUSpeed(cpu.id);
+            }
+        }
+        
+        double fastest = 0.0;
+        for (const auto& entry : class_speed) {
+            fastest = std::max(fastest, entry.second);
+        }
+        
+        for (const auto& cpu : topology.cpus) {
+            auto it = class_speed.find(std::make_pair(cpu.type, cpu.capacity));
+            if (it != class_speed.end() && fastest > 0.0) {
+                speeds[cpu.id] = it->second / fastest;
+            } else {
+                // Fall back to the scheduler's capacity estimate
+                speeds[cpu.id] = cpu.capacity / 1024.0;
+            }
+        }
+    });
+    
+    return speeds;
+}
+
+} // namespace
+
 MFPMethod3::MFPMethod3(int numThreads) {
     // Initialize Method 3 (Parallelized with Dynamic Blocks)
     m_numThreads = (numThreads > 0) ? numThreads : std::thread::hardware_concurrency();
@@ -20,6 +163,88 @@ MFPMethod3::~MFPMethod3() {
     // Nothing to clean up
 }
 
+std::vector<MFPMethod3::WorkerSlot> MFPMethod3::selectWorkerSlots(bool performance_only) const {
+    std::vector<WorkerSlot> slots;
+    const CPUInfo& cpu_info = hostCPUInfo();
+    
+    // On uniform CPUs leave placement to the OS scheduler
+    if (!cpu_info.getTopology().is_hybrid) {
+        for (int i = 0; i < m_numThreads; i++) {
+            slots.push_back({-1, 1.0});
+        }
+        return slots;
+    }
+    
+    const std::map<int, double>& speeds = measuredCPUSpeeds();
+    std::vector<WorkerSlot> candidates;
+    for (const auto& cpu : cpu_info.getCPUsBySpeed()) {
+        if (!isCPUAllowed(cpu.id)) {
+            continue;
+        }
+        if (performance_only && cpu.type == CoreType::EFFICIENCY) {
+            continue;
+        }
+        auto it = speeds.find(cpu.id);
+        candidates.push_back({cpu.id, it != speeds.end() ? it->second : 1.0});
+    }
+    
+    if (candidates.empty()) {
+        for (int i = 0; i < m_numThreads; i++) {
+            slots.push_back({-1, 1.0});
+        }
+        return slots;
+    }
+    
+    // Fastest CPUs first; latency-critical work never exceeds the performance core count
+    int count = performance_only ? std::min<int>(m_numThreads, candidates.size()) : m_numThreads;
+    for (int i = 0; i < count; i++) {
+        slots.push_back(candidates[i % candidates.size()]);
+    }
+    
+    return slots;
+}
+
+std::vector<int> MFPMethod3::splitBySpeed(const std::vector<WorkerSlot>& slots, int total) {
+    std::vector<int> shares(slots.size(), 0);
+    if (slots.empty()) {
+        return shares;
+    }
+    
+    double speed_sum = 0.0;
+    for (const auto& slot : slots) {
+        speed_sum += std::max(slot.speed, 0.0);
+    }
+    
+    // Without any known speed every slot counts the same
+    if (speed_sum <= 0.0) {
+        int count = static_cast<int>(slots.size());
+        for (int i = 0; i < count; i++) {
+            shares[i] = total / count + (i < total % count ? 1 : 0);
+        }
+        return shares;
+    }
+    
+    // Largest remainder apportionment keeps the shares summing to total
+    std::vector<std::pair<double, size_t>> remainders;
+    int assigned = 0;
+    for (size_t i = 0; i < slots.size(); i++) {
+        double exact = total * std::max(slots[i].speed, 0.0) / speed_sum;
+        shares[i] = static_cast<int>(exact);
+        assigned += shares[i];
+        remainders.push_back({exact - shares[i], i});
+    }
+    
+    std::stable_sort(remainders.begin(), remainders.end(), [](const auto& a, const auto& b) {
+        return a.first > b.first;
+    });
+    for (size_t i = 0; assigned < total; i = (i + 1) % remainders.size()) {
+        shares[remainders[i].second]++;
+        assigned++;
+    }
+    
+    return shares;
+}
+
 bool MFPMethod3::isPrime(const std::string& number) {
     // For small numbers, use the base class implementation
     try {
@@ -44,40 +269,19 @@ std::vector<std::string> MFPMethod3::factorize(const std::string& number) {
         return factors;
     }
     
-    // Use the parallel factorization method
-    if (parallelFactorization(number, factors)) {
+    // Small primes come out first so only the cofactor reaches the engines
+    if (smallFactorStripping(number, factors)) {
         return factors;
     }
     
-    // Fallback to trial division for small numbers
-    try {
-        unsigned long n = std::stoul(number);
-        if (n <= 1000000) {
-            // Trial division for small numbers
-            if (n <= 1) {
-                return factors; // Empty for 0 and 1
-            }
-            
-            while (n % 2 == 0) {
-                factors.push_back("2");
-                n /= 2;
-            }
-            
-            for (unsigned long i = 3; i * i <= n; i += 2) {
-                while (n % i == 0) {
-                    factors.push_back(std::to_string(i));
-                    n /= i;
-                }
-            }
-            
-            if (n > 1) {
-                factors.push_back(std::to_string(n));
-            }
-            
-            return factors;
-        }
-    } catch (const std::exception& e) {
-        // Number is too large for unsigned long, continue with GMP
+    // Perfect powers m^k: factor m once instead of running the engines on n
+    if (perfectPowerFactorization(number, factors)) {
+        return factors;
+    }
+    
+    // One split by this method's engines
+    if (splitComposite(number, factors)) {
+        return factors;
     }
     
     // If all else fails, just return the number itself
@@ -85,6 +289,25 @@ std::vector<std::string> MFPMethod3::factorize(const std::string& number) {
     return factors;
 }
 
+bool MFPMethod3::splitComposite(const std::string& number, std::vector<std::string>& parts) {
+    // Use the parallel factorization method
+    if (parallelFactorization(number, parts)) {
+        return true;
+    }
+    
+    // Rho ran out of budget; factors with smooth p-1 or p+1 are still cheap
+    if (smoothFactorization(number, parts, m_numThreads)) {
+        return true;
+    }
+    
+    // Fallback: complete factorization with the word-size engines below 2^128
+    if (wordSizeFactorization(number, parts)) {
+        return true;
+    }
+    
+    return false;
+}
+
 std::string MFPMethod3::findNextPrime(const std::string& number) {
     // Use the base class implementation
     return MFPBase::findNextPrime(number);
@@ -94,7 +317,10 @@ bool MFPMethod3::parallelPrimalityTest(const std::string& number) {
     // Convert string to mpz_t
     mpz_t n;
     mpz_init(n);
-    mpz_set_str(n, number.c_str(), 10);
+    {
+        TraceScope trace(TraceEvent::STRING_CONVERSION, number.size());
+        mpz_set_str(n, number.c_str(), 10);
+    }
     
     // Check if n is 2 or 3
     if (mpz_cmp_ui(n, 2) == 0 || mpz_cmp_ui(n, 3) == 0) {
@@ -108,6 +334,12 @@ bool MFPMethod3::parallelPrimalityTest(const std::string& number) {
         return false;
     }
     
+    // Reject composites with a small prime factor before starting threads
+    if (hasSmallFactor(n, smallFactorFilterBound(mpz_sizeinbase(n, 2)))) {
+        mpz_clear(n);
+        return false;
+    }
+    
     // Write n-1 as 2^s * d where d is odd
     mpz_t d;
     mpz_init(d);
@@ -127,11 +359,15 @@ bool MFPMethod3::parallelPrimalityTest(const std::string& number) {
     // Mutex for thread synchronization
     std::mutex mtx;
     
-    // Vector to hold thread objects
-    std::vector<std::thread> threads;
+    // Workers poll the control of the call that started them
+    const CallControl& control = currentCallControl();
     
     // Function to test a range of witnesses
     auto test_witnesses = [&](int start, int end) {
+        CallControlScope control_scope(control);
+        PerfCounterRegistry::Scope perf_scope(PerfStage::PRIMALITY_TEST);
+        TraceScope worker_trace(TraceEvent::WORKER, start);
+        
         // Create thread-local GMP variables
         mpz_t a, y, j, n_local, d_local, n_minus_1;
         mpz_init(a);
@@ -151,6 +387,14 @@ bool MFPMethod3::parallelPrimalityTest(const std::string& number) {
         
         // Test witnesses in the assigned range
         for (int i = start; i < end && !is_composite; i++) {
+            TraceScope round_trace(TraceEvent::MR_ROUND, i + 2);
+            
+            // A stopped test reports composite; whoever stopped it discards the result
+            if (isCancelled()) {
+                is_composite = true;
+                break;
+            }
+            
             // Set a to i+2 (witnesses start from 2)
             mpz_set_ui(a, i + 2);
             
@@ -196,23 +440,23 @@ bool MFPMethod3::parallelPrimalityTest(const std::string& number) {
         mpz_clear(n_minus_1);
     };
     
-    // Divide the work among threads
-    int witnesses_per_thread = iterations / m_numThreads;
-    int remaining_witnesses = iterations % m_numThreads;
-    
-    int start = 0;
-    for (int i = 0; i < m_numThreads; i++) {
-        int thread_witnesses = witnesses_per_thread + (i < remaining_witnesses ? 1 : 0);
-        int end = start + thread_witnesses;
-        
-        threads.push_back(std::thread(test_witnesses, start, end));
-        start = end;
+    // Divide the witnesses among threads by core speed; the primality test is
+    // latency-critical, so on hybrid CPUs it runs on performance cores only
+    std::vector<WorkerSlot> slots = selectWorkerSlots(true);
+    std::vector<int> shares = splitBySpeed(slots, iterations);
+    std::vector<int> starts(slots.size() + 1, 0);
+    for (size_t i = 0; i < slots.size(); i++) {
+        starts[i + 1] = starts[i] + shares[i];
     }
     
-    // Wait for all threads to complete
-    for (auto& thread : threads) {
-        thread.join();
-    }
+    // Shared pool workers are never pinned; threads started here are
+    runWorkers(getEnginePool().get(), slots.size(),
+               [&](size_t i) {
+                   if (shares[i] > 0) {
+                       test_witnesses(starts[i], starts[i + 1]);
+                   }
+               },
+               [&](size_t i, std::thread& thread) { pinToCPU(thread, slots[i].cpu_id); });
     
     // Free GMP variables
     mpz_clear(n);
@@ -227,7 +471,10 @@ bool MFPMethod3::parallelFactorization(const std::string& number, std::vector<st
     mpz_init(n);
     
     // Convert string to mpz_t
-    mpz_set_str(n, number.c_str(), 10);
+    {
+        TraceScope trace(TraceEvent::STRING_CONVERSION, number.size());
+        mpz_set_str(n, number.c_str(), 10);
+    }
     
     // Check if n is even
     if (mpz_even_p(n) != 0) {
@@ -237,7 +484,7 @@ bool MFPMethod3::parallelFactorization(const std::string& number, std::vector<st
         // Convert n back to string and recursively factorize
         char* n_str = mpz_get_str(nullptr, 10, n);
         std::string remaining(n_str);
-        free(n_str);
+        freeGMPString(n_str);
         
         std::vector<std::string> remaining_factors = factorize(remaining);
         factors.insert(factors.end(), remaining_factors.begin(), remaining_factors.end());
@@ -246,21 +493,31 @@ bool MFPMethod3::parallelFactorization(const std::string& number, std::vector<st
         return true;
     }
     
+    // Word-size inputs split faster on one thread than the rho workers start
+    if (mpz_sizeinbase(n, 2) <= 128) {
+        mpz_clear(n);
+        return wordSizeSplit(number, factors);
+    }
+    
     // Mutex for thread synchronization
     std::mutex mtx;
     
     // Atomic flag to indicate if a factor was found
     std::atomic<bool> factor_found(false);
     
-    // Vector to hold thread objects
-    std::vector<std::thread> threads;
-    
     // Shared variables for the found factor
     mpz_t found_factor;
     mpz_init(found_factor);
     
+    // Workers poll the control of the call that started them
+    const CallControl& control = currentCallControl();
+    
     // Function to search for factors in a range
-    auto search_factors = [&](int thread_id) {
+    auto search_factors = [&](int thread_id, int max_iterations) {
+        CallControlScope control_scope(control);
+        PerfCounterRegistry::Scope perf_scope(PerfStage::FACTOR_SEARCH);
+        TraceScope worker_trace(TraceEvent::WORKER, thread_id);
+        
         // Create thread-local GMP variables
         mpz_t x, y, d, n_local, c;
         mpz_init(x);
@@ -294,7 +551,8 @@ bool MFPMethod3::parallelFactorization(const std::string& number, std::vector<st
         
         // Main loop
         int iterations = 0;
-        while (mpz_cmp_ui(d, 1) == 0 && !factor_found && iterations < 100000) {
+        TraceBlocks rho_trace(TraceEvent::RHO_BLOCK, TRACE_RHO_BLOCK);
+        while (mpz_cmp_ui(d, 1) == 0 && !factor_found && !isCancelled() && iterations < max_iterations) {
             // x = f(x)
             f(x, x);
             
@@ -308,6 +566,7 @@ bool MFPMethod3::parallelFactorization(const std::string& number, std::vector<st
             mpz_gcd(d, d, n_local);
             
             iterations++;
+            rho_trace.step();
         }
         
         // Check if we found a proper factor
@@ -328,22 +587,21 @@ bool MFPMethod3::parallelFactorization(const std::string& number, std::vector<st
         mpz_clear(c);
     };
     
-    // Create threads
-    for (int i = 0; i < m_numThreads; i++) {
-        threads.push_back(std::thread(search_factors, i));
-    }
-    
-    // Wait for all threads to complete
-    for (auto& thread : threads) {
-        thread.join();
-    }
+    // One rho worker per slot, each budget scaled by core speed so slow cores finish together with fast ones
+    std::vector<WorkerSlot> slots = selectWorkerSlots(false);
+    runWorkers(getEnginePool().get(), slots.size(),
+               [&](size_t i) {
+                   int max_iterations = std::max(1000, static_cast<int>(100000 * slots[i].speed));
+                   search_factors(static_cast<int>(i), max_iterations);
+               },
+               [&](size_t i, std::thread& thread) { pinToCPU(thread, slots[i].cpu_id); });
     
     // Check if a factor was found
     if (factor_found) {
         // Add the found factor to the list
         char* factor1 = mpz_get_str(nullptr, 10, found_factor);
         factors.push_back(std::string(factor1));
-        free(factor1);
+        freeGMPString(factor1);
         
         // Calculate the other factor
         mpz_t other_factor;
@@ -353,7 +611,7 @@ bool MFPMethod3::parallelFactorization(const std::string& number, std::vector<st
         // Add the other factor to the list
         char* factor2 = mpz_get_str(nullptr, 10, other_factor);
         factors.push_back(std::string(factor2));
-        free(factor2);
+        freeGMPString(factor2);
         
         // Free GMP variables
         mpz_clear(other_factor);
@@ -0,0 +1,350 @@
+#include "mfp_portfolio.h"
+#include "mfp_method1.h"
+#include "mfp_method2.h"
+#include "mfp_method3.h"
+#include "factor_graph.h"
+#include "thread_pool.h"
+#include "perf_counters.h"
+#include "trace.h"
+#include "memory_accounting.h"
+#include "factor/small_factors.h"
+#include <gmp.h>
+#include <algorithm>
+#include <functional>
+#include <thread>
+#include <vector>
+
+namespace mfp {
+
+namespace {
+
+// Divisor pairs 6k - 1, 6k + 1 claimed at a time by a sweep worker
+const uint64_t SWEEP_BLOCK = 1 << 12;
+
+// Entrants in order of preference when their win rates tie, which decides
+// who runs when the budget is smaller than the field
+const PortfolioEntrant ENTRANT_PREFERENCE[PORTFOLIO_ENTRANT_COUNT] = {
+    PortfolioEntrant::RHO, PortfolioEntrant::PARALLEL_RHO, PortfolioEntrant::FERMAT, PortfolioEntrant::TRIAL_DIVISION};
+
+// Entrants that put more than one thread to work
+bool isScalable(PortfolioEntrant entrant) {
+    return entrant == PortfolioEntrant::PARALLEL_RHO || entrant == PortfolioEntrant::TRIAL_DIVISION;
+}
+
+// Win rate with one win and one loss assumed up front, so unseen entrants start at 1/2
+double winRate(const PortfolioRecord& record) {
+    return (record.wins + 1.0) / (record.races + 2.0);
+}
+
+// Trial division by 6k +- 1 from just above the small-factor bound up to
+// sqrt(n), in blocks claimed by the workers. Pairs below 2^32 share one
+// remainder of n. stop is polled once per block.
+bool trialDivisionSweep(const mpz_t n, int threads, ThreadPool* pool, const std::function<bool()>& stop,
+                        mpz_t factor) {
+    mpz_t root;
+    mpz_init(root);
+    mpz_sqrt(root, n);
+    uint64_t limit = mpz_fits_ulong_p(root) ? mpz_get_ui(root) : UINT64_MAX / 2;
+    mpz_clear(root);
+    
+    const uint64_t first_k = SMALL_FACTOR_BOUND / 6 + 1;
+    std::atomic<uint64_t> next_block(0);
+    std::atomic<uint64_t> divisor(0);
+    
+    auto sweep = [&](int worker_id) {
+        PerfCounterRegistry::Scope perf_scope(PerfStage::TRIAL_DIVISION);
+        TraceScope worker_trace(TraceEvent::WORKER, worker_id);
+        while (divisor.load(std::memory_order_relaxed) == 0 && !stop()) {
+            uint64_t k_lo = first_k + next_block.fetch_add(1) * SWEEP_BLOCK;
+            if (6 * k_lo - 1 > limit) {
+                return;
+            }
+            for (uint64_t k = k_lo; k < k_lo + SWEEP_BLOCK && 6 * k - 1 <= limit; k++) {
+                uint64_t low = 6 * k - 1;
+                uint64_t high = 6 * k + 1;
+                uint64_t found = 0;
+                if (high < (1ULL << 32)) {
+                    uint64_t residue = mpz_fdiv_ui(n, low * high);
+                    found = residue % low == 0 ? low : residue % high == 0 ? high : 0;
+                } else {
+                    found = mpz_divisible_ui_p(n, low) ? low : mpz_divisible_ui_p(n, high) ? high : 0;
+                }
+                if (found != 0) {
+                    uint64_t none = 0;
+                    divisor.compare_exchange_strong(none, found);
+                    return;
+                }
+            }
+        }
+    };
+    
+    runWorkers(pool, static_cast<size_t>(threads), [&](size_t i) { sweep(static_cast<int>(i)); });
+    
+    if (divisor == 0) {
+        return false;
+    }
+    mpz_set_ui(factor, divisor);
+    return true;
+}
+
+// Parts are usable when there are at least two and none is trivial
+bool isProperSplit(const std::string& number, const std::vector<std::string>& parts) {
+    if (parts.size() < 2) {
+        return false;
+    }
+    for (const std::string& part : parts) {
+        if (part.empty() || part == "0" || part == "1" || part == number) {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+MFPPortfolio::MFPPortfolio(int numThreads) {
+    m_numThreads = (numThreads > 0) ? numThreads : std::thread::hardware_concurrency();
+    if (m_numThreads == 0) m_numThreads = 1; // Fallback to single thread
+}
+
+MFPPortfolio::~MFPPortfolio() {
+    // Nothing to clean up
+}
+
+bool MFPPortfolio::isPrime(const std::string& number) {
+    // Use the base class implementation
+    return MFPBase::isPrime(number);
+}
+
+std::vector<std::string> MFPPortfolio::factorize(const std::string& number) {
+    std::vector<std::string> factors;
+    
+    // A negative number is -1 times its magnitude, which is what races
+    if (!number.empty() && number[0] == '-') {
+        factors = factorize(number.substr(1));
+        factors.insert(factors.begin(), "-1");
+        return factors;
+    }
+    
+    // 0 and 1 have no prime factors, as with the other methods
+    if (decimalBitLength(number) < 2) {
+        return factors;
+    }
+    
+    // If the number is prime, just return it
+    if (isPrime(number)) {
+        factors.push_back(number);
+        return factors;
+    }
+    
+    // Small primes and perfect powers never reach the race
+    if (!smallFactorStripping(number, factors) && !perfectPowerFactorization(number, factors)) {
+        // The winner's cofactors are factored the same way, each in a fresh race
+        std::vector<std::string> parts;
+        if (splitComposite(number, parts)) {
+            for (const std::string& part : parts) {
+                std::vector<std::string> part_factors = factorize(part);
+                factors.insert(factors.end(), part_factors.begin(), part_factors.end());
+            }
+        } else {
+            // If all else fails, just return the number itself
+            factors.push_back(number);
+        }
+    }
+    
+    std::sort(factors.begin(), factors.end(), DecimalLess());
+    return factors;
+}
+
+std::string MFPPortfolio::findNextPrime(const std::string& number) {
+    // Use the base class implementation
+    return MFPBase::findNextPrime(number);
+}
+
+bool MFPPortfolio::splitComposite(const std::string& number, std::vector<std::string>& parts) {
+    // Word-size inputs split in microseconds; a race would only add thread starts
+    size_t bits = decimalBitLength(number);
+    if (bits <= 128) {
+        return wordSizeSplit(number, parts);
+    }
+    
+    PortfolioShares shares = planShares(bits);
+    
+    // Set by the first proper split; the other entrants poll it and give up.
+    // They also stop when the caller's own control says so (a scheduler
+    // budget, preemption or shutdown).
+    std::atomic<bool> cancel(false);
+    const CallControl& outer = currentCallControl();
+    std::mutex mtx;
+    int winner = -1;
+    std::vector<std::string> winning_parts;
+    
+    auto race = [&](size_t entrant) {
+        TraceScope worker_trace(TraceEvent::WORKER, static_cast<int>(entrant));
+        CallControl control;
+        control.cancel = &cancel;
+        if (!outer.empty()) {
+            control.checkpoint = [&outer] { return outer.stopped(); };
+        }
+        CallControlScope control_scope(std::move(control));
+        
+        std::vector<std::string> found;
+        if (runEntrant(static_cast<PortfolioEntrant>(entrant), shares[entrant], number, found) &&
+            isProperSplit(number, found)) {
+            std::lock_guard<std::mutex> lock(mtx);
+            if (winner < 0) {
+                winner = static_cast<int>(entrant);
+                winning_parts = found;
+                cancel = true;
+            }
+        }
+    };
+    
+    // On a busy engine pool the caller may run entrants one after another;
+    // the first to split still cancels the rest
+    std::vector<size_t> entrants;
+    for (size_t entrant = 0; entrant < PORTFOLIO_ENTRANT_COUNT; entrant++) {
+        if (shares[entrant] > 0) {
+            entrants.push_back(entrant);
+        }
+    }
+    runWorkers(getEnginePool().get(), entrants.size(), [&](size_t i) { race(entrants[i]); });
+    
+    // Every entrant that ran counts a race; the winner also a win
+    size_t bucket = MetricsRegistry::bitBucket(bits);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (size_t entrant = 0; entrant < PORTFOLIO_ENTRANT_COUNT; entrant++) {
+            if (shares[entrant] > 0) {
+                m_records[entrant][bucket].races++;
+            }
+        }
+        if (winner >= 0) {
+            m_records[winner][bucket].wins++;
+        }
+    }
+    
+    if (winner < 0) {
+        return false;
+    }
+    parts.insert(parts.end(), winning_parts.begin(), winning_parts.end());
+    return true;
+}
+
+PortfolioShares MFPPortfolio::planShares(size_t bits) const {
+    size_t bucket = MetricsRegistry::bitBucket(bits);
+    std::array<double, PORTFOLIO_ENTRANT_COUNT> rates;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (size_t entrant = 0; entrant < PORTFOLIO_ENTRANT_COUNT; entrant++) {
+            rates[entrant] = winRate(m_records[entrant][bucket]);
+        }
+    }
+    
+    // One thread each, best win rate first, while the budget lasts
+    std::vector<PortfolioEntrant> order(ENTRANT_PREFERENCE, ENTRANT_PREFERENCE + PORTFOLIO_ENTRANT_COUNT);
+    std::stable_sort(order.begin(), order.end(), [&rates](PortfolioEntrant a, PortfolioEntrant b) {
+        return rates[static_cast<size_t>(a)] > rates[static_cast<size_t>(b)];
+    });
+    
+    PortfolioShares shares = {};
+    int spare = m_numThreads;
+    std::vector<size_t> scalable;
+    for (PortfolioEntrant entrant : order) {
+        if (spare == 0) {
+            break;
+        }
+        shares[static_cast<size_t>(entrant)] = 1;
+        spare--;
+        if (isScalable(entrant)) {
+            scalable.push_back(static_cast<size_t>(entrant));
+        }
+    }
+    if (spare == 0 || scalable.empty()) {
+        return shares;
+    }
+    
+    // Spare threads to the scalable entrants by win rate, largest remainders first
+    double total = 0.0;
+    for (size_t entrant : scalable) {
+        total += rates[entrant];
+    }
+    std::vector<std::pair<double, size_t>> remainders;
+    int given = 0;
+    for (size_t entrant : scalable) {
+        double exact = spare * rates[entrant] / total;
+        int whole = static_cast<int>(exact);
+        shares[entrant] += whole;
+        given += whole;
+        remainders.push_back({exact - whole, entrant});
+    }
+    std::stable_sort(remainders.begin(), remainders.end(),
+                     [](const std::pair<double, size_t>& a, const std::pair<double, size_t>& b) { return a.first > b.first; });
+    for (size_t i = 0; given < spare; i = (i + 1) % remainders.size(), given++) {
+        shares[remainders[i].second]++;
+    }
+    
+    return shares;
+}
+
+PortfolioRecord MFPPortfolio::getRecord(PortfolioEntrant entrant, size_t bit_bucket) const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_records[static_cast<size_t>(entrant)][std::min(bit_bucket, METRICS_BIT_BUCKET_COUNT - 1)];
+}
+
+const char* MFPPortfolio::entrantName(PortfolioEntrant entrant) {
+    switch (entrant) {
+        case PortfolioEntrant::FERMAT: return "fermat";
+        case PortfolioEntrant::RHO: return "rho";
+        case PortfolioEntrant::PARALLEL_RHO: return "parallel_rho";
+        case PortfolioEntrant::TRIAL_DIVISION: return "trial_division";
+    }
+    return "unknown";
+}
+
+bool MFPPortfolio::runEntrant(PortfolioEntrant entrant, int threads, const std::string& number,
+                              std::vector<std::string>& parts) {
+    switch (entrant) {
+        case PortfolioEntrant::FERMAT: {
+            MFPMethod1 method;
+            return method.splitComposite(number, parts);
+        }
+        case PortfolioEntrant::RHO: {
+            MFPMethod2 method;
+            return method.splitComposite(number, parts);
+        }
+        case PortfolioEntrant::PARALLEL_RHO: {
+            MFPMethod3 method(threads);
+            method.setEnginePool(getEnginePool());
+            return method.splitComposite(number, parts);
+        }
+        case PortfolioEntrant::TRIAL_DIVISION: {
+            mpz_t n, factor;
+            mpz_init(n);
+            mpz_init(factor);
+            {
+                TraceScope trace(TraceEvent::STRING_CONVERSION, number.size());
+                mpz_set_str(n, number.c_str(), 10);
+            }
+            // The sweep workers poll this thread's control
+            const CallControl& control = currentCallControl();
+            bool found = trialDivisionSweep(n, threads, getEnginePool().get(),
+                                            [&control] { return control.stopped(); }, factor);
+            if (found) {
+                char* factor1 = mpz_get_str(nullptr, 10, factor);
+                parts.push_back(std::string(factor1));
+                freeGMPString(factor1);
+                mpz_divexact(n, n, factor);
+                char* factor2 = mpz_get_str(nullptr, 10, n);
+                parts.push_back(std::string(factor2));
+                freeGMPString(factor2);
+            }
+            mpz_clear(n);
+            mpz_clear(factor);
+            return found;
+        }
+    }
+    return false;
+}
+
+} // namespace mfp
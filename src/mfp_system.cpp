@@ -1,81 +1,312 @@
 #include "mfp_system.h"
+#include "metrics.h"
+#include <atomic>
+#include <chrono>
 #include <iostream>
+#include <stdexcept>
 #include <thread>
+#include <utility>
 
 namespace mfp {
 
+namespace {
+
+std::unique_ptr<MFPBase> createMethod(MFPMethodType method, int numThreads) {
+    switch (method) {
+        case MFPMethodType::METHOD_1:
+            return std::make_unique<MFPMethod1>();
+        case MFPMethodType::METHOD_2:
+            return std::make_unique<MFPMethod2>();
+        case MFPMethodType::METHOD_3:
+            return std::make_unique<MFPMethod3>(numThreads);
+        case MFPMethodType::PORTFOLIO:
+            return std::make_unique<MFPPortfolio>(numThreads);
+        case MFPMethodType::AUTO:
+            // For AUTO, use Method 3 if we have multiple cores, otherwise use Method 2
+            if (numThreads > 1) {
+                return std::make_unique<MFPMethod3>(numThreads);
+            }
+            return std::make_unique<MFPMethod2>();
+    }
+    return std::make_unique<MFPMethod2>();
+}
+
+// A method whose engine workers run on pool, or on threads of their own when
+// pool is null
+std::unique_ptr<MFPBase> createMethodInstance(MFPMethodType method, int numThreads,
+                                              std::shared_ptr<ThreadPool> pool) {
+    std::unique_ptr<MFPBase> instance = createMethod(method, numThreads);
+    instance->setEnginePool(std::move(pool));
+    return instance;
+}
+
+// The result of a job queued by a synchronous call. A stopped job has no
+// answer, and reporting its empty fields would turn a timeout into
+// "composite" or "no factors".
+JobResult runScheduled(JobScheduler& scheduler, MetricsOperation operation, const std::string& number) {
+    JobResult result = scheduler.submit(operation, number).get();
+    if (result.status != JobStatus::COMPLETED) {
+        throw std::runtime_error(std::string(MetricsRegistry::operationName(operation)) + " of " + number +
+                                 " was stopped before it finished");
+    }
+    return result;
+}
+
+uint64_t elapsedNanoseconds(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Usage of the calling thread's most recent request and the system it was on
+struct LastRequestMemory {
+    const MFPSystem* system = nullptr;
+    MemoryUsage usage;
+};
+
+thread_local LastRequestMemory t_last_request;
+
+} // namespace
+
 MFPSystem::MFPSystem(MFPMethodType method, int numThreads) 
-    : m_methodType(method), m_numThreads(numThreads) {
+    : m_numThreads(numThreads), m_methodType(method) {
     // If numThreads is not specified, use all available cores
     if (m_numThreads <= 0) {
         m_numThreads = std::thread::hardware_concurrency();
         if (m_numThreads == 0) m_numThreads = 1; // Fallback to single thread
     }
     
+    // Account GMP allocations from here on
+    getMemoryAccounting().installGMPHooks();
+    
+    // Factor graphs and engine workers of every caller share one pool
+    m_pool = std::make_shared<ThreadPool>(m_numThreads);
+    
     // Create the appropriate method
-    createMethod();
+    m_method = createMethodInstance(m_methodType, m_numThreads, m_pool);
 }
 
 MFPSystem::~MFPSystem() {
-    // m_method is a unique_ptr, so it will be automatically deleted
+    // Stop the scheduler and shadow workers before the pool and method go
+    m_scheduler.reset();
+    m_shadow.reset();
 }
 
 bool MFPSystem::isPrime(const std::string& number) {
-    if (!m_method) {
-        createMethod();
-    }
+    Snapshot current = snapshot();
     
-    return m_method->isPrime(number);
+    MetricsRegistry::Scope scope(getMetricsRegistry(), MetricsOperation::IS_PRIME, number);
+    MemoryAccounting::RequestScope memory(getMemoryAccounting());
+    bool shadowed = current.shadow && current.shadow->sample();
+    auto start = std::chrono::steady_clock::now();
+    bool result = current.scheduler
+        ? runScheduled(*current.scheduler, MetricsOperation::IS_PRIME, number).is_prime
+        : current.method->isPrime(number);
+    recordRequestMemory(memory.getUsage());
+    if (shadowed) {
+        current.shadow->submitIsPrime(number, result, elapsedNanoseconds(start));
+    }
+    return result;
+}
+
+Factorization MFPSystem::factorization(const std::string& number) {
+    Factorization result;
+    if (!Factorization::fromPrimePowers(factorizePrimePowers(number), result)) {
+        // Never return a partial result as if it were the whole factorization
+        throw std::invalid_argument("Cannot factorize " + number + ": a factor is not a number");
+    }
+    return result;
 }
 
 std::vector<std::string> MFPSystem::factorize(const std::string& number) {
-    if (!m_method) {
-        createMethod();
+    return expandPrimeFactors(factorizePrimePowers(number));
+}
+
+PrimeFactorMap MFPSystem::factorizePrimePowers(const std::string& number) {
+    // Malformed input never reaches the scheduler or the engines
+    bool negative = false;
+    factorableMagnitude(number, negative);
+    
+    Snapshot current = snapshot();
+    
+    MetricsRegistry::Scope scope(getMetricsRegistry(), MetricsOperation::FACTORIZE, number);
+    MemoryAccounting::RequestScope memory(getMemoryAccounting());
+    bool shadowed = current.shadow && current.shadow->sample();
+    auto start = std::chrono::steady_clock::now();
+    PrimeFactorMap result;
+    if (current.scheduler) {
+        result = runScheduled(*current.scheduler, MetricsOperation::FACTORIZE, number).prime_factors;
+    } else {
+        FactorGraph graph(*current.method, *m_pool);
+        result = graph.factorize(number);
+    }
+    recordRequestMemory(memory.getUsage());
+    if (shadowed) {
+        current.shadow->submitFactorize(number, expandPrimeFactors(result), elapsedNanoseconds(start));
     }
+    return result;
+}
+
+std::string MFPSystem::streamFactors(const std::string& number, const FactorCallback& callback) {
+    Snapshot current = snapshot();
+    
+    // The flag is this call's own control, so stopping cancels only its engines
+    std::atomic<bool> cancel(false);
+    CallControl control;
+    control.cancel = &cancel;
+    CallControlScope control_scope(std::move(control));
     
-    return m_method->factorize(number);
+    MetricsRegistry::Scope scope(getMetricsRegistry(), MetricsOperation::FACTORIZE, number);
+    MemoryAccounting::RequestScope memory(getMemoryAccounting());
+    FactorGraph graph(*current.method, *m_pool);
+    std::string cofactor = graph.stream(number, [&](const StreamedFactor& factor) {
+        if (callback(factor)) {
+            return true;
+        }
+        cancel = true;
+        return false;
+    });
+    recordRequestMemory(memory.getUsage());
+    return cofactor;
 }
 
 std::string MFPSystem::findNextPrime(const std::string& number) {
-    if (!m_method) {
-        createMethod();
-    }
+    Snapshot current = snapshot();
     
-    return m_method->findNextPrime(number);
+    MetricsRegistry::Scope scope(getMetricsRegistry(), MetricsOperation::NEXT_PRIME, number);
+    MemoryAccounting::RequestScope memory(getMemoryAccounting());
+    bool shadowed = current.shadow && current.shadow->sample();
+    auto start = std::chrono::steady_clock::now();
+    std::string result = current.scheduler
+        ? runScheduled(*current.scheduler, MetricsOperation::NEXT_PRIME, number).next_prime
+        : current.method->findNextPrime(number);
+    recordRequestMemory(memory.getUsage());
+    if (shadowed) {
+        current.shadow->submitNextPrime(number, result, elapsedNanoseconds(start));
+    }
+    return result;
 }
 
 void MFPSystem::setMethod(MFPMethodType method) {
-    if (m_methodType != method) {
-        m_methodType = method;
-        createMethod();
+    if (getMethod() == method) {
+        return;
     }
+    
+    // Build outside the lock; type and instance change together
+    std::shared_ptr<MFPBase> instance = createMethodInstance(method, m_numThreads, m_pool);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_methodType = method;
+    m_method = std::move(instance);
 }
 
 MFPMethodType MFPSystem::getMethod() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
     return m_methodType;
 }
 
-void MFPSystem::createMethod() {
-    // Create the appropriate method based on the method type
-    switch (m_methodType) {
-        case MFPMethodType::METHOD_1:
-            m_method = std::make_unique<MFPMethod1>();
-            break;
-        case MFPMethodType::METHOD_2:
-            m_method = std::make_unique<MFPMethod2>();
-            break;
-        case MFPMethodType::METHOD_3:
-            m_method = std::make_unique<MFPMethod3>(m_numThreads);
-            break;
-        case MFPMethodType::AUTO:
-            // For AUTO, use Method 3 if we have multiple cores, otherwise use Method 2
-            if (m_numThreads > 1) {
-                m_method = std::make_unique<MFPMethod3>(m_numThreads);
-            } else {
-                m_method = std::make_unique<MFPMethod2>();
-            }
-            break;
+const MemoryUsage& MFPSystem::getLastRequestMemory() const {
+    static const MemoryUsage none;
+    return t_last_request.system == this ? t_last_request.usage : none;
+}
+
+void MFPSystem::enableShadowMode(MFPMethodType method, double sample_rate, int num_threads) {
+    int threads = num_threads > 0 ? num_threads : m_numThreads;
+    // Shadow engines start their own threads, which inherit the shadow thread's lower priority
+    std::shared_ptr<ShadowExecutor> shadow = std::make_shared<ShadowExecutor>(
+        [method, threads]() { return createMethodInstance(method, threads, nullptr); }, sample_rate);
+    
+    // The old executor drains outside the lock
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_shadow.swap(shadow);
+}
+
+void MFPSystem::disableShadowMode() {
+    std::shared_ptr<ShadowExecutor> old;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        old.swap(m_shadow);
+    }
+}
+
+bool MFPSystem::isShadowModeEnabled() const {
+    return snapshot().shadow != nullptr;
+}
+
+ShadowStats MFPSystem::getShadowStats() const {
+    std::shared_ptr<ShadowExecutor> shadow = snapshot().shadow;
+    return shadow ? shadow->getStats() : ShadowStats();
+}
+
+std::vector<ShadowDisagreement> MFPSystem::getShadowDisagreements() const {
+    std::shared_ptr<ShadowExecutor> shadow = snapshot().shadow;
+    return shadow ? shadow->getDisagreements() : std::vector<ShadowDisagreement>();
+}
+
+void MFPSystem::waitForShadowRuns() {
+    std::shared_ptr<ShadowExecutor> shadow = snapshot().shadow;
+    if (shadow) {
+        shadow->waitForIdle();
     }
 }
 
+void MFPSystem::enableScheduler(const SchedulerParams& params) {
+    std::shared_ptr<JobScheduler> scheduler = createScheduler(params);
+    
+    // The old scheduler finishes its running jobs outside the lock
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_scheduler.swap(scheduler);
+}
+
+void MFPSystem::disableScheduler() {
+    std::shared_ptr<JobScheduler> old;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        old.swap(m_scheduler);
+    }
+}
+
+bool MFPSystem::isSchedulerEnabled() const {
+    return snapshot().scheduler != nullptr;
+}
+
+std::future<JobResult> MFPSystem::submit(MetricsOperation operation, const std::string& number,
+                                         const JobOptions& options) {
+    std::shared_ptr<JobScheduler> scheduler = snapshot().scheduler;
+    if (!scheduler) {
+        // Callers racing to turn scheduler mode on share the first one
+        std::shared_ptr<JobScheduler> created = createScheduler(SchedulerParams());
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_scheduler) {
+            m_scheduler = created;
+        }
+        scheduler = m_scheduler;
+    }
+    return scheduler->submit(operation, number, options);
+}
+
+SchedulerStats MFPSystem::getSchedulerStats() const {
+    std::shared_ptr<JobScheduler> scheduler = snapshot().scheduler;
+    return scheduler ? scheduler->getStats() : SchedulerStats();
+}
+
+std::shared_ptr<JobScheduler> MFPSystem::createScheduler(const SchedulerParams& params) {
+    SchedulerParams scheduler_params = params;
+    if (scheduler_params.num_workers <= 0) {
+        scheduler_params.num_workers = m_numThreads;
+    }
+    scheduler_params.factor_pool = m_pool.get();
+    
+    // Jobs run on the method that is current when they start
+    return std::make_shared<JobScheduler>(
+        [this]() { return createMethodInstance(getMethod(), m_numThreads, m_pool); }, scheduler_params);
+}
+
+MFPSystem::Snapshot MFPSystem::snapshot() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return Snapshot{m_method, m_shadow, m_scheduler};
+}
+
+void MFPSystem::recordRequestMemory(const MemoryUsage& usage) const {
+    t_last_request.system = this;
+    t_last_request.usage = usage;
+}
+
 } // namespace mfp
@@ -0,0 +1,398 @@
+#include "perf_counters.h"
+#include <chrono>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace mfp {
+
+namespace {
+
+// Counters owned by one thread, closed when the thread exits
+struct ThreadCounters {
+    std::array<int, PERF_EVENT_COUNT> fds;
+    bool probed = false;
+    PerfCounterRegistry::Scope* current = nullptr;
+    
+    ThreadCounters() {
+        fds.fill(-1);
+    }
+    
+    ~ThreadCounters() {
+#ifdef __linux__
+        for (int fd : fds) {
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+#endif
+    }
+};
+
+thread_local ThreadCounters t_counters;
+
+uint64_t steadyNanoseconds() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+#ifdef __linux__
+// Event type and config for each PerfEvent
+struct EventConfig {
+    uint32_t type;
+    uint64_t config;
+};
+
+const EventConfig EVENT_CONFIGS[PERF_EVENT_COUNT] = {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                         (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+};
+
+int openEvent(const EventConfig& event) {
+    struct perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = event.type;
+    attr.config = event.config;
+    attr.exclude_kernel = 1;   // User-space only, which perf_event_paranoid 2 still allows
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    
+    // Count the calling thread on whichever CPU it runs
+    return static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC));
+}
+
+std::string deniedReason(int error) {
+    if (error == EACCES || error == EPERM) {
+        std::string paranoid = "unknown";
+        std::ifstream file("/proc/sys/kernel/perf_event_paranoid");
+        if (file) {
+            file >> paranoid;
+        }
+        return "permission denied (kernel.perf_event_paranoid is " + paranoid +
+               "; lower it or grant CAP_PERFMON)";
+    }
+    if (error == ENOENT || error == EOPNOTSUPP || error == ENODEV) {
+        return "no hardware PMU is exposed to this system";
+    }
+    if (error == ENOSYS) {
+        return "perf_event_open is not supported by this kernel";
+    }
+    return std::string("perf_event_open failed: ") + std::strerror(error);
+}
+#endif
+
+} // namespace
+
+double PerfStageTotals::instructionsPerCycle() const {
+    size_t cycles = static_cast<size_t>(PerfEvent::CYCLES);
+    size_t instructions = static_cast<size_t>(PerfEvent::INSTRUCTIONS);
+    if (!counted[cycles] || !counted[instructions] || events[cycles] == 0) {
+        return 0.0;
+    }
+    return static_cast<double>(events[instructions]) / events[cycles];
+}
+
+double PerfStageTotals::effectiveGHz() const {
+    size_t cycles = static_cast<size_t>(PerfEvent::CYCLES);
+    if (!counted[cycles] || nanoseconds == 0) {
+        return 0.0;
+    }
+    return static_cast<double>(events[cycles]) / nanoseconds;
+}
+
+PerfCounterRegistry::PerfCounterRegistry()
+    : m_enabled(false), m_available(false), m_denied(false) {
+}
+
+PerfCounterRegistry::Scope::Scope(PerfStage stage)
+    : m_active(getPerfCounters().isEnabled()), m_stage(stage), m_parent(nullptr) {
+    if (!m_active) {
+        return;
+    }
+    
+    getPerfCounters().probe();
+    takeReading(m_checkpoint);
+    
+    // Pause the enclosing stage so each count lands in exactly one stage
+    m_parent = t_counters.current;
+    if (m_parent != nullptr) {
+        m_parent->charge(m_checkpoint);
+    }
+    t_counters.current = this;
+}
+
+PerfCounterRegistry::Scope::~Scope() {
+    if (!m_active) {
+        return;
+    }
+    
+    Reading now;
+    takeReading(now);
+    charge(now);
+    getPerfCounters().add(m_stage, 0, {}, {}, true);
+    
+    // Resume the enclosing stage from here
+    t_counters.current = m_parent;
+    if (m_parent != nullptr) {
+        m_parent->m_checkpoint = now;
+    }
+}
+
+void PerfCounterRegistry::Scope::charge(const Reading& now) {
+    std::array<uint64_t, PERF_EVENT_COUNT> events{};
+    std::array<bool, PERF_EVENT_COUNT> counted{};
+    
+    for (size_t i = 0; i < PERF_EVENT_COUNT; i++) {
+        if (t_counters.fds[i] < 0) {
+            continue;
+        }
+        
+        // Scale up when the kernel multiplexed the event off the PMU for part of the interval
+        uint64_t value = now.values[i] - m_checkpoint.values[i];
+        uint64_t enabled = now.enabled[i] - m_checkpoint.enabled[i];
+        uint64_t running = now.running[i] - m_checkpoint.running[i];
+        if (running > 0 && running < enabled) {
+            value = static_cast<uint64_t>(static_cast<double>(value) * enabled / running);
+        }
+        
+        events[i] = value;
+        counted[i] = true;
+    }
+    
+    getPerfCounters().add(m_stage, now.nanoseconds - m_checkpoint.nanoseconds, events, counted, false);
+    m_checkpoint = now;
+}
+
+void PerfCounterRegistry::Scope::takeReading(Reading& reading) {
+#ifdef __linux__
+    for (size_t i = 0; i < PERF_EVENT_COUNT; i++) {
+        if (t_counters.fds[i] < 0) {
+            continue;
+        }
+        
+        uint64_t buffer[3] = {0, 0, 0};
+        if (read(t_counters.fds[i], buffer, sizeof(buffer)) == static_cast<ssize_t>(sizeof(buffer))) {
+            reading.values[i] = buffer[0];
+            reading.enabled[i] = buffer[1];
+            reading.running[i] = buffer[2];
+        }
+    }
+#endif
+
+    reading.nanoseconds = steadyNanoseconds();
+}
+
+void PerfCounterRegistry::setEnabled(bool enabled) {
+    m_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+bool PerfCounterRegistry::isEnabled() const {
+    return m_enabled.load(std::memory_order_relaxed);
+}
+
+bool PerfCounterRegistry::probe() {
+    if (t_counters.probed) {
+        for (int fd : t_counters.fds) {
+            if (fd >= 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+    t_counters.probed = true;
+    
+    // A refusal applies to every thread, so later threads skip the syscalls
+    if (m_denied.load(std::memory_order_relaxed)) {
+        return false;
+    }
+
+#ifdef __linux__
+    bool any_opened = false;
+    int first_error = 0;
+    for (size_t i = 0; i < PERF_EVENT_COUNT; i++) {
+        t_counters.fds[i] = openEvent(EVENT_CONFIGS[i]);
+        if (t_counters.fds[i] >= 0) {
+            any_opened = true;
+        } else if (first_error == 0) {
+            first_error = errno;
+        }
+    }
+    
+    recordOpenResult(any_opened, any_opened ? std::string() : deniedReason(first_error));
+    return any_opened;
+#else
+    recordOpenResult(false, "perf_event_open is only available on Linux");
+    return false;
+#endif
+}
+
+bool PerfCounterRegistry::isAvailable() const {
+    return m_available.load(std::memory_order_relaxed);
+}
+
+std::string PerfCounterRegistry::getUnavailableReason() const {
+    std::lock_guard<std::mutex> lock(m_reason_mutex);
+    return m_unavailable_reason;
+}
+
+PerfStageTotals PerfCounterRegistry::getTotals(PerfStage stage) const {
+    const StageCounters& counters = m_stages[static_cast<size_t>(stage)];
+    PerfStageTotals totals;
+    totals.calls = counters.calls.load(std::memory_order_relaxed);
+    totals.nanoseconds = counters.nanoseconds.load(std::memory_order_relaxed);
+    for (size_t i = 0; i < PERF_EVENT_COUNT; i++) {
+        totals.events[i] = counters.events[i].load(std::memory_order_relaxed);
+        totals.counted[i] = counters.counted[i].load(std::memory_order_relaxed);
+    }
+    return totals;
+}
+
+void PerfCounterRegistry::reset() {
+    for (StageCounters& counters : m_stages) {
+        counters.calls.store(0, std::memory_order_relaxed);
+        counters.nanoseconds.store(0, std::memory_order_relaxed);
+        for (size_t i = 0; i < PERF_EVENT_COUNT; i++) {
+            counters.events[i].store(0, std::memory_order_relaxed);
+            counters.counted[i].store(false, std::memory_order_relaxed);
+        }
+    }
+}
+
+std::string PerfCounterRegistry::formatReport() const {
+    std::ostringstream ss;
+    const PerfStage stages[] = {PerfStage::PRIMALITY_FILTER, PerfStage::PRIMALITY_TEST,
+                                PerfStage::FACTOR_SEARCH, PerfStage::TRIAL_DIVISION,
+                                PerfStage::WORD_SIZE, PerfStage::SMALL_FACTORS};
+    
+    if (isAvailable()) {
+        ss << "Hardware counters (per stage, summed over threads):" << std::endl;
+    } else {
+        std::string reason = getUnavailableReason();
+        ss << "Hardware counters unavailable: " << (reason.empty() ? "not probed" : reason)
+           << "; showing stage timings only" << std::endl;
+    }
+    
+    ss << "  " << std::left << std::setw(18) << "Stage" << std::right
+       << std::setw(8) << "Calls" << std::setw(12) << "Time (ms)";
+    for (size_t i = 0; i < PERF_EVENT_COUNT; i++) {
+        ss << std::setw(15) << eventName(static_cast<PerfEvent>(i));
+    }
+    ss << std::setw(7) << "IPC" << std::setw(7) << "GHz" << std::endl;
+    
+    bool any_calls = false;
+    for (PerfStage stage : stages) {
+        PerfStageTotals totals = getTotals(stage);
+        if (totals.calls == 0) {
+            continue;
+        }
+        any_calls = true;
+        
+        ss << "  " << std::left << std::setw(18) << stageName(stage) << std::right
+           << std::setw(8) << totals.calls
+           << std::setw(12) << std::fixed << std::setprecision(3) << totals.nanoseconds / 1e6;
+        for (size_t i = 0; i < PERF_EVENT_COUNT; i++) {
+            if (totals.counted[i]) {
+                ss << std::setw(15) << totals.events[i];
+            } else {
+                ss << std::setw(15) << "-";
+            }
+        }
+        
+        ss << std::setprecision(2);
+        if (totals.counted[static_cast<size_t>(PerfEvent::CYCLES)]) {
+            ss << std::setw(7) << totals.instructionsPerCycle() << std::setw(7) << totals.effectiveGHz();
+        } else {
+            ss << std::setw(7) << "-" << std::setw(7) << "-";
+        }
+        ss << std::endl;
+    }
+    
+    if (!any_calls) {
+        ss << "  (no instrumented stages ran)" << std::endl;
+    }
+    
+    return ss.str();
+}
+
+const char* PerfCounterRegistry::stageName(PerfStage stage) {
+    switch (stage) {
+        case PerfStage::PRIMALITY_FILTER:
+            return "primality-filter";
+        case PerfStage::PRIMALITY_TEST:
+            return "primality-test";
+        case PerfStage::FACTOR_SEARCH:
+            return "factor-search";
+        case PerfStage::TRIAL_DIVISION:
+            return "trial-division";
+        case PerfStage::WORD_SIZE:
+            return "word-size";
+        case PerfStage::SMALL_FACTORS:
+            return "small-factors";
+    }
+    return "unknown";
+}
+
+const char* PerfCounterRegistry::eventName(PerfEvent event) {
+    switch (event) {
+        case PerfEvent::CYCLES:
+            return "cycles";
+        case PerfEvent::INSTRUCTIONS:
+            return "instructions";
+        case PerfEvent::L1D_MISSES:
+            return "l1d-misses";
+        case PerfEvent::LLC_MISSES:
+            return "llc-misses";
+        case PerfEvent::BRANCH_MISSES:
+            return "branch-misses";
+    }
+    return "unknown";
+}
+
+void PerfCounterRegistry::add(PerfStage stage, uint64_t nanoseconds, const std::array<uint64_t, PERF_EVENT_COUNT>& events,
+                              const std::array<bool, PERF_EVENT_COUNT>& counted, bool finished) {
+    StageCounters& counters = m_stages[static_cast<size_t>(stage)];
+    if (finished) {
+        counters.calls.fetch_add(1, std::memory_order_relaxed);
+    }
+    counters.nanoseconds.fetch_add(nanoseconds, std::memory_order_relaxed);
+    
+    for (size_t i = 0; i < PERF_EVENT_COUNT; i++) {
+        if (counted[i]) {
+            counters.events[i].fetch_add(events[i], std::memory_order_relaxed);
+            counters.counted[i].store(true, std::memory_order_relaxed);
+        }
+    }
+}
+
+void PerfCounterRegistry::recordOpenResult(bool any_opened, const std::string& reason) {
+    if (any_opened) {
+        m_available.store(true, std::memory_order_relaxed);
+        return;
+    }
+    
+    m_denied.store(true, std::memory_order_relaxed);
+    std::lock_guard<std::mutex> lock(m_reason_mutex);
+    if (m_unavailable_reason.empty()) {
+        m_unavailable_reason = reason;
+    }
+}
+
+PerfCounterRegistry& getPerfCounters() {
+    static PerfCounterRegistry s_registry;
+    return s_registry;
+}
+
+} // namespace mfp
@@ -0,0 +1,206 @@
+#include "shadow_executor.h"
+#include "factor_graph.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <chrono>
+
+#ifdef __linux__
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace mfp {
+
+namespace {
+
+// Niceness of the shadow thread; engines it starts inherit it
+const int SHADOW_NICE = 10;
+
+void lowerThreadPriority() {
+#ifdef __linux__
+    // Linux applies nice values per thread
+    setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), SHADOW_NICE);
+#endif
+}
+
+} // namespace
+
+double ShadowStats::meanLatencyDeltaMs() const {
+    if (completed == 0) {
+        return 0.0;
+    }
+    double delta = static_cast<double>(shadow_nanoseconds) - static_cast<double>(primary_nanoseconds);
+    return delta / completed / 1e6;
+}
+
+ShadowExecutor::ShadowExecutor(MethodFactory factory, double sample_rate, size_t max_queue)
+    : m_factory(std::move(factory)),
+      m_sample_rate(std::min(1.0, std::max(0.0, sample_rate))),
+      m_max_queue(std::max<size_t>(1, max_queue)),
+      m_sample_credit(0.0),
+      m_busy(false),
+      m_stopping(false),
+      m_cancel(false) {
+    m_worker = std::thread(&ShadowExecutor::workerLoop, this);
+}
+
+ShadowExecutor::~ShadowExecutor() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+        m_queue.clear();
+    }
+    // A shadow run on a hard input may take unboundedly long; stop it
+    m_cancel = true;
+    m_cv.notify_all();
+    m_worker.join();
+}
+
+bool ShadowExecutor::sample() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_sample_credit += m_sample_rate;
+    if (m_sample_credit >= 1.0) {
+        m_sample_credit -= 1.0;
+        return true;
+    }
+    return false;
+}
+
+void ShadowExecutor::submitIsPrime(const std::string& number, bool primary_result, uint64_t primary_nanoseconds) {
+    submit({MetricsOperation::IS_PRIME, number, primary_result ? "prime" : "composite", primary_nanoseconds});
+}
+
+void ShadowExecutor::submitFactorize(const std::string& number, const std::vector<std::string>& primary_result,
+                                     uint64_t primary_nanoseconds) {
+    submit({MetricsOperation::FACTORIZE, number, canonicalFactors(primary_result), primary_nanoseconds});
+}
+
+void ShadowExecutor::submitNextPrime(const std::string& number, const std::string& primary_result,
+                                     uint64_t primary_nanoseconds) {
+    submit({MetricsOperation::NEXT_PRIME, number, primary_result, primary_nanoseconds});
+}
+
+void ShadowExecutor::waitForIdle() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_idle_cv.wait(lock, [this] { return m_queue.empty() && !m_busy; });
+}
+
+ShadowStats ShadowExecutor::getStats() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats;
+}
+
+std::vector<ShadowDisagreement> ShadowExecutor::getDisagreements() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_disagreements;
+}
+
+double ShadowExecutor::getSampleRate() const {
+    return m_sample_rate;
+}
+
+std::string ShadowExecutor::canonicalFactors(std::vector<std::string> factors) {
+    // Order numerically: shorter decimal strings are smaller
+    std::sort(factors.begin(), factors.end(), [](const std::string& a, const std::string& b) {
+        return a.size() != b.size() ? a.size() < b.size() : a < b;
+    });
+    
+    std::string result;
+    for (const auto& factor : factors) {
+        if (!result.empty()) {
+            result += " * ";
+        }
+        result += factor;
+    }
+    return result;
+}
+
+void ShadowExecutor::submit(Job job) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_queue.size() >= m_max_queue) {
+            m_stats.dropped++;
+            return;
+        }
+        m_stats.sampled++;
+        m_queue.push_back(std::move(job));
+    }
+    m_cv.notify_one();
+}
+
+void ShadowExecutor::workerLoop() {
+    lowerThreadPriority();
+    
+    // The shadow engine lives on this thread and a one-thread graph pool
+    // started from it, and every run on it stops once the executor is destroyed
+    std::unique_ptr<MFPBase> method = m_factory();
+    ThreadPool pool(1);
+    CallControl control;
+    control.cancel = &m_cancel;
+    CallControlScope control_scope(std::move(control));
+    
+    while (true) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cv.wait(lock, [this] { return m_stopping || !m_queue.empty(); });
+            if (m_stopping) {
+                return;
+            }
+            job = std::move(m_queue.front());
+            m_queue.pop_front();
+            m_busy = true;
+        }
+        
+        auto start = std::chrono::steady_clock::now();
+        std::string shadow_result;
+        bool failed = false;
+        try {
+            shadow_result = run(*method, pool, job);
+        } catch (const std::exception& e) {
+            shadow_result = std::string("exception: ") + e.what();
+            failed = true;
+        }
+        uint64_t shadow_nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count();
+        
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_stopping) {
+                // A cancelled run has no result to compare
+                return;
+            }
+            m_stats.completed++;
+            m_stats.primary_nanoseconds += job.primary_nanoseconds;
+            m_stats.shadow_nanoseconds += shadow_nanoseconds;
+            
+            if (failed || shadow_result != job.primary_result) {
+                m_stats.disagreements++;
+                if (m_disagreements.size() < MAX_SHADOW_DISAGREEMENTS) {
+                    m_disagreements.push_back({job.operation, job.number, job.primary_result, shadow_result});
+                }
+            }
+            
+            m_busy = false;
+        }
+        m_idle_cv.notify_all();
+    }
+}
+
+std::string ShadowExecutor::run(MFPBase& method, ThreadPool& pool, const Job& job) {
+    switch (job.operation) {
+        case MetricsOperation::IS_PRIME:
+            return method.isPrime(job.number) ? "prime" : "composite";
+        case MetricsOperation::FACTORIZE: {
+            // The same factor graph as the primary, so only the engines differ
+            FactorGraph graph(method, pool);
+            return canonicalFactors(expandPrimeFactors(graph.factorize(job.number)));
+        }
+        case MetricsOperation::NEXT_PRIME:
+            return method.findNextPrime(job.number);
+    }
+    return std::string();
+}
+
+} // namespace mfp
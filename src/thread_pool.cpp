@@ -0,0 +1,142 @@
+#include "thread_pool.h"
+#include "trace.h"
+#include <exception>
+
+namespace mfp {
+
+ThreadPool::ThreadPool(int numThreads) : m_stopping(false) {
+    if (numThreads <= 0) {
+        numThreads = std::thread::hardware_concurrency();
+        if (numThreads <= 0) numThreads = 1; // Fallback to single thread
+    }
+    
+    for (int i = 0; i < numThreads; i++) {
+        m_workers.emplace_back([this] { workerLoop(); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_cv.notify_all();
+    
+    for (auto& worker : m_workers) {
+        worker.join();
+    }
+}
+
+void ThreadPool::parallelFor(size_t count, const std::function<void(size_t)>& body) {
+    if (count == 0) {
+        return;
+    }
+    
+    // Shared between the caller and helper tasks; helpers that start after all
+    // indices are claimed exit without touching body
+    struct State {
+        std::atomic<size_t> next{0};
+        std::atomic<size_t> done{0};
+        size_t count = 0;
+        const std::function<void(size_t)>* body = nullptr;
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::exception_ptr error;
+    };
+    
+    auto state = std::make_shared<State>();
+    state->count = count;
+    state->body = &body;
+    
+    auto run = [state] {
+        size_t i;
+        while ((i = state->next.fetch_add(1)) < state->count) {
+            try {
+                (*state->body)(i);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(state->mutex);
+                if (!state->error) state->error = std::current_exception();
+            }
+            
+            if (state->done.fetch_add(1) + 1 == state->count) {
+                std::lock_guard<std::mutex> lock(state->mutex);
+                state->cv.notify_all();
+            }
+        }
+    };
+    
+    // One helper per worker at most, the caller covers the rest
+    size_t helpers = std::min(count - 1, m_workers.size());
+    for (size_t i = 0; i < helpers; i++) {
+        enqueue(run);
+    }
+    
+    run();
+    
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->cv.wait(lock, [&] { return state->done.load() == state->count; });
+    
+    if (state->error) {
+        std::rethrow_exception(state->error);
+    }
+}
+
+void runWorkers(ThreadPool* pool, size_t count, const std::function<void(size_t)>& worker,
+                const std::function<void(size_t, std::thread&)>& started) {
+    if (pool) {
+        pool->parallelFor(count, worker);
+        return;
+    }
+    
+    std::vector<std::thread> threads;
+    {
+        TraceScope spawn_trace(TraceEvent::THREAD_SPAWN, count);
+        for (size_t i = 0; i < count; i++) {
+            threads.push_back(std::thread(worker, i));
+            if (started) {
+                started(i, threads.back());
+            }
+        }
+    }
+    
+    {
+        TraceScope join_trace(TraceEvent::THREAD_JOIN, threads.size());
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+}
+
+int ThreadPool::getThreadCount() const {
+    return static_cast<int>(m_workers.size());
+}
+
+void ThreadPool::enqueue(std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_tasks.push_back(std::move(task));
+    }
+    m_cv.notify_one();
+}
+
+void ThreadPool::workerLoop() {
+    while (true) {
+        std::function<void()> task;
+        
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cv.wait(lock, [this] { return m_stopping || !m_tasks.empty(); });
+            
+            if (m_stopping && m_tasks.empty()) {
+                return;
+            }
+            
+            task = std::move(m_tasks.front());
+            m_tasks.pop_front();
+        }
+        
+        task();
+    }
+}
+
+} // namespace mfp
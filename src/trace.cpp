@@ -0,0 +1,191 @@
+#include "trace.h"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <sstream>
+
+namespace mfp {
+
+namespace {
+
+uint64_t steadyNanoseconds() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+std::atomic<uint32_t> g_next_thread_id(1);
+
+} // namespace
+
+// Calling thread's buffer, released for reuse when the thread exits
+struct TraceThreadState {
+    TraceRecorder::Buffer* buffer = nullptr;
+    uint32_t thread_id = 0;
+    
+    ~TraceThreadState() {
+        if (buffer != nullptr) {
+            buffer->owned.store(false, std::memory_order_release);
+        }
+    }
+};
+
+namespace {
+
+thread_local TraceThreadState t_trace;
+
+} // namespace
+
+TraceRecorder::TraceRecorder()
+    : m_enabled(false), m_epoch(steadyNanoseconds()) {
+}
+
+TraceRecorder::~TraceRecorder() {
+}
+
+void TraceRecorder::record(TraceEvent event, TracePhase phase, uint64_t arg) {
+    if (t_trace.buffer == nullptr) {
+        t_trace.buffer = claimBuffer();
+        t_trace.thread_id = g_next_thread_id.fetch_add(1, std::memory_order_relaxed);
+    }
+    
+    Buffer* buffer = t_trace.buffer;
+    uint64_t head = buffer->head.load(std::memory_order_relaxed);
+    
+    Record& slot = buffer->records[head % TRACE_BUFFER_CAPACITY];
+    slot.timestamp = steadyNanoseconds() - m_epoch;
+    slot.arg = arg;
+    slot.thread_id = t_trace.thread_id;
+    slot.event = event;
+    slot.phase = phase;
+    
+    // Publish the record to exporters
+    buffer->head.store(head + 1, std::memory_order_release);
+}
+
+void TraceRecorder::clear() {
+    std::lock_guard<std::mutex> lock(m_buffers_mutex);
+    for (auto& buffer : m_buffers) {
+        buffer->head.store(0, std::memory_order_relaxed);
+    }
+}
+
+size_t TraceRecorder::getEventCount() const {
+    std::lock_guard<std::mutex> lock(m_buffers_mutex);
+    size_t count = 0;
+    for (const auto& buffer : m_buffers) {
+        count += static_cast<size_t>(std::min<uint64_t>(buffer->head.load(std::memory_order_acquire), TRACE_BUFFER_CAPACITY));
+    }
+    return count;
+}
+
+std::string TraceRecorder::exportChromeJson() const {
+    std::vector<Record> records;
+    {
+        std::lock_guard<std::mutex> lock(m_buffers_mutex);
+        for (const auto& buffer : m_buffers) {
+            uint64_t head = buffer->head.load(std::memory_order_acquire);
+            uint64_t first = head > TRACE_BUFFER_CAPACITY ? head - TRACE_BUFFER_CAPACITY : 0;
+            
+            std::vector<Record> copied;
+            for (uint64_t i = first; i < head; i++) {
+                copied.push_back(buffer->records[i % TRACE_BUFFER_CAPACITY]);
+            }
+            
+            // Skip slots the owner overwrote while we were copying
+            uint64_t head_after = buffer->head.load(std::memory_order_acquire);
+            uint64_t valid_from = head_after > TRACE_BUFFER_CAPACITY ? head_after - TRACE_BUFFER_CAPACITY : 0;
+            size_t skip = static_cast<size_t>(std::min<uint64_t>(valid_from > first ? valid_from - first : 0, copied.size()));
+            records.insert(records.end(), copied.begin() + skip, copied.end());
+        }
+    }
+    
+    std::stable_sort(records.begin(), records.end(), [](const Record& a, const Record& b) {
+        return a.timestamp < b.timestamp;
+    });
+    
+    std::ostringstream ss;
+    ss << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[" << std::endl;
+    ss << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"mfp\"}}";
+    
+    // Ends whose begin was overwritten by the ring would unbalance the viewer
+    std::map<uint32_t, std::map<TraceEvent, int>> open_spans;
+    ss << std::fixed << std::setprecision(3);
+    for (const Record& record : records) {
+        int& depth = open_spans[record.thread_id][record.event];
+        if (record.phase == TracePhase::END) {
+            if (depth == 0) {
+                continue;
+            }
+            depth--;
+        } else {
+            depth++;
+        }
+        
+        ss << "," << std::endl << "{\"name\":\"" << eventName(record.event) << "\",\"cat\":\"mfp\",\"ph\":\""
+           << (record.phase == TracePhase::BEGIN ? "B" : "E") << "\",\"pid\":1,\"tid\":" << record.thread_id
+           << ",\"ts\":" << record.timestamp / 1e3;
+        if (record.phase == TracePhase::BEGIN) {
+            ss << ",\"args\":{\"arg\":" << record.arg << "}";
+        }
+        ss << "}";
+    }
+    
+    ss << std::endl << "]}" << std::endl;
+    return ss.str();
+}
+
+bool TraceRecorder::writeChromeTrace(const std::string& path) const {
+    std::ofstream out(path);
+    if (!out) {
+        return false;
+    }
+    out << exportChromeJson();
+    return static_cast<bool>(out);
+}
+
+const char* TraceRecorder::eventName(TraceEvent event) {
+    switch (event) {
+        case TraceEvent::WORKER:
+            return "worker";
+        case TraceEvent::MR_ROUND:
+            return "mr-round";
+        case TraceEvent::RHO_BLOCK:
+            return "rho-block";
+        case TraceEvent::FERMAT_SWEEP:
+            return "fermat-sweep";
+        case TraceEvent::THREAD_SPAWN:
+            return "thread-spawn";
+        case TraceEvent::THREAD_JOIN:
+            return "thread-join";
+        case TraceEvent::STRING_CONVERSION:
+            return "string-conversion";
+    }
+    return "unknown";
+}
+
+TraceRecorder::Buffer* TraceRecorder::claimBuffer() {
+    std::lock_guard<std::mutex> lock(m_buffers_mutex);
+    
+    // Reuse a buffer left by an exited thread before allocating
+    for (auto& buffer : m_buffers) {
+        bool expected = false;
+        if (buffer->owned.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+            return buffer.get();
+        }
+    }
+    
+    std::unique_ptr<Buffer> buffer(new Buffer());
+    buffer->records.resize(TRACE_BUFFER_CAPACITY);
+    buffer->owned.store(true, std::memory_order_relaxed);
+    m_buffers.push_back(std::move(buffer));
+    return m_buffers.back().get();
+}
+
+TraceRecorder& getTraceRecorder() {
+    static TraceRecorder s_recorder;
+    return s_recorder;
+}
+
+} // namespace mfp
@@ -1,14 +1,52 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <iostream>
+#include <thread>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <numeric>
+#include <random>
+#include <stdexcept>
 #include <gtest/gtest.h>
 #include "mfp_base.h"
 #include "mfp_method1.h"
 #include "mfp_method2.h"
 #include "mfp_method3.h"
+#include "mfp_portfolio.h"
 #include "resource_manager.h"
 #include "configuration_manager.h"
 #include "hardware/cpu_detector.h"
 #include "hardware/memory_storage_detector.h"
 #include "hardware/gpu_detector.h"
+#include "gpu/caching_allocator.h"
+#include "gpu/cuda_accelerator.h"
+#include "gpu/cuda_memory.h"
+#include "gpu/limb_layout.h"
+#include "gpu/cpu_emulated_accelerator.h"
+#include "gpu/opencl_accelerator.h"
+#include "metrics.h"
+#include "perf_counters.h"
+#include "trace.h"
+#include "memory_accounting.h"
+#include "mfp_system.h"
+#include "factor_graph.h"
+#include "job_scheduler.h"
+#include "factorization.h"
+#include "thread_pool.h"
+#include "hybrid_scheduler.h"
+#include "factor/prime_table.h"
+#include "factor/smooth_factor.h"
+#include "factor/word_factor.h"
+#include "factor/range_factorizer.h"
+#include "factor/arithmetic_sieve.h"
+#include "factor/prime_tuple.h"
+#include "factor/random_prime.h"
+#include "factor/interval_primes.h"
+#include "factor/perfect_power.h"
+#include "factor/small_factors.h"
 
 namespace mfp {
 namespace test {
@@ -431,6 +469,1687 @@ TEST_F(MFPOperationsTest, AllMethods) {
     }
 }
 
+// Test Method 3's core-speed weighting of work
+TEST(HybridCoreTest, SplitBySpeedWeightsSlots) {
+    using Slot = MFPMethod3::WorkerSlot;
+
+    // Two performance cores at twice the speed of two efficiency cores
+    std::vector<Slot> hybrid = {{0, 1.0}, {1, 1.0}, {2, 0.5}, {3, 0.5}};
+    std::vector<int> shares = MFPMethod3::splitBySpeed(hybrid, 40);
+    EXPECT_EQ(shares, std::vector<int>({13, 13, 7, 7}));
+
+    // Shares always add up to the total, whatever the rounding
+    std::vector<Slot> uneven = {{-1, 1.0}, {-1, 0.7}, {-1, 0.3}};
+    for (int total : {0, 1, 7, 40, 1001}) {
+        std::vector<int> split = MFPMethod3::splitBySpeed(uneven, total);
+        EXPECT_EQ(std::accumulate(split.begin(), split.end(), 0), total);
+        EXPECT_GE(split[0], split[1]);
+        EXPECT_GE(split[1], split[2]);
+    }
+
+    // Unknown or zero speeds fall back to an even split instead of NaN shares
+    std::vector<Slot> unknown = {{-1, 0.0}, {-1, 0.0}, {-1, 0.0}};
+    EXPECT_EQ(MFPMethod3::splitBySpeed(unknown, 40), std::vector<int>({14, 13, 13}));
+
+    // A slot with no measured speed gets nothing while others are known
+    std::vector<Slot> partial = {{0, 1.0}, {1, 0.0}};
+    EXPECT_EQ(MFPMethod3::splitBySpeed(partial, 40), std::vector<int>({40, 0}));
+
+    EXPECT_TRUE(MFPMethod3::splitBySpeed({}, 40).empty());
+}
+
+
+// Test caching allocator size classes and block reuse
+TEST(CachingAllocatorTest, ReusesBlocksBySizeClass) {
+    int raw_allocations = 0;
+    CachingAllocator allocator(
+        [&](size_t size) { raw_allocations++; return malloc(size); },
+        [](void* ptr) { free(ptr); },
+        1024 * 1024);
+    
+    EXPECT_EQ(CachingAllocator::sizeClass(1), 256);
+    EXPECT_EQ(CachingAllocator::sizeClass(257), 512);
+    EXPECT_EQ(CachingAllocator::sizeClass(4096), 4096);
+    
+    void* first = allocator.allocate(300);
+    ASSERT_NE(first, nullptr);
+    EXPECT_EQ(allocator.getBlockSize(first), 512);
+    EXPECT_EQ(allocator.getStats().allocated_bytes, 512);
+    
+    // Freeing keeps the block cached and decrements the live byte count
+    EXPECT_TRUE(allocator.free(first));
+    EXPECT_EQ(allocator.getStats().allocated_bytes, 0);
+    EXPECT_EQ(allocator.getStats().cached_bytes, 512);
+    
+    // A request in the same class reuses the block without a backend allocation
+    void* second = allocator.allocate(400);
+    EXPECT_EQ(second, first);
+    EXPECT_EQ(raw_allocations, 1);
+    EXPECT_EQ(allocator.getStats().cache_hits, 1);
+    
+    EXPECT_TRUE(allocator.free(second));
+    EXPECT_FALSE(allocator.free(second));
+}
+
+// Test that cached blocks are returned when the capacity would be exceeded
+TEST(CachingAllocatorTest, TrimsCacheUnderPressure) {
+    int raw_frees = 0;
+    CachingAllocator allocator(
+        [](size_t size) { return malloc(size); },
+        [&](void* ptr) { raw_frees++; free(ptr); },
+        8192);
+    
+    void* small = allocator.allocate(4096);
+    ASSERT_NE(small, nullptr);
+    allocator.free(small);
+    
+    // 8192 does not fit next to the cached 4096 block, so the cache is trimmed first
+    void* large = allocator.allocate(8192);
+    ASSERT_NE(large, nullptr);
+    EXPECT_EQ(raw_frees, 1);
+    EXPECT_EQ(allocator.getStats().cached_bytes, 0);
+    EXPECT_GE(allocator.getStats().trims, 1);
+    
+    // Nothing left to trim: the request fails instead of exceeding the capacity
+    EXPECT_EQ(allocator.allocate(256), nullptr);
+    
+    allocator.free(large);
+    EXPECT_EQ(allocator.trim(), 8192);
+}
+
+// Test CUDA memory accounting in the simulation build
+TEST(CachingAllocatorTest, CUDAMemoryTracksFrees) {
+    CUDAMemory memory;
+    ASSERT_TRUE(memory.initialize(64 * 1024));
+    
+    // Repeated allocate/free cycles must not leak capacity
+    for (int i = 0; i < 1000; i++) {
+        void* ptr = memory.allocate(1000);
+        ASSERT_NE(ptr, nullptr);
+        memory.free(ptr);
+    }
+    
+    EXPECT_EQ(memory.getAvailableMemory(), memory.getTotalMemory());
+    EXPECT_EQ(memory.getStats().cache_misses, 1);
+    EXPECT_EQ(memory.trim(), 1024);
+}
+
+// Test the packed structure-of-arrays limb layout
+TEST(LimbLayoutTest, PacksLanesAsLimbRows) {
+    std::vector<std::string> numbers = {"1", "4294967296", "18446744073709551617"};
+    PackedLimbBatch batch;
+    ASSERT_TRUE(packLimbs(numbers, batch));
+    
+    EXPECT_EQ(batch.lane_count, 3);
+    EXPECT_EQ(batch.lane_stride, LANE_ALIGNMENT);
+    EXPECT_EQ(batch.limb_count, 3);
+    
+    // Limb k of lane i lives at k * lane_stride + i, least significant limb first
+    EXPECT_EQ(batch.limbs[0 * batch.lane_stride + 0], 1u);
+    EXPECT_EQ(batch.limbs[1 * batch.lane_stride + 1], 1u);
+    EXPECT_EQ(batch.limbs[0 * batch.lane_stride + 2], 1u);
+    EXPECT_EQ(batch.limbs[2 * batch.lane_stride + 2], 1u);
+    EXPECT_EQ(batch.limbs[1 * batch.lane_stride + 2], 0u);
+    
+    for (size_t i = 0; i < numbers.size(); i++) {
+        EXPECT_EQ(unpackLaneString(batch, i), numbers[i]);
+    }
+    
+    EXPECT_TRUE(laneEquals(batch, 0, 1));
+    EXPECT_FALSE(laneEquals(batch, 2, 1));
+    
+    // Inputs wider than the requested width are rejected
+    EXPECT_FALSE(packLimbs(numbers, batch, 2));
+    EXPECT_FALSE(packLimbs({"-5"}, batch));
+}
+
+// Test batch remainders against GMP
+TEST(LimbLayoutTest, BatchRemaindersMatchGMP) {
+    std::vector<std::string> numbers = {"0", "97", "123456789012345678901234567890", "340282366920938463463374607431768211455"};
+    PackedLimbBatch batch;
+    ASSERT_TRUE(packLimbs(numbers, batch));
+    
+    for (uint32_t divisor : {3u, 97u, 65537u, 4294967291u}) {
+        std::vector<uint32_t> remainders;
+        batchRemainders(batch, divisor, remainders);
+        ASSERT_EQ(remainders.size(), numbers.size());
+        
+        for (size_t i = 0; i < numbers.size(); i++) {
+            mpz_t n;
+            mpz_init_set_str(n, numbers[i].c_str(), 10);
+            EXPECT_EQ(remainders[i], mpz_fdiv_ui(n, divisor));
+            mpz_clear(n);
+        }
+    }
+}
+
+// Test that the emulated device batch path agrees with single-number calls
+TEST(LimbLayoutTest, EmulatedBatchMatchesSingleCalls) {
+    CPUEmulatedAccelerator device;
+    ASSERT_TRUE(device.initialize(2));
+    
+    std::vector<std::string> numbers = {"0", "1", "2", "3", "37", "91", "1000003", "4294967297", "18446744073709551557"};
+    std::vector<uint8_t> results;
+    ASSERT_TRUE(device.isPrimeBatch(numbers, results));
+    ASSERT_EQ(results.size(), numbers.size());
+    
+    for (size_t i = 0; i < numbers.size(); i++) {
+        mpz_t n;
+        mpz_init_set_str(n, numbers[i].c_str(), 10);
+        bool expected = false;
+        ASSERT_TRUE(device.isPrime(n, expected));
+        EXPECT_EQ(results[i] != 0, expected) << numbers[i];
+        mpz_clear(n);
+    }
+    
+    std::vector<std::vector<std::string>> factors;
+    ASSERT_TRUE(device.factorizeBatch({"4294967297", "91"}, factors));
+    EXPECT_EQ(factors[0], std::vector<std::string>({"641", "6700417"}));
+    EXPECT_EQ(factors[1], std::vector<std::string>({"7", "13"}));
+}
+
+// Decimal string of an mpz value
+std::string mpzString(const mpz_t value) {
+    char* str = mpz_get_str(nullptr, 10, value);
+    std::string result(str);
+    free(str);
+    return result;
+}
+
+// Test the shared worker pool
+TEST(ThreadPoolTest, SubmitAndParallelForCoverEveryIndex) {
+    ThreadPool pool(3);
+    EXPECT_EQ(pool.getThreadCount(), 3);
+
+    std::future<int> answer = pool.submit([] { return 42; });
+    EXPECT_EQ(answer.get(), 42);
+
+    // Every index runs exactly once
+    std::vector<std::atomic<int>> visits(1000);
+    pool.parallelFor(visits.size(), [&](size_t i) { visits[i]++; });
+    for (const auto& count : visits) {
+        EXPECT_EQ(count.load(), 1);
+    }
+
+    // Nested from inside pool tasks without deadlocking the workers
+    std::atomic<int> nested(0);
+    pool.parallelFor(8, [&](size_t) {
+        pool.parallelFor(16, [&](size_t) { nested++; });
+    });
+    EXPECT_EQ(nested.load(), 8 * 16);
+
+    // An exception in the body reaches the caller once all indices are done
+    std::atomic<int> finished(0);
+    EXPECT_THROW(pool.parallelFor(50, [&](size_t i) {
+        finished++;
+        if (i == 7) {
+            throw std::runtime_error("lane failed");
+        }
+    }), std::runtime_error);
+    EXPECT_EQ(finished.load(), 50);
+}
+
+// Test the emulated device kernels against GMP
+TEST(CPUEmulatedAcceleratorTest, ResultsMatchGMP) {
+    CPUEmulatedAccelerator device;
+    ASSERT_TRUE(device.initialize(3));
+    EXPECT_TRUE(device.isAvailable());
+    EXPECT_EQ(device.getDeviceThreads(), 3);
+
+    gmp_randstate_t state;
+    gmp_randinit_default(state);
+    gmp_randseed_ui(state, 52);
+
+    // Random widths up to 256 bits, plus a strong pseudoprime to base 2 and a Carmichael number
+    std::vector<std::string> numbers = {"2047", "561", "3215031751"};
+    mpz_t n, next, expected;
+    mpz_inits(n, next, expected, NULL);
+    for (int i = 0; i < 200; i++) {
+        mpz_urandomb(n, state, 2 + i % 255);
+        numbers.push_back(mpzString(n));
+    }
+
+    std::vector<uint8_t> results;
+    ASSERT_TRUE(device.isPrimeBatch(numbers, results));
+    ASSERT_EQ(results.size(), numbers.size());
+    for (size_t i = 0; i < numbers.size(); i++) {
+        mpz_set_str(n, numbers[i].c_str(), 10);
+        EXPECT_EQ(results[i] != 0, mpz_probab_prime_p(n, 40) != 0) << numbers[i];
+
+        ASSERT_TRUE(device.nextPrime(n, next));
+        mpz_nextprime(expected, n);
+        EXPECT_EQ(mpz_cmp(next, expected), 0) << numbers[i];
+    }
+
+    // Factors multiply back to the input and are all prime
+    std::vector<std::string> composites = {"4294967297", "600851475143", "1000000016000000063", "18446744073709551615"};
+    std::vector<std::vector<std::string>> factors;
+    ASSERT_TRUE(device.factorizeBatch(composites, factors));
+    ASSERT_EQ(factors.size(), composites.size());
+    for (size_t i = 0; i < composites.size(); i++) {
+        mpz_set_ui(n, 1);
+        for (const std::string& factor : factors[i]) {
+            mpz_set_str(next, factor.c_str(), 10);
+            EXPECT_NE(mpz_probab_prime_p(next, 40), 0) << factor;
+            mpz_mul(n, n, next);
+        }
+        EXPECT_EQ(mpzString(n), composites[i]);
+    }
+
+    mpz_clears(n, next, expected, NULL);
+    gmp_randclear(state);
+}
+
+// Host method that answers correctly but slowly, so the device wins the throughput race
+class SlowHostMethod : public MFPMethod2 {
+public:
+    bool isPrime(const std::string& number) override {
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        return MFPMethod2::isPrime(number);
+    }
+};
+
+// Test that hybrid batches follow the measured throughput of each side
+TEST(HybridSchedulerTest, SplitFollowsThroughput) {
+    auto device = std::make_shared<CPUEmulatedAccelerator>();
+    ASSERT_TRUE(device->initialize(2));
+    auto host_pool = std::make_shared<ThreadPool>(1);
+    HybridScheduler scheduler(device, std::make_shared<SlowHostMethod>(), host_pool);
+
+    // Before any batch, shares follow thread counts: 2 device threads against 1 worker plus the caller
+    EXPECT_DOUBLE_EQ(scheduler.getDeviceShare(), 0.5);
+
+    std::vector<std::string> numbers;
+    for (int i = 0; i < 200; i++) {
+        numbers.push_back(std::to_string(1000003 + 2 * i));
+    }
+
+    for (int round = 0; round < 5; round++) {
+        std::vector<uint8_t> results = scheduler.isPrimeBatch(numbers);
+        ASSERT_EQ(results.size(), numbers.size());
+
+        // Results line up with the inputs wherever the split fell
+        for (size_t i = 0; i < numbers.size(); i++) {
+            mpz_t n;
+            mpz_init_set_str(n, numbers[i].c_str(), 10);
+            EXPECT_EQ(results[i] != 0, mpz_probab_prime_p(n, 40) != 0) << numbers[i];
+            mpz_clear(n);
+        }
+    }
+
+    // The sleeping host delivers far fewer items per millisecond, so the device
+    // takes most of the batch, but never all of it
+    EXPECT_GT(scheduler.getDeviceThroughput(), scheduler.getHostThroughput());
+    EXPECT_GT(scheduler.getDeviceShare(), 0.5);
+    EXPECT_LT(scheduler.getDeviceShare(), 1.0);
+
+    // Without a device everything runs on the host
+    HybridScheduler host_only(nullptr, std::make_shared<MFPMethod2>(), host_pool);
+    EXPECT_EQ(host_only.getDeviceShare(), 0.0);
+    std::vector<std::vector<std::string>> factors = host_only.factorizeBatch({"91", "4294967297"});
+    for (auto& list : factors) {
+        std::sort(list.begin(), list.end(), DecimalLess());
+    }
+    EXPECT_EQ(factors[0], std::vector<std::string>({"7", "13"}));
+    EXPECT_EQ(factors[1], std::vector<std::string>({"641", "6700417"}));
+}
+
+// Device that claims lanes but refuses every batch, like a backend without the kernel
+class RefusingDevice : public BatchAccelerator {
+public:
+    bool isAvailable() const override { return true; }
+    std::string getDeviceProperties() const override { return "refusing"; }
+    int getParallelism() const override { return 4; }
+    bool isPrimeBatch(const std::vector<std::string>&, std::vector<uint8_t>&) override { return false; }
+    bool factorizeBatch(const std::vector<std::string>&, std::vector<std::vector<std::string>>&) override {
+        return false;
+    }
+};
+
+// Test that the scheduler drives any BatchAccelerator and finishes refused shares on the host
+TEST(HybridSchedulerTest, AnyDeviceBehindTheInterface) {
+    auto host_pool = std::make_shared<ThreadPool>(1);
+
+    HybridScheduler refusing(std::make_shared<RefusingDevice>(), std::make_shared<MFPMethod2>(), host_pool);
+    EXPECT_GT(refusing.getDeviceShare(), 0.0);
+    std::vector<uint8_t> flags = refusing.isPrimeBatch({"97", "91", "1000003", "1000005"});
+    EXPECT_EQ(flags, std::vector<uint8_t>({1, 0, 1, 0}));
+    std::vector<std::vector<std::string>> factors = refusing.factorizeBatch({"91", "4294967297"});
+    for (auto& list : factors) {
+        std::sort(list.begin(), list.end(), DecimalLess());
+    }
+    EXPECT_EQ(factors[0], std::vector<std::string>({"7", "13"}));
+    EXPECT_EQ(factors[1], std::vector<std::string>({"641", "6700417"}));
+
+    // The OpenCL backend plugs in the same way: primality on the device, factorization on the host
+    auto opencl = std::make_shared<OpenCLAccelerator>();
+    ASSERT_TRUE(opencl->initialize());
+    EXPECT_GT(opencl->getParallelism(), 0);
+    HybridScheduler scheduler(opencl, std::make_shared<MFPMethod2>(), host_pool);
+    flags = scheduler.isPrimeBatch({"1000003", "1000005", "1000033", "1000037"});
+    EXPECT_EQ(flags, std::vector<uint8_t>({1, 0, 1, 1}));
+    factors = scheduler.factorizeBatch({"1000036000099"});
+    std::sort(factors[0].begin(), factors[0].end(), DecimalLess());
+    EXPECT_EQ(factors[0], std::vector<std::string>({"1000003", "1000033"}));
+}
+
+// Test batch Montgomery exponentiation against GMP
+TEST(OpenCLAcceleratorTest, ModExpBatchMatchesGMP) {
+    OpenCLAccelerator device;
+    ASSERT_TRUE(device.initialize());
+    
+    gmp_randstate_t state;
+    gmp_randinit_default(state);
+    gmp_randseed_ui(state, 55);
+    
+    std::vector<std::string> bases, exponents, moduli, expected;
+    mpz_t b, e, m, r;
+    mpz_inits(b, e, m, r, NULL);
+    for (int i = 0; i < 40; i++) {
+        // Mix widths so lanes of one batch use different limb counts
+        mpz_urandomb(m, state, 16 + 37 * i);
+        mpz_setbit(m, 0);
+        mpz_urandomb(b, state, 16 + 41 * i);
+        mpz_urandomb(e, state, 8 + 29 * i);
+        mpz_powm(r, b, e, m);
+        
+        bases.push_back(mpzString(b));
+        exponents.push_back(mpzString(e));
+        moduli.push_back(mpzString(m));
+        expected.push_back(mpzString(r));
+    }
+    mpz_clears(b, e, m, r, NULL);
+    gmp_randclear(state);
+    
+    std::vector<std::string> results;
+    ASSERT_TRUE(device.modExpBatch(bases, exponents, moduli, results));
+    EXPECT_EQ(results, expected);
+    
+    // Even moduli are rejected
+    EXPECT_FALSE(device.modExpBatch({"3"}, {"5"}, {"10"}, results));
+}
+
+// Test strong probable-prime tests on known primes and pseudoprimes
+TEST(OpenCLAcceleratorTest, SprpBatchSeparatesPseudoprimes) {
+    OpenCLAccelerator device;
+    ASSERT_TRUE(device.initialize());
+    
+    std::vector<std::string> numbers = {"0", "1", "2", "3", "4", "9", "37", "561", "2047", "4294967291",
+                                        "18446744073709551557", "170141183460469231731687303715884105727",
+                                        "170141183460469231731687303715884105729"};
+    std::vector<uint8_t> results;
+    ASSERT_TRUE(device.isPrimeBatch(numbers, results));
+    EXPECT_EQ(results, std::vector<uint8_t>({0, 0, 1, 1, 0, 0, 1, 0, 0, 1, 1, 1, 0}));
+    
+    // 2047 = 23 * 89 is a strong pseudoprime to base 2 only
+    ASSERT_TRUE(device.sprpBatch({"2047"}, {2}, results));
+    EXPECT_EQ(results[0], 1);
+    ASSERT_TRUE(device.sprpBatch({"2047"}, {2, 3}, results));
+    EXPECT_EQ(results[0], 0);
+}
+
+// Test sieve segment marking and the next-prime search built on it
+TEST(OpenCLAcceleratorTest, SieveSegmentMarksComposites) {
+    OpenCLAccelerator device;
+    ASSERT_TRUE(device.initialize());
+    
+    // Primes up to 31 sieve [1000, 1100) completely
+    std::vector<uint32_t> composite_bits;
+    ASSERT_TRUE(device.sieveSegment(1000, 100, {2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31}, composite_bits));
+    
+    mpz_t n, next;
+    mpz_init(n);
+    mpz_init(next);
+    for (uint32_t i = 0; i < 100; i++) {
+        bool composite = (composite_bits[i >> 5] >> (i & 31)) & 1;
+        mpz_set_ui(n, 1000 + i);
+        EXPECT_EQ(!composite, mpz_probab_prime_p(n, 25) > 0) << (1000 + i);
+    }
+    
+    // Below 2^63 the search sieves on the device, above it tests odd candidates
+    for (const char* start : {"1000000", "9223372036854775783", "340282366920938463463374607431768211297"}) {
+        mpz_set_str(n, start, 10);
+        ASSERT_TRUE(device.nextPrime(n, next));
+        mpz_nextprime(n, n);
+        EXPECT_EQ(mpz_cmp(n, next), 0) << start;
+    }
+    
+    mpz_clear(n);
+    mpz_clear(next);
+}
+
+// Test histogram bucket mapping and quantiles
+TEST(MetricsTest, HistogramQuantilesWithinBucketError) {
+    // Every value lies inside its bucket, and buckets are at most 1/16 wide
+    for (uint64_t value : {0ULL, 1ULL, 15ULL, 16ULL, 17ULL, 1000ULL, 123456789ULL, 1ULL << 40}) {
+        size_t index = LatencyHistogram::bucketIndex(value);
+        EXPECT_GE(LatencyHistogram::bucketUpperBound(index), value);
+        EXPECT_LE(LatencyHistogram::bucketUpperBound(index), value + value / 16 + 1);
+        if (index > 0) {
+            EXPECT_LT(LatencyHistogram::bucketUpperBound(index - 1), value);
+        }
+    }
+    
+    LatencyHistogram histogram;
+    for (uint64_t i = 1; i <= 1000; i++) {
+        histogram.record(i * 1000);
+    }
+    
+    EXPECT_EQ(histogram.getCount(), 1000);
+    EXPECT_EQ(histogram.getMax(), 1000000);
+    EXPECT_NEAR(static_cast<double>(histogram.valueAtQuantile(0.5)), 500000.0, 500000.0 / 16);
+    EXPECT_NEAR(static_cast<double>(histogram.valueAtQuantile(0.99)), 990000.0, 990000.0 / 16);
+    EXPECT_EQ(histogram.valueAtQuantile(1.0), 1000000);
+    EXPECT_EQ(histogram.countAtOrBelow(UINT64_MAX - 1), 1000);
+}
+
+// Test that MFPSystem calls are counted per operation and bit-length bucket
+TEST(MetricsTest, SystemCallsAppearInSnapshot) {
+    MetricsRegistry& metrics = getMetricsRegistry();
+    uint64_t before = metrics.getCompleted(MetricsOperation::FACTORIZE);
+    uint64_t bucket_before = metrics.getHistogram(MetricsOperation::FACTORIZE, MetricsRegistry::bitBucket(40)).getCount();
+    
+    MFPSystem system(MFPMethodType::METHOD_2, 1);
+    system.factorize("1000000016000000063");  // 1000000007 * 1000000009, 60 bits
+    system.factorize("1099511627776");        // 2^40
+    
+    EXPECT_EQ(metrics.getCompleted(MetricsOperation::FACTORIZE), before + 2);
+    EXPECT_EQ(metrics.getInFlight(MetricsOperation::FACTORIZE), 0);
+    EXPECT_EQ(metrics.getHistogram(MetricsOperation::FACTORIZE, MetricsRegistry::bitBucket(40)).getCount(), bucket_before + 2);
+    EXPECT_EQ(MetricsRegistry::bitBucketLabel(MetricsRegistry::bitBucket(60)), "33-64");
+    
+    std::string text = metrics.formatPrometheus();
+    EXPECT_NE(text.find("# TYPE mfp_operation_latency_seconds histogram"), std::string::npos);
+    EXPECT_NE(text.find("mfp_operation_latency_seconds_count{operation=\"factorize\",bits=\"33-64\"}"), std::string::npos);
+    EXPECT_NE(text.find("mfp_operations_in_flight{operation=\"factorize\"} 0"), std::string::npos);
+    
+    // Quantiles belong to a summary family of their own, never to the histogram
+    EXPECT_NE(text.find("# TYPE mfp_operation_latency_summary_seconds summary"), std::string::npos);
+    EXPECT_NE(text.find("mfp_operation_latency_summary_seconds{operation=\"factorize\",bits=\"33-64\",quantile=\"0.5\"}"), std::string::npos);
+    EXPECT_NE(text.find("mfp_operation_latency_summary_seconds_count{operation=\"factorize\",bits=\"33-64\"}"), std::string::npos);
+    EXPECT_EQ(text.find("mfp_operation_latency_seconds{"), std::string::npos);
+    
+    // Size buckets come from the digit count: never below the exact length, at most 4 bits above
+    for (const char* number : {"1", "9", "10", "255", "256", "4294967295", "4294967296", "1000000016000000063", "-1099511627776", "000123"}) {
+        size_t exact = decimalBitLength(number);
+        EXPECT_GE(decimalBitEstimate(number), exact) << number;
+        EXPECT_LE(decimalBitEstimate(number), exact + 4) << number;
+    }
+    EXPECT_EQ(decimalBitEstimate("0"), 0);
+    EXPECT_EQ(decimalBitEstimate("12a"), 0);
+}
+
+// Test that engine stages are attributed whether or not the kernel grants counters
+TEST(PerfCountersTest, StagesRecordedWithOrWithoutCounters) {
+    PerfCounterRegistry& counters = getPerfCounters();
+    counters.reset();
+    counters.setEnabled(true);
+    
+    MFPMethod2 method;
+    EXPECT_TRUE(method.isPrime("1000000000000000003"));
+    EXPECT_EQ(method.factorize("1000000016000000063").size(), 2);
+    counters.setEnabled(false);
+    
+    PerfStageTotals filter = counters.getTotals(PerfStage::PRIMALITY_FILTER);
+    PerfStageTotals search = counters.getTotals(PerfStage::FACTOR_SEARCH);
+    EXPECT_GE(filter.calls, 2);
+    EXPECT_GE(counters.getTotals(PerfStage::PRIMALITY_TEST).calls, 1);
+    EXPECT_GE(search.calls, 1);
+    EXPECT_GT(search.nanoseconds, 0);
+    EXPECT_EQ(counters.getTotals(PerfStage::TRIAL_DIVISION).calls, 0);
+    
+    // Word-size factoring and small-factor stripping have stages of their own
+    counters.setEnabled(true);
+    method.factorize("1000000000000000000000000000000000000000000000");
+    counters.setEnabled(false);
+    EXPECT_GE(counters.getTotals(PerfStage::SMALL_FACTORS).calls, 1);
+    struct WordSizeProbe : MFPMethod2 {
+        using MFPBase::wordSizeFactorization;
+    } probe;
+    std::vector<std::string> factors;
+    counters.setEnabled(true);
+    EXPECT_TRUE(probe.wordSizeFactorization("600851475143", factors));
+    counters.setEnabled(false);
+    EXPECT_GE(counters.getTotals(PerfStage::WORD_SIZE).calls, 1);
+    EXPECT_EQ(counters.getTotals(PerfStage::TRIAL_DIVISION).calls, 0);
+    
+    // Denied access is reported instead of counts, never as zeros
+    if (counters.isAvailable()) {
+        EXPECT_TRUE(search.counted[static_cast<size_t>(PerfEvent::CYCLES)]);
+    } else {
+        EXPECT_FALSE(counters.getUnavailableReason().empty());
+        EXPECT_FALSE(search.counted[static_cast<size_t>(PerfEvent::CYCLES)]);
+        EXPECT_NE(counters.formatReport().find("unavailable"), std::string::npos);
+    }
+    
+    // Disabled scopes record nothing
+    counters.reset();
+    method.isPrime("1000000000000000003");
+    EXPECT_EQ(counters.getTotals(PerfStage::PRIMALITY_FILTER).calls, 0);
+}
+
+// Test that Method 3 worker activity is exported as balanced Chrome trace spans
+TEST(TraceTest, ExportsBalancedSpansFromWorkerThreads) {
+    TraceRecorder& recorder = getTraceRecorder();
+    recorder.clear();
+    recorder.setEnabled(true);
+    
+    // Above 128 bits, so the rho workers run instead of the word-size engines
+    MFPMethod3 method(2);
+    EXPECT_EQ(method.factorize("1361129477211660127639775406701561854082509921951").size(), 2);
+    recorder.setEnabled(false);
+    
+    std::string json = recorder.exportChromeJson();
+    EXPECT_EQ(json.find("{\"displayTimeUnit\":\"ns\",\"traceEvents\":["), 0);
+    for (const char* name : {"rho-block", "mr-round", "thread-spawn", "thread-join", "worker", "string-conversion"}) {
+        EXPECT_NE(json.find(std::string("\"name\":\"") + name + "\""), std::string::npos) << name;
+    }
+    
+    size_t begins = 0;
+    size_t ends = 0;
+    for (size_t pos = json.find("\"ph\":\"B\""); pos != std::string::npos; pos = json.find("\"ph\":\"B\"", pos + 1)) {
+        begins++;
+    }
+    for (size_t pos = json.find("\"ph\":\"E\""); pos != std::string::npos; pos = json.find("\"ph\":\"E\"", pos + 1)) {
+        ends++;
+    }
+    EXPECT_GT(begins, 0);
+    EXPECT_EQ(begins, ends);
+    
+    // Disabled spans record nothing
+    size_t count = recorder.getEventCount();
+    method.isPrime("1000000000000000003");
+    EXPECT_EQ(recorder.getEventCount(), count);
+}
+
+// Test that a full ring keeps the newest events and drops ends of lost begins
+TEST(TraceTest, RingOverwritesOldestEvents) {
+    TraceRecorder& recorder = getTraceRecorder();
+    recorder.clear();
+    
+    std::thread writer([&recorder]() {
+        for (size_t i = 0; i < TRACE_BUFFER_CAPACITY; i++) {
+            recorder.record(TraceEvent::MR_ROUND, TracePhase::BEGIN, i);
+            recorder.record(TraceEvent::MR_ROUND, TracePhase::END, 0);
+        }
+        recorder.record(TraceEvent::RHO_BLOCK, TracePhase::END, 0);
+    });
+    writer.join();
+    
+    EXPECT_GE(recorder.getEventCount(), TRACE_BUFFER_CAPACITY);
+    std::string json = recorder.exportChromeJson();
+    EXPECT_EQ(json.find("\"arg\":0}"), std::string::npos);
+    EXPECT_NE(json.find("\"arg\":" + std::to_string(TRACE_BUFFER_CAPACITY - 1) + "}"), std::string::npos);
+    EXPECT_EQ(json.find("rho-block"), std::string::npos);
+    recorder.clear();
+}
+
+// Test that GMP and library allocations are accounted per request and per thread
+TEST(MemoryAccountingTest, TracksRequestPeakAndThreadTotals) {
+    MemoryAccounting& accounting = getMemoryAccounting();
+    accounting.installGMPHooks();
+    EXPECT_TRUE(accounting.hooksInstalled());
+    
+    MemoryUsage thread_before = accounting.getThreadUsage();
+    MemoryUsage usage;
+    {
+        MemoryAccounting::RequestScope request(accounting);
+        
+        mpz_t big;
+        mpz_init(big);
+        mpz_setbit(big, 80000);   // At least 10000 bytes of limbs
+        
+        char* str = mpz_get_str(nullptr, 16, big);
+        freeGMPString(str);
+        mpz_clear(big);
+        
+        std::vector<uint32_t, AccountedAllocator<uint32_t>> buffer(4096);
+        buffer.clear();
+        buffer.shrink_to_fit();
+        
+        usage = request.getUsage();
+    }
+    
+    EXPECT_GE(usage.peak_live_bytes, 10000);
+    EXPECT_GE(usage.allocated_bytes, 10000 + 4096 * sizeof(uint32_t));
+    EXPECT_GE(usage.allocations, 3);
+    EXPECT_EQ(usage.live_bytes, 0);
+    EXPECT_EQ(usage.allocations, usage.frees);
+    
+    MemoryUsage thread_after = accounting.getThreadUsage();
+    EXPECT_GE(thread_after.allocated_bytes - thread_before.allocated_bytes, usage.allocated_bytes);
+    EXPECT_GE(thread_after.peak_live_bytes, 10000);
+    
+    // Worker threads are listed while running and folded into the exited totals after
+    uint64_t exited_before = accounting.getExitedThreadCount();
+    std::thread worker([&accounting]() {
+        mpz_t value;
+        mpz_init_set_ui(value, 1);
+        mpz_mul_2exp(value, value, 8000);
+        EXPECT_EQ(accounting.getThreadUsages().empty(), false);
+        mpz_clear(value);
+    });
+    worker.join();
+    EXPECT_EQ(accounting.getExitedThreadCount(), exited_before + 1);
+    EXPECT_GE(accounting.getExitedThreadPeak(), 1000);
+    
+    // MFPSystem records each call
+    MFPSystem system(MFPMethodType::METHOD_2, 1);
+    system.factorize("1000000016000000063");
+    EXPECT_GT(system.getLastRequestMemory().allocations, 0);
+    EXPECT_NE(accounting.formatReport().find("Process:"), std::string::npos);
+}
+
+// Test that shadow mode samples calls and records disagreements without changing results
+TEST(ShadowModeTest, RecordsDisagreementsWithoutAffectingCaller) {
+    MFPSystem system(MFPMethodType::METHOD_2, 1);
+    system.enableShadowMode(MFPMethodType::METHOD_1, 0.5);
+    EXPECT_TRUE(system.isShadowModeEnabled());
+    
+    // 1000000007 * (2^107 - 1): Method 2's rho splits it; Method 1's Fermat
+    // sweep cannot, and above 2^128 it has no fallback
+    const std::string mersenne = "162259276829213363391578010288127";
+    const std::string product = "162259277965028301196071554029173072016889";
+    std::vector<std::string> factors = system.factorize(product);
+    std::vector<std::string> again = system.factorize(product);
+    EXPECT_EQ(factors, again);
+    EXPECT_EQ(ShadowExecutor::canonicalFactors(factors), "1000000007 * " + mersenne);
+    
+    for (int i = 0; i < 4; i++) {
+        EXPECT_TRUE(system.isPrime("1000000007"));
+    }
+    system.waitForShadowRuns();
+    
+    ShadowStats stats = system.getShadowStats();
+    EXPECT_EQ(stats.sampled, 3);
+    EXPECT_EQ(stats.completed, 3);
+    EXPECT_EQ(stats.dropped, 0);
+    EXPECT_EQ(stats.disagreements, 1);
+    
+    std::vector<ShadowDisagreement> disagreements = system.getShadowDisagreements();
+    ASSERT_EQ(disagreements.size(), 1);
+    EXPECT_EQ(disagreements[0].operation, MetricsOperation::FACTORIZE);
+    EXPECT_EQ(disagreements[0].primary_result, "1000000007 * " + mersenne);
+    EXPECT_EQ(disagreements[0].shadow_result, product);
+    
+    system.disableShadowMode();
+    EXPECT_EQ(system.getShadowStats().sampled, 0);
+    
+    // Disabling cancels a shadow run that would not finish in reasonable
+    // time: Method 2's rho on (2^89 - 1)(2^107 - 1)
+    auto shadow = std::unique_ptr<ShadowExecutor>(
+        new ShadowExecutor([]() { return std::unique_ptr<MFPBase>(new MFPMethod2()); }, 1.0));
+    shadow->submitIsPrime("100433627766186892221372630609062766858404681029709092356097", false, 0);
+    shadow->submitFactorize("100433627766186892221372630609062766858404681029709092356097", {}, 0);
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    auto start = std::chrono::steady_clock::now();
+    shadow.reset();
+    EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(5));
+}
+
+// Test that p-1 and p+1 catch factors rho would need ~2^26 steps for, with stage 2 split across threads
+TEST(SmoothFactorTest, PMinus1AndPPlus1FindSmoothFactors) {
+    // Prime powers up to B1 and the segmented sieve agree with the table
+    std::shared_ptr<const std::vector<uint64_t>> powers = getPrimePowers(100);
+    EXPECT_EQ((*powers)[0], 64);
+    EXPECT_EQ((*powers)[1], 81);
+    EXPECT_EQ(powers->back(), 97);
+    std::vector<uint8_t> flags;
+    segmentPrimeFlags(1000000, 1000040, *getPrimeTable(1000), flags);
+    EXPECT_EQ(flags[3], 1);   // 1000003
+    EXPECT_EQ(flags[33], 1);  // 1000033
+    EXPECT_EQ(flags[1], 0);
+    
+    mpz_t n, factor;
+    mpz_init(n);
+    mpz_init(factor);
+    
+    // p = 1535084115116339, p - 1 = 2 * 193^2 * 269 * 383 * 200003
+    mpz_set_str(n, "1376596323297555161854025388308939439593", 10);
+    SmoothFactorParams params;
+    params.b1 = 40000;
+    params.b2 = 0;
+    EXPECT_FALSE(pollardPMinus1(n, factor, params));
+    params.b2 = 1000000;
+    params.num_threads = 4;
+    ASSERT_TRUE(pollardPMinus1(n, factor, params));
+    EXPECT_EQ(mpz_cmp_ui(factor, 1535084115116339ULL), 0);
+    
+    // p = 9937350128692793, p + 1 = 2 * 300007 * (primes below 1000); 2/7 is a good seed for p
+    mpz_set_str(n, "8911381152193242710011648696809933217691", 10);
+    params.b1 = 1000;
+    params.b2 = 0;
+    params.pplus1_seeds = 1;
+    EXPECT_FALSE(williamsPPlus1(n, factor, params));
+    params.b2 = 1000000;
+    ASSERT_TRUE(williamsPPlus1(n, factor, params));
+    EXPECT_EQ(mpz_cmp_ui(factor, 9937350128692793ULL), 0);
+    
+    mpz_clear(n);
+    mpz_clear(factor);
+    
+    // Method 2 tries the engines before rho on large inputs
+    MFPMethod2 method2;
+    std::vector<std::string> factors = method2.factorize("8911381152193242710011648696809933217691");
+    ASSERT_EQ(factors.size(), 2);
+    EXPECT_EQ(factors[0], "9937350128692793");
+    EXPECT_EQ(factors[1], "896756281784094569167987");
+}
+
+// Test the word-size engines against known factorizations and each other
+TEST(WordFactorTest, EnginesAgreeAcrossSizes) {
+    EXPECT_TRUE(isPrime64(18446744073709551557ULL));   // Largest 64-bit prime
+    EXPECT_FALSE(isPrime64(3215031751ULL));            // Strong pseudoprime to bases 2, 3, 5, 7
+    EXPECT_TRUE(isPrime128((static_cast<uint128_t>(1) << 127) - 1));
+    
+    // 1000003 * 1000033 for every engine in its range
+    const uint64_t small = 1000036000099ULL;
+    EXPECT_EQ(small % hartFactor(small), 0);
+    EXPECT_EQ(small % lehmanFactor(small), 0);
+    EXPECT_EQ(small % squfofFactor(small), 0);
+    EXPECT_EQ(small % rhoFactor64(small), 0);
+    EXPECT_NE(hartFactor(small), 1);
+    EXPECT_NE(lehmanFactor(small), 1);
+    
+    // 1000000007 * 1000000009 is past Hart and Lehman
+    EXPECT_EQ(hartFactor(1000000016000000063ULL), 0);
+    uint64_t factor = findFactor64(1000000016000000063ULL);
+    EXPECT_TRUE(factor == 1000000007ULL || factor == 1000000009ULL);
+    
+    std::vector<uint64_t> expected = {3, 5, 17, 257, 641, 65537, 6700417};
+    EXPECT_EQ(factorize64(UINT64_MAX), expected);
+    EXPECT_TRUE(factorize64(1).empty());
+    
+    // 2^128 - 1 needs the 128-bit rho for 2^64 + 1
+    uint128_t value;
+    ASSERT_TRUE(parseUint128("340282366920938463463374607431768211455", value));
+    std::vector<std::string> factors;
+    for (uint128_t prime : factorize128(value)) {
+        factors.push_back(uint128ToString(prime));
+    }
+    std::vector<std::string> expected_text = {"3", "5", "17", "257", "641", "65537", "274177", "6700417", "67280421310721"};
+    EXPECT_EQ(factors, expected_text);
+    EXPECT_FALSE(parseUint128("340282366920938463463374607431768211456", value));
+    
+    // The methods' fallback now covers everything below 2^128
+    MFPMethod1 method1;
+    expected_text = {"3", "1000003", "1000033"};
+    EXPECT_EQ(method1.factorize("3000108000297"), expected_text);
+}
+
+// Test that range factorization streams segments in order and matches per-integer factoring
+TEST(RangeFactorizerTest, SegmentsMatchWordSizeFactoring) {
+    RangeFactorizer factorizer(2, 4096);
+    
+    const uint64_t low = 1000000000000ULL;
+    uint64_t expected = low;
+    size_t mismatches = 0;
+    factorizer.factorRange(low, low + 20000, [&](const FactoredSegment& segment) {
+        EXPECT_EQ(segment.low, expected);
+        for (size_t i = 0; i < segment.size(); i++) {
+            std::vector<uint64_t> primes;
+            for (const PrimePower* factor = segment.factorsBegin(i); factor != segment.factorsEnd(i); ++factor) {
+                primes.insert(primes.end(), factor->exponent, factor->prime);
+            }
+            if (primes != factorize64(segment.number(i))) {
+                mismatches++;
+            }
+        }
+        expected += segment.size();
+    });
+    EXPECT_EQ(expected, low + 20000);
+    EXPECT_EQ(mismatches, 0);
+    
+    // 1 has no factors; more than RANGE_SIEVE_SLOTS distinct primes falls back to direct factoring
+    FactoredSegment segment;
+    factorizer.factorSegment(1, 13, segment);
+    EXPECT_EQ(formatFactorization(segment.factorsBegin(0), segment.factorsEnd(0)), "1");
+    EXPECT_EQ(formatFactorization(segment.factorsBegin(11), segment.factorsEnd(11)), "2^2 * 3");
+    
+    const uint64_t primorial = 2ULL * 3 * 5 * 7 * 11 * 13 * 17 * 19 * 23 * 29;
+    factorizer.factorSegment(primorial, primorial + 1, segment);
+    EXPECT_EQ(formatFactorization(segment.factorsBegin(0), segment.factorsEnd(0)),
+              "2 * 3 * 5 * 7 * 11 * 13 * 17 * 19 * 23 * 29");
+}
+
+// Test sieved multiplicative functions against direct factoring
+TEST(ArithmeticSieveTest, TablesMatchFactorizations) {
+    ArithmeticSieve sieve(2, 4096);
+    
+    // Values from the definitions, using the factorization of n
+    auto check = [](uint64_t n, uint64_t phi, int mu, uint64_t sigma, unsigned omega) {
+        std::vector<uint64_t> primes = factorize64(n);
+        uint64_t expected_phi = 1;
+        uint64_t expected_sigma = 1;
+        int expected_mu = 1;
+        unsigned expected_omega = 0;
+        for (size_t i = 0; i < primes.size();) {
+            uint64_t p = primes[i];
+            uint64_t power = 1;
+            uint64_t power_sum = 1;
+            size_t exponent = 0;
+            for (; i < primes.size() && primes[i] == p; i++) {
+                power *= p;
+                power_sum += power;
+                exponent++;
+            }
+            expected_phi *= power / p * (p - 1);
+            expected_sigma *= power_sum;
+            expected_mu = exponent > 1 ? 0 : -expected_mu;
+            expected_omega++;
+        }
+        return phi == expected_phi && mu == expected_mu && sigma == expected_sigma && omega == expected_omega;
+    };
+    
+    ArithmeticTables tables;
+    const uint64_t low = 1000000000000ULL;
+    ASSERT_TRUE(sieve.computeTables(low, low + 20000, ARITH_ALL, tables));
+    size_t mismatches = 0;
+    for (size_t i = 0; i < 20000; i++) {
+        if (!check(low + i, tables.phi[i], tables.mu[i], tables.sigma[i], tables.omega[i])) {
+            mismatches++;
+        }
+    }
+    EXPECT_EQ(mismatches, 0);
+    
+    // Small values, including 0 and 1, with only phi and mu requested
+    ASSERT_TRUE(sieve.computeTables(0, 13, ARITH_PHI | ARITH_MU, tables));
+    EXPECT_TRUE(tables.sigma.empty());
+    EXPECT_EQ(tables.phi[0], 0);
+    EXPECT_EQ(tables.phi[1], 1);
+    EXPECT_EQ(tables.phi[12], 4);
+    EXPECT_EQ(tables.mu[6], 1);
+    EXPECT_EQ(tables.mu[8], 0);
+    EXPECT_EQ(tables.mu[11], -1);
+    EXPECT_FALSE(sieve.computeTables(5, 5, ARITH_ALL, tables));
+
+#ifdef __linux__
+    // The mapped file holds the same values as the in-memory tables
+    std::string path = "arithmetic_sieve_test.bin";
+    ASSERT_TRUE(sieve.computeToFile(low, low + 20000, ARITH_SIGMA | ARITH_OMEGA, path));
+    std::ifstream file(path, std::ios::binary);
+    std::vector<char> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    ASSERT_GE(bytes.size(), sizeof(ArithmeticFileHeader));
+    ArithmeticFileHeader header;
+    std::memcpy(&header, bytes.data(), sizeof(header));
+    EXPECT_EQ(std::string(header.magic, 8), "MFPARITH");
+    EXPECT_EQ(header.count, 20000);
+    EXPECT_EQ(header.phi_offset, 0);
+    ASSERT_LE(header.omega_offset + header.count, bytes.size());
+    ArithmeticTables full;
+    sieve.computeTables(low, low + 20000, ARITH_SIGMA | ARITH_OMEGA, full);
+    EXPECT_EQ(std::memcmp(bytes.data() + header.sigma_offset, full.sigma.data(), 20000 * sizeof(uint64_t)), 0);
+    EXPECT_EQ(std::memcmp(bytes.data() + header.omega_offset, full.omega.data(), 20000), 0);
+    std::remove(path.c_str());
+#endif
+}
+
+// Test the prime-tuple sieve against direct primality checks
+TEST(PrimeTupleTest, SieveFindsSmallestTuples) {
+    TupleSearchParams params;
+    params.num_threads = 2;
+    params.window = 4096;
+    params.sieve_bound = 1000;
+    
+    // Walk each pattern from 1 and compare with a direct scan
+    auto isTuple = [](unsigned long q, const TuplePattern& pattern) {
+        for (const TupleForm& form : pattern) {
+            mpz_t value;
+            mpz_init_set_ui(value, form.multiplier * q + form.offset);
+            bool prime = mpz_probab_prime_p(value, 25) > 0;
+            mpz_clear(value);
+            if (!prime) {
+                return false;
+            }
+        }
+        return true;
+    };
+    
+    mpz_t start, q;
+    mpz_init(start);
+    mpz_init(q);
+    for (const TuplePattern& pattern : {safePrimePattern(), twinPrimePattern(), cunninghamChainPattern(3)}) {
+        mpz_set_ui(start, 1);
+        size_t mismatches = 0;
+        for (int found = 0; found < 40; found++) {
+            ASSERT_TRUE(findPrimeTuple(start, pattern, q, params));
+            unsigned long expected = mpz_get_ui(start);
+            while (!isTuple(expected, pattern)) {
+                expected++;
+            }
+            if (mpz_get_ui(q) != expected) {
+                mismatches++;
+            }
+            mpz_add_ui(start, q, 1);
+        }
+        EXPECT_EQ(mismatches, 0);
+    }
+    
+    // Patterns some prime always divides are rejected
+    EXPECT_FALSE(findPrimeTuple(start, {{1, 0}, {1, 1}}, q, params));
+    EXPECT_FALSE(findPrimeTuple(start, {{1, 0}, {1, 2}, {1, 4}}, q, params));
+    EXPECT_FALSE(findPrimeTuple(start, {{2, 4}}, q, params));
+    
+    // A 256-bit safe prime
+    gmp_randstate_t state;
+    gmp_randinit_default(state);
+    gmp_randseed_ui(state, 65);
+    mpz_t p;
+    mpz_init(p);
+    ASSERT_TRUE(randomSafePrime(256, state, p));
+    EXPECT_EQ(mpz_sizeinbase(p, 2), 256);
+    EXPECT_GT(mpz_probab_prime_p(p, 25), 0);
+    mpz_sub_ui(q, p, 1);
+    mpz_fdiv_q_2exp(q, q, 1);
+    EXPECT_GT(mpz_probab_prime_p(q, 25), 0);
+    
+    mpz_clear(p);
+    gmp_randclear(state);
+    mpz_clear(start);
+    mpz_clear(q);
+}
+
+// Test random prime generation with a caller-supplied source
+TEST(RandomPrimeTest, GeneratesPrimesOfExactSize) {
+    std::mt19937_64 generator(66);
+    RandomPrimeParams params;
+    params.num_threads = 2;
+    params.random = [&generator](unsigned char* buffer, size_t size) {
+        for (size_t i = 0; i < size; i++) {
+            buffer[i] = static_cast<unsigned char>(generator());
+        }
+        return true;
+    };
+    
+    mpz_t prime;
+    mpz_init(prime);
+    for (unsigned long bits : {2UL, 17UL, 64UL, 100UL, 512UL}) {
+        ASSERT_TRUE(randomPrime(bits, prime, params));
+        EXPECT_EQ(mpz_sizeinbase(prime, 2), bits);
+        EXPECT_GT(mpz_probab_prime_p(prime, 25), 0);
+    }
+    
+    // Top two bits for RSA moduli of exactly twice the size
+    params.set_top_two_bits = true;
+    ASSERT_TRUE(randomPrime(256, prime, params));
+    EXPECT_EQ(mpz_sizeinbase(prime, 2), 256);
+    EXPECT_EQ(mpz_tstbit(prime, 254), 1);
+    
+    // Different draws give different primes; a failing source gives none
+    mpz_t other;
+    mpz_init(other);
+    ASSERT_TRUE(randomPrime(256, other, params));
+    EXPECT_NE(mpz_cmp(prime, other), 0);
+    params.random = [](unsigned char*, size_t) { return false; };
+    EXPECT_FALSE(randomPrime(256, prime, params));
+    EXPECT_FALSE(randomPrime(1, prime));
+    
+    mpz_clear(other);
+    mpz_clear(prime);
+}
+
+// Test interval prime enumeration against mpz_nextprime
+TEST(IntervalPrimeSieveTest, MatchesNextPrimeWalk) {
+    IntervalPrimeSieve sieve(2, 4096, 1 << 16);
+    
+    mpz_t low, high, expected, prime;
+    mpz_init(low);
+    mpz_init(high);
+    mpz_init(expected);
+    mpz_init(prime);
+    
+    // Small intervals are sieved exactly, 2 included
+    mpz_set_ui(low, 0);
+    mpz_set_ui(high, 1000);
+    EXPECT_EQ(sieve.countPrimes(low, high), 168);
+    mpz_set_ui(low, 3);
+    mpz_set_ui(high, 4);
+    EXPECT_EQ(sieve.countPrimes(low, high), 1);
+    
+    // Across 2^64 and near 10^40 every prime arrives once, in order
+    for (const char* start : {"18446744073709451616", "10000000000000000000000000000000000000000"}) {
+        mpz_set_str(low, start, 10);
+        mpz_add_ui(high, low, 100000);
+        mpz_sub_ui(expected, low, 1);
+        mpz_nextprime(expected, expected);
+        size_t mismatches = 0;
+        size_t found = 0;
+        sieve.findPrimes(low, high, [&](mpz_srcptr base, const std::vector<uint32_t>& offsets) {
+            for (uint32_t offset : offsets) {
+                mpz_add_ui(prime, base, offset);
+                if (mpz_cmp(prime, expected) != 0) {
+                    mismatches++;
+                }
+                mpz_nextprime(expected, prime);
+                found++;
+            }
+        });
+        EXPECT_EQ(mismatches, 0);
+        EXPECT_GT(found, 0);
+        EXPECT_GE(mpz_cmp(expected, high), 0);
+    }
+    
+    mpz_clear(low);
+    mpz_clear(high);
+    mpz_clear(expected);
+    mpz_clear(prime);
+}
+
+// Test perfect-power detection and the factoring fast path
+TEST(PerfectPowerTest, DetectsPowersAndFactorsTheRoot) {
+    mpz_t n, root;
+    mpz_init(n);
+    mpz_init(root);
+    unsigned long exponent = 0;
+    
+    // The largest exponent is found, through roots that are powers themselves
+    mpz_ui_pow_ui(n, 6, 30);
+    ASSERT_TRUE(perfectPower(n, root, exponent));
+    EXPECT_EQ(mpz_get_ui(root), 6);
+    EXPECT_EQ(exponent, 30);
+    mpz_ui_pow_ui(n, 2, 64);
+    ASSERT_TRUE(perfectPower(n, root, exponent));
+    EXPECT_EQ(mpz_get_ui(root), 2);
+    EXPECT_EQ(exponent, 64);
+    mpz_ui_pow_ui(n, 1000003, 7);
+    ASSERT_TRUE(perfectPower(n, root, exponent));
+    EXPECT_EQ(mpz_get_ui(root), 1000003);
+    EXPECT_EQ(exponent, 7);
+    
+    // Near misses and tiny values are not powers
+    mpz_ui_pow_ui(n, 1000003, 7);
+    mpz_add_ui(n, n, 2);
+    EXPECT_FALSE(perfectPower(n, root, exponent));
+    mpz_set_ui(n, 2);
+    EXPECT_FALSE(perfectPower(n, root, exponent));
+    mpz_set_ui(n, 4 * 27);
+    EXPECT_FALSE(perfectPower(n, root, exponent));
+    
+    mpz_clear(n);
+    mpz_clear(root);
+    
+    // (2^200 + 235)^3: every method factors the root once instead of giving up
+    const std::string prime = "1606938044258990275541962092341162602522202993782792835301611";
+    const std::string cube = "4149515568880992958512407863691161151012446232242436899997477815854704081968615569415969172318506236872142489187846670258216790257147548764670423430290633724204488503845285074962131";
+    std::vector<std::unique_ptr<MFPBase>> methods;
+    methods.emplace_back(new MFPMethod1());
+    methods.emplace_back(new MFPMethod2());
+    methods.emplace_back(new MFPMethod3(2));
+    for (auto& method : methods) {
+        EXPECT_EQ(method->factorize(cube), std::vector<std::string>(3, prime));
+        std::vector<std::string> factors = method->factorize("1000108004185068040414316058508970299");
+        std::sort(factors.begin(), factors.end());
+        std::vector<std::string> expected = {"1000003", "1000003", "1000003", "1000033", "1000033", "1000033"};
+        EXPECT_EQ(factors, expected);
+    }
+}
+
+// Test small-factor stripping and the primality pre-filter
+TEST(SmallFactorsTest, StripsEveryPrimeUpToTheBound) {
+    mpz_t n, cofactor, big;
+    mpz_init(n);
+    mpz_init(cofactor);
+    mpz_init_set_str(big, "1606938044258990275541962092341162602522202993782792835301611", 10);
+    
+    // 2^5 * 3^2 * 1021 * 1031^3 * 1048573 * (2^200 + 235): quick and GCD stages, repeats, and a kept cofactor
+    mpz_set(n, big);
+    const std::vector<uint64_t> small = {2, 2, 2, 2, 2, 3, 3, 1021, 1031, 1031, 1031, 1048573};
+    for (uint64_t p : small) {
+        mpz_mul_ui(n, n, p);
+    }
+    std::vector<uint64_t> factors;
+    stripSmallFactors(n, factors);
+    EXPECT_EQ(factors, small);
+    EXPECT_EQ(mpz_cmp(n, big), 0);
+    
+    // Enough distinct primes that their GCD spans several words
+    mpz_set(n, big);
+    std::vector<uint64_t> many;
+    for (uint64_t p = 1031; many.size() < 40; p += 2) {
+        mpz_set_ui(cofactor, p);
+        if (mpz_probab_prime_p(cofactor, 25)) {
+            many.push_back(p);
+            mpz_mul_ui(n, n, p);
+        }
+    }
+    factors.clear();
+    stripSmallFactors(n, factors);
+    EXPECT_EQ(factors, many);
+    EXPECT_EQ(mpz_cmp(n, big), 0);
+    
+    // Primes above the bound stay in the cofactor
+    mpz_set_ui(n, 1048583ULL * 1048583ULL);
+    factors.clear();
+    stripSmallFactors(n, factors);
+    EXPECT_TRUE(factors.empty());
+    
+    // The filter finds small factors but never the number itself
+    EXPECT_FALSE(hasSmallFactor(big, SMALL_FACTOR_BOUND));
+    mpz_mul_ui(n, big, 1048573);
+    EXPECT_TRUE(hasSmallFactor(n, SMALL_FACTOR_BOUND));
+    EXPECT_FALSE(hasSmallFactor(n, smallFactorFilterBound(mpz_sizeinbase(n, 2))));
+    mpz_set_ui(n, 1048573);
+    EXPECT_FALSE(hasSmallFactor(n, SMALL_FACTOR_BOUND));
+    mpz_set_ui(n, 1021 * 1031);
+    EXPECT_TRUE(hasSmallFactor(n, SMALL_FACTOR_BOUND));
+    
+    mpz_clear(n);
+    mpz_clear(cofactor);
+    mpz_clear(big);
+}
+
+// Test concurrent factorization of split cofactors into prime powers
+TEST(FactorGraphTest, MergesCofactorsIntoSortedPrimePowers) {
+    ThreadPool pool(2);
+    
+    // 3^2 * 1048573 * 1000000007^2 * 1500000001 * 2000000011^3 * 3000000019, 238 bits
+    const std::string number = "339737664740162149926172733293239738252910151478452123999923222656905277";
+    const PrimeFactorMap expected = {{"3", 2}, {"1048573", 1}, {"1000000007", 2}, {"1500000001", 1},
+                                     {"2000000011", 3}, {"3000000019", 1}};
+    
+    std::vector<std::unique_ptr<MFPBase>> methods;
+    methods.push_back(std::make_unique<MFPMethod2>());
+    methods.push_back(std::make_unique<MFPMethod3>(2));
+    for (auto& method : methods) {
+        FactorGraph graph(*method, pool);
+        EXPECT_EQ(graph.factorize(number), expected);
+        
+        // Word-size inputs, a perfect power, a prime and the empty product
+        EXPECT_EQ(graph.factorize("1000000016000000063"), (PrimeFactorMap{{"1000000007", 1}, {"1000000009", 1}}));
+        EXPECT_EQ(graph.factorize("1099511627776"), (PrimeFactorMap{{"2", 40}}));
+        EXPECT_EQ(graph.factorize("97"), (PrimeFactorMap{{"97", 1}}));
+        EXPECT_TRUE(graph.factorize("1").empty());
+        
+        // The sign is an entry of its own; 0 and malformed input never reach the engines
+        EXPECT_EQ(graph.factorize("-12"), (PrimeFactorMap{{"-1", 1}, {"2", 2}, {"3", 1}}));
+        EXPECT_EQ(graph.factorize("-1"), (PrimeFactorMap{{"-1", 1}}));
+        EXPECT_EQ(graph.factorize("0012"), (PrimeFactorMap{{"2", 2}, {"3", 1}}));
+        EXPECT_THROW(graph.factorize("0"), std::invalid_argument);
+        EXPECT_THROW(graph.factorize("-0"), std::invalid_argument);
+        EXPECT_THROW(graph.factorize("abc"), std::invalid_argument);
+        EXPECT_THROW(graph.factorize("12a"), std::invalid_argument);
+        EXPECT_THROW(graph.factorize("-"), std::invalid_argument);
+        EXPECT_THROW(graph.factorize(""), std::invalid_argument);
+    }
+    
+    // Keys are ordered by value, not as text, with -1 first
+    EXPECT_TRUE(DecimalLess()("97", "1031"));
+    EXPECT_FALSE(DecimalLess()("1031", "1031"));
+    EXPECT_TRUE(DecimalLess()("-1", "2"));
+    EXPECT_TRUE(DecimalLess()("-12", "-1"));
+    EXPECT_EQ(expandPrimeFactors({{"-1", 1}, {"2", 2}, {"3", 1}}), std::vector<std::string>({"-1", "2", "2", "3"}));
+}
+
+// Test portfolio factoring: thread shares, the race, and cancellation
+TEST(PortfolioTest, RacesEnginesAndCancelsLosers) {
+    // Untried entrants tie, so the budget goes by preference and spare threads to the scalable ones
+    MFPPortfolio portfolio(8);
+    PortfolioShares shares = portfolio.planShares(256);
+    EXPECT_EQ(std::accumulate(shares.begin(), shares.end(), 0), 8);
+    for (int share : shares) {
+        EXPECT_GE(share, 1);
+    }
+    EXPECT_EQ(shares[static_cast<size_t>(PortfolioEntrant::FERMAT)], 1);
+    EXPECT_EQ(shares[static_cast<size_t>(PortfolioEntrant::RHO)], 1);
+    PortfolioShares single = MFPPortfolio(1).planShares(256);
+    EXPECT_EQ(single[static_cast<size_t>(PortfolioEntrant::RHO)], 1);
+    EXPECT_EQ(std::accumulate(single.begin(), single.end(), 0), 1);
+    
+    // 1000000007 * 2000000011 * (2^127 - 1): the first split's 158-bit cofactor gets a second race
+    MFPPortfolio racing(4);
+    std::vector<std::string> expected = {"1000000007", "2000000011", "170141183460469231731687303715884105727"};
+    EXPECT_EQ(racing.factorize("340282371174468063075976527180081647691025029298076140979"), expected);
+    size_t bucket = MetricsRegistry::bitBucket(188);
+    uint64_t wins = 0;
+    for (size_t entrant = 0; entrant < PORTFOLIO_ENTRANT_COUNT; entrant++) {
+        PortfolioRecord record = racing.getRecord(static_cast<PortfolioEntrant>(entrant), bucket);
+        EXPECT_EQ(record.races, 2u);
+        wins += record.wins;
+    }
+    EXPECT_EQ(wins, 2u);
+    
+    // Like the other methods, 0 and 1 have no factors
+    EXPECT_TRUE(racing.factorize("1").empty());
+    EXPECT_TRUE(racing.factorize("0").empty());
+    
+    // The sign comes off before the race, as -1
+    EXPECT_EQ(racing.factorize("-12"), (std::vector<std::string>{"-1", "2", "2", "3"}));
+    EXPECT_EQ(racing.factorize("-1000000016000000063"),
+              (std::vector<std::string>{"-1", "1000000007", "1000000009"}));
+    
+    // A set cancel flag stops Method 2's unbounded rho on (2^89 - 1) * (2^107 - 1)
+    std::atomic<bool> cancel(true);
+    CallControl control;
+    control.cancel = &cancel;
+    CallControlScope control_scope(std::move(control));
+    MFPMethod2 method;
+    std::vector<std::string> parts;
+    auto start = std::chrono::steady_clock::now();
+    EXPECT_FALSE(method.splitComposite("100433627766186892221372630609062766858404681029709092356097", parts));
+    EXPECT_TRUE(parts.empty());
+    EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(5));
+}
+
+// Test that Method 3 and portfolio engines run on a shared pool, even from its own tasks
+TEST(PortfolioTest, EnginesRunOnASharedPool) {
+    std::shared_ptr<ThreadPool> pool = std::make_shared<ThreadPool>(2);
+    MFPMethod3 method(4);
+    MFPPortfolio portfolio(4);
+    method.setEnginePool(pool);
+    portfolio.setEnginePool(pool);
+    
+    TraceRecorder& recorder = getTraceRecorder();
+    recorder.clear();
+    recorder.setEnabled(true);
+    
+    // More calls than pool threads, each inside a pool task, so engines cannot wait on a free thread
+    const std::string semiprime = "1361129477211660127639775406701561854082509921951";
+    const std::string number = "340282371174468063075976527180081647691025029298076140979";
+    std::vector<std::string> expected = {"1000000007", "2000000011", "170141183460469231731687303715884105727"};
+    std::vector<std::vector<std::string>> results(4);
+    std::vector<uint8_t> primes(4, 0);
+    pool->parallelFor(results.size(), [&](size_t i) {
+        results[i] = (i % 2 == 0) ? method.factorize(semiprime) : portfolio.factorize(number);
+        primes[i] = method.isPrime(expected[2]) ? 1 : 0;
+    });
+    recorder.setEnabled(false);
+    
+    for (size_t i = 0; i < results.size(); i++) {
+        if (i % 2 == 0) {
+            EXPECT_EQ(results[i].size(), 2) << i;
+        } else {
+            EXPECT_EQ(results[i], expected) << i;
+        }
+        EXPECT_EQ(primes[i], 1) << i;
+    }
+    
+    // Workers ran as pool tasks, so no thread was started for them
+    std::string json = recorder.exportChromeJson();
+    EXPECT_NE(json.find("\"name\":\"worker\""), std::string::npos);
+    EXPECT_EQ(json.find("\"name\":\"thread-spawn\""), std::string::npos);
+}
+
+// Test that a call control stops only the calls made under it
+TEST(CallControlTest, ControlFollowsTheCall) {
+    EXPECT_TRUE(currentCallControl().empty());
+    std::atomic<bool> cancel(true);
+    {
+        CallControl outer;
+        outer.cancel = &cancel;
+        CallControlScope outer_scope(std::move(outer));
+        EXPECT_TRUE(currentCallControl().stopped());
+        {
+            CallControlScope inner_scope{CallControl()};
+            EXPECT_TRUE(currentCallControl().empty());
+        }
+        EXPECT_TRUE(currentCallControl().stopped());
+    }
+    EXPECT_TRUE(currentCallControl().empty());
+    
+    // One instance, two callers: the cancelled split gives up while the
+    // other caller's primality test on 2^127 - 1 runs to its real answer
+    MFPMethod3 method(2);
+    std::thread cancelled([&] {
+        CallControl control;
+        control.cancel = &cancel;
+        CallControlScope control_scope(std::move(control));
+        std::vector<std::string> parts;
+        EXPECT_FALSE(method.splitComposite("100433627766186892221372630609062766858404681029709092356097", parts));
+    });
+    for (int i = 0; i < 20; i++) {
+        EXPECT_TRUE(method.isPrime("170141183460469231731687303715884105727"));
+    }
+    cancelled.join();
+}
+
+// Test size classes, budgets and checkpoint preemption in the job scheduler
+TEST(JobSchedulerTest, BudgetsAndPreemption) {
+    EXPECT_EQ(JobScheduler::classify(MetricsOperation::IS_PRIME, 512), SizeClass::SHORT);
+    EXPECT_EQ(JobScheduler::classify(MetricsOperation::NEXT_PRIME, 2048), SizeClass::MEDIUM);
+    EXPECT_EQ(JobScheduler::classify(MetricsOperation::FACTORIZE, 100), SizeClass::SHORT);
+    EXPECT_EQ(JobScheduler::classify(MetricsOperation::FACTORIZE, 200), SizeClass::LONG);
+    
+    SchedulerParams params;
+    params.num_workers = 1;
+    JobScheduler scheduler([]() { return std::unique_ptr<MFPBase>(new MFPMethod3(2)); }, params);
+    
+    // (2^89-1)(2^107-1) does not split in reasonable time
+    const std::string hard = "100433627766186892221372630609062766858404681029709092356097";
+    JobOptions options;
+    options.budget_ms = 300;
+    auto start = std::chrono::steady_clock::now();
+    std::future<JobResult> hard_job = scheduler.submit(MetricsOperation::FACTORIZE, hard, options);
+    
+    // A primality test queued behind the long job is run at one of its checkpoints
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    JobResult quick = scheduler.submit(MetricsOperation::IS_PRIME, "170141183460469231731687303715884105727").get();
+    EXPECT_EQ(quick.status, JobStatus::COMPLETED);
+    EXPECT_TRUE(quick.is_prime);
+    EXPECT_EQ(hard_job.wait_for(std::chrono::seconds(0)), std::future_status::timeout);
+    
+    JobResult stopped = hard_job.get();
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    EXPECT_EQ(stopped.status, JobStatus::BUDGET_EXCEEDED);
+    EXPECT_TRUE(stopped.factors.empty());
+    EXPECT_LT(elapsed, 5000);
+    
+    JobResult next = scheduler.submit(MetricsOperation::NEXT_PRIME, "100").get();
+    EXPECT_EQ(next.next_prime, "101");
+    
+    SchedulerStats stats = scheduler.getStats();
+    EXPECT_GE(stats.preemptions, 1u);
+    EXPECT_EQ(stats.budget_exceeded, 1u);
+    EXPECT_EQ(stats.completed[static_cast<size_t>(SizeClass::SHORT)], 2u);
+    EXPECT_EQ(stats.completed[static_cast<size_t>(SizeClass::LONG)], 1u);
+}
+
+// Test that the portfolio's racing entrants honour scheduler budgets, preemption and shutdown
+TEST(JobSchedulerTest, PortfolioEntrantsStopAtCheckpoints) {
+    const std::string hard = "100433627766186892221372630609062766858404681029709092356097";
+    SchedulerParams params;
+    params.num_workers = 1;
+    auto scheduler = std::make_unique<JobScheduler>(
+        []() { return std::unique_ptr<MFPBase>(new MFPPortfolio(4)); }, params);
+
+    JobOptions options;
+    options.budget_ms = 300;
+    auto start = std::chrono::steady_clock::now();
+    std::future<JobResult> hard_job = scheduler->submit(MetricsOperation::FACTORIZE, hard, options);
+
+    // The only worker is racing, so the primality test runs at an entrant's checkpoint
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    JobResult quick = scheduler->submit(MetricsOperation::IS_PRIME, "170141183460469231731687303715884105727").get();
+    EXPECT_TRUE(quick.is_prime);
+    EXPECT_EQ(hard_job.wait_for(std::chrono::seconds(0)), std::future_status::timeout);
+
+    JobResult stopped = hard_job.get();
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    EXPECT_EQ(stopped.status, JobStatus::BUDGET_EXCEEDED);
+    EXPECT_TRUE(stopped.factors.empty());
+    EXPECT_LT(elapsed, 5000);
+    EXPECT_GE(scheduler->getStats().preemptions, 1u);
+
+    // Shutdown stops an unbudgeted race instead of waiting for it
+    std::future<JobResult> endless = scheduler->submit(MetricsOperation::FACTORIZE, hard);
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    start = std::chrono::steady_clock::now();
+    scheduler.reset();
+    EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(5));
+    EXPECT_EQ(endless.get().status, JobStatus::BUDGET_EXCEEDED);
+}
+
+// Test that a scheduled call stopped by its budget fails instead of answering
+TEST(JobSchedulerTest, SystemCallsReportStoppedJobs) {
+    MFPSystem system(MFPMethodType::METHOD_2, 1);
+    SchedulerParams params;
+    params.num_workers = 1;
+    params.default_options.budget_ms = 100;
+    system.enableScheduler(params);
+    
+    // 40 Miller-Rabin rounds on the prime 2^11213 - 1 take far longer than the budget
+    mpz_t mersenne;
+    mpz_init(mersenne);
+    mpz_ui_pow_ui(mersenne, 2, 11213);
+    mpz_sub_ui(mersenne, mersenne, 1);
+    char* mersenne_str = mpz_get_str(nullptr, 10, mersenne);
+    const std::string prime(mersenne_str);
+    freeGMPString(mersenne_str);
+    mpz_clear(mersenne);
+    
+    EXPECT_THROW(system.isPrime(prime), std::runtime_error);
+    EXPECT_THROW(system.factorize("100433627766186892221372630609062766858404681029709092356097"),
+                 std::runtime_error);
+    EXPECT_TRUE(system.isPrime("1000000007"));
+    EXPECT_EQ(system.getSchedulerStats().budget_exceeded, 2u);
+    
+    // Scheduled factorizations run on the factor graph too, so every cofactor is split
+    EXPECT_EQ(system.factorize("1000073001431003663"),
+              (std::vector<std::string>{"1000003", "1000033", "1000037"}));
+}
+
+// Test one system shared by concurrent callers while the method is switched
+TEST(MFPSystemTest, SharedAcrossThreadsWhileSwitchingMethods) {
+    MFPSystem system(MFPMethodType::METHOD_2, 2);
+    
+    // 1000000007 * 2000000011 * (2^61 - 1)
+    const std::string number = "4611686076073463309892260484454434227";
+    const std::vector<std::string> expected = {"1000000007", "2000000011", "2305843009213693951"};
+    
+    std::atomic<bool> done(false);
+    std::thread switcher([&]() {
+        const MFPMethodType methods[] = {MFPMethodType::METHOD_1, MFPMethodType::METHOD_3, MFPMethodType::METHOD_2};
+        for (int i = 0; !done; i++) {
+            system.setMethod(methods[i % 3]);
+            if (i % 4 == 0) {
+                system.enableShadowMode(MFPMethodType::METHOD_2, 0.5, 1);
+            } else if (i % 4 == 2) {
+                system.disableShadowMode();
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    });
+    
+    std::atomic<int> wrong(0);
+    std::vector<std::thread> callers;
+    for (int t = 0; t < 4; t++) {
+        callers.emplace_back([&, t]() {
+            for (int i = 0; i < 20; i++) {
+                // factorize() may stop at one split; its parts must still multiply back
+                mpz_t product;
+                mpz_init_set_ui(product, 1);
+                for (const auto& factor : system.factorize(number)) {
+                    mpz_t part;
+                    mpz_init_set_str(part, factor.c_str(), 10);
+                    mpz_mul(product, product, part);
+                    mpz_clear(part);
+                }
+                mpz_t n;
+                mpz_init_set_str(n, number.c_str(), 10);
+                bool multiplies = mpz_cmp(product, n) == 0;
+                mpz_clear(n);
+                mpz_clear(product);
+                
+                PrimeFactorMap powers = system.factorizePrimePowers(number);
+                std::vector<std::string> primes;
+                for (const auto& power : powers) {
+                    primes.push_back(power.first);
+                }
+                if (!multiplies || primes != expected || !system.isPrime(expected[2]) ||
+                    system.findNextPrime("1000000000") != "1000000007") {
+                    wrong++;
+                }
+            }
+        });
+    }
+    for (auto& caller : callers) {
+        caller.join();
+    }
+    done = true;
+    switcher.join();
+    
+    EXPECT_EQ(wrong.load(), 0);
+    MFPMethodType method = system.getMethod();
+    EXPECT_TRUE(method == MFPMethodType::METHOD_1 || method == MFPMethodType::METHOD_2 ||
+                method == MFPMethodType::METHOD_3);
+    
+    // A thread that has made no call on this system sees no usage
+    std::thread([&]() { EXPECT_EQ(system.getLastRequestMemory().allocations, 0u); }).join();
+}
+
+// Test that streamed primes carry full exponents and shrinking cofactors
+TEST(FactorStreamTest, DeliversPrimePowersAndStopsEarly) {
+    MFPSystem system(MFPMethodType::METHOD_2, 2);
+    
+    // 2^10 * 3^2 * 1000000007 * (2^61 - 1)^2 * 2000000011
+    const std::string number = "98001322898246802080878642073677438789225062965181796242432";
+    const PrimeFactorMap expected = {{"2", 10}, {"3", 2}, {"1000000007", 1},
+                                     {"2000000011", 1}, {"2305843009213693951", 2}};
+    
+    std::vector<StreamedFactor> delivered;
+    std::string cofactor = system.streamFactors(number, [&](const StreamedFactor& factor) {
+        delivered.push_back(factor);
+        return true;
+    });
+    EXPECT_EQ(cofactor, "1");
+    
+    // Each cofactor is the previous one with the delivered power divided out
+    PrimeFactorMap found;
+    mpz_t rest, power;
+    mpz_init_set_str(rest, number.c_str(), 10);
+    mpz_init(power);
+    for (const auto& factor : delivered) {
+        EXPECT_EQ(found.count(factor.prime), 0u);
+        found[factor.prime] = factor.exponent;
+        mpz_set_str(power, factor.prime.c_str(), 10);
+        mpz_pow_ui(power, power, factor.exponent);
+        EXPECT_NE(mpz_divisible_p(rest, power), 0);
+        mpz_divexact(rest, rest, power);
+        char* text = mpz_get_str(nullptr, 10, rest);
+        EXPECT_EQ(factor.cofactor, text);
+        freeGMPString(text);
+    }
+    EXPECT_EQ(found, expected);
+    EXPECT_EQ(mpz_cmp_ui(rest, 1), 0);
+    mpz_clear(rest);
+    mpz_clear(power);
+    
+    // Stopping at the first prime leaves its cofactor
+    int calls = 0;
+    std::string first_cofactor;
+    cofactor = system.streamFactors(number, [&](const StreamedFactor& factor) {
+        calls++;
+        first_cofactor = factor.cofactor;
+        return false;
+    });
+    EXPECT_EQ(calls, 1);
+    EXPECT_EQ(cofactor, first_cofactor);
+    
+    EXPECT_EQ(system.streamFactors("1000000007", [](const StreamedFactor& factor) {
+        return factor.prime == "1000000007" && factor.exponent == 1 && factor.cofactor == "1";
+    }), "1");
+}
+
+// Test that stopping a portfolio stream also stops the race on the cofactor
+TEST(FactorStreamTest, PortfolioStopsEarly) {
+    MFPSystem system(MFPMethodType::PORTFOLIO, 4);
+    
+    // 1000000007 * (2^89 - 1) * (2^107 - 1); the second split does not finish
+    // in reasonable time, so only cancellation ends the race on it
+    const std::string hard = "100433627766186892221372630609062766858404681029709092356097";
+    const std::string number = "100433628469222286584680876158671181121844049038541859564060646492679";
+    
+    std::vector<std::string> primes;
+    auto start = std::chrono::steady_clock::now();
+    std::string cofactor = system.streamFactors(number, [&](const StreamedFactor& factor) {
+        primes.push_back(factor.prime);
+        return false;
+    });
+    EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(10));
+    EXPECT_EQ(primes, std::vector<std::string>{"1000000007"});
+    EXPECT_EQ(cofactor, hard);
+}
+
+// Test the compact factorization type and the factor-list adapter
+TEST(FactorizationTest, CompactPairsAndListAdapter) {
+    // Out of order, with repeats, and one value above 2^128
+    const std::string big = "1361129467683753853853498429727072845827";
+    Factorization factorization;
+    ASSERT_TRUE(Factorization::fromStrings({"5", "2", big, "3", "2", "5", "2"}, factorization));
+    ASSERT_EQ(factorization.size(), 4u);
+    EXPECT_EQ(factorization.countFactors(), 7u);
+    EXPECT_EQ(factorization.toString(), "2^3 * 3 * 5^2 * " + big);
+    EXPECT_EQ(factorization.toString(16), "2^3 * 3 * 5^2 * 400000000000000000000000000000003");
+    EXPECT_TRUE(factorization[0].prime.isInline());
+    EXPECT_FALSE(factorization[3].prime.isInline());
+    EXPECT_EQ(factorization.exponentOf(FactorPrime(5)), 2u);
+    EXPECT_EQ(factorization.exponentOf(FactorPrime(7)), 0u);
+    
+    std::vector<std::string> expected = {"2", "2", "2", "3", "5", "5", big};
+    EXPECT_EQ(factorization.toStrings(), expected);
+    
+    // Copies of large primes are independent; a move leaves the source inline
+    FactorPrime copy = factorization[3].prime;
+    FactorPrime moved(std::move(copy));
+    EXPECT_TRUE(copy.isInline());
+    EXPECT_EQ(moved.toString(), big);
+    EXPECT_EQ(factorization[3].prime.toString(), big);
+    
+    mpz_t product, expected_product;
+    mpz_init(product);
+    mpz_init_set_str(expected_product, big.c_str(), 10);
+    mpz_mul_ui(expected_product, expected_product, 600);
+    factorization.product(product);
+    EXPECT_EQ(mpz_cmp(product, expected_product), 0);
+    mpz_clear(product);
+    mpz_clear(expected_product);
+    
+    Factorization invalid;
+    EXPECT_FALSE(Factorization::fromStrings({"12a"}, invalid));
+    Factorization zero;
+    EXPECT_FALSE(Factorization::fromStrings({"0"}, zero));
+    
+    // 0 and 1 are not primes
+    FactorPrime prime(7);
+    EXPECT_FALSE(prime.parse("0"));
+    EXPECT_FALSE(prime.parse("1"));
+    EXPECT_FALSE(prime.parse("0001"));
+    EXPECT_EQ(prime.toString(), "7");
+    EXPECT_TRUE(prime.parse("2"));
+    
+    // A sign on any entry is a factor of -1, and 1 is the empty product
+    Factorization negative;
+    ASSERT_TRUE(Factorization::fromStrings({"2", "1", "2", "-3"}, negative));
+    EXPECT_TRUE(negative.isNegative());
+    EXPECT_EQ(negative.size(), 2u);
+    EXPECT_EQ(negative.countFactors(), 4u);
+    EXPECT_EQ(negative.toString(), "-1 * 2^2 * 3");
+    EXPECT_EQ(negative.toStrings(), (std::vector<std::string>{"-1", "2", "2", "3"}));
+    mpz_t negative_product;
+    mpz_init(negative_product);
+    negative.product(negative_product);
+    EXPECT_EQ(mpz_cmp_si(negative_product, -12), 0);
+    mpz_clear(negative_product);
+    
+    Factorization minus_one;
+    ASSERT_TRUE(Factorization::fromStrings({"-1"}, minus_one));
+    EXPECT_TRUE(minus_one.empty());
+    EXPECT_EQ(minus_one.toString(), "-1");
+    
+    // 2^64 * 3 is two entries; the list form still repeats 2 sixty-four times
+    MFPSystem system(MFPMethodType::METHOD_2, 1);
+    Factorization compact = system.factorization("55340232221128654848");
+    ASSERT_EQ(compact.size(), 2u);
+    EXPECT_EQ(compact[0].exponent, 64u);
+    EXPECT_EQ(compact.toString(), "2^64 * 3");
+    std::vector<std::string> list = system.factorize("55340232221128654848");
+    EXPECT_EQ(list.size(), 65u);
+    EXPECT_EQ(std::count(list.begin(), list.end(), "2"), 64);
+    
+    // Prime powers from the graph convert with one parse per distinct prime
+    Factorization from_powers;
+    ASSERT_TRUE(Factorization::fromPrimePowers({{"-1", 1}, {"2", 64}, {"3", 1}}, from_powers));
+    EXPECT_EQ(from_powers.toString(), "-1 * 2^64 * 3");
+    Factorization bad_powers;
+    EXPECT_FALSE(Factorization::fromPrimePowers({{"1", 1}}, bad_powers));
+    
+    // Negative inputs keep their sign; malformed input and 0 are rejected
+    // before any engine runs
+    EXPECT_EQ(system.factorize("-5"), (std::vector<std::string>{"-1", "5"}));
+    EXPECT_EQ(system.factorization("-12").toString(), "-1 * 2^2 * 3");
+    EXPECT_TRUE(system.factorization("1").empty());
+    for (const char* invalid : {"+7", "abc", "12a", "0", "-", ""}) {
+        EXPECT_THROW(system.factorization(invalid), std::invalid_argument) << invalid;
+        EXPECT_THROW(system.factorize(invalid), std::invalid_argument) << invalid;
+    }
+    
+    // Every entry is prime: a one-split engine result such as
+    // 1000033 * 1000040000111 has its composite part factored further
+    for (MFPMethodType method : {MFPMethodType::METHOD_2, MFPMethodType::METHOD_3, MFPMethodType::AUTO}) {
+        MFPSystem split_system(method, 2);
+        EXPECT_EQ(split_system.factorization("1000073001431003663").toString(), "1000003 * 1000033 * 1000037");
+    }
+}
+
 } // namespace test
 } // namespace mfp
 